@@ -0,0 +1,272 @@
+#include "../renderer.h"
+#include "../scenes.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// times the intersection and shading kernels in float and double on coherent
+// and random rays against the bundled meshes. results are written as json to
+// the file given as the first argument (kernelBench.json by default), one
+// record per kernel / scalar / ray set / mesh so that runs can be compared
+// over time
+// -----------------------------------------------------------------------------
+constexpr unsigned int kImageWidth = 256;  // rays per set is its square
+constexpr double       kMinSeconds = 0.25; // kernels repeat at least this long
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct result
+{
+    const char * kernel;
+    const char * scalar;
+    const char * rays;
+    const char * model;
+    unsigned int count;  // rays per repetition
+    unsigned int repeat; // repetitions timed
+    double       seconds;
+    unsigned int hits; // of the last repetition
+};
+
+// -----------------------------------------------------------------------------
+// runs fn until kMinSeconds have passed, fn returns its hit count
+// -----------------------------------------------------------------------------
+template <typename Fn>
+static result measure( unsigned int count, Fn &&fn )
+{
+    result r{};
+    r.count    = count;
+    auto start = std::chrono::steady_clock::now();
+    do
+    {
+        r.hits = fn();
+        ++r.repeat;
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        r.seconds = elapsed.count();
+    } while ( r.seconds < kMinSeconds );
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+// camera rays through the pixel centers, in scanline order
+// -----------------------------------------------------------------------------
+template <typename T>
+static std::vector<ray<T>> coherentRays( const camera<T> &cam )
+{
+    std::vector<ray<T>> rays;
+    rays.reserve( kImageWidth * kImageWidth );
+    for ( unsigned int jj = 0; jj < kImageWidth; ++jj )
+    {
+        for ( unsigned int ii = 0; ii < kImageWidth; ++ii )
+        {
+            T       u = T( 1 ) * ii / ( kImageWidth - 1 ) - T( 0.5 );
+            T       v = T( 0.5 ) - T( 1 ) * jj / ( kImageWidth - 1 );
+            vec3<T> d = cam.direction( u, v );
+            d.normalize();
+            rays.push_back( {cam.position(), d} );
+        }
+    }
+    return rays;
+}
+
+// -----------------------------------------------------------------------------
+// rays from random points on a sphere around the box towards random points
+// inside it, the incoherent case of secondary bounces
+// -----------------------------------------------------------------------------
+template <typename T>
+static std::vector<ray<T>> randomRays( const bbox<T> &box )
+{
+    std::mt19937                      rng( 7 );
+    std::uniform_real_distribution<T> unit( T( 0 ), T( 1 ) );
+    std::normal_distribution<T>       normal;
+
+    vec3<T> center = box.center();
+    T       radius = box.radius();
+    vec3<T> extent = box.max() - box.min();
+
+    std::vector<ray<T>> rays;
+    rays.reserve( kImageWidth * kImageWidth );
+    while ( rays.size() < kImageWidth * kImageWidth )
+    {
+        vec3<T> o{normal( rng ), normal( rng ), normal( rng )};
+        if ( o.len2() == T( 0 ) )
+            continue;
+        o.normalize();
+        o = center + o * ( 2 * radius );
+
+        vec3<T> target =
+            box.min() + vec3<T>{unit( rng ) * extent[0],
+                                unit( rng ) * extent[1],
+                                unit( rng ) * extent[2]};
+        vec3<T> d = target - o;
+        d.normalize();
+        rays.push_back( {o, d} );
+    }
+    return rays;
+}
+
+// -----------------------------------------------------------------------------
+// sphere, triangle and box kernels on their own, then the whole scene and
+// complete paths through it
+// -----------------------------------------------------------------------------
+template <typename T>
+static void benchmark( const char *          model,
+                       const char *          scalar,
+                       std::vector<result> &results )
+{
+    scene<T>  world;
+    camera<T> cam = buildMeshScene(
+        world, std::string( PATHTRACER_ASSET_DIR ) + "/" + model );
+
+    // a second copy of the mesh for the kernels that bypass the scene
+    mesh<T>   shape( std::string( PATHTRACER_ASSET_DIR ) + "/" + model );
+    bbox<T>   box = shape.bounds();
+    sphere<T> ball( box.center(), T( 0.5 ) * box.radius() );
+
+    renderparams rp;
+    renderer<T>  device( cam, rp );
+
+    struct rayset
+    {
+        const char *        name;
+        std::vector<ray<T>> rays;
+    };
+    rayset sets[] = {{"coherent", coherentRays( cam )},
+                     {"random", randomRays( box )}};
+
+    for ( const rayset &set : sets )
+    {
+        const std::vector<ray<T>> &rays  = set.rays;
+        auto                       count = static_cast<unsigned int>(
+            rays.size() );
+
+        auto record = [&]( const char *kernel, result r ) {
+            r.kernel = kernel;
+            r.scalar = scalar;
+            r.rays   = set.name;
+            r.model  = model;
+            results.push_back( r );
+        };
+
+        record( "sphere", measure( count, [&]() {
+                    unsigned int hits = 0;
+                    hit<T>       h;
+                    for ( const auto &r : rays )
+                        hits += ball.intersect( r, h ) ? 1 : 0;
+                    return hits;
+                } ) );
+
+        // ray n against triangle n modulo the triangle count
+        record( "triangle", measure( count, [&]() {
+                    unsigned int hits = 0;
+                    unsigned int n    = shape.numTriangles();
+                    for ( unsigned int ii = 0; ii < count; ++ii )
+                    {
+                        T t;
+                        hits += shape.intersectTriangle( rays[ii], ii % n, t )
+                                    ? 1
+                                    : 0;
+                    }
+                    return hits;
+                } ) );
+
+        record( "bbox", measure( count, [&]() {
+                    unsigned int hits = 0;
+                    for ( const auto &r : rays )
+                    {
+                        vec3<T> invdir{
+                            T( 1 ) / r.d[0], T( 1 ) / r.d[1], T( 1 ) / r.d[2]};
+                        T tnear;
+                        hits += box.intersect( r.o, invdir, r.tmax, tnear )
+                                    ? 1
+                                    : 0;
+                    }
+                    return hits;
+                } ) );
+
+        record( "scene", measure( count, [&]() {
+                    unsigned int hits = 0;
+                    hit<T>       h;
+                    for ( const auto &r : rays )
+                        hits += world.intersect( r, h ) ? 1 : 0;
+                    return hits;
+                } ) );
+
+        // a path per ray that hits, with the default depth and roulette.
+        // hits counts paths that carried radiance back
+        record( "tracepath", measure( count, [&]() {
+                    unsigned int hits = 0;
+                    hit<T>       first;
+                    surface<T>   s;
+                    for ( unsigned int ii = 0; ii < count; ++ii )
+                    {
+                        const ray<T> &r = rays[ii];
+                        if ( !world.intersect( r, first ) )
+                            continue;
+                        world.shade( r, first, s );
+                        sampler smp( rp.samplerType(), ii, 0, 2 );
+                        color c = device.tracepath( world, smp, r, first, s );
+                        hits += ( c.r + c.g + c.b ) > 0.0f ? 1 : 0;
+                    }
+                    return hits;
+                } ) );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void writejson( FILE *out, const std::vector<result> &results )
+{
+    fprintf( out, "{\n" );
+    fprintf( out, "  \"benchmark\": \"kernelBench\",\n" );
+    fprintf( out, "  \"raysPerSet\": %u,\n", kImageWidth * kImageWidth );
+    fprintf( out, "  \"results\": [\n" );
+    for ( std::size_t ii = 0; ii < results.size(); ++ii )
+    {
+        const result &r = results[ii];
+        double        mrays = r.count * double( r.repeat ) / r.seconds * 1e-6;
+        fprintf( out,
+                 "    {\"kernel\": \"%s\", \"scalar\": \"%s\", "
+                 "\"rays\": \"%s\", \"model\": \"%s\", \"count\": %u, "
+                 "\"repeat\": %u, \"seconds\": %.6f, \"mrays\": %.4f, "
+                 "\"hits\": %u}%s\n",
+                 r.kernel,
+                 r.scalar,
+                 r.rays,
+                 r.model,
+                 r.count,
+                 r.repeat,
+                 r.seconds,
+                 mrays,
+                 r.hits,
+                 ii + 1 < results.size() ? "," : "" );
+    }
+    fprintf( out, "  ]\n}\n" );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main( int argc, char **argv )
+{
+    std::vector<result> results;
+    for ( const char *model : {"box.obj", "cornellbox.obj", "suzanne.obj"} )
+    {
+        benchmark<float>( model, "float", results );
+        benchmark<double>( model, "double", results );
+    }
+
+    const char *path = argc > 1 ? argv[1] : "kernelBench.json";
+    FILE *      out  = fopen( path, "w" );
+    if ( !out )
+    {
+        fprintf( stderr, "could not open %s\n", path );
+        return 1;
+    }
+    writejson( out, results );
+    fclose( out );
+    printf( "wrote %zu results to %s\n", results.size(), path );
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "../mesh.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using FLOAT = float;
+using vec3f = vec3<FLOAT>;
+using rayf  = ray<FLOAT>;
+using meshf = mesh<FLOAT>;
+
+static std::mt19937 rng;
+static auto         range = rng.max() - rng.min();
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static FLOAT randomlength() { return ( FLOAT( 1 ) * rng() / range ); }
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static vec3f randomdirection()
+{
+    vec3f v{randomlength() - 0.5f, randomlength() - 0.5f, randomlength() - 0.5f};
+    v.normalize();
+    return v;
+}
+
+// -----------------------------------------------------------------------------
+// uv sphere with 2 * rings * segments triangles
+// -----------------------------------------------------------------------------
+static meshf makeSphere( unsigned int rings, unsigned int segments )
+{
+    std::vector<vec3f>        vertices;
+    std::vector<unsigned int> trias;
+    for ( unsigned int ii = 0; ii <= rings; ++ii )
+    {
+        FLOAT theta = M_PI * ii / rings;
+        for ( unsigned int jj = 0; jj < segments; ++jj )
+        {
+            FLOAT phi = 2 * M_PI * jj / segments;
+            vertices.emplace_back( std::sin( theta ) * std::cos( phi ),
+                                   std::sin( theta ) * std::sin( phi ),
+                                   std::cos( theta ) );
+        }
+    }
+
+    for ( unsigned int ii = 0; ii < rings; ++ii )
+    {
+        for ( unsigned int jj = 0; jj < segments; ++jj )
+        {
+            unsigned int a = ii * segments + jj;
+            unsigned int b = ii * segments + ( jj + 1 ) % segments;
+            unsigned int c = a + segments;
+            unsigned int d = b + segments;
+            trias.insert( trias.end(), {a, c, b, b, c, d} );
+        }
+    }
+
+    return meshf( std::move( vertices ), std::move( trias ) );
+}
+
+// -----------------------------------------------------------------------------
+// rays start on a sphere around the mesh and aim at random points inside its
+// bounds so that most of them hit
+// -----------------------------------------------------------------------------
+static void benchmark( const char *name, const meshf &m )
+{
+    const auto &box    = m.accel().bounds();
+    vec3f       center = box.center();
+    FLOAT       radius = box.radius();
+
+    constexpr unsigned int numRays = 200000;
+    std::vector<rayf>      rays( numRays );
+    for ( auto &r : rays )
+    {
+        r.o      = center + randomdirection() * ( 3 * radius );
+        vec3f to = center + randomdirection() * ( 0.5f * radius );
+        r.d      = to - r.o;
+        r.d.normalize();
+    }
+
+    unsigned int numHits = 0;
+    hit<FLOAT>   h;
+    auto         start = std::chrono::steady_clock::now();
+    for ( const auto &r : rays )
+        numHits += m.intersect( r, h ) ? 1 : 0;
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    printf( "%-16s %10u %10zu %10.1f %10.1f %12.3f %8.1f%%\n",
+            name,
+            m.numTriangles(),
+            m.accel().nodes().size(),
+            m.indexedBytes() / 1024.0,
+            m.triangleBytes() / 1024.0,
+            numRays / elapsed.count() * 1e-6,
+            100.0 * numHits / numRays );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    printf( "%-16s %10s %10s %10s %10s %12s %9s\n",
+            "mesh",
+            "triangles",
+            "bvh nodes",
+            "index KB",
+            "soa KB",
+            "Mrays/s",
+            "hits" );
+
+    for ( unsigned int n = 4; n <= 1024; n *= 2 )
+    {
+        char name[32];
+        snprintf( name, sizeof( name ), "uvsphere %ux%u", n, 2 * n );
+        benchmark( name, makeSphere( n, 2 * n ) );
+    }
+
+    for ( const char *file : {"box.obj", "cornellbox.obj", "suzanne.obj"} )
+    {
+        std::string path = std::string( PATHTRACER_ASSET_DIR ) + "/" + file;
+        benchmark( file, meshf( path ) );
+    }
+
+    return 0;
+}
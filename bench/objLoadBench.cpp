@@ -0,0 +1,194 @@
+#include "../mesh.h"
+#include "../objloader.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// writes a uv sphere with 2 * rings * segments triangles. with full syntax
+// every corner also references a texture coordinate and a normal
+// -----------------------------------------------------------------------------
+static void writeSphere( const std::string &path,
+                         unsigned int       rings,
+                         unsigned int       segments,
+                         bool               full )
+{
+    FILE *file = fopen( path.c_str(), "wb" );
+    for ( unsigned int ii = 0; ii <= rings; ++ii )
+    {
+        double theta = M_PI * ii / rings;
+        for ( unsigned int jj = 0; jj < segments; ++jj )
+        {
+            double phi = 2 * M_PI * jj / segments;
+            double x   = std::sin( theta ) * std::cos( phi );
+            double y   = std::sin( theta ) * std::sin( phi );
+            double z   = std::cos( theta );
+            fprintf( file, "v %f %f %f\n", x, y, z );
+            if ( full )
+            {
+                fprintf( file,
+                         "vt %f %f\n",
+                         1.0 * jj / segments,
+                         1.0 * ii / rings );
+                fprintf( file, "vn %f %f %f\n", x, y, z );
+            }
+        }
+    }
+
+    for ( unsigned int ii = 0; ii < rings; ++ii )
+    {
+        for ( unsigned int jj = 0; jj < segments; ++jj )
+        {
+            unsigned int a = 1 + ii * segments + jj;
+            unsigned int b = 1 + ii * segments + ( jj + 1 ) % segments;
+            unsigned int c = a + segments;
+            unsigned int d = b + segments;
+            if ( full )
+                fprintf( file,
+                         "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n",
+                         a, a, a, c, c, c, d, d, d, b, b, b );
+            else
+                fprintf( file, "f %u %u %u %u\n", a, c, d, b );
+        }
+    }
+    fclose( file );
+}
+
+// -----------------------------------------------------------------------------
+// the getline / sscanf loop the mesh constructor used before, for reference
+// -----------------------------------------------------------------------------
+static unsigned int loadReference( const std::string &path )
+{
+    std::ifstream file( path );
+
+    std::vector<float>        vertices;
+    std::vector<unsigned int> trias;
+    std::string               line;
+    char                      ch;
+    float                     x, y, z;
+    int                       nodes[4];
+    while ( getline( file, line ) )
+    {
+        if ( line[0] == 'v' )
+        {
+            if ( line[1] != 'n' &&
+                 4 == sscanf( line.c_str(), "%s %f %f %f", &ch, &x, &y, &z ) )
+                vertices.insert( vertices.end(), {x, y, z} );
+        }
+        else if ( line[0] == 'f' )
+        {
+            if ( 5 == sscanf( line.c_str(),
+                              "%s %d %d %d %d",
+                              &ch,
+                              &nodes[0],
+                              &nodes[1],
+                              &nodes[2],
+                              &nodes[3] ) )
+            {
+                trias.insert( trias.end(),
+                              {unsigned( nodes[0] - 1 ),
+                               unsigned( nodes[1] - 1 ),
+                               unsigned( nodes[2] - 1 ),
+                               unsigned( nodes[0] - 1 ),
+                               unsigned( nodes[2] - 1 ),
+                               unsigned( nodes[3] - 1 )} );
+            }
+        }
+    }
+    return static_cast<unsigned int>( trias.size() / 3 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void report( const char * name,
+                    const char * loader,
+                    double       megabytes,
+                    unsigned int triangles,
+                    double       seconds )
+{
+    printf( "%-12s %-18s %10.1f %12u %10.1f %10.1f\n",
+            name,
+            loader,
+            megabytes,
+            triangles,
+            1e3 * seconds,
+            megabytes / seconds );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    printf( "%-12s %-18s %10s %12s %10s %10s\n",
+            "file",
+            "loader",
+            "MB",
+            "triangles",
+            "ms",
+            "MB/s" );
+
+    for ( bool full : {false, true} )
+    {
+        const char *name = full ? "v/vt/vn" : "v";
+        std::string path = std::string( "objLoadBench_" ) +
+                           ( full ? "full" : "plain" ) + ".obj";
+        writeSphere( path, 1024, 2048, full );
+
+        objdata obj;
+        unsigned int hardware = ThreadPool::hardwareThreads();
+        for ( unsigned int threads = 1; threads <= hardware;
+              threads = threads < hardware ? hardware : threads + 1 )
+        {
+            loadobj( path, obj, threads );
+            char loader[32];
+            snprintf( loader,
+                      sizeof( loader ),
+                      "mmap %u thread%s",
+                      threads,
+                      threads == 1 ? "" : "s" );
+            report( name,
+                    loader,
+                    obj.bytes * 1e-6,
+                    obj.numTriangles(),
+                    obj.seconds );
+        }
+
+        // the old loader cannot read faces with texture coordinates or
+        // normals, it is only timed on the plain file. the same goes for the
+        // full mesh startup, first from source and then from its cache
+        if ( !full )
+        {
+            std::string cache = meshCachePath<float>( path );
+            std::remove( cache.c_str() );
+            for ( const char *loader : {"mesh from source", "mesh from cache"} )
+            {
+                auto start = std::chrono::steady_clock::now();
+                mesh<float>                   m( path );
+                std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - start;
+                report( name,
+                        loader,
+                        obj.bytes * 1e-6,
+                        m.numTriangles(),
+                        elapsed.count() );
+            }
+            std::remove( cache.c_str() );
+
+            auto         start     = std::chrono::steady_clock::now();
+            unsigned int triangles = loadReference( path );
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            report( name,
+                    "getline + sscanf",
+                    obj.bytes * 1e-6,
+                    triangles,
+                    elapsed.count() );
+        }
+
+        remove( path.c_str() );
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include "../mesh.h"
+#include "../scene.h"
+#include <chrono>
+#include <cstdio>
+
+using FLOAT = float;
+using vec3f = vec3<FLOAT>;
+using rayf  = ray<FLOAT>;
+using meshf = mesh<FLOAT>;
+
+// -----------------------------------------------------------------------------
+// camera rays of a width x width image looking at the mesh, in scanline order
+// so that consecutive rays are coherent like the renderer's packets
+// -----------------------------------------------------------------------------
+static std::vector<rayf> primaryRays( const scene<FLOAT> &world,
+                                      unsigned int        width )
+{
+    const auto &box    = world.accel().bounds();
+    vec3f       center = box.center();
+    FLOAT       radius = box.radius();
+    vec3f       eye    = center + vec3f{0, 0, 2.5f * radius};
+
+    std::vector<rayf> rays;
+    rays.reserve( width * width );
+    for ( unsigned int jj = 0; jj < width; ++jj )
+    {
+        for ( unsigned int ii = 0; ii < width; ++ii )
+        {
+            FLOAT u = 1.0f * ii / ( width - 1 ) - 0.5f;
+            FLOAT v = 0.5f - 1.0f * jj / ( width - 1 );
+            vec3f d = center + vec3f{u, v, 0} * ( 2 * radius ) - eye;
+            d.normalize();
+            rays.push_back( {eye, d} );
+        }
+    }
+    return rays;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static unsigned int lanes( unsigned int mask )
+{
+    unsigned int n = 0;
+    for ( ; mask; mask &= mask - 1 )
+        ++n;
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename Fn>
+static double mrays( unsigned int numRays, Fn &&fn )
+{
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return numRays / elapsed.count() * 1e-6;
+}
+
+// -----------------------------------------------------------------------------
+// primary rays measure closest hit queries, shadow rays run from every
+// primary hit towards a point light above the mesh and only ask for occlusion
+// -----------------------------------------------------------------------------
+static void benchmark( const char *file )
+{
+    std::string  path = std::string( PATHTRACER_ASSET_DIR ) + "/" + file;
+    scene<FLOAT> world;
+    world << new meshf( path );
+
+    std::vector<rayf> rays    = primaryRays( world, 512 );
+    auto              numRays = static_cast<unsigned int>( rays.size() );
+
+    std::vector<rayf> shadowRays;
+    const auto &      box   = world.accel().bounds();
+    vec3f             light = box.center() + vec3f{0.5f, 2, 1} * box.radius();
+    for ( const auto &r : rays )
+    {
+        hit<FLOAT>     h;
+        surface<FLOAT> hs;
+        if ( !world.intersect( r, h ) )
+            continue;
+        world.shade( r, h, hs );
+        vec3f to = light - hs._pos;
+        FLOAT t  = std::sqrt( to.len2() );
+        rayf  s( hs._pos + hs._normal * 1e-3f, to / t );
+        s.tmax = t;
+        shadowRays.push_back( s );
+    }
+    auto numShadow = static_cast<unsigned int>( shadowRays.size() );
+
+    unsigned int scalarHits = 0, packetHits = 0;
+    double       scalarPrimary = mrays( numRays, [&]() {
+        hit<FLOAT> h;
+        for ( const auto &r : rays )
+            scalarHits += world.intersect( r, h ) ? 1 : 0;
+    } );
+    double       packetPrimary = mrays( numRays, [&]() {
+        for ( unsigned int ii = 0; ii < numRays; ii += kPacketSize )
+        {
+            raypacket<FLOAT> p;
+            for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+                p.set( lane, rays[ii + lane] );
+            packethit<FLOAT> ph;
+            world.intersect( p, ph );
+            packetHits += lanes( ph.mask );
+        }
+    } );
+
+    unsigned int scalarBlocked = 0, packetBlocked = 0;
+    double       scalarShadow = mrays( numShadow, [&]() {
+        for ( const auto &r : shadowRays )
+            scalarBlocked += world.occluded( r ) ? 1 : 0;
+    } );
+    double       packetShadow = mrays( numShadow, [&]() {
+        for ( unsigned int ii = 0; ii < numShadow; ii += kPacketSize )
+        {
+            raypacket<FLOAT> p;
+            for ( unsigned int lane = 0;
+                  lane < kPacketSize && ii + lane < numShadow;
+                  ++lane )
+                p.set( lane, shadowRays[ii + lane] );
+            packetBlocked += lanes( world.occluded( p ) );
+        }
+    } );
+
+    printf( "%-16s %-8s %10.3f %10.3f %8.2fx %9u\n",
+            file,
+            "primary",
+            scalarPrimary,
+            packetPrimary,
+            packetPrimary / scalarPrimary,
+            packetHits );
+    printf( "%-16s %-8s %10.3f %10.3f %8.2fx %9u\n",
+            file,
+            "shadow",
+            scalarShadow,
+            packetShadow,
+            packetShadow / scalarShadow,
+            packetBlocked );
+
+    if ( scalarHits != packetHits || scalarBlocked != packetBlocked )
+        printf( "warning: scalar and packet results differ (%u/%u, %u/%u)\n",
+                scalarHits,
+                packetHits,
+                scalarBlocked,
+                packetBlocked );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    printf( "packet kernels: %s\n", packetops<FLOAT>::isa() );
+    printf( "%-16s %-8s %10s %10s %9s %9s\n",
+            "mesh",
+            "rays",
+            "scalar",
+            "packet",
+            "speedup",
+            "hits" );
+
+    for ( const char *file : {"cornellbox.obj", "suzanne.obj"} )
+        benchmark( file );
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "../renderer.h"
+#include "../scenes.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// renders the same scenes with renderer<float> and renderer<double> and
+// reports the render times and how far the float image is from the double
+// one. both use the same sample sequences, so the difference is due to
+// precision and to the paths that it sends elsewhere, not to sampling noise
+// -----------------------------------------------------------------------------
+constexpr unsigned int kWidth   = 128;
+constexpr unsigned int kSamples = 16;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+static double render( const std::string &name, film &image )
+{
+    scene<T>  world;
+    camera<T> cam = name == "cornell"
+                        ? buildCornellBoxScene( world )
+                        : buildMeshScene( world,
+                                          std::string( PATHTRACER_ASSET_DIR ) +
+                                              "/" + name );
+
+    renderparams rp{kWidth, kWidth, 4, kSamples};
+    rp._samplesPerPass = kSamples;
+    renderer<T> device( cam, rp );
+
+    auto start = std::chrono::steady_clock::now();
+    device.render( world, image );
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// -----------------------------------------------------------------------------
+// writes the per pixel absolute difference, scaled by 4, next to the binary
+// -----------------------------------------------------------------------------
+static void benchmark( const std::string &name )
+{
+    film   single, reference;
+    double floatSeconds  = render<float>( name, single );
+    double doubleSeconds = render<double>( name, reference );
+
+    double       sumSquared = 0, sumSingle = 0, sumReference = 0;
+    float        maxDiff = 0;
+    unsigned int changed = 0;
+    film         diff( kWidth, kWidth );
+    for ( unsigned int y = 0; y < kWidth; ++y )
+    {
+        for ( unsigned int x = 0; x < kWidth; ++x )
+        {
+            color a = single.pixel( x, y );
+            color b = reference.pixel( x, y );
+            color d = {std::abs( a.r - b.r ),
+                       std::abs( a.g - b.g ),
+                       std::abs( a.b - b.b ),
+                       0.0f};
+            sumSquared += d.r * d.r + d.g * d.g + d.b * d.b;
+            sumSingle += a.r + a.g + a.b;
+            sumReference += b.r + b.g + b.b;
+            maxDiff = std::max( {maxDiff, d.r, d.g, d.b} );
+            changed += d.r + d.g + d.b > 0.0f ? 1 : 0;
+            diff.add( x, y, d * 4.0f, 1 );
+        }
+    }
+
+    double numValues = 3.0 * kWidth * kWidth;
+    double rmse      = std::sqrt( sumSquared / numValues );
+    double mean      = sumReference / numValues;
+    double bias      = ( sumSingle - sumReference ) / sumReference;
+
+    printf( "%-16s %9.3f %9.3f %8.2fx %10.5f %10.5f %9.5f %+9.5f %8u\n",
+            name.c_str(),
+            floatSeconds,
+            doubleSeconds,
+            doubleSeconds / floatSeconds,
+            rmse,
+            rmse / mean,
+            maxDiff,
+            bias,
+            changed );
+
+    std::string base = name.substr( 0, name.find( '.' ) );
+    diff.writeppm( "precision_" + base + "_diff.ppm" );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    printf( "%ux%u, %u samples per subpixel\n", kWidth, kWidth, kSamples );
+    printf( "%-16s %9s %9s %9s %10s %10s %9s %9s %8s\n",
+            "scene",
+            "float s",
+            "double s",
+            "speedup",
+            "rmse",
+            "rel rmse",
+            "max diff",
+            "bias",
+            "changed" );
+
+    for ( const char *name : {"cornell", "box.obj", "suzanne.obj"} )
+        benchmark( name );
+
+    return 0;
+}
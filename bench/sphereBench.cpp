@@ -0,0 +1,103 @@
+#include "../scene.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using FLOAT   = float;
+using vec3f   = vec3<FLOAT>;
+using rayf    = ray<FLOAT>;
+using spheref = sphere<FLOAT>;
+
+static std::mt19937 rng;
+static auto         range = rng.max() - rng.min();
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static FLOAT randomlength() { return ( FLOAT( 1 ) * rng() / range ); }
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static vec3f randomdirection()
+{
+    vec3f v{randomlength() - 0.5f, randomlength() - 0.5f, randomlength() - 0.5f};
+    v.normalize();
+    return v;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename Fn>
+static double mrays( unsigned int numRays, Fn &&fn )
+{
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return numRays / elapsed.count() * 1e-6;
+}
+
+// -----------------------------------------------------------------------------
+// a cloud of small particles in a ball of radius 10, traced once with every
+// sphere allocated on its own behind the primitive interface and once with
+// all of them in the scene's sphere group
+// -----------------------------------------------------------------------------
+static void benchmark( unsigned int numSpheres )
+{
+    rng.seed( numSpheres );
+    std::vector<spheref> spheres;
+    for ( unsigned int ii = 0; ii < numSpheres; ++ii )
+        spheres.emplace_back( randomdirection() * ( 10.0f * randomlength() ),
+                              0.01f + 0.04f * randomlength() );
+
+    std::vector<rayf> rays;
+    for ( unsigned int ii = 0; ii < 200000; ++ii )
+        rays.emplace_back( randomdirection() * 12.0f, randomdirection() );
+    auto numRays = static_cast<unsigned int>( rays.size() );
+
+    scene<FLOAT> separate, grouped;
+    for ( const spheref &s : spheres )
+    {
+        separate << new spheref( s );
+        grouped << s;
+    }
+
+    for ( scene<FLOAT> *world : {&separate, &grouped} )
+    {
+        unsigned int hits = 0, blocked = 0;
+        double       closest = mrays( numRays, [&]() {
+            hit<FLOAT> h;
+            for ( const auto &r : rays )
+                hits += world->intersect( r, h ) ? 1 : 0;
+        } );
+        double       shadow = mrays( numRays, [&]() {
+            for ( const auto &r : rays )
+                blocked += world->occluded( r ) ? 1 : 0;
+        } );
+
+        printf( "%9u %-9s %10.3f %10.3f %9u %9u\n",
+                numSpheres,
+                world == &grouped ? "grouped" : "separate",
+                closest,
+                shadow,
+                hits,
+                blocked );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    printf( "%9s %-9s %10s %10s %9s %9s\n",
+            "spheres",
+            "storage",
+            "closest",
+            "occluded",
+            "hits",
+            "blocked" );
+
+    for ( unsigned int numSpheres : {1000u, 100000u, 400000u} )
+        benchmark( numSpheres );
+
+    return 0;
+}
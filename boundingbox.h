@@ -2,6 +2,7 @@
 #include "vec3.h"
 #include <cassert>
 #include <limits>
+#include <utility>
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -57,6 +58,59 @@ public:
             _max[2] = point[2];
     }
 
+    constexpr void expand( const bbox<T> &other ) noexcept
+    {
+        expand( other._min );
+        expand( other._max );
+    }
+
+    // surface area, used as the hit probability estimate by the bvh builder
+    constexpr T area() const noexcept
+    {
+        vec3<T> d = _max - _min;
+        return T( 2 ) * ( d[0] * d[1] + d[1] * d[2] + d[2] * d[0] );
+    }
+
+    constexpr unsigned int longestAxis() const noexcept
+    {
+        vec3<T> d = _max - _min;
+        if ( d[0] > d[1] && d[0] > d[2] )
+            return 0;
+        return d[1] > d[2] ? 1 : 2;
+    }
+
+    // the exit distance is scaled by this before it is compared with the
+    // entry distance. it covers the rounding of the slab distances, 1 + 2
+    // gamma( 3 ) in pbrt's notation, so that rays through an edge or a corner
+    // of the box are not culled
+    static constexpr T kExitScale =
+        T( 1 ) + T( 4 ) * std::numeric_limits<T>::epsilon();
+
+    // slab test against a ray with precomputed reciprocal direction. returns
+    // true if the box overlaps [0, tmax] along the ray, tnear receives the
+    // entry distance (0 if the origin is inside)
+    constexpr bool intersect( const vec3<T> &origin,
+                              const vec3<T> &invdir,
+                              T              tmax,
+                              T &            tnear ) const noexcept
+    {
+        T t0 = T( 0 );
+        T t1 = tmax;
+        for ( unsigned int ii = 0; ii < 3; ++ii )
+        {
+            T tslab0 = ( _min[ii] - origin[ii] ) * invdir[ii];
+            T tslab1 = ( _max[ii] - origin[ii] ) * invdir[ii];
+            if ( tslab0 > tslab1 )
+                std::swap( tslab0, tslab1 );
+            t0 = tslab0 > t0 ? tslab0 : t0;
+            t1 = tslab1 < t1 ? tslab1 : t1;
+            if ( t0 > t1 * kExitScale )
+                return false;
+        }
+        tnear = t0;
+        return true;
+    }
+
     T radius() const noexcept
     {
         vec3<T> c = center();
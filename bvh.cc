@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void bvh<T>::build( const std::vector<bbox<T>> &bounds )
+{
+    clear();
+    if ( bounds.empty() )
+        return;
+
+    std::vector<buildref> refs( bounds.size() );
+    for ( unsigned int ii = 0; ii < bounds.size(); ++ii )
+    {
+        refs[ii].box      = bounds[ii];
+        refs[ii].centroid = bounds[ii].center();
+        refs[ii].index    = ii;
+    }
+
+    std::vector<bvhnode<T>> &nodes = _nodes.edit();
+    nodes.reserve( 2 * bounds.size() );
+    nodes.emplace_back();
+    build( refs, nodes, 0, 0, static_cast<unsigned int>( refs.size() ), 0 );
+
+    std::vector<unsigned int> &order = _order.edit();
+    order.resize( refs.size() );
+    for ( unsigned int ii = 0; ii < refs.size(); ++ii )
+        order[ii] = refs[ii].index;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void bvh<T>::build( std::vector<buildref> &  refs,
+                    std::vector<bvhnode<T>> &nodes,
+                    unsigned int             node,
+                    unsigned int             first,
+                    unsigned int             count,
+                    unsigned int             depth )
+{
+    bbox<T> box;
+    bbox<T> centroidBox;
+    for ( unsigned int ii = first; ii < first + count; ++ii )
+    {
+        box.expand( refs[ii].box );
+        centroidBox.expand( refs[ii].centroid );
+    }
+
+    nodes[node].box   = box;
+    nodes[node].first = first;
+    nodes[node].count = count;
+
+    if ( count <= kMaxLeafSize || depth >= kMaxDepth )
+        return;
+
+    // find the cheapest split plane over all axes using binned centroids
+    T            bestCost  = std::numeric_limits<T>::max();
+    unsigned int bestAxis  = 0;
+    unsigned int bestSplit = 0;
+    for ( unsigned int axis = 0; axis < 3; ++axis )
+    {
+        T lo = centroidBox.min()[axis];
+        T hi = centroidBox.max()[axis];
+        if ( !( hi > lo ) )
+            continue;
+
+        bbox<T>      binBox[kNumBins];
+        unsigned int binCount[kNumBins] = {};
+        T            scale              = kNumBins / ( hi - lo );
+        for ( unsigned int ii = first; ii < first + count; ++ii )
+        {
+            auto bin = static_cast<unsigned int>(
+                ( refs[ii].centroid[axis] - lo ) * scale );
+            bin = std::min( bin, kNumBins - 1 );
+            binBox[bin].expand( refs[ii].box );
+            ++binCount[bin];
+        }
+
+        // sweep from the right to get the area and count of every suffix
+        T            rightArea[kNumBins];
+        unsigned int rightCount[kNumBins];
+        bbox<T>      acc;
+        unsigned int n = 0;
+        for ( unsigned int ii = kNumBins - 1; ii > 0; --ii )
+        {
+            acc.expand( binBox[ii] );
+            n += binCount[ii];
+            rightArea[ii]  = n ? acc.area() : T( 0 );
+            rightCount[ii] = n;
+        }
+
+        acc.reset();
+        n = 0;
+        for ( unsigned int ii = 0; ii < kNumBins - 1; ++ii )
+        {
+            acc.expand( binBox[ii] );
+            n += binCount[ii];
+            if ( n == 0 || rightCount[ii + 1] == 0 )
+                continue;
+
+            T cost = n * acc.area() + rightCount[ii + 1] * rightArea[ii + 1];
+            if ( cost < bestCost )
+            {
+                bestCost  = cost;
+                bestAxis  = axis;
+                bestSplit = ii;
+            }
+        }
+    }
+
+    T leafCost = T( count );
+    T area     = box.area();
+    if ( bestCost != std::numeric_limits<T>::max() && area > T( 0 ) )
+        bestCost = kTraversalCost + bestCost / area;
+
+    auto begin = refs.begin() + first;
+    auto end   = begin + count;
+    auto mid   = begin;
+    if ( bestCost < leafCost )
+    {
+        T lo    = centroidBox.min()[bestAxis];
+        T scale = kNumBins / ( centroidBox.max()[bestAxis] - lo );
+        mid     = std::partition( begin, end, [&]( const buildref &ref ) {
+            auto bin = static_cast<unsigned int>(
+                ( ref.centroid[bestAxis] - lo ) * scale );
+            return std::min( bin, kNumBins - 1 ) <= bestSplit;
+        } );
+    }
+    else if ( count > 4 * kMaxLeafSize )
+    {
+        // the heuristic prefers a leaf (or all centroids coincide) but the
+        // leaf would be too large, fall back to a median split
+        unsigned int axis = centroidBox.longestAxis();
+        mid               = begin + count / 2;
+        std::nth_element(
+            begin, mid, end, [axis]( const buildref &a, const buildref &b ) {
+                return a.centroid[axis] < b.centroid[axis];
+            } );
+    }
+    else
+    {
+        return;
+    }
+
+    auto leftCount = static_cast<unsigned int>( mid - begin );
+    if ( leftCount == 0 || leftCount == count )
+        return;
+
+    auto left = static_cast<unsigned int>( nodes.size() );
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[node].first = left;
+    nodes[node].count = 0;
+
+    build( refs, nodes, left, first, leftCount, depth + 1 );
+    build( refs,
+           nodes,
+           left + 1,
+           first + leftCount,
+           count - leftCount,
+           depth + 1 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+bool bvh<T>::valid( unsigned int numPrimitives ) const
+{
+    for ( unsigned int index : _order )
+    {
+        if ( index >= numPrimitives )
+            return false;
+    }
+    if ( _nodes.empty() )
+        return true;
+
+    struct entry
+    {
+        std::size_t  node;
+        unsigned int depth;
+    };
+
+    std::vector<bool>  seen( _nodes.size(), false );
+    std::vector<entry> stack{{0, 0}};
+    while ( !stack.empty() )
+    {
+        entry e = stack.back();
+        stack.pop_back();
+        if ( e.node >= _nodes.size() || seen[e.node] || e.depth > kMaxDepth )
+            return false;
+        seen[e.node] = true;
+
+        const bvhnode<T> &n = _nodes[e.node];
+        if ( n.isleaf() )
+        {
+            if ( std::uint64_t( n.first ) + n.count > numPrimitives )
+                return false;
+            continue;
+        }
+        stack.push_back( {std::size_t( n.first ), e.depth + 1} );
+        stack.push_back( {std::size_t( n.first ) + 1, e.depth + 1} );
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+template <typename LeafFn>
+bool bvh<T>::traverse( const ray<T> &r, T tmax, LeafFn &&leaf ) const noexcept
+{
+    if ( _nodes.empty() )
+        return false;
+
+    vec3<T> invdir{T( 1 ) / r.d[0], T( 1 ) / r.d[1], T( 1 ) / r.d[2]};
+
+    T tnear = T( 0 );
+    PT_STAT_ADD( kBoxTests, 1 );
+    if ( !_nodes[0].box.intersect( r.o, invdir, tmax, tnear ) )
+        return false;
+
+    struct entry
+    {
+        unsigned int node;
+        T            tnear;
+    };
+
+    entry stack[kStackSize];
+    int   top   = 0;
+    bool  found = false;
+
+    stack[top++] = {0u, tnear};
+    while ( top > 0 )
+    {
+        entry e = stack[--top];
+        if ( e.tnear > tmax )
+            continue;
+
+        const bvhnode<T> *node = &_nodes[e.node];
+        while ( !node->isleaf() )
+        {
+            const bvhnode<T> *left  = &_nodes[node->first];
+            const bvhnode<T> *right = left + 1;
+
+            T tleft = T( 0 ), tright = T( 0 );
+            PT_STAT_ADD( kBoxTests, 2 );
+            bool hitLeft  = left->box.intersect( r.o, invdir, tmax, tleft );
+            bool hitRight = right->box.intersect( r.o, invdir, tmax, tright );
+            if ( hitLeft && hitRight )
+            {
+                // descend into the nearer child, the farther one waits on
+                // the stack and is culled if a closer hit turns up first
+                if ( tright < tleft )
+                {
+                    std::swap( left, right );
+                    std::swap( tleft, tright );
+                }
+                stack[top++] = {static_cast<unsigned int>( right - &_nodes[0] ),
+                                tright};
+                node         = left;
+            }
+            else if ( hitLeft )
+            {
+                node = left;
+            }
+            else if ( hitRight )
+            {
+                node = right;
+            }
+            else
+            {
+                node = nullptr;
+                break;
+            }
+        }
+
+        if ( node && leaf( node->first, node->count, tmax ) )
+            found = true;
+    }
+
+    return found;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+template <typename LeafFn>
+void bvh<T>::traverse( raypacket<T> &p, LeafFn &&leaf ) const noexcept
+{
+    if ( _nodes.empty() || !p.active )
+        return;
+
+    T tnear = T( 0 );
+    PT_STAT_ADD( kBoxTests, BitCount( p.active ) );
+    if ( !packetops<T>::intersectBox( _nodes[0].box, p, tnear ) )
+        return;
+
+    // farthest distance any active lane may still hit something at
+    auto farthest = [&p]() {
+        T t = T( 0 );
+        for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+            if ( p.active & ( 1u << lane ) )
+                t = p.tmax[lane] > t ? p.tmax[lane] : t;
+        return t;
+    };
+
+    struct entry
+    {
+        unsigned int node;
+        T            tnear;
+    };
+
+    entry stack[kStackSize];
+    int   top = 0;
+
+    stack[top++] = {0u, tnear};
+    while ( top > 0 && p.active )
+    {
+        entry e = stack[--top];
+        if ( e.tnear > farthest() )
+            continue;
+
+        const bvhnode<T> *node = &_nodes[e.node];
+        while ( !node->isleaf() )
+        {
+            const bvhnode<T> *left  = &_nodes[node->first];
+            const bvhnode<T> *right = left + 1;
+
+            T tleft = T( 0 ), tright = T( 0 );
+            PT_STAT_ADD( kBoxTests, 2 * BitCount( p.active ) );
+            bool hitLeft  = packetops<T>::intersectBox( left->box, p, tleft );
+            bool hitRight = packetops<T>::intersectBox( right->box, p, tright );
+            if ( hitLeft && hitRight )
+            {
+                if ( tright < tleft )
+                {
+                    std::swap( left, right );
+                    std::swap( tleft, tright );
+                }
+                stack[top++] = {static_cast<unsigned int>( right - &_nodes[0] ),
+                                tright};
+                node         = left;
+            }
+            else if ( hitLeft )
+            {
+                node = left;
+            }
+            else if ( hitRight )
+            {
+                node = right;
+            }
+            else
+            {
+                node = nullptr;
+                break;
+            }
+        }
+
+        if ( node )
+            leaf( node->first, node->count, p );
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "boundingbox.h"
+#include "packet.h"
+#include "ray.h"
+#include "util/mappedarray.h"
+#include "util/stats.h"
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// flattened bvh node. interior nodes store the index of their left child in
+// first (the right child is always first + 1), leaves store the range
+// [first, first + count) into the primitive order
+// -----------------------------------------------------------------------------
+template <typename T>
+struct bvhnode
+{
+    bbox<T>      box;
+    unsigned int first = 0;
+    unsigned int count = 0;
+
+    constexpr bool isleaf() const noexcept { return count != 0; }
+};
+
+// -----------------------------------------------------------------------------
+// bounding volume hierarchy built with a binned surface area heuristic. the
+// tree only knows about primitive bounds; owners reorder their primitive data
+// by order() so that every leaf references a contiguous range
+// -----------------------------------------------------------------------------
+template <typename T>
+class bvh
+{
+public:
+    static constexpr unsigned int kNumBins       = 16;
+    static constexpr unsigned int kMaxLeafSize   = 4;
+    static constexpr unsigned int kMaxDepth      = 60;
+    static constexpr unsigned int kStackSize     = 64;
+    static constexpr T            kTraversalCost = T( 1 );
+
+    bvh() = default;
+
+    void build( const std::vector<bbox<T>> &bounds );
+
+    // takes over a tree built earlier, e.g. borrowed from a mapped cache
+    void assign( MappedArray<bvhnode<T>>   nodes,
+                 MappedArray<unsigned int> order ) noexcept
+    {
+        _nodes = std::move( nodes );
+        _order = std::move( order );
+    }
+
+    void clear() noexcept
+    {
+        _nodes.clear();
+        _order.clear();
+    }
+
+    bool empty() const noexcept { return _nodes.empty(); }
+
+    // true if the tree can be traversed safely: every node is reached once
+    // from the root, no deeper than a built tree, leaves lie within
+    // [0, numPrimitives) and so do the entries of order(). for trees that
+    // were read from a file instead of built
+    bool valid( unsigned int numPrimitives ) const;
+
+    const MappedArray<bvhnode<T>> & nodes() const noexcept { return _nodes; }
+    const MappedArray<unsigned int> &order() const noexcept { return _order; }
+
+    const bbox<T> &bounds() const noexcept { return _nodes.front().box; }
+
+    // visits the leaves overlapping the ray front to back. leaf( first,
+    // count, tmax ) tests the primitives of one leaf, shrinks tmax when it
+    // finds a closer hit and returns true if it did. nodes entered beyond
+    // the current tmax are culled
+    template <typename LeafFn>
+    bool traverse( const ray<T> &r, T tmax, LeafFn &&leaf ) const noexcept;
+
+    // packet version. a node is entered if any active lane overlaps it and
+    // children are ordered by their nearest lane. leaf( first, count, p )
+    // shrinks the tmax of lanes that found closer hits and may clear lanes
+    // that are done from p.active, traversal ends when none is left
+    template <typename LeafFn>
+    void traverse( raypacket<T> &p, LeafFn &&leaf ) const noexcept;
+
+private:
+    struct buildref
+    {
+        bbox<T>      box;
+        vec3<T>      centroid;
+        unsigned int index;
+    };
+
+    void build( std::vector<buildref> &  refs,
+                std::vector<bvhnode<T>> &nodes,
+                unsigned int             node,
+                unsigned int             first,
+                unsigned int             count,
+                unsigned int             depth );
+
+    MappedArray<bvhnode<T>>   _nodes;
+    MappedArray<unsigned int> _order;
+};
+
+#include "bvh.cc"
@@ -10,7 +10,7 @@ class camera
 public:
     constexpr camera( const vec3<T> &position, const vec3<T> &lookAt, float fov = 70 ) noexcept
         : _position( position ), _upVector( {0, 0, 1} ), _lookAt( lookAt ),
-          _fov( .5 / tanf( fov * M_PI * .5f / 180.0 ) )
+          _fovDegrees( fov ), _fov( .5 / tanf( fov * M_PI * .5f / 180.0 ) )
     {
         _dir = ( _lookAt - _position );
         _dir.normalize();
@@ -22,6 +22,7 @@ public:
 
     constexpr const vec3<T> &position() const noexcept { return _position; }
     constexpr const vec3<T> &lookAt() const noexcept { return _lookAt; }
+    constexpr float           fov() const noexcept { return _fovDegrees; }
 
     vec3<T> direction( T u, T v ) const noexcept
     {
@@ -32,6 +33,7 @@ private:
     vec3<T> _position;
     vec3<T> _upVector;
     vec3<T> _lookAt;
+    float   _fovDegrees; // horizontal field of view as constructed
     float   _fov;
 
     // computed once when camera is initialized or when camera params change
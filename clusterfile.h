@@ -0,0 +1,83 @@
+#pragma once
+
+#include "meshcache.h"
+#include <cstdint>
+#include <cstring>
+
+// -----------------------------------------------------------------------------
+// a mesh split into clusters for out of core rendering. each cluster is a
+// subtree of the mesh bvh, its triangles are contiguous in leaf order and
+// close together in space. the header and the materials are followed by a
+// table of the clusters and then their data, every cluster at a page aligned
+// offset so that it is read in and dropped from the mapping on its own:
+//
+//   bvh nodes         numNodes x bvhnode<T>, leaves index the cluster's
+//                     triangles from 0
+//   triangles         the intersection layout of mesh<T>, numTriangles
+//                     values per component
+//   material ids      numTriangles x std::uint32_t
+//
+// each array starts at a kMeshCacheAlignment aligned offset in the cluster
+// -----------------------------------------------------------------------------
+constexpr char kClusterFileMagic[8]     = {'p', 't', 'c', 'l', 'u', 's'};
+constexpr char kClusterFileExtension[] = ".ptclusters";
+constexpr std::uint32_t kClusterFileVersion = 1;
+constexpr std::uint64_t kClusterAlignment   = 4096;
+
+// memory for the clusters read in, unless the renderer is given another
+constexpr std::size_t kClusterBudget = std::size_t( 512 ) << 20;
+
+struct clusterinfo
+{
+    double        boxMin[3]    = {};
+    double        boxMax[3]    = {};
+    std::uint64_t offset       = 0; // from the start of the file
+    std::uint64_t bytes        = 0;
+    std::uint32_t first        = 0; // first triangle in leaf order
+    std::uint32_t numTriangles = 0;
+    std::uint32_t numNodes     = 0;
+    std::uint32_t numEmitters  = 0; // triangles of emissive materials
+};
+
+struct clusterfileheader
+{
+    char          magic[8]     = {};
+    std::uint32_t version      = 0;
+    std::uint32_t byteOrder    = 0;
+    std::uint32_t scalarSize   = 0;
+    std::uint32_t numTriangles = 0;
+    double        boxMin[3]    = {};
+    double        boxMax[3]    = {};
+
+    meshcachesection materials; // material
+    meshcachesection clusters;  // clusterinfo
+
+    // true if the header was written by this build
+    bool matches( std::uint32_t scalar ) const noexcept
+    {
+        return memcmp( magic, kClusterFileMagic, sizeof( magic ) ) == 0 &&
+               version == kClusterFileVersion &&
+               byteOrder == kMeshCacheByteOrder && scalarSize == scalar;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// offsets of the arrays of a cluster from its start, and its size in bytes
+// -----------------------------------------------------------------------------
+template <typename NODE, typename T>
+void clusterLayout( std::uint64_t  numNodes,
+                    std::uint64_t  numTriangles,
+                    unsigned int   numComponents,
+                    std::uint64_t &values,
+                    std::uint64_t &ids,
+                    std::uint64_t &bytes ) noexcept
+{
+    auto align = []( std::uint64_t offset ) {
+        return ( offset + kMeshCacheAlignment - 1 ) / kMeshCacheAlignment *
+               kMeshCacheAlignment;
+    };
+
+    values = align( numNodes * sizeof( NODE ) );
+    ids    = align( values + numComponents * numTriangles * sizeof( T ) );
+    bytes  = ids + numTriangles * sizeof( std::uint32_t );
+}
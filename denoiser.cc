@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline denoiser::denoiser( const denoiseparams &dp )
+    : _params( dp ), _pool( dp.numThreads() )
+{
+}
+
+// -----------------------------------------------------------------------------
+// albedo below this is treated as black, the radiance is filtered as is
+// -----------------------------------------------------------------------------
+constexpr float kDenoiseMinAlbedo = 1e-3f;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline float demodulate( float radiance, float albedo ) noexcept
+{
+    return albedo > kDenoiseMinAlbedo ? radiance / albedo : radiance;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline float remodulate( float irradiance, float albedo ) noexcept
+{
+    return albedo > kDenoiseMinAlbedo ? irradiance * albedo : irradiance;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline void denoiser::run( const film &in, film &out )
+{
+    PT_TRACE_SCOPE( "denoise", "output" );
+    prepare( in );
+
+    layer *src = &_ping;
+    layer *dst = &_pong;
+    for ( unsigned int ii = 0; ii < _params.iterations(); ++ii )
+    {
+        iterate( 1u << ii, *src, *dst );
+        std::swap( src, dst );
+    }
+
+    out.resize( _width, _height );
+    for ( unsigned int y = 0; y < _height; ++y )
+    {
+        for ( unsigned int x = 0; x < _width; ++x )
+        {
+            unsigned int index = y * _width + x;
+            const color &a     = _albedo[index];
+            const color &e     = src->irradiance[index];
+            out.add( x,
+                     y,
+                     {remodulate( e.r, a.r ),
+                      remodulate( e.g, a.g ),
+                      remodulate( e.b, a.b ),
+                      1.0f},
+                     1 );
+            out.addFeatures(
+                x, y, in.albedo( x, y ), in.normal( x, y ), in.depth( x, y ), 1 );
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// pulls the features and the demodulated radiance out of the film. the
+// variance of the pixel mean is scaled by the albedo like the radiance
+// -----------------------------------------------------------------------------
+inline void denoiser::prepare( const film &in )
+{
+    _width                = in.width();
+    _height               = in.height();
+    std::size_t numPixels = std::size_t( _width ) * _height;
+    _albedo.resize( numPixels );
+    _normal.resize( numPixels );
+    _depth.resize( numPixels );
+    _gradient.resize( numPixels );
+    for ( layer *l : {&_ping, &_pong} )
+    {
+        l->irradiance.resize( numPixels );
+        l->variance.resize( numPixels );
+    }
+
+    for ( unsigned int y = 0; y < _height; ++y )
+    {
+        for ( unsigned int x = 0; x < _width; ++x )
+        {
+            unsigned int index = y * _width + x;
+            color        a     = in.albedo( x, y );
+            color        c     = in.pixel( x, y );
+            float        scale = std::max( a.luminance(), kDenoiseMinAlbedo );
+
+            _albedo[index] = a;
+            _normal[index] = in.normal( x, y );
+            _normal[index].normalize();
+            _depth[index]           = in.depth( x, y );
+            _ping.irradiance[index] = {demodulate( c.r, a.r ),
+                                       demodulate( c.g, a.g ),
+                                       demodulate( c.b, a.b ),
+                                       1.0f};
+            _ping.variance[index] =
+                std::min( in.variance( x, y ) / ( scale * scale ), 1e6f );
+        }
+    }
+
+    // depth change per pixel towards the closer neighbour along x and y.
+    // slanted surfaces keep their weight over the depth they span, and the
+    // closer neighbour keeps depth edges from inflating it
+    auto slope = [this]( unsigned int index,
+                         bool         before,
+                         bool         after,
+                         unsigned int stride ) {
+        float z = _depth[index];
+        float s = std::numeric_limits<float>::max();
+        if ( before )
+            s = std::abs( z - _depth[index - stride] );
+        if ( after )
+            s = std::min( s, std::abs( z - _depth[index + stride] ) );
+        return before || after ? s : 0.0f;
+    };
+
+    for ( unsigned int y = 0; y < _height; ++y )
+    {
+        for ( unsigned int x = 0; x < _width; ++x )
+        {
+            unsigned int index = y * _width + x;
+            _gradient[index] =
+                std::max( slope( index, x > 0, x + 1 < _width, 1 ),
+                          slope( index, y > 0, y + 1 < _height, _width ) );
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// one a-trous level with taps step pixels apart. the variance is filtered
+// with the squared weights, which is how it shrinks as the noise is averaged
+// -----------------------------------------------------------------------------
+inline void denoiser::iterate( unsigned int step, const layer &src, layer &dst )
+{
+    static constexpr float kernel[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+    unsigned int tilesX   = ( _width + kTileSize - 1 ) / kTileSize;
+    unsigned int tilesY   = ( _height + kTileSize - 1 ) / kTileSize;
+    unsigned int numTiles = tilesX * tilesY;
+    _pool.run( numTiles, [&]( unsigned int tile, unsigned int ) {
+        unsigned int x0 = ( tile % tilesX ) * kTileSize;
+        unsigned int y0 = ( tile / tilesX ) * kTileSize;
+        unsigned int x1 = std::min( x0 + kTileSize, _width );
+        unsigned int y1 = std::min( y0 + kTileSize, _height );
+        for ( unsigned int y = y0; y < y1; ++y )
+        {
+            for ( unsigned int x = x0; x < x1; ++x )
+            {
+                unsigned int       p  = y * _width + x;
+                const color &      cp = src.irradiance[p];
+                const vec3<float> &np = _normal[p];
+                float              lp = cp.luminance();
+                float              zp = _depth[p];
+                float              colorScale =
+                    _params.colorSigma() * std::sqrt( src.variance[p] ) + 1e-4f;
+                float depthScale = _params.depthSigma() * _gradient[p] + 1e-4f;
+
+                color sum         = {0.0f, 0.0f, 0.0f, 0.0f};
+                float sumWeight   = 0.0f;
+                float sumVariance = 0.0f;
+                for ( int dy = -2; dy <= 2; ++dy )
+                {
+                    int qy = int( y ) + dy * int( step );
+                    if ( qy < 0 || qy >= int( _height ) )
+                        continue;
+                    for ( int dx = -2; dx <= 2; ++dx )
+                    {
+                        int qx = int( x ) + dx * int( step );
+                        if ( qx < 0 || qx >= int( _width ) )
+                            continue;
+
+                        unsigned int q = qy * _width + qx;
+                        float        w =
+                            kernel[std::abs( dx )] * kernel[std::abs( dy )];
+                        if ( q != p )
+                        {
+                            // escaped rays have no normal and keep to
+                            // themselves
+                            float cosine = std::max( 0.0f, np % _normal[q] );
+                            float wn     = std::pow( cosine,
+                                                     _params.normalPower() );
+                            float distance = step * std::sqrt(
+                                                        float( dx * dx +
+                                                               dy * dy ) );
+                            float wz = std::abs( zp - _depth[q] ) /
+                                       ( depthScale * distance );
+                            float wl =
+                                std::abs( lp - src.irradiance[q].luminance() ) /
+                                colorScale;
+                            w *= wn * std::exp( -wz - wl );
+                        }
+
+                        sum = sum + src.irradiance[q] * w;
+                        sumWeight += w;
+                        sumVariance += w * w * src.variance[q];
+                    }
+                }
+
+                // the center tap always has weight, sumWeight is never 0
+                dst.irradiance[p] = sum / sumWeight;
+                dst.variance[p]   = sumVariance / ( sumWeight * sumWeight );
+            }
+        }
+    } );
+}
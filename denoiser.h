@@ -0,0 +1,73 @@
+#pragma once
+
+#include "film.h"
+#include "util/concurrent.h"
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct denoiseparams
+{
+    constexpr unsigned int iterations() const noexcept { return _iterations; }
+    constexpr float        colorSigma() const noexcept { return _colorSigma; }
+    constexpr float        normalPower() const noexcept { return _normalPower; }
+    constexpr float        depthSigma() const noexcept { return _depthSigma; }
+    constexpr unsigned int numThreads() const noexcept { return _numThreads; }
+
+    unsigned int _iterations  = 4;     // filter radius is 2^iterations pixels
+    float        _colorSigma  = 2.0f;  // in standard deviations of the noise
+    float        _normalPower = 64.0f; // exponent of the normal cosine
+    float        _depthSigma  = 1.0f;  // in units of the local depth slope
+    unsigned int _numThreads  = 0;     // 0 uses every hardware thread
+};
+
+// -----------------------------------------------------------------------------
+// edge avoiding a-trous wavelet filter guided by the features of the film.
+// after dammertz et al., "edge-avoiding a-trous wavelet transform for fast
+// global illumination filtering", with the variance driven color weight of
+// schied et al., "spatiotemporal variance-guided filtering"
+//
+// the radiance is divided by the first hit albedo before filtering and
+// multiplied by it afterwards, so only the lighting is smoothed and face
+// colors stay sharp. each iteration applies a 5x5 b3 spline kernel whose taps
+// are 2^i pixels apart, weighted by how alike the two pixels are in lighting,
+// normal and depth. iterations run one after the other, the tiles of each in
+// parallel
+// -----------------------------------------------------------------------------
+class denoiser
+{
+public:
+    // the image is split into square tiles that are filtered in parallel
+    static constexpr unsigned int kTileSize = 32;
+
+    explicit denoiser( const denoiseparams &dp = {} );
+
+    // filters the radiance of in into out, which is resized to match. the
+    // features are copied along, every pixel of out holds one sample
+    void run( const film &in, film &out );
+
+private:
+    // demodulated radiance and the variance of its luminance
+    struct layer
+    {
+        std::vector<color> irradiance;
+        std::vector<float> variance;
+    };
+
+    void prepare( const film &in );
+    void iterate( unsigned int step, const layer &src, layer &dst );
+
+    denoiseparams _params;
+    ThreadPool    _pool;
+
+    unsigned int             _width  = 0;
+    unsigned int             _height = 0;
+    std::vector<color>       _albedo;
+    std::vector<vec3<float>> _normal;   // unit length, 0 where nothing was hit
+    std::vector<float>       _depth;
+    std::vector<float>       _gradient; // depth change per pixel
+    layer                    _ping;
+    layer                    _pong;
+};
+
+#include "denoiser.cc"
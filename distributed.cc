@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <type_traits>
+
+static_assert( std::is_trivially_copyable<film::pixelstate>::value,
+               "pixels are sent as they are in memory" );
+
+// -----------------------------------------------------------------------------
+// the largest payload accepted, guards against garbage on the connection
+// -----------------------------------------------------------------------------
+constexpr std::uint32_t kMaxPayload = 1u << 30;
+
+// -----------------------------------------------------------------------------
+// seconds the coordinator waits for a worker to go on with a message it has
+// started, or to take one it is sent. the coordinator serves every worker
+// from one thread, so a worker that stalls halfway must not hold it for the
+// whole silence timeout
+// -----------------------------------------------------------------------------
+constexpr double kStallTimeout = 10.0;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct messageheader
+{
+    std::uint32_t type;
+    std::uint32_t size;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline bool sendMessage( Socket &    socket,
+                         message     type,
+                         const void *payload,
+                         std::size_t size )
+{
+    if ( size > kMaxPayload )
+        return false;
+
+    messageheader header{static_cast<std::uint32_t>( type ),
+                         static_cast<std::uint32_t>( size )};
+    return socket.SendAll( &header, sizeof( header ) ) &&
+           ( !size || socket.SendAll( payload, size ) );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline bool receiveMessage( Socket &           socket,
+                            message &          type,
+                            std::vector<char> &payload )
+{
+    messageheader header;
+    if ( !socket.RecvAll( &header, sizeof( header ) ) ||
+         header.type > static_cast<std::uint32_t>( message::kQuit ) ||
+         header.size > kMaxPayload )
+        return false;
+
+    type = static_cast<message>( header.type );
+    payload.resize( header.size );
+    return !header.size || socket.RecvAll( payload.data(), header.size );
+}
+
+// -----------------------------------------------------------------------------
+// the kJob payload: every field of rp as a std::uint32_t, floats by their
+// bits, then the scene name. independent of how either end lays out
+// renderparams in memory
+// -----------------------------------------------------------------------------
+constexpr std::size_t kJobFields = 11;
+
+inline std::vector<char> packJob( const renderparams &rp,
+                                  const std::string & sceneName )
+{
+    std::uint32_t threshold;
+    std::memcpy( &threshold, &rp._adaptiveThreshold, sizeof( threshold ) );
+    std::uint32_t fields[kJobFields] = {
+        rp._width,
+        rp._height,
+        rp._maxDepth,
+        rp._numSamples,
+        rp._numThreads,
+        rp._samplesPerPass,
+        rp._rouletteDepth,
+        static_cast<std::uint32_t>( rp._samplerType ),
+        rp._lightSampling ? 1u : 0u,
+        threshold,
+        rp._previewLevels};
+
+    std::vector<char> job( sizeof( fields ) + sceneName.size() );
+    std::memcpy( job.data(), fields, sizeof( fields ) );
+    std::memcpy(
+        job.data() + sizeof( fields ), sceneName.data(), sceneName.size() );
+    return job;
+}
+
+// false if the payload is too short or a field is out of range
+inline bool unpackJob( const std::vector<char> &job,
+                       renderparams &           rp,
+                       std::string &            sceneName )
+{
+    std::uint32_t fields[kJobFields];
+    if ( job.size() < sizeof( fields ) )
+        return false;
+    std::memcpy( fields, job.data(), sizeof( fields ) );
+    if ( fields[7] > static_cast<std::uint32_t>( samplertype::kSobol ) ||
+         fields[8] > 1 )
+        return false;
+
+    rp._width          = fields[0];
+    rp._height         = fields[1];
+    rp._maxDepth       = fields[2];
+    rp._numSamples     = fields[3];
+    rp._numThreads     = fields[4];
+    rp._samplesPerPass = fields[5];
+    rp._rouletteDepth  = fields[6];
+    rp._samplerType    = static_cast<samplertype>( fields[7] );
+    rp._lightSampling  = fields[8] != 0;
+    std::memcpy( &rp._adaptiveThreshold, &fields[9], sizeof( float ) );
+    rp._previewLevels = fields[10];
+    sceneName.assign( job.begin() + sizeof( fields ), job.end() );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+coordinator<T>::coordinator( const renderparams &rp,
+                             const std::string & sceneName,
+                             double              timeout )
+    : _renderParams( rp ), _sceneName( sceneName ), _timeout( timeout )
+{
+}
+
+// -----------------------------------------------------------------------------
+// one poll over the listener and the workers per round: messages are handled,
+// silent workers dropped, idle ones given tiles, and new ones accepted
+// -----------------------------------------------------------------------------
+template <typename T>
+bool coordinator<T>::render( Socket &listener, film &f )
+{
+    if ( _renderParams.adaptiveThreshold() > 0.0f )
+    {
+        std::cerr << "adaptive sampling needs the whole image in one process\n";
+        return false;
+    }
+
+    unsigned int numTiles = renderer<T>::numTiles( _renderParams );
+    f.resize( _renderParams.width(), _renderParams.height() );
+    _done.assign( numTiles, 0 );
+    _copies.assign( numTiles, 0 );
+    _queue.clear();
+    for ( unsigned int tile = 0; tile < numTiles; ++tile )
+        _queue.push_back( tile );
+    _remaining = numTiles;
+
+    std::vector<connection> connections;
+    std::vector<pollfd>     fds;
+    clock::time_point       lastWorker = clock::now();
+    while ( _remaining )
+    {
+        fds.clear();
+        for ( const connection &c : connections )
+            fds.push_back( {c.socket.Fd(), POLLIN, 0} );
+        fds.push_back( {listener.Fd(), POLLIN, 0} );
+
+        if ( ::poll( fds.data(), fds.size(), 100 ) < 0 && errno != EINTR )
+        {
+            std::cerr << "poll failed: " << std::strerror( errno ) << "\n";
+            return false;
+        }
+
+        unsigned int before = _remaining;
+        for ( std::size_t ii = 0; ii < connections.size(); ++ii )
+        {
+            if ( fds[ii].revents && !handle( connections[ii], f ) )
+                drop( connections[ii] );
+        }
+
+        clock::time_point now = clock::now();
+        for ( connection &c : connections )
+        {
+            std::chrono::duration<double> silent = now - c.heard;
+            bool waiting = !c.numThreads || !c.tiles.empty();
+            if ( c.socket.Valid() && waiting && silent.count() > _timeout )
+            {
+                std::cerr << "worker timed out\n";
+                drop( c );
+            }
+        }
+
+        if ( fds.back().revents & POLLIN )
+        {
+            Socket s = listener.Accept();
+            if ( s.Valid() &&
+                 s.SetTimeout( std::min( _timeout, kStallTimeout ) ) )
+                connections.push_back( {std::move( s ), 0, {}, now} );
+        }
+
+        for ( connection &c : connections )
+        {
+            if ( c.socket.Valid() && c.numThreads && c.tiles.empty() &&
+                 !assign( c ) )
+                drop( c );
+        }
+
+        connections.erase( std::remove_if( connections.begin(),
+                                           connections.end(),
+                                           []( const connection &c ) {
+                                               return !c.socket.Valid();
+                                           } ),
+                           connections.end() );
+
+        if ( !connections.empty() )
+            lastWorker = now;
+        else if ( std::chrono::duration<double>( now - lastWorker ).count() >
+                  _timeout )
+        {
+            std::cerr << "no workers left to render " << _remaining
+                      << " tiles\n";
+            return false;
+        }
+
+        // progress in tenths of the tiles
+        unsigned int doneBefore = numTiles - before;
+        unsigned int doneNow    = numTiles - _remaining;
+        if ( 10 * doneNow / numTiles != 10 * doneBefore / numTiles )
+            std::cout << "[" << 100 * doneNow / numTiles << "% ...]\n";
+    }
+
+    for ( connection &c : connections )
+        sendMessage( c.socket, message::kQuit );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// reads one message of c. false if c broke or sent something it should not
+// -----------------------------------------------------------------------------
+template <typename T>
+bool coordinator<T>::handle( connection &c, film &f )
+{
+    message           type;
+    std::vector<char> payload;
+    if ( !receiveMessage( c.socket, type, payload ) )
+        return false;
+    c.heard = clock::now();
+
+    if ( type == message::kHello && !c.numThreads )
+    {
+        std::uint32_t hello[2];
+        if ( payload.size() != sizeof( hello ) )
+            return false;
+        std::memcpy( hello, payload.data(), sizeof( hello ) );
+        if ( hello[0] != kProtocolVersion )
+        {
+            std::cerr << "worker speaks protocol " << hello[0] << ", not "
+                      << kProtocolVersion << "\n";
+            return false;
+        }
+        c.numThreads = std::max( hello[1], 1u );
+
+        std::vector<char> job = packJob( _renderParams, _sceneName );
+        return sendMessage( c.socket, message::kJob, job.data(), job.size() );
+    }
+
+    if ( type != message::kResult || payload.size() < sizeof( std::uint32_t ) )
+        return false;
+
+    std::uint32_t tile;
+    std::memcpy( &tile, payload.data(), sizeof( tile ) );
+    auto out = std::find( c.tiles.begin(), c.tiles.end(), tile );
+    if ( out == c.tiles.end() )
+        return false;
+
+    unsigned int x0, y0, x1, y1;
+    renderer<T>::tileBounds( _renderParams, tile, x0, y0, x1, y1 );
+    std::size_t numPixels = std::size_t( x1 - x0 ) * ( y1 - y0 );
+    if ( payload.size() !=
+         sizeof( tile ) + numPixels * sizeof( film::pixelstate ) )
+        return false;
+
+    c.tiles.erase( out );
+    --_copies[tile];
+    if ( _done[tile] )
+        return true;
+
+    const char *ptr = payload.data() + sizeof( tile );
+    for ( unsigned int y = y0; y < y1; ++y )
+    {
+        for ( unsigned int x = x0; x < x1; ++x )
+        {
+            film::pixelstate ps;
+            std::memcpy( &ps, ptr, sizeof( ps ) );
+            ptr += sizeof( ps );
+            f.merge( x, y, ps );
+        }
+    }
+    _done[tile] = 1;
+    --_remaining;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// sends an idle worker a batch of queued tiles, or with the queue empty,
+// backup copies of tiles that only one other worker has
+// -----------------------------------------------------------------------------
+template <typename T>
+bool coordinator<T>::assign( connection &c )
+{
+    std::vector<std::uint32_t> batch;
+    while ( batch.size() < c.numThreads && !_queue.empty() )
+    {
+        batch.push_back( _queue.front() );
+        _queue.pop_front();
+    }
+
+    // c is idle, a single copy is out with some other worker
+    for ( unsigned int tile = 0;
+          _queue.empty() && tile < _done.size() && batch.size() < c.numThreads;
+          ++tile )
+    {
+        if ( !_done[tile] && _copies[tile] == 1 )
+            batch.push_back( tile );
+    }
+
+    if ( batch.empty() )
+        return true;
+
+    c.tiles.assign( batch.begin(), batch.end() );
+    for ( std::uint32_t tile : batch )
+        ++_copies[tile];
+    return sendMessage( c.socket,
+                        message::kTiles,
+                        batch.data(),
+                        batch.size() * sizeof( std::uint32_t ) );
+}
+
+// -----------------------------------------------------------------------------
+// gives up on c, its tiles go back to the front of the queue unless another
+// worker still has a copy
+// -----------------------------------------------------------------------------
+template <typename T>
+void coordinator<T>::drop( connection &c )
+{
+    for ( unsigned int tile : c.tiles )
+    {
+        if ( --_copies[tile] == 0 && !_done[tile] )
+            _queue.push_front( tile );
+    }
+    c.tiles.clear();
+    c.socket.Close();
+}
+
+// -----------------------------------------------------------------------------
+// tiles are rendered a batch at a time with every thread, and sent back one
+// message per tile. the film is only a scratch area, each tile is cleared
+// once it is sent in case the same tile comes again
+// -----------------------------------------------------------------------------
+template <typename T>
+bool worker<T>::run( Socket &connection )
+{
+    std::uint32_t numThreads =
+        _numThreads ? _numThreads
+                    : std::max( std::thread::hardware_concurrency(), 1u );
+    std::uint32_t hello[2] = {kProtocolVersion, numThreads};
+    if ( !sendMessage( connection, message::kHello, hello, sizeof( hello ) ) )
+        return false;
+
+    message           type;
+    std::vector<char> payload;
+    renderparams rp;
+    std::string  sceneName;
+    if ( !receiveMessage( connection, type, payload ) ||
+         type != message::kJob || !unpackJob( payload, rp, sceneName ) )
+        return false;
+    rp._numThreads = numThreads;
+
+    scene<T>    world;
+    camera<T>   cam = buildScene( world, sceneName );
+    renderer<T> device( cam, rp );
+    film        f( rp.width(), rp.height() );
+
+    unsigned int              numTiles = renderer<T>::numTiles( rp );
+    std::vector<unsigned int> tiles;
+    std::vector<char>         result;
+    while ( receiveMessage( connection, type, payload ) )
+    {
+        if ( type == message::kQuit )
+            return true;
+        if ( type != message::kTiles ||
+             payload.size() % sizeof( std::uint32_t ) )
+            return false;
+
+        tiles.resize( payload.size() / sizeof( std::uint32_t ) );
+        std::memcpy( tiles.data(), payload.data(), payload.size() );
+        if ( std::any_of( tiles.begin(), tiles.end(), [=]( unsigned int t ) {
+                 return t >= numTiles;
+             } ) )
+            return false;
+
+        device.renderTiles( world, tiles, f );
+
+        for ( std::uint32_t tile : tiles )
+        {
+            unsigned int x0, y0, x1, y1;
+            renderer<T>::tileBounds( rp, tile, x0, y0, x1, y1 );
+            std::size_t numPixels = std::size_t( x1 - x0 ) * ( y1 - y0 );
+            result.resize( sizeof( tile ) +
+                           numPixels * sizeof( film::pixelstate ) );
+
+            char *ptr = result.data();
+            std::memcpy( ptr, &tile, sizeof( tile ) );
+            ptr += sizeof( tile );
+            for ( unsigned int y = y0; y < y1; ++y )
+            {
+                for ( unsigned int x = x0; x < x1; ++x )
+                {
+                    film::pixelstate ps = f.state( x, y );
+                    std::memcpy( ptr, &ps, sizeof( ps ) );
+                    ptr += sizeof( ps );
+                }
+            }
+            f.clear( x0, y0, x1, y1 );
+
+            if ( !sendMessage( connection,
+                               message::kResult,
+                               result.data(),
+                               result.size() ) )
+                return false;
+        }
+    }
+    return false;
+}
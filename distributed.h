@@ -0,0 +1,119 @@
+#pragma once
+
+#include "film.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "util/socket.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// messages between the coordinator and its workers. each is a header followed
+// by size bytes of payload, in the byte order of the machines, which must
+// agree
+//
+// kHello   worker -> coordinator  protocol version and render threads
+// kJob     coordinator -> worker  renderparams field by field, scene name
+// kTiles   coordinator -> worker  tile indices to render
+// kResult  worker -> coordinator  tile index and its film::pixelstate rows
+// kQuit    coordinator -> worker  no more tiles
+// -----------------------------------------------------------------------------
+enum class message : std::uint32_t
+{
+    kHello,
+    kJob,
+    kTiles,
+    kResult,
+    kQuit
+};
+
+// bumped whenever a payload changes
+constexpr std::uint32_t kProtocolVersion = 2;
+
+inline bool sendMessage( Socket &    socket,
+                         message     type,
+                         const void *payload = nullptr,
+                         std::size_t size    = 0 );
+
+// false if the connection broke or the message is malformed
+inline bool receiveMessage( Socket &           socket,
+                            message &          type,
+                            std::vector<char> &payload );
+
+// -----------------------------------------------------------------------------
+// renders an image on worker processes. the image is cut into the tiles of
+// the renderer, handed out to the workers in batches of as many tiles as
+// they have threads, and the pixels they send back are merged into the film.
+// a tile always renders to the same pixels wherever it runs, so the merged
+// image is bit for bit the one a single process renders
+//
+// workers may connect at any time while rendering. a worker that drops its
+// connection, stays silent for longer than the timeout or stalls halfway
+// through a message is given up, and its tiles go back to the queue. once
+// the queue is empty, idle workers get a second copy of tiles still out
+// elsewhere, so a slow worker does not hold up the image. whichever copy
+// comes back first is used
+// -----------------------------------------------------------------------------
+template <typename T>
+class coordinator
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    // sceneName is resolved by every worker on its own, see buildScene()
+    coordinator( const renderparams &rp,
+                 const std::string & sceneName,
+                 double              timeout = 300.0 );
+
+    // accepts workers on listener until every tile is in f. false if
+    // adaptive sampling was asked for, which needs the whole image in one
+    // process, or if no worker was around for longer than the timeout
+    bool render( Socket &listener, film &f );
+
+private:
+    struct connection
+    {
+        Socket                    socket;
+        unsigned int              numThreads = 0; // 0 until it said hello
+        std::vector<unsigned int> tiles;          // sent and not returned
+        clock::time_point         heard;          // last message received
+    };
+
+    bool handle( connection &c, film &f );
+    bool assign( connection &c );
+    void drop( connection &c );
+
+    renderparams _renderParams;
+    std::string  _sceneName;
+    double       _timeout;
+
+    std::vector<unsigned char> _done;   // 1 for every tile merged
+    std::vector<unsigned int>  _copies; // workers a tile is out with
+    std::deque<unsigned int>   _queue;  // tiles with no copy out
+    unsigned int               _remaining = 0;
+};
+
+// -----------------------------------------------------------------------------
+// serves a coordinator: says hello, builds the scene of the job and renders
+// the tiles it is sent until it is told to quit
+// -----------------------------------------------------------------------------
+template <typename T>
+class worker
+{
+public:
+    // 0 threads uses every hardware thread
+    explicit worker( unsigned int numThreads = 0 ) : _numThreads( numThreads )
+    {
+    }
+
+    // false if the connection broke before the coordinator said quit
+    bool run( Socket &connection );
+
+private:
+    unsigned int _numThreads;
+};
+
+#include "distributed.cc"
@@ -0,0 +1,275 @@
+#pragma once
+
+#include "material.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// floating point accumulation buffer. every pixel keeps the running sum of
+// its sample radiance and the number of samples taken, so passes can be added
+// progressively and resolved at any point. the sum of squared sample
+// luminances gives the variance of each pixel for adaptive sampling
+//
+// alongside the radiance the film averages features of the first hit of the
+// camera rays: albedo, normal and distance, 0 where a ray escapes. they are
+// noise free after a few samples and guide the denoiser
+// -----------------------------------------------------------------------------
+class film
+{
+public:
+    // raw accumulations of one pixel, the unit in which partial films are
+    // copied between processes
+    struct pixelstate
+    {
+        color        sum;
+        float        sumSquared;
+        unsigned int count;
+        color        albedo;
+        vec3<float>  normal;
+        float        depth;
+        unsigned int featureCount;
+    };
+
+    film() = default;
+    film( unsigned int width, unsigned int height ) { resize( width, height ); }
+
+    void resize( unsigned int width, unsigned int height )
+    {
+        _width  = width;
+        _height = height;
+        _sum.assign( width * height, {0.0f, 0.0f, 0.0f, 0.0f} );
+        _sumSquared.assign( width * height, 0.0f );
+        _count.assign( width * height, 0u );
+        _albedo.assign( width * height, {0.0f, 0.0f, 0.0f, 0.0f} );
+        _normal.assign( width * height, {0.0f, 0.0f, 0.0f} );
+        _depth.assign( width * height, 0.0f );
+        _featureCount.assign( width * height, 0u );
+    }
+
+    void clear() { resize( _width, _height ); }
+
+    // empties the pixels in [x0, x1) x [y0, y1)
+    void clear( unsigned int x0,
+                unsigned int y0,
+                unsigned int x1,
+                unsigned int y1 ) noexcept
+    {
+        for ( unsigned int y = y0; y < y1; ++y )
+        {
+            for ( unsigned int x = x0; x < x1; ++x )
+            {
+                unsigned int index   = y * _width + x;
+                _sum[index]          = {0.0f, 0.0f, 0.0f, 0.0f};
+                _sumSquared[index]   = 0.0f;
+                _count[index]        = 0u;
+                _albedo[index]       = {0.0f, 0.0f, 0.0f, 0.0f};
+                _normal[index]       = {0.0f, 0.0f, 0.0f};
+                _depth[index]        = 0.0f;
+                _featureCount[index] = 0u;
+            }
+        }
+    }
+
+    unsigned int width() const noexcept { return _width; }
+    unsigned int height() const noexcept { return _height; }
+
+    // not synchronized, concurrent writers must touch disjoint pixels.
+    // sumSquared is the sum of the squared luminances of the samples
+    void add( unsigned int x,
+              unsigned int y,
+              const color &sum,
+              unsigned int numSamples,
+              float        sumSquared = 0.0f ) noexcept
+    {
+        unsigned int index = y * _width + x;
+        _sum[index]        = _sum[index] + sum;
+        _sumSquared[index] += sumSquared;
+        _count[index] += numSamples;
+    }
+
+    // sums of the features of numRays camera rays
+    void addFeatures( unsigned int       x,
+                      unsigned int       y,
+                      const color &      albedo,
+                      const vec3<float> &normal,
+                      float              depth,
+                      unsigned int       numRays ) noexcept
+    {
+        unsigned int index = y * _width + x;
+        _albedo[index]     = _albedo[index] + albedo;
+        _normal[index] += normal;
+        _depth[index] += depth;
+        _featureCount[index] += numRays;
+    }
+
+    color albedo( unsigned int x, unsigned int y ) const noexcept
+    {
+        unsigned int index = y * _width + x;
+        if ( _featureCount[index] == 0 )
+            return {0.0f, 0.0f, 0.0f, 0.0f};
+        return _albedo[index] / static_cast<float>( _featureCount[index] );
+    }
+
+    // average of the unit normals, shorter than 1 where they differ
+    vec3<float> normal( unsigned int x, unsigned int y ) const noexcept
+    {
+        unsigned int index = y * _width + x;
+        if ( _featureCount[index] == 0 )
+            return {0.0f, 0.0f, 0.0f};
+        return _normal[index] / static_cast<float>( _featureCount[index] );
+    }
+
+    float depth( unsigned int x, unsigned int y ) const noexcept
+    {
+        unsigned int index = y * _width + x;
+        if ( _featureCount[index] == 0 )
+            return 0.0f;
+        return _depth[index] / _featureCount[index];
+    }
+
+    // variance of the mean luminance of the pixel, infinite below 2 samples
+    float variance( unsigned int x, unsigned int y ) const noexcept
+    {
+        unsigned int index = y * _width + x;
+        unsigned int n     = _count[index];
+        if ( n < 2 )
+            return std::numeric_limits<float>::infinity();
+
+        float mean     = _sum[index].luminance() / n;
+        float variance = ( _sumSquared[index] - n * mean * mean ) / ( n - 1 );
+        return std::max( variance, 0.0f ) / n;
+    }
+
+    pixelstate state( unsigned int x, unsigned int y ) const noexcept
+    {
+        unsigned int index = y * _width + x;
+        return {_sum[index],
+                _sumSquared[index],
+                _count[index],
+                _albedo[index],
+                _normal[index],
+                _depth[index],
+                _featureCount[index]};
+    }
+
+    // adds the accumulations of a pixel of another film, added to an empty
+    // pixel they are kept bit for bit
+    void merge( unsigned int x, unsigned int y, const pixelstate &ps ) noexcept
+    {
+        add( x, y, ps.sum, ps.count, ps.sumSquared );
+        addFeatures( x, y, ps.albedo, ps.normal, ps.depth, ps.featureCount );
+    }
+
+    unsigned int samples( unsigned int x, unsigned int y ) const noexcept
+    {
+        return _count[y * _width + x];
+    }
+
+    unsigned long long totalSamples() const noexcept
+    {
+        unsigned long long total = 0;
+        for ( unsigned int count : _count )
+            total += count;
+        return total;
+    }
+
+    // half width of the 95% confidence interval of the mean luminance,
+    // relative to the mean, and measured against 1 / 256 for darker pixels.
+    // a pixel none of whose samples found light has no usable estimate yet:
+    // with a small light most paths return 0, so its variance is 0 too
+    float relativeError( unsigned int x, unsigned int y ) const noexcept
+    {
+        unsigned int index = y * _width + x;
+        unsigned int n     = _count[index];
+        float        mean  = n ? _sum[index].luminance() / n : 0.0f;
+        if ( n < 2 || mean <= 0.0f )
+            return std::numeric_limits<float>::infinity();
+
+        float stderror = std::sqrt( variance( x, y ) );
+        return 1.96f * stderror / std::max( mean, 1.0f / 256.0f );
+    }
+
+    // mean radiance of the pixel, black until the first sample arrives
+    color pixel( unsigned int x, unsigned int y ) const noexcept
+    {
+        unsigned int index = y * _width + x;
+        if ( _count[index] == 0 )
+            return {0.0f, 0.0f, 0.0f, 0.0f};
+        return _sum[index] / static_cast<float>( _count[index] );
+    }
+
+    // gamma encoded 8 bit rgba, the layout the viewer uploads as a texture
+    void resolve( std::vector<unsigned char> &rgba ) const
+    {
+        rgba.resize( 4 * _width * _height );
+        unsigned char *ptr = rgba.data();
+        for ( unsigned int y = 0; y < _height; ++y )
+        {
+            for ( unsigned int x = 0; x < _width; ++x )
+            {
+                vec3<unsigned char> c = pixel( x, y ).touchar();
+                *ptr++                = c[0];
+                *ptr++                = c[1];
+                *ptr++                = c[2];
+                *ptr++                = 255;
+            }
+        }
+    }
+
+    // binary ppm of the resolved image, false if the file cannot be written
+    bool writeppm( const std::string &path ) const
+    {
+        FILE *image = fopen( path.c_str(), "wb" );
+        if ( !image )
+            return false;
+
+        std::vector<unsigned char> rgba;
+        resolve( rgba );
+        fprintf( image, "P6\n%u %u\n255\n", _width, _height );
+        for ( std::size_t ii = 0; ii < std::size_t( _width ) * _height; ++ii )
+            fwrite( &rgba[4 * ii], 1, 3, image );
+        return fclose( image ) == 0;
+    }
+
+    // sample counts as a heat map from black through red and yellow to white
+    // at the largest count, so adaptive sampling can be checked at a glance
+    bool writeheatmap( const std::string &path ) const
+    {
+        FILE *image = fopen( path.c_str(), "wb" );
+        if ( !image )
+            return false;
+
+        unsigned int maxCount = 1;
+        for ( unsigned int count : _count )
+            maxCount = std::max( maxCount, count );
+
+        fprintf( image, "P6\n%u %u\n255\n", _width, _height );
+        for ( unsigned int count : _count )
+        {
+            float         t = 3.0f * count / maxCount;
+            unsigned char rgb[3];
+            for ( unsigned int c = 0; c < 3; ++c )
+            {
+                float level = std::clamp( t - c, 0.0f, 1.0f );
+                rgb[c]      = static_cast<unsigned char>( 255 * level + 0.5f );
+            }
+            fwrite( rgb, 1, 3, image );
+        }
+        return fclose( image ) == 0;
+    }
+
+private:
+    unsigned int              _width  = 0;
+    unsigned int              _height = 0;
+    std::vector<color>        _sum;
+    std::vector<float>        _sumSquared;
+    std::vector<unsigned int> _count;
+    std::vector<color>        _albedo;
+    std::vector<vec3<float>>  _normal;
+    std::vector<float>        _depth;
+    std::vector<unsigned int> _featureCount;
+};
@@ -4,16 +4,39 @@
 #include "material.h"
 #include "vec3.h"
 
+template <typename T>
+class primitive;
+
 // -----------------------------------------------------------------------------
+// compact record that intersection loops carry and compare: the distance, the
+// primitive and its element (the triangle of a mesh) and the barycentric
+// coordinates of the hit point within the element. the shading data is
+// resolved into a surface once the closest hit is known
 // -----------------------------------------------------------------------------
 template <typename T>
 class hit
 {
 public:
     hit() = default;
-    vec3<T>  _pos;
-    vec3<T>  _normal;
-    material _mat;
+    T                   _t = T( 0 ); // distance along the ray
+    const primitive<T> *_object  = nullptr;
+    unsigned int        _element = 0;
+    float               _u       = 0.0f; // weights of the second and third
+    float               _v       = 0.0f; // vertex, 0 off triangles
+};
+
+// -----------------------------------------------------------------------------
+// shading data of a hit. the normal faces the side the ray came from and the
+// material is owned by the primitive that was hit
+// -----------------------------------------------------------------------------
+template <typename T>
+class surface
+{
+public:
+    surface() = default;
+    vec3<T>         _pos;
+    vec3<T>         _normal;
+    const material *_mat = nullptr;
 };
 
 #endif // _hit_h_
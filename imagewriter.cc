@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline bool imageFormat( const std::string &path, imageformat &format )
+{
+    std::size_t dot = path.rfind( '.' );
+    if ( dot == std::string::npos )
+        return false;
+
+    std::string extension = path.substr( dot + 1 );
+    for ( char &c : extension )
+        c = static_cast<char>( std::tolower( static_cast<unsigned char>( c ) ) );
+
+    if ( extension == "ppm" )
+        format = imageformat::kPPM;
+    else if ( extension == "pfm" )
+        format = imageformat::kPFM;
+    else if ( extension == "png" )
+        format = imageformat::kPNG;
+    else
+        return false;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline bool writeFile( const std::string &path, const std::vector<char> &data )
+{
+    FILE *file = fopen( path.c_str(), "wb" );
+    if ( !file )
+        return false;
+    bool ok = fwrite( data.data(), 1, data.size(), file ) == data.size();
+    return fclose( file ) == 0 && ok;
+}
+
+// -----------------------------------------------------------------------------
+// 8 bit rgb rows of a linear image
+// -----------------------------------------------------------------------------
+inline std::vector<unsigned char> encodeRGB8( unsigned int width,
+                                              unsigned int height,
+                                              const float *rgb )
+{
+    std::vector<unsigned char> bytes( std::size_t( 3 ) * width * height );
+    for ( std::size_t ii = 0; ii < bytes.size(); ++ii )
+        bytes[ii] = gammaEncode( std::clamp( rgb[ii], 0.0f, 1.0f ) );
+    return bytes;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline std::vector<char> encodePPM( unsigned int width,
+                                    unsigned int height,
+                                    const float *rgb )
+{
+    char header[64];
+    int  size = snprintf( header, sizeof( header ), "P6\n%u %u\n255\n",
+                          width, height );
+
+    std::vector<unsigned char> bytes = encodeRGB8( width, height, rgb );
+    std::vector<char>          data( header, header + size );
+    data.insert( data.end(), bytes.begin(), bytes.end() );
+    return data;
+}
+
+// -----------------------------------------------------------------------------
+// rows run from the bottom up, a negative scale marks little endian floats
+// -----------------------------------------------------------------------------
+inline std::vector<char> encodePFM( unsigned int width,
+                                    unsigned int height,
+                                    const float *rgb )
+{
+    const std::uint16_t one          = 1;
+    bool                littleEndian = *reinterpret_cast<const char *>( &one );
+
+    char header[64];
+    int  size = snprintf( header, sizeof( header ), "PF\n%u %u\n%s\n", width,
+                          height, littleEndian ? "-1.0" : "1.0" );
+
+    std::size_t       row = std::size_t( 3 ) * width * sizeof( float );
+    std::vector<char> data( header, header + size );
+    data.resize( size + row * height );
+    for ( unsigned int y = 0; y < height; ++y )
+    {
+        std::memcpy( data.data() + size + row * ( height - 1 - y ),
+                     rgb + std::size_t( 3 ) * width * y,
+                     row );
+    }
+    return data;
+}
+
+// -----------------------------------------------------------------------------
+// bits are packed from the least significant end, as deflate wants them
+// -----------------------------------------------------------------------------
+class BitWriter
+{
+public:
+    explicit BitWriter( std::vector<char> &out ) : p_out( out ) {}
+
+    void Put( unsigned int bits, unsigned int count )
+    {
+        p_buffer |= std::uint64_t( bits ) << p_count;
+        p_count += count;
+        while ( p_count >= 8 )
+        {
+            p_out.push_back( static_cast<char>( p_buffer & 0xff ) );
+            p_buffer >>= 8;
+            p_count -= 8;
+        }
+    }
+
+    // huffman codes go most significant bit first
+    void PutCode( unsigned int code, unsigned int length )
+    {
+        unsigned int reversed = 0;
+        for ( unsigned int ii = 0; ii < length; ++ii )
+            reversed |= ( ( code >> ii ) & 1u ) << ( length - 1 - ii );
+        Put( reversed, length );
+    }
+
+    void Flush()
+    {
+        if ( p_count )
+            Put( 0, 8 - p_count );
+    }
+
+private:
+    std::vector<char> &p_out;
+    std::uint64_t      p_buffer = 0;
+    unsigned int       p_count  = 0;
+};
+
+// -----------------------------------------------------------------------------
+// literal or length symbol with the fixed huffman code of deflate
+// -----------------------------------------------------------------------------
+inline void putFixedSymbol( BitWriter &bits, unsigned int symbol )
+{
+    if ( symbol < 144 )
+        bits.PutCode( 0x30 + symbol, 8 );
+    else if ( symbol < 256 )
+        bits.PutCode( 0x190 + symbol - 144, 9 );
+    else if ( symbol < 280 )
+        bits.PutCode( symbol - 256, 7 );
+    else
+        bits.PutCode( 0xc0 + symbol - 280, 8 );
+}
+
+// -----------------------------------------------------------------------------
+// zlib stream of data as a single deflate block with the fixed codes. matches
+// are found greedily through hash chains of 3 byte prefixes over a 32k window
+// -----------------------------------------------------------------------------
+inline std::vector<char> deflate( const std::vector<unsigned char> &data )
+{
+    static const unsigned short lengthBase[29] = {
+        3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const unsigned char lengthExtra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+        2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const unsigned short distanceBase[30] = {
+        1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+        33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+    static const unsigned char distanceExtra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    constexpr unsigned int kWindow    = 32768;
+    constexpr unsigned int kHashBits  = 15;
+    constexpr unsigned int kMaxChain  = 64;
+    constexpr unsigned int kMinMatch  = 3;
+    constexpr unsigned int kMaxMatch  = 258;
+    constexpr int          kNoEntry   = -1;
+
+    std::vector<char> out = {0x78, 0x01};
+    BitWriter         bits( out );
+    bits.Put( 1, 1 ); // final block
+    bits.Put( 1, 2 ); // fixed codes
+
+    auto hash = [&]( std::size_t pos ) {
+        std::uint32_t v = data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16;
+        return ( v * 2654435761u ) >> ( 32 - kHashBits );
+    };
+
+    std::vector<int> head( 1u << kHashBits, kNoEntry );
+    std::vector<int> prev( kWindow, kNoEntry );
+    auto insert = [&]( std::size_t pos ) {
+        if ( pos + kMinMatch > data.size() )
+            return;
+        std::uint32_t h       = hash( pos );
+        prev[pos % kWindow] = head[h];
+        head[h]               = static_cast<int>( pos );
+    };
+
+    std::size_t pos = 0;
+    while ( pos < data.size() )
+    {
+        unsigned int bestLength = 0, bestDistance = 0;
+        if ( pos + kMinMatch <= data.size() )
+        {
+            std::size_t  limit = std::min<std::size_t>( kMaxMatch,
+                                                        data.size() - pos );
+            int          candidate = head[hash( pos )];
+            for ( unsigned int chain = 0;
+                  candidate != kNoEntry && chain < kMaxChain &&
+                  pos - candidate <= kWindow - 1;
+                  ++chain, candidate = prev[candidate % kWindow] )
+            {
+                unsigned int length = 0;
+                while ( length < limit &&
+                        data[candidate + length] == data[pos + length] )
+                    ++length;
+                if ( length > bestLength )
+                {
+                    bestLength   = length;
+                    bestDistance = static_cast<unsigned int>( pos - candidate );
+                    if ( length == limit )
+                        break;
+                }
+            }
+        }
+
+        if ( bestLength < kMinMatch )
+        {
+            putFixedSymbol( bits, data[pos] );
+            insert( pos++ );
+            continue;
+        }
+
+        unsigned int code = 0;
+        while ( code + 1 < 29 && lengthBase[code + 1] <= bestLength )
+            ++code;
+        putFixedSymbol( bits, 257 + code );
+        bits.Put( bestLength - lengthBase[code], lengthExtra[code] );
+
+        code = 0;
+        while ( code + 1 < 30 && distanceBase[code + 1] <= bestDistance )
+            ++code;
+        bits.PutCode( code, 5 );
+        bits.Put( bestDistance - distanceBase[code], distanceExtra[code] );
+
+        for ( unsigned int ii = 0; ii < bestLength; ++ii )
+            insert( pos++ );
+    }
+    putFixedSymbol( bits, 256 );
+    bits.Flush();
+
+    // adler-32 of the uncompressed data, big endian
+    std::uint32_t a = 1, b = 0;
+    for ( unsigned char c : data )
+    {
+        a = ( a + c ) % 65521;
+        b = ( b + a ) % 65521;
+    }
+    std::uint32_t adler = b << 16 | a;
+    for ( int shift = 24; shift >= 0; shift -= 8 )
+        out.push_back( static_cast<char>( adler >> shift ) );
+    return out;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline std::uint32_t crc32( const char *data, std::size_t size,
+                            std::uint32_t crc = 0 )
+{
+    static const std::vector<std::uint32_t> table = [] {
+        std::vector<std::uint32_t> t( 256 );
+        for ( std::uint32_t n = 0; n < 256; ++n )
+        {
+            std::uint32_t c = n;
+            for ( int k = 0; k < 8; ++k )
+                c = c & 1 ? 0xedb88320u ^ ( c >> 1 ) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for ( std::size_t ii = 0; ii < size; ++ii )
+        crc = table[( crc ^ static_cast<unsigned char>( data[ii] ) ) & 0xff] ^
+              ( crc >> 8 );
+    return ~crc;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline void appendBigEndian( std::vector<char> &out, std::uint32_t value )
+{
+    for ( int shift = 24; shift >= 0; shift -= 8 )
+        out.push_back( static_cast<char>( value >> shift ) );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline void appendChunk( std::vector<char> &      out,
+                         const char *             type,
+                         const std::vector<char> &payload )
+{
+    appendBigEndian( out, static_cast<std::uint32_t>( payload.size() ) );
+    std::size_t start = out.size();
+    out.insert( out.end(), type, type + 4 );
+    out.insert( out.end(), payload.begin(), payload.end() );
+    appendBigEndian( out, crc32( out.data() + start, out.size() - start ) );
+}
+
+// -----------------------------------------------------------------------------
+// every row is filtered with whichever of the five png filters leaves the
+// smallest sum of absolute differences, which is what compresses best on
+// smooth renders
+// -----------------------------------------------------------------------------
+inline std::vector<char> encodePNG( unsigned int width,
+                                    unsigned int height,
+                                    const float *rgb )
+{
+    std::vector<unsigned char> bytes = encodeRGB8( width, height, rgb );
+    std::size_t                row   = std::size_t( 3 ) * width;
+
+    std::vector<unsigned char> filtered;
+    filtered.reserve( ( row + 1 ) * height );
+    std::vector<unsigned char> zero( row, 0 ), candidate( row ), best( row );
+    for ( unsigned int y = 0; y < height; ++y )
+    {
+        const unsigned char *cur  = &bytes[row * y];
+        const unsigned char *up   = y ? &bytes[row * ( y - 1 )] : zero.data();
+        unsigned int         bestFilter = 0;
+        std::uint64_t        bestCost   = ~std::uint64_t( 0 );
+        for ( unsigned int filter = 0; filter < 5; ++filter )
+        {
+            std::uint64_t cost = 0;
+            for ( std::size_t ii = 0; ii < row; ++ii )
+            {
+                int a = ii >= 3 ? cur[ii - 3] : 0;
+                int b = up[ii];
+                int c = ii >= 3 ? up[ii - 3] : 0;
+                int predictor = 0;
+                if ( filter == 1 )
+                    predictor = a;
+                else if ( filter == 2 )
+                    predictor = b;
+                else if ( filter == 3 )
+                    predictor = ( a + b ) / 2;
+                else if ( filter == 4 )
+                {
+                    int p  = a + b - c;
+                    int pa = std::abs( p - a ), pb = std::abs( p - b ),
+                        pc = std::abs( p - c );
+                    predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                }
+                candidate[ii] =
+                    static_cast<unsigned char>( cur[ii] - predictor );
+                cost += std::abs( static_cast<signed char>( candidate[ii] ) );
+            }
+            if ( cost < bestCost )
+            {
+                bestCost   = cost;
+                bestFilter = filter;
+                best.swap( candidate );
+            }
+        }
+        filtered.push_back( static_cast<unsigned char>( bestFilter ) );
+        filtered.insert( filtered.end(), best.begin(), best.end() );
+    }
+
+    std::vector<char> header;
+    appendBigEndian( header, width );
+    appendBigEndian( header, height );
+    header.insert( header.end(), {8, 2, 0, 0, 0} ); // 8 bit rgb
+
+    std::vector<char> data = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n'};
+    appendChunk( data, "IHDR", header );
+    appendChunk( data, "IDAT", deflate( filtered ) );
+    appendChunk( data, "IEND", {} );
+    return data;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline bool writeImage( const std::string &path,
+                        imageformat        format,
+                        unsigned int       width,
+                        unsigned int       height,
+                        const float *      rgb )
+{
+    switch ( format )
+    {
+    case imageformat::kPPM:
+        return writeFile( path, encodePPM( width, height, rgb ) );
+    case imageformat::kPFM:
+        return writeFile( path, encodePFM( width, height, rgb ) );
+    case imageformat::kPNG:
+        return writeFile( path, encodePNG( width, height, rgb ) );
+    }
+    return false;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline imagewriter::imagewriter( unsigned int             width,
+                                 unsigned int             height,
+                                 std::vector<std::string> paths )
+    : _width( width ),
+      _height( height ),
+      _paths( std::move( paths ) ),
+      _image( std::size_t( 3 ) * width * height, 0.0f ),
+      _thread( [this]() { run(); } )
+{
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline void imagewriter::submit( const film & f,
+                                 unsigned int x0,
+                                 unsigned int y0,
+                                 unsigned int x1,
+                                 unsigned int y1 )
+{
+    tile t{x0, y0, x1, y1, {}};
+    t.rgb.reserve( std::size_t( 3 ) * ( x1 - x0 ) * ( y1 - y0 ) );
+    for ( unsigned int y = y0; y < y1; ++y )
+    {
+        for ( unsigned int x = x0; x < x1; ++x )
+        {
+            color c = f.pixel( x, y );
+            t.rgb.insert( t.rgb.end(), {c.r, c.g, c.b} );
+        }
+    }
+    _queue.push( std::move( t ) );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline bool imagewriter::finish()
+{
+    if ( _thread.joinable() )
+    {
+        _queue.close();
+        _thread.join();
+    }
+    return _failed.empty();
+}
+
+// -----------------------------------------------------------------------------
+// the files are written as soon as the last pixel arrives, usually while the
+// caller is still busy after rendering
+// -----------------------------------------------------------------------------
+inline void imagewriter::run()
+{
+    Tracer::SetThreadName( "image writer" );
+    std::uint64_t numPixels = std::uint64_t( _width ) * _height;
+    tile          t;
+    while ( _queue.pop( t ) )
+    {
+        const float *src = t.rgb.data();
+        for ( unsigned int y = t.y0; y < t.y1; ++y )
+        {
+            std::size_t count = std::size_t( 3 ) * ( t.x1 - t.x0 );
+            std::memcpy( &_image[3 * ( std::size_t( y ) * _width + t.x0 )],
+                         src,
+                         count * sizeof( float ) );
+            src += count;
+        }
+
+        bool complete = _received >= numPixels;
+        _received += std::uint64_t( t.x1 - t.x0 ) * ( t.y1 - t.y0 );
+        _dirty = true;
+        if ( !complete && _received >= numPixels )
+            write();
+    }
+
+    if ( _dirty )
+        write();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline void imagewriter::write()
+{
+    PT_TRACE_SCOPE( "write image", "output" );
+    _failed.clear();
+    for ( const std::string &path : _paths )
+    {
+        imageformat format;
+        if ( !imageFormat( path, format ) ||
+             !writeImage( path, format, _width, _height, _image.data() ) )
+            _failed.push_back( path );
+    }
+    _dirty = false;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "film.h"
+#include "util/concurrent.h"
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// image file formats, told apart by the extension of the path
+//
+// kPPM  .ppm  binary p6, 8 bit gamma encoded
+// kPFM  .pfm  portable float map, linear 32 bit float for compositing
+// kPNG  .png  8 bit gamma encoded rgb, deflate compressed
+// -----------------------------------------------------------------------------
+enum class imageformat
+{
+    kPPM,
+    kPFM,
+    kPNG
+};
+
+// false if the extension of path is not one of the formats
+inline bool imageFormat( const std::string &path, imageformat &format );
+
+// writes a linear rgb image of 3 floats per pixel, rows from the top.
+// false if the file cannot be written
+inline bool writeImage( const std::string &path,
+                        imageformat        format,
+                        unsigned int       width,
+                        unsigned int       height,
+                        const float *      rgb );
+
+// -----------------------------------------------------------------------------
+// writes the finished image off the render threads. tiles are copied out of
+// the film into a queue by whoever submits them and assembled by a thread of
+// the writer, which encodes and writes every path once all pixels arrived.
+// submitting more pixels afterwards writes the files again on finish()
+// -----------------------------------------------------------------------------
+class imagewriter
+{
+public:
+    // paths must have supported extensions, see imageFormat()
+    imagewriter( unsigned int width,
+                 unsigned int height,
+                 std::vector<std::string> paths );
+    ~imagewriter() { finish(); }
+
+    imagewriter( const imagewriter & ) = delete;
+    imagewriter &operator=( const imagewriter & ) = delete;
+
+    // copies the mean radiance of the pixels in [x0, x1) x [y0, y1) of f.
+    // may be called from any thread while nothing writes those pixels
+    void submit( const film & f,
+                 unsigned int x0,
+                 unsigned int y0,
+                 unsigned int x1,
+                 unsigned int y1 );
+
+    void submit( const film &f ) { submit( f, 0, 0, _width, _height ); }
+
+    // waits until every file is written, false if any of them failed
+    bool finish();
+
+    // paths that could not be written, complete after finish()
+    const std::vector<std::string> &failed() const noexcept { return _failed; }
+
+private:
+    struct tile
+    {
+        unsigned int       x0, y0, x1, y1;
+        std::vector<float> rgb;
+    };
+
+    void run();
+    void write();
+
+    unsigned int             _width;
+    unsigned int             _height;
+    std::vector<std::string> _paths;
+    std::vector<std::string> _failed;
+
+    // touched by the writer thread only until finish() joins it
+    std::vector<float> _image;
+    std::uint64_t      _received = 0;     // pixels, counted with repeats
+    bool               _dirty    = false; // pixels not in the files yet
+
+    WorkQueue<tile> _queue;
+    std::thread     _thread;
+};
+
+#include "imagewriter.cc"
@@ -3,6 +3,39 @@
 
 #include "vec3.h"
 #include <algorithm>
+#include <array>
+#include <cmath>
+
+// -----------------------------------------------------------------------------
+// 8 bit code of a linear value in [0, 1] with gamma 2.2, by table instead of
+// pow(). entry k holds the smallest value that rounds to code k + 1, so the
+// code is the number of entries not above the value
+// -----------------------------------------------------------------------------
+inline unsigned char gammaEncode( float linear ) noexcept
+{
+    static const std::array<float, 255> thresholds = [] {
+        auto code = []( float x ) {
+            return 255 * std::pow( x, 1 / 2.2f ) + 0.5f;
+        };
+
+        std::array<float, 255> t;
+        for ( unsigned int k = 0; k < 255; ++k )
+        {
+            // pow() is not exact, step to the float where the code changes
+            float x = std::pow( ( k + 0.5f ) / 255, 2.2f );
+            while ( x > 0.0f && code( std::nextafter( x, 0.0f ) ) >= k + 1 )
+                x = std::nextafter( x, 0.0f );
+            while ( code( x ) < k + 1 )
+                x = std::nextafter( x, 1.0f );
+            t[k] = x;
+        }
+        return t;
+    }();
+
+    return static_cast<unsigned char>(
+        std::upper_bound( thresholds.begin(), thresholds.end(), linear ) -
+        thresholds.begin() );
+}
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -33,6 +66,12 @@ struct color
         return {r * other.r, g * other.g, b * other.b, a * other.a};
     }
 
+    // rec. 709 luma of the linear values
+    float luminance() const noexcept
+    {
+        return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    }
+
     void clamp()
     {
         r = std::clamp( r, 0.0f, 1.0f );
@@ -44,10 +83,7 @@ struct color
     vec3<unsigned char> touchar() noexcept
     {
         clamp();
-        return {
-            static_cast<unsigned char>( 255 * std::pow( r, 1 / 2.2f ) + 0.5f ),
-            static_cast<unsigned char>( 255 * std::pow( g, 1 / 2.2f ) + 0.5f ),
-            static_cast<unsigned char>( 255 * std::pow( b, 1 / 2.2f ) + 0.5f )};
+        return {gammaEncode( r ), gammaEncode( g ), gammaEncode( b )};
     }
 
     static color random()
@@ -1,201 +1,615 @@
-#include <fstream>
+#include "sampler.h"
+#include "util/hash.h"
+#include "util/mappedfile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <string>
 
+// -----------------------------------------------------------------------------
+// random color of a face, hashed from its index instead of drawn from rand()
+// so a mesh gets the same colors whether it is parsed or mapped from a cache
+// written by another run
+// -----------------------------------------------------------------------------
+inline color faceColor( unsigned int face ) noexcept
+{
+    sampler s( samplertype::kRandom, face, 0 );
+    float   r = s.next1D();
+    float   g = s.next1D();
+    float   b = s.next1D();
+    return {r, g, b, 1.0f};
+}
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 template <typename T>
-mesh<T>::mesh( const std::string &filename ) noexcept
+mesh<T>::mesh( const std::string &filename, bool useCache ) noexcept
 {
-    std::ifstream file( filename );
+    PT_TRACE_SCOPE( "load mesh", "scene" );
+    auto start = std::chrono::steady_clock::now();
 
-    std::string line;
-    char        ch;
-    float       x, y, z;
-    int         nodes[4];
-    while ( getline( file, line ) )
+    std::uint64_t sourceSize = 0;
+    std::uint64_t sourceHash = 0;
+    std::string   cachePath  = meshCachePath<T>( filename );
+    if ( useCache )
     {
-        if ( line[0] == 'v' )
+        MappedFile source( filename, Access::kSequential );
+        if ( !source.isOpen() )
         {
-            if ( line[1] != 'n' )
-            {
-                if ( 4 ==
-                     sscanf( line.c_str(), "%s %f %f %f", &ch, &x, &y, &z ) )
-                {
-                    _vertices.emplace_back( x, y, z );
-                    _box.expand( _vertices.back() );
-                }
-            }
+            std::cout << "could not open " << filename << "\n";
+            return;
         }
-        else if ( line[0] == 'f' )
+        sourceSize = source.size();
+        sourceHash = Hash64( source.data(), source.size() );
+
+        if ( readCache( cachePath, sourceSize, sourceHash ) )
         {
-            if ( 5 == sscanf( line.c_str(),
-                              "%s %d %d %d %d",
-                              &ch,
-                              &nodes[0],
-                              &nodes[1],
-                              &nodes[2],
-                              &nodes[3] ) )
-            {
-                _trias.push_back( nodes[0] - 1 );
-                _trias.push_back( nodes[1] - 1 );
-                _trias.push_back( nodes[2] - 1 );
-                auto randomcol = color::random();
-                _mat.emplace_back( randomcol );
-
-                _trias.push_back( nodes[0] - 1 );
-                _trias.push_back( nodes[2] - 1 );
-                _trias.push_back( nodes[3] - 1 );
-                _mat.push_back( randomcol );
-            }
-            else if ( 4 == sscanf( line.c_str(),
-                                   "%s %d %d %d",
-                                   &ch,
-                                   &nodes[0],
-                                   &nodes[1],
-                                   &nodes[2] ) )
-            {
-                _trias.push_back( nodes[0] - 1 );
-                _trias.push_back( nodes[1] - 1 );
-                _trias.push_back( nodes[2] - 1 );
-                _mat.emplace_back( color::random() );
-            }
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            std::cout << "mesh stats: " << _vertices.size() << " vertices | "
+                      << numTriangles() << " triangles | bounding box "
+                      << _box << "\n";
+            std::cout << "mapped " << cachePath << " in "
+                      << 1e3 * elapsed.count() << " ms\n";
+            return;
         }
     }
 
+    objdata obj;
+    if ( !loadobj( filename, obj ) )
+    {
+        std::cout << "could not open " << filename << "\n";
+        return;
+    }
+
+    std::vector<vec3<T>> &vertices = _vertices.edit();
+    vertices.reserve( obj.positions.size() / 3 );
+    for ( std::size_t ii = 0; ii < obj.positions.size(); ii += 3 )
+    {
+        vertices.emplace_back(
+            obj.positions[ii], obj.positions[ii + 1], obj.positions[ii + 2] );
+        _box.expand( vertices.back() );
+    }
+
+    // one random color per face, shared by the triangles it was split into
+    _trias = std::move( obj.trias );
+    std::vector<material> &     mat   = _materials.edit();
+    std::vector<std::uint32_t> &ids   = _materialIds.edit();
+    unsigned int                faces = 0;
+    for ( unsigned int face : obj.faces )
+        faces = std::max( faces, face + 1 );
+    mat.reserve( faces );
+    for ( unsigned int face = 0; face < faces; ++face )
+        mat.emplace_back( faceColor( face ) );
+    ids.assign( obj.faces.begin(), obj.faces.end() );
+
+    build();
+
     std::cout << "mesh stats: " << _vertices.size() << " vertices | "
-              << _trias.size() / 3 << " triangles | bounding box " << _box
+              << numTriangles() << " triangles | bounding box " << _box
               << "\n";
+    std::cout << "loaded " << filename << ": " << obj.bytes / 1e6 << " MB in "
+              << 1e3 * obj.seconds << " ms (" << obj.throughput() << " MB/s)";
+    if ( obj.numInvalidFaces )
+        std::cout << ", skipped " << obj.numInvalidFaces << " invalid faces";
+    std::cout << "\n";
+
+    if ( useCache && !writeCache( cachePath, sourceSize, sourceHash ) )
+        std::cout << "could not write " << cachePath << "\n";
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 template <typename T>
-bool mesh<T>::intersect( const ray<T> &r, hit<T> &h ) const noexcept
+mesh<T>::mesh( std::vector<vec3<T>>      vertices,
+               std::vector<unsigned int> trias ) noexcept
+    : _vertices( std::move( vertices ) ), _trias( std::move( trias ) )
 {
-    if ( !intersect( _box, r ) )
-        return false;
+    for ( const auto &v : _vertices )
+        _box.expand( v );
 
-    hit<T> localHit;
-    T      shortestDist = std::numeric_limits<T>::max();
+    std::vector<material> &     mat = _materials.edit();
+    std::vector<std::uint32_t> &ids = _materialIds.edit();
     for ( unsigned int ii = 0; ii < _trias.size() / 3; ++ii )
+    {
+        mat.emplace_back( faceColor( ii ) );
+        ids.push_back( ii );
+    }
+
+    build();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void mesh<T>::build() noexcept
+{
+    PT_TRACE_SCOPE( "build mesh bvh", "scene", "triangles", numTriangles() );
+    unsigned int         numTrias = numTriangles();
+    std::vector<bbox<T>> bounds( numTrias );
+    for ( unsigned int ii = 0; ii < numTrias; ++ii )
+    {
+        const unsigned int *t = &_trias[3 * ii];
+        bounds[ii].expand( _vertices[t[0]] );
+        bounds[ii].expand( _vertices[t[1]] );
+        bounds[ii].expand( _vertices[t[2]] );
+    }
+
+    _bvh.build( bounds );
+
+    // reorder triangles so that every leaf covers a contiguous range
+    const auto &              order = _bvh.order();
+    std::vector<unsigned int> trias( _trias.size() );
+    std::vector<std::uint32_t> ids( _materialIds.size() );
+    for ( unsigned int ii = 0; ii < numTrias; ++ii )
+    {
+        unsigned int src = order[ii];
+        trias[3 * ii]     = _trias[3 * src];
+        trias[3 * ii + 1] = _trias[3 * src + 1];
+        trias[3 * ii + 2] = _trias[3 * src + 2];
+        ids[ii]           = _materialIds[src];
+    }
+    _trias       = std::move( trias );
+    _materialIds = std::move( ids );
+
+    std::vector<T> values( triangles::kNumComponents * numTrias );
+    for ( unsigned int ii = 0; ii < numTrias; ++ii )
     {
         const unsigned int *t  = &_trias[3 * ii];
         const vec3<T> &     v0 = _vertices[t[0]];
         const vec3<T> &     v1 = _vertices[t[1]];
         const vec3<T> &     v2 = _vertices[t[2]];
-        if ( rayTriaIntersect( r, v0, v1, v2, localHit ) )
-        {
-            T dist = ( r.o - localHit._pos ).len2();
-            if ( dist < shortestDist )
-            {
-                shortestDist = dist;
-                h            = localHit;
-                h._mat       = _mat[ii];
-            }
-        }
+        vec3<T>             n  = ( v1 - v0 ) * ( v2 - v0 );
+        n.normalize();
+
+        T *column = values.data() + ii;
+        column[triangles::kV0x * numTrias] = v0[0];
+        column[triangles::kV0y * numTrias] = v0[1];
+        column[triangles::kV0z * numTrias] = v0[2];
+        column[triangles::kV1x * numTrias] = v1[0];
+        column[triangles::kV1y * numTrias] = v1[1];
+        column[triangles::kV1z * numTrias] = v1[2];
+        column[triangles::kV2x * numTrias] = v2[0];
+        column[triangles::kV2y * numTrias] = v2[1];
+        column[triangles::kV2z * numTrias] = v2[2];
+        column[triangles::kNx * numTrias]  = n[0];
+        column[triangles::kNy * numTrias]  = n[1];
+        column[triangles::kNz * numTrias]  = n[2];
     }
+    _tri.values = std::move( values );
+    _tri.count  = numTrias;
+}
+
+// -----------------------------------------------------------------------------
+// maps the cache and points every array into it. fails if the cache is
+// missing, stale, was written by an incompatible build or indexes out of
+// range
+// -----------------------------------------------------------------------------
+template <typename T>
+bool mesh<T>::readCache( const std::string &path,
+                         std::uint64_t      sourceSize,
+                         std::uint64_t      sourceHash ) noexcept
+{
+    auto file = std::make_shared<MappedFile>();
+    if ( !file->open( path, Access::kRandom ) ||
+         file->size() < sizeof( meshcacheheader ) )
+        return false;
+
+    meshcacheheader header;
+    memcpy( &header, file->data(), sizeof( header ) );
+    if ( !header.matches( sizeof( T ), sourceSize, sourceHash ) )
+        return false;
+
+    using section = meshcacheheader::section;
+    bool valid    = true;
+    auto vertices =
+        mapCacheSection<vec3<T>>( file, header, section::kVertices, valid );
+    auto trias =
+        mapCacheSection<unsigned int>( file, header, section::kTrias, valid );
+    auto mat =
+        mapCacheSection<material>( file, header, section::kMaterials, valid );
+    auto ids = mapCacheSection<std::uint32_t>(
+        file, header, section::kMaterialIds, valid );
+    auto values =
+        mapCacheSection<T>( file, header, section::kTriangles, valid );
+    auto nodes =
+        mapCacheSection<bvhnode<T>>( file, header, section::kNodes, valid );
+    auto order =
+        mapCacheSection<unsigned int>( file, header, section::kOrder, valid );
 
-    return ( shortestDist != std::numeric_limits<T>::max() );
+    std::size_t numTrias = trias.size() / 3;
+    valid = valid && trias.size() == 3 * numTrias && ids.size() == numTrias &&
+            ( numTrias == 0 || !mat.empty() ) &&
+            values.size() == triangles::kNumComponents * numTrias &&
+            order.size() == numTrias && ( numTrias == 0 || !nodes.empty() );
+    if ( !valid )
+        return false;
+
+    // the source hash does not cover the cache itself, so every index into
+    // another array is checked once here instead of on every access
+    for ( unsigned int vertex : trias )
+    {
+        if ( vertex >= vertices.size() )
+            return false;
+    }
+    for ( std::uint32_t id : ids )
+    {
+        if ( id >= mat.size() )
+            return false;
+    }
+    bvh<T> tree;
+    tree.assign( std::move( nodes ), std::move( order ) );
+    if ( !tree.valid( static_cast<unsigned int>( numTrias ) ) )
+        return false;
+
+    _vertices    = std::move( vertices );
+    _trias       = std::move( trias );
+    _materials   = std::move( mat );
+    _materialIds = std::move( ids );
+    _tri.values  = std::move( values );
+    _tri.count   = static_cast<unsigned int>( numTrias );
+    _bvh         = std::move( tree );
+    vec3<T> boxMin{T( header.boxMin[0] ),
+                   T( header.boxMin[1] ),
+                   T( header.boxMin[2] )};
+    vec3<T> boxMax{T( header.boxMax[0] ),
+                   T( header.boxMax[1] ),
+                   T( header.boxMax[2] )};
+    _box = {boxMin, boxMax};
+    return true;
 }
 
 // -----------------------------------------------------------------------------
+// writes to a temporary file that is renamed over the cache once complete, so
+// readers never map a partially written cache
 // -----------------------------------------------------------------------------
 template <typename T>
-bool mesh<T>::intersect( const bbox<T> &box, const ray<T> &r )
+bool mesh<T>::writeCache( const std::string &path,
+                          std::uint64_t      sourceSize,
+                          std::uint64_t      sourceHash ) const noexcept
 {
-    if ( box.contains( r.o ) )
-        return true;
+    meshcacheheader header;
+    memcpy( header.magic, kMeshCacheMagic, sizeof( header.magic ) );
+    header.version    = kMeshCacheVersion;
+    header.byteOrder  = kMeshCacheByteOrder;
+    header.scalarSize = sizeof( T );
+    header.sourceSize = sourceSize;
+    header.sourceHash = sourceHash;
+    for ( unsigned int ii = 0; ii < 3; ++ii )
+    {
+        header.boxMin[ii] = _box.min()[ii];
+        header.boxMax[ii] = _box.max()[ii];
+    }
+
+    struct array
+    {
+        const void *data;
+        std::size_t count;
+        std::size_t elementSize;
+    };
+    array arrays[meshcacheheader::kNumSections];
+    arrays[meshcacheheader::kVertices] = {
+        _vertices.data(), _vertices.size(), sizeof( vec3<T> )};
+    arrays[meshcacheheader::kTrias] = {
+        _trias.data(), _trias.size(), sizeof( unsigned int )};
+    arrays[meshcacheheader::kMaterials] = {
+        _materials.data(), _materials.size(), sizeof( material )};
+    arrays[meshcacheheader::kMaterialIds] = {
+        _materialIds.data(), _materialIds.size(), sizeof( std::uint32_t )};
+    arrays[meshcacheheader::kTriangles] = {
+        _tri.values.data(), _tri.values.size(), sizeof( T )};
+    arrays[meshcacheheader::kNodes] = {_bvh.nodes().data(),
+                                       _bvh.nodes().size(),
+                                       sizeof( bvhnode<T> )};
+    arrays[meshcacheheader::kOrder] = {
+        _bvh.order().data(), _bvh.order().size(), sizeof( unsigned int )};
 
-    // https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-box-intersection
-    T tmin, tmax, tymin, tymax, tzmin, tzmax;
+    auto align = []( std::uint64_t offset ) {
+        return ( offset + kMeshCacheAlignment - 1 ) / kMeshCacheAlignment *
+               kMeshCacheAlignment;
+    };
 
-    vec3<T> invdir{1 / r.d[0], 1 / r.d[1], 1 / r.d[2]};
-    int     sign[3] = {( invdir[0] < 0 ), ( invdir[1] < 0 ), ( invdir[2] < 0 )};
-    vec3<T> bounds[2] = {box.min(), box.max()};
-    tmin              = ( bounds[sign[0]][0] - r.o[0] ) * invdir[0];
-    tmax              = ( bounds[1 - sign[0]][0] - r.o[0] ) * invdir[0];
-    tymin             = ( bounds[sign[1]][1] - r.o[1] ) * invdir[1];
-    tymax             = ( bounds[1 - sign[1]][1] - r.o[1] ) * invdir[1];
+    std::uint64_t offset = align( sizeof( header ) );
+    for ( unsigned int ii = 0; ii < meshcacheheader::kNumSections; ++ii )
+    {
+        header.sections[ii].offset      = offset;
+        header.sections[ii].count       = arrays[ii].count;
+        header.sections[ii].elementSize = arrays[ii].elementSize;
+        offset = align( offset + arrays[ii].count * arrays[ii].elementSize );
+    }
 
-    if ( ( tmin > tymax ) || ( tymin > tmax ) )
+    std::string tmpPath = path + ".tmp";
+    FILE *      file    = fopen( tmpPath.c_str(), "wb" );
+    if ( !file )
         return false;
 
-    if ( tymin > tmin )
-        tmin = tymin;
-    if ( tymax < tmax )
-        tmax = tymax;
+    static const char padding[kMeshCacheAlignment] = {};
+    bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1;
+    std::uint64_t written = sizeof( header );
+    for ( unsigned int ii = 0; ok && ii < meshcacheheader::kNumSections; ++ii )
+    {
+        const meshcachesection &section = header.sections[ii];
+        std::size_t bytes = arrays[ii].count * arrays[ii].elementSize;
+        ok = ok &&
+             fwrite( padding, 1, section.offset - written, file ) ==
+                 section.offset - written &&
+             fwrite( arrays[ii].data, 1, bytes, file ) == bytes;
+        written = section.offset + bytes;
+    }
+    ok = fclose( file ) == 0 && ok;
 
-    tzmin = ( bounds[sign[2]][2] - r.o[2] ) * invdir[2];
-    tzmax = ( bounds[1 - sign[2]][2] - r.o[2] ) * invdir[2];
+    // rename does not replace an existing file everywhere
+    std::remove( path.c_str() );
+    if ( !ok || std::rename( tmpPath.c_str(), path.c_str() ) != 0 )
+    {
+        std::remove( tmpPath.c_str() );
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// only the distance is tracked during traversal, the barycentrics are worked
+// out once for the closest triangle
+// -----------------------------------------------------------------------------
+template <typename T>
+bool mesh<T>::intersect( const ray<T> &r, hit<T> &h ) const noexcept
+{
+    shearedray<T> sr( r );
+    unsigned int  closest  = 0;
+    T             tclosest = T( 0 );
+    auto leaf = [&]( unsigned int first, unsigned int count, T &tmax ) {
+        PT_STAT_ADD( kTriangleTests, count );
+        bool found = false;
+        for ( unsigned int ii = first; ii < first + count; ++ii )
+        {
+            T t;
+            if ( ::intersectTriangle(
+                     sr, _tri.v0( ii ), _tri.v1( ii ), _tri.v2( ii ), t ) &&
+                 t < tmax )
+            {
+                tmax     = t;
+                tclosest = t;
+                closest  = ii;
+                found    = true;
+            }
+        }
+        return found;
+    };
 
-    if ( ( tmin > tzmax ) || ( tzmin > tmax ) )
+    if ( !_bvh.traverse( r, r.tmax, leaf ) )
         return false;
-    if ( tzmin > tmin )
-        tmin = tzmin;
-    if ( tzmax < tmax )
-        tmax = tzmax;
 
+    resolve( r, tclosest, closest, h );
     return true;
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 template <typename T>
-bool mesh<T>::rayTriaIntersect( const ray<T> & r,
-                                const vec3<T> &v0,
-                                const vec3<T> &v1,
-                                const vec3<T> &v2,
-                                hit<T> &       h )
-{
-    // https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
-    auto v0v1 = v1 - v0; 
-    auto v0v2 = v2 - v0; 
-    const vec3<T> &dir = r.d;
-    const vec3<T> &orig = r.o;
-    auto pvec = dir * v0v2; 
-    T det = v0v1 % pvec; 
-
-    constexpr float kEpsilon = 1e-8;
-    // if the determinant is negative the triangle is backfacing
-    // if the determinant is close to 0, the ray misses the triangle
-    // ray and triangle are parallel if det is close to 0
-    if (fabs(det) < kEpsilon) return false; 
-
-    bool backfacing = (det < kEpsilon);
-    T invDet = 1.0 / det; 
- 
-    auto tvec = orig - v0; 
-    T u = (tvec % pvec) * invDet; 
-    if (u < 0 || u > 1) return false; 
- 
-    auto qvec = tvec * v0v1; 
-    T v = (dir % qvec) * invDet; 
-    if (v < 0 || u + v > 1) return false; 
- 
-    T t = (v0v2 % qvec) * invDet; 
-    if ( t < kEpsilon )
+bool mesh<T>::occluded( const ray<T> &r ) const noexcept
+{
+    shearedray<T> sr( r );
+    auto leaf = [&]( unsigned int first, unsigned int count, T &tmax ) {
+        for ( unsigned int ii = first; ii < first + count; ++ii )
+        {
+            T t;
+            PT_STAT_ADD( kTriangleTests, 1 );
+            if ( ::intersectTriangle(
+                     sr, _tri.v0( ii ), _tri.v1( ii ), _tri.v2( ii ), t ) &&
+                 t < tmax )
+            {
+                // any hit will do, a negative tmax ends the traversal
+                tmax = T( -1 );
+                return true;
+            }
+        }
         return false;
- 
-    auto N = v0v1 * v0v2;
-    N.normalize();
+    };
 
-    h._normal = N;
-    if ( backfacing )
-        h._normal = N * -1.0;
-    h._pos    = r.o + r.d * t;
-    return true; // this ray hits the triangle
+    return _bvh.traverse( r, r.tmax, leaf );
 }
 
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void mesh<T>::intersect( raypacket<T> &p, packethit<T> &h ) const noexcept
+{
+    auto leaf = [&]( unsigned int first, unsigned int count,
+                     raypacket<T> &pk ) {
+        for ( unsigned int ii = first; ii < first + count; ++ii )
+        {
+            PT_STAT_ADD( kTriangleTests, BitCount( pk.active ) );
+            T            dist[kPacketSize];
+            unsigned int hits = packetops<T>::intersectTriangle(
+                _tri.v0( ii ), _tri.v1( ii ), _tri.v2( ii ), pk, pk.active,
+                dist );
+            for ( unsigned int lane = 0; hits; ++lane, hits >>= 1 )
+            {
+                if ( !( hits & 1u ) )
+                    continue;
+                pk.tmax[lane]   = dist[lane];
+                h.t[lane]       = dist[lane];
+                h.element[lane] = ii;
+                h.object[lane]  = this;
+                h.mask |= 1u << lane;
+            }
+        }
+    };
+
+    _bvh.traverse( p, leaf );
+}
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-template<typename T>
-constexpr void mesh<T>::transform(const mat44<T> &mat) noexcept
+template <typename T>
+unsigned int mesh<T>::occluded( raypacket<T> &p ) const noexcept
 {
+    unsigned int blocked = 0;
+    auto leaf = [&]( unsigned int first, unsigned int count,
+                     raypacket<T> &pk ) {
+        for ( unsigned int ii = first; ii < first + count && pk.active; ++ii )
+        {
+            PT_STAT_ADD( kTriangleTests, BitCount( pk.active ) );
+            T            dist[kPacketSize];
+            unsigned int hits = packetops<T>::intersectTriangle(
+                _tri.v0( ii ), _tri.v1( ii ), _tri.v2( ii ), pk, pk.active,
+                dist );
+            blocked |= hits;
+            pk.active &= ~hits;
+        }
+    };
+
+    _bvh.traverse( p, leaf );
+    return blocked;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void mesh<T>::resolve( const ray<T> &r,
+                       T             t,
+                       unsigned int  element,
+                       hit<T> &      h ) const noexcept
+{
+    T b1, b2;
+    barycentrics( r.o + r.d * t,
+                  _tri.v0( element ),
+                  _tri.v1( element ),
+                  _tri.v2( element ),
+                  b1,
+                  b2 );
+    h._t       = t;
+    h._object  = this;
+    h._element = element;
+    h._u       = static_cast<float>( b1 );
+    h._v       = static_cast<float>( b2 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void mesh<T>::shade( const ray<T> &r,
+                     const hit<T> &h,
+                     surface<T> &  s ) const noexcept
+{
+    // the normal faces the side the ray came from
+    vec3<T> N = _tri.normal( h._element );
+    s._normal = N;
+    if ( N % r.d > 0 )
+        s._normal = N * -1.0;
+    s._pos = r.o + r.d * h._t;
+    s._mat = &triangleMaterial( h._element );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void mesh<T>::setMaterial( const material &mat )
+{
+    _materials = std::vector<material>( 1, mat );
+    std::vector<std::uint32_t> &ids = _materialIds.edit();
+    std::fill( ids.begin(), ids.end(), 0u );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+T mesh<T>::area( unsigned int ii ) const noexcept
+{
+    vec3<T> v0 = _tri.v0( ii );
+    return T( 0.5 ) * ( ( _tri.v1( ii ) - v0 ) * ( _tri.v2( ii ) - v0 ) ).len();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void mesh<T>::emitters( std::vector<unsigned int> &elements ) const
+{
+    for ( unsigned int ii = 0; ii < numTriangles(); ++ii )
+    {
+        if ( triangleMaterial( ii ).emission() > 0.0f )
+            elements.push_back( ii );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+float mesh<T>::emitterPower( unsigned int element ) const noexcept
+{
+    const material &mat = triangleMaterial( element );
+    return mat.emission() * mat.diffuse().luminance() * area( element );
+}
+
+// -----------------------------------------------------------------------------
+// uniform on the triangle, both sides emit
+// -----------------------------------------------------------------------------
+template <typename T>
+bool mesh<T>::sampleEmitter( unsigned int    element,
+                             const vec3<T> & from,
+                             float           u,
+                             float           v,
+                             lightsample<T> &ls ) const noexcept
+{
+    float   su = std::sqrt( u );
+    T       b1 = T( 1.0f - su );
+    T       b2 = T( v * su );
+    vec3<T> v0 = _tri.v0( element );
+    ls.pos     = v0 + ( _tri.v1( element ) - v0 ) * b1 +
+             ( _tri.v2( element ) - v0 ) * b2;
+
+    vec3<T> n = _tri.normal( element );
+    ls.normal = n % ( from - ls.pos ) < 0 ? n * T( -1 ) : n;
+
+    const material &mat = triangleMaterial( element );
+    ls.radiance         = mat.diffuse() * mat.emission();
+    ls.pdf              = emitterPdf( element, from, ls.pos );
+    return ls.pdf > 0.0f;
+}
+
+// -----------------------------------------------------------------------------
+// area density converted to solid angle at from
+// -----------------------------------------------------------------------------
+template <typename T>
+float mesh<T>::emitterPdf( unsigned int   element,
+                           const vec3<T> &from,
+                           const vec3<T> &pos ) const noexcept
+{
+    vec3<T> d      = pos - from;
+    T       len2   = d.len2();
+    T       cosine = std::abs( _tri.normal( element ) % d ) / std::sqrt( len2 );
+    T       a      = area( element );
+    if ( !( cosine > T( 0 ) ) || !( a > T( 0 ) ) )
+        return 0.0f;
+    return static_cast<float>( len2 / ( cosine * a ) );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+bool mesh<T>::intersectTriangle( const ray<T> &r,
+                                 unsigned int  ii,
+                                 T &           t ) const noexcept
+{
+    return ::intersectTriangle(
+        shearedray<T>( r ), _tri.v0( ii ), _tri.v1( ii ), _tri.v2( ii ), t );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void mesh<T>::transform( const mat44<T> &mat ) noexcept
+{
+    PT_TRACE_SCOPE( "transform mesh", "scene" );
     _box.reset();
-    for ( auto& v : _vertices )
+    for ( auto& v : _vertices.edit() )
     {
         mat.Transform(v);
         _box.expand(v);
     }
+
+    build();
 }
@@ -1,39 +1,206 @@
 #pragma once
 #include "boundingbox.h"
+#include "bvh.h"
 #include "hit.h"
 #include "material.h"
 #include "primitive.h"
 #include "ray.h"
 #include "mat44.h"
+#include "meshcache.h"
+#include "objloader.h"
+#include "triangle.h"
+#include "util/mappedarray.h"
+#include "util/stats.h"
+#include "util/trace.h"
+#include <cstdint>
 #include <vector>
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 template <typename T>
-class mesh : public primitive<T>
+class mesh final : public primitive<T>
 {
 public:
     constexpr mesh() noexcept = default;
-    mesh( const std::string &filename ) noexcept;
+
+    // loads an .obj file. with useCache the built mesh is written to a binary
+    // cache next to it on first load and mapped from there afterwards
+    mesh( const std::string &filename, bool useCache = true ) noexcept;
+    mesh( std::vector<vec3<T>>      vertices,
+          std::vector<unsigned int> trias ) noexcept;
 
     virtual bool intersect( const ray<T> &r, hit<T> &h ) const
         noexcept override;
 
-    constexpr void transform(const mat44<T> &mat) noexcept;
+    virtual void intersect( raypacket<T> &p, packethit<T> &h ) const
+        noexcept override;
+
+    virtual bool occluded( const ray<T> &r ) const noexcept override;
+
+    virtual unsigned int occluded( raypacket<T> &p ) const noexcept override;
+
+    virtual void resolve( const ray<T> &r,
+                          T             t,
+                          unsigned int  element,
+                          hit<T> &      h ) const noexcept override;
+
+    virtual void shade( const ray<T> &r,
+                        const hit<T> &h,
+                        surface<T> &  s ) const noexcept override;
+
+    virtual bbox<T> bounds() const noexcept override { return _box; }
+
+    virtual void emitters( std::vector<unsigned int> &elements ) const override;
+
+    virtual float emitterPower( unsigned int element ) const noexcept override;
+
+    virtual bool sampleEmitter( unsigned int    element,
+                                const vec3<T> & from,
+                                float           u,
+                                float           v,
+                                lightsample<T> &ls ) const noexcept override;
+
+    virtual float emitterPdf( unsigned int   element,
+                              const vec3<T> &from,
+                              const vec3<T> &pos ) const noexcept override;
+
+    void transform( const mat44<T> &mat ) noexcept;
+
+    // gives every triangle the same material, e.g. to turn the mesh into a
+    // light
+    void setMaterial( const material &mat );
+
+    // material of triangle ii in bvh leaf order
+    const material &triangleMaterial( unsigned int ii ) const noexcept
+    {
+        return _materials[_materialIds[ii]];
+    }
+
+    // distinct materials, and the index of the one of every triangle in bvh
+    // leaf order
+    const MappedArray<material> &materials() const noexcept
+    {
+        return _materials;
+    }
+    const MappedArray<std::uint32_t> &materialIds() const noexcept
+    {
+        return _materialIds;
+    }
+
+    // vertices and unit face normal of triangle ii in bvh leaf order
+    void triangleVertices( unsigned int ii,
+                           vec3<T> &    v0,
+                           vec3<T> &    v1,
+                           vec3<T> &    v2,
+                           vec3<T> &    n ) const noexcept
+    {
+        v0 = _tri.v0( ii );
+        v1 = _tri.v1( ii );
+        v2 = _tri.v2( ii );
+        n  = _tri.normal( ii );
+    }
+
+    unsigned int numTriangles() const noexcept
+    {
+        return static_cast<unsigned int>( _trias.size() / 3 );
+    }
+
+    const bvh<T> &accel() const noexcept { return _bvh; }
+
+    // bytes held by the indexed vertex / triangle lists and by the
+    // intersection layout built from them
+    std::size_t indexedBytes() const noexcept
+    {
+        return _vertices.size() * sizeof( vec3<T> ) +
+               _trias.size() * sizeof( unsigned int );
+    }
+    std::size_t triangleBytes() const noexcept
+    {
+        return _tri.values.size() * sizeof( T );
+    }
+
+    // true if the mesh data is used in place from a mapped cache file
+    bool mapped() const noexcept { return _tri.values.borrowed(); }
+
+    // watertight test against triangle ii in bvh leaf order, t receives the
+    // distance. public so that the kernel can be benchmarked on its own, the
+    // traversal prepares the sheared ray once instead of per triangle
+    bool intersectTriangle( const ray<T> &r,
+                            unsigned int  ii,
+                            T &           t ) const noexcept;
 
 private:
-    static bool intersect( const bbox<T> &box, const ray<T> &r );
-    static bool rayTriaIntersect( const ray<T> & r,
-                                  const vec3<T> &v0,
-                                  const vec3<T> &v1,
-                                  const vec3<T> &v2,
-                                  hit<T> &       h );
-
-    std::vector<vec3<T>>      _vertices;
-    std::vector<unsigned int> _trias;
-
-    bbox<T>  _box;
-    std::vector<material> _mat;
+    // intersection ready copy of the triangles in structure of arrays form:
+    // the three vertices and the unit face normal. every component is a run
+    // of numTriangles() values within one allocation
+    struct triangles
+    {
+        enum component
+        {
+            kV0x,
+            kV0y,
+            kV0z,
+            kV1x,
+            kV1y,
+            kV1z,
+            kV2x,
+            kV2y,
+            kV2z,
+            kNx,
+            kNy,
+            kNz,
+            kNumComponents
+        };
+
+        MappedArray<T> values;
+        unsigned int   count = 0;
+
+        T get( unsigned int c, unsigned int ii ) const noexcept
+        {
+            return values[c * count + ii];
+        }
+        vec3<T> v0( unsigned int ii ) const noexcept
+        {
+            return {get( kV0x, ii ), get( kV0y, ii ), get( kV0z, ii )};
+        }
+        vec3<T> v1( unsigned int ii ) const noexcept
+        {
+            return {get( kV1x, ii ), get( kV1y, ii ), get( kV1z, ii )};
+        }
+        vec3<T> v2( unsigned int ii ) const noexcept
+        {
+            return {get( kV2x, ii ), get( kV2y, ii ), get( kV2z, ii )};
+        }
+        vec3<T> normal( unsigned int ii ) const noexcept
+        {
+            return {get( kNx, ii ), get( kNy, ii ), get( kNz, ii )};
+        }
+    };
+
+    void build() noexcept;
+
+    // area of triangle ii in bvh leaf order
+    T area( unsigned int ii ) const noexcept;
+
+    bool readCache( const std::string &path,
+                    std::uint64_t      sourceSize,
+                    std::uint64_t      sourceHash ) noexcept;
+    bool writeCache( const std::string &path,
+                     std::uint64_t      sourceSize,
+                     std::uint64_t      sourceHash ) const noexcept;
+
+    MappedArray<vec3<T>>      _vertices;
+    MappedArray<unsigned int> _trias;
+
+    bbox<T> _box;
+
+    // distinct materials, and the index of the one of every triangle
+    MappedArray<material>      _materials;
+    MappedArray<std::uint32_t> _materialIds;
+
+    // triangles in _trias, _tri and _materialIds are kept in bvh leaf order
+    triangles _tri;
+    bvh<T>    _bvh;
 };
 
 #include "mesh.cc"
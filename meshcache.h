@@ -0,0 +1,108 @@
+#pragma once
+
+#include "util/mappedarray.h"
+#include "util/mappedfile.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// binary cache of a loaded and built mesh. a fixed header is followed by the
+// mesh arrays, each at a 64 byte aligned offset, so that a mapped cache file
+// is used in place. the header ties the cache to the source file through its
+// size and hash and to the build through the format version, scalar size and
+// byte order; any mismatch makes the loader fall back to the source
+// -----------------------------------------------------------------------------
+constexpr char          kMeshCacheMagic[8]  = {'p', 't', 'm', 'e', 's', 'h'};
+constexpr std::uint32_t kMeshCacheVersion   = 3;
+constexpr std::uint32_t kMeshCacheByteOrder = 0x01020304;
+constexpr std::uint64_t kMeshCacheAlignment = 64;
+
+struct meshcachesection
+{
+    std::uint64_t offset      = 0; // from the start of the file
+    std::uint64_t count       = 0; // elements
+    std::uint64_t elementSize = 0; // bytes per element
+};
+
+struct meshcacheheader
+{
+    enum section
+    {
+        kVertices,
+        kTrias,
+        kMaterials,
+        kMaterialIds,
+        kTriangles,
+        kNodes,
+        kOrder,
+        kNumSections
+    };
+
+    char          magic[8]   = {};
+    std::uint32_t version    = 0;
+    std::uint32_t byteOrder  = 0;
+    std::uint32_t scalarSize = 0;
+    std::uint32_t reserved   = 0;
+    std::uint64_t sourceSize = 0;
+    std::uint64_t sourceHash = 0;
+    double        boxMin[3]  = {};
+    double        boxMax[3]  = {};
+
+    meshcachesection sections[kNumSections];
+
+    // true if the header was written by this build for the given source
+    bool matches( std::uint32_t scalar,
+                  std::uint64_t size,
+                  std::uint64_t hash ) const noexcept
+    {
+        return memcmp( magic, kMeshCacheMagic, sizeof( magic ) ) == 0 &&
+               version == kMeshCacheVersion &&
+               byteOrder == kMeshCacheByteOrder && scalarSize == scalar &&
+               sourceSize == size && sourceHash == hash;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// the cache lives next to its source, one file per scalar type
+// -----------------------------------------------------------------------------
+template <typename T>
+std::string meshCachePath( const std::string &source )
+{
+    return source + ( sizeof( T ) == 4 ? ".f32" : ".f64" ) + ".ptcache";
+}
+
+// -----------------------------------------------------------------------------
+// borrows a section of a mapped file. clears valid and returns an empty array
+// if the section does not fit the file or holds a different type
+// -----------------------------------------------------------------------------
+template <typename E>
+MappedArray<E> mapCacheSection( const std::shared_ptr<MappedFile> &file,
+                                const meshcachesection &           section,
+                                bool &                             valid )
+{
+    std::uint64_t size = file->size();
+    valid = valid && section.elementSize == sizeof( E ) &&
+            section.offset % alignof( E ) == 0 && section.offset <= size &&
+            section.count <= ( size - section.offset ) / sizeof( E );
+    if ( !valid )
+        return {};
+
+    return MappedArray<E>::borrow(
+        reinterpret_cast<const E *>( file->data() + section.offset ),
+        static_cast<std::size_t>( section.count ),
+        file );
+}
+
+// -----------------------------------------------------------------------------
+// one section of a mapped cache
+// -----------------------------------------------------------------------------
+template <typename E>
+MappedArray<E> mapCacheSection( const std::shared_ptr<MappedFile> &file,
+                                const meshcacheheader &            header,
+                                meshcacheheader::section           s,
+                                bool &                             valid )
+{
+    return mapCacheSection<E>( file, header.sections[s], valid );
+}
@@ -0,0 +1,568 @@
+#include "util/concurrent.h"
+#include "util/mappedfile.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+// -----------------------------------------------------------------------------
+// parse result of one chunk of the file. corners given by negative (relative)
+// indices are stored relative to the chunk and listed in the fixup arrays,
+// they are rebased once the vertex counts of all earlier chunks are known
+// -----------------------------------------------------------------------------
+struct objchunk
+{
+    std::vector<float> positions;
+    std::vector<float> texcoords;
+    std::vector<float> normals;
+
+    std::vector<unsigned int> trias;
+    std::vector<unsigned int> texcoordIndices;
+    std::vector<unsigned int> normalIndices;
+    std::vector<unsigned int> faces; // chunk local face numbers
+
+    std::vector<unsigned int> positionFixups;
+    std::vector<unsigned int> texcoordFixups;
+    std::vector<unsigned int> normalFixups;
+
+    unsigned int numFaces        = 0;
+    unsigned int numInvalidFaces = 0;
+    bool         hasTexcoords    = false;
+    bool         hasNormals      = false;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline bool isObjSpace( char c ) noexcept
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isObjDigit( char c ) noexcept
+{
+    return static_cast<unsigned char>( c - '0' ) < 10;
+}
+
+inline const char *skipObjSpace( const char *p, const char *end ) noexcept
+{
+    while ( p < end && isObjSpace( *p ) )
+        ++p;
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+// decimal floating point number with optional sign, fraction and exponent.
+// the first 19 significant digits are accumulated as an integer and scaled by
+// an exact power of ten, which rounds correctly for the short numbers found
+// in .obj files. returns nullptr if there is no number at p
+// -----------------------------------------------------------------------------
+inline const char *parseObjFloat( const char *p,
+                                  const char *end,
+                                  float &     out ) noexcept
+{
+    static const double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                    1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                    1e18, 1e19, 1e20, 1e21, 1e22};
+
+    bool negative = false;
+    if ( p < end && ( *p == '-' || *p == '+' ) )
+        negative = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    int                digits   = 0;
+    int                exponent = 0;
+    bool               any      = false;
+    for ( ; p < end && isObjDigit( *p ); ++p, any = true )
+    {
+        if ( digits < 19 )
+        {
+            mantissa = 10 * mantissa + ( *p - '0' );
+            digits += mantissa != 0;
+        }
+        else
+        {
+            ++exponent;
+        }
+    }
+
+    if ( p < end && *p == '.' )
+    {
+        for ( ++p; p < end && isObjDigit( *p ); ++p, any = true )
+        {
+            if ( digits < 19 )
+            {
+                mantissa = 10 * mantissa + ( *p - '0' );
+                digits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+
+    if ( !any )
+        return nullptr;
+
+    if ( p < end && ( *p == 'e' || *p == 'E' ) )
+    {
+        const char *q           = p + 1;
+        bool        negativeExp = false;
+        if ( q < end && ( *q == '-' || *q == '+' ) )
+            negativeExp = *q++ == '-';
+        if ( q < end && isObjDigit( *q ) )
+        {
+            int e = 0;
+            for ( ; q < end && isObjDigit( *q ); ++q )
+                e = std::min( 10 * e + ( *q - '0' ), 100000 );
+            exponent += negativeExp ? -e : e;
+            p = q;
+        }
+    }
+
+    double value = static_cast<double>( mantissa );
+    if ( mantissa != 0 && exponent != 0 )
+    {
+        if ( exponent > 0 && exponent <= 22 )
+            value *= kPow10[exponent];
+        else if ( exponent < 0 && exponent >= -22 )
+            value /= kPow10[-exponent];
+        else
+            value *= std::pow( 10.0, exponent );
+    }
+
+    out = static_cast<float>( negative ? -value : value );
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+// signed integer, returns nullptr if there is none at p
+// -----------------------------------------------------------------------------
+inline const char *parseObjIndex( const char *p,
+                                  const char *end,
+                                  long long & out ) noexcept
+{
+    bool negative = false;
+    if ( p < end && ( *p == '-' || *p == '+' ) )
+        negative = *p++ == '-';
+
+    if ( p == end || !isObjDigit( *p ) )
+        return nullptr;
+
+    long long value = 0;
+    for ( ; p < end && isObjDigit( *p ); ++p )
+        value = std::min( 10 * value + ( *p - '0' ), 1ll << 40 );
+
+    out = negative ? -value : value;
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+// reads up to count floats of a v, vt or vn line, missing ones are 0 so that
+// a malformed line still takes up its slot in the vertex numbering
+// -----------------------------------------------------------------------------
+inline void parseObjVector( const char *        p,
+                            const char *        end,
+                            unsigned int        count,
+                            std::vector<float> &out )
+{
+    for ( unsigned int ii = 0; ii < count; ++ii )
+    {
+        float value = 0.0f;
+        p           = skipObjSpace( p, end );
+        if ( const char *q = parseObjFloat( p, end, value ) )
+            p = q;
+        out.push_back( value );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// corner of a face as written in the file
+// -----------------------------------------------------------------------------
+struct objcorner
+{
+    long long position = 0;
+    long long texcoord = 0; // 0 if absent
+    long long normal   = 0; // 0 if absent
+};
+
+// -----------------------------------------------------------------------------
+// v, v/vt, v//vn or v/vt/vn
+// -----------------------------------------------------------------------------
+inline const char *parseObjCorner( const char *p,
+                                   const char *end,
+                                   objcorner & corner ) noexcept
+{
+    corner = {};
+    p      = parseObjIndex( p, end, corner.position );
+    if ( !p || p == end || *p != '/' )
+        return p;
+
+    // a slash ends the line only in a malformed corner
+    if ( ++p == end )
+        return nullptr;
+    if ( *p != '/' )
+    {
+        p = parseObjIndex( p, end, corner.texcoord );
+        if ( !p || p == end || *p != '/' )
+            return p;
+    }
+
+    if ( ++p == end )
+        return nullptr;
+    return parseObjIndex( p, end, corner.normal );
+}
+
+// -----------------------------------------------------------------------------
+// converts a 1 based index to 0 based. negative indices count back from the
+// vertices seen so far in this chunk, the corner is recorded for rebasing.
+// returns false for the invalid index 0 and indices beyond 32 bits
+// -----------------------------------------------------------------------------
+inline bool resolveObjIndex( long long                  index,
+                             std::size_t                count,
+                             unsigned int               corner,
+                             unsigned int &             out,
+                             std::vector<unsigned int> &fixups )
+{
+    if ( index > 0 && index <= objdata::kNoIndex )
+    {
+        out = static_cast<unsigned int>( index - 1 );
+        return true;
+    }
+    if ( index >= 0 )
+        return false;
+
+    // may wrap below 0 when it refers to an earlier chunk, adding the chunk
+    // base later wraps it back
+    out = static_cast<unsigned int>( static_cast<long long>( count ) + index );
+    fixups.push_back( corner );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline void parseObjFace( const char *            p,
+                          const char *            end,
+                          objchunk &              chunk,
+                          std::vector<objcorner> &corners )
+{
+    corners.clear();
+    while ( true )
+    {
+        p = skipObjSpace( p, end );
+        if ( p >= end )
+            break;
+
+        objcorner corner;
+        p = parseObjCorner( p, end, corner );
+        if ( !p )
+        {
+            ++chunk.numInvalidFaces;
+            ++chunk.numFaces;
+            return;
+        }
+        corners.push_back( corner );
+    }
+
+    unsigned int face = chunk.numFaces++;
+    if ( corners.size() < 3 )
+    {
+        ++chunk.numInvalidFaces;
+        return;
+    }
+
+    std::size_t  numPositions = chunk.positions.size() / 3;
+    std::size_t  numTexcoords = chunk.texcoords.size() / 2;
+    std::size_t  numNormals   = chunk.normals.size() / 3;
+    std::size_t  numCorners   = chunk.trias.size();
+    std::size_t  numFixups[3] = {chunk.positionFixups.size(),
+                                chunk.texcoordFixups.size(),
+                                chunk.normalFixups.size()};
+    unsigned int fan[3]       = {0, 0, 0};
+
+    // fan triangulation ( 0, ii - 1, ii ), quads split along 0-2
+    bool valid = true;
+    for ( unsigned int ii = 2; ii < corners.size() && valid; ++ii )
+    {
+        fan[1] = ii - 1;
+        fan[2] = ii;
+        for ( unsigned int c : fan )
+        {
+            const objcorner &corner = corners[c];
+            unsigned int     slot   = static_cast<unsigned int>(
+                chunk.trias.size() );
+            unsigned int     position = 0;
+            unsigned int     texcoord = objdata::kNoIndex;
+            unsigned int     normal   = objdata::kNoIndex;
+
+            valid = valid && resolveObjIndex( corner.position,
+                                              numPositions,
+                                              slot,
+                                              position,
+                                              chunk.positionFixups );
+            if ( corner.texcoord )
+            {
+                chunk.hasTexcoords = true;
+                valid              = valid && resolveObjIndex( corner.texcoord,
+                                                  numTexcoords,
+                                                  slot,
+                                                  texcoord,
+                                                  chunk.texcoordFixups );
+            }
+            if ( corner.normal )
+            {
+                chunk.hasNormals = true;
+                valid            = valid && resolveObjIndex( corner.normal,
+                                                  numNormals,
+                                                  slot,
+                                                  normal,
+                                                  chunk.normalFixups );
+            }
+
+            chunk.trias.push_back( position );
+            chunk.texcoordIndices.push_back( texcoord );
+            chunk.normalIndices.push_back( normal );
+        }
+        chunk.faces.push_back( face );
+    }
+
+    if ( !valid )
+    {
+        // roll back the triangles of the face
+        chunk.trias.resize( numCorners );
+        chunk.texcoordIndices.resize( numCorners );
+        chunk.normalIndices.resize( numCorners );
+        chunk.faces.resize( numCorners / 3 );
+        chunk.positionFixups.resize( numFixups[0] );
+        chunk.texcoordFixups.resize( numFixups[1] );
+        chunk.normalFixups.resize( numFixups[2] );
+        ++chunk.numInvalidFaces;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// parses the whole lines in [ begin, end )
+// -----------------------------------------------------------------------------
+inline void parseObjChunk( const char *begin, const char *end, objchunk &chunk )
+{
+    std::vector<objcorner> corners;
+    for ( const char *p = begin; p < end; )
+    {
+        const char *eol = static_cast<const char *>(
+            memchr( p, '\n', static_cast<std::size_t>( end - p ) ) );
+        if ( !eol )
+            eol = end;
+
+        p = skipObjSpace( p, eol );
+        if ( eol - p >= 2 && p[0] == 'v' && isObjSpace( p[1] ) )
+            parseObjVector( p + 2, eol, 3, chunk.positions );
+        else if ( eol - p >= 3 && p[0] == 'v' && p[1] == 't' &&
+                  isObjSpace( p[2] ) )
+            parseObjVector( p + 3, eol, 2, chunk.texcoords );
+        else if ( eol - p >= 3 && p[0] == 'v' && p[1] == 'n' &&
+                  isObjSpace( p[2] ) )
+            parseObjVector( p + 3, eol, 3, chunk.normals );
+        else if ( eol - p >= 2 && p[0] == 'f' && isObjSpace( p[1] ) )
+            parseObjFace( p + 2, eol, chunk, corners );
+
+        p = eol + 1;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// moves the relative corners and the face numbers by the counts of the
+// earlier chunks, then drops faces with indices beyond the merged vertex
+// counts
+// -----------------------------------------------------------------------------
+inline void rebaseObjChunk( objchunk &         chunk,
+                            const unsigned int base[4],
+                            const std::size_t  total[3] )
+{
+    // positive indices are already absolute, only relative ones move
+    for ( unsigned int corner : chunk.positionFixups )
+        chunk.trias[corner] += base[0];
+    for ( unsigned int corner : chunk.texcoordFixups )
+        chunk.texcoordIndices[corner] += base[1];
+    for ( unsigned int corner : chunk.normalFixups )
+        chunk.normalIndices[corner] += base[2];
+    for ( auto &face : chunk.faces )
+        face += base[3];
+
+    auto inRange = [&]( unsigned int index, std::size_t count ) {
+        return index == objdata::kNoIndex || index < count;
+    };
+
+    // the triangles of a face are consecutive, a face is kept or dropped as
+    // a whole
+    std::size_t numTrias = chunk.faces.size();
+    std::size_t kept     = 0;
+    for ( std::size_t first = 0, last = 0; first < numTrias; first = last )
+    {
+        bool valid = true;
+        for ( last = first;
+              last < numTrias && chunk.faces[last] == chunk.faces[first];
+              ++last )
+        {
+            for ( std::size_t c = 3 * last; c < 3 * last + 3; ++c )
+            {
+                valid = valid && chunk.trias[c] < total[0] &&
+                        inRange( chunk.texcoordIndices[c], total[1] ) &&
+                        inRange( chunk.normalIndices[c], total[2] );
+            }
+        }
+
+        if ( !valid )
+        {
+            ++chunk.numInvalidFaces;
+            continue;
+        }
+
+        for ( std::size_t ii = first; ii < last; ++ii, ++kept )
+        {
+            for ( std::size_t c = 0; c < 3; ++c )
+            {
+                chunk.trias[3 * kept + c] = chunk.trias[3 * ii + c];
+                chunk.texcoordIndices[3 * kept + c] =
+                    chunk.texcoordIndices[3 * ii + c];
+                chunk.normalIndices[3 * kept + c] =
+                    chunk.normalIndices[3 * ii + c];
+            }
+            chunk.faces[kept] = chunk.faces[ii];
+        }
+    }
+
+    chunk.trias.resize( 3 * kept );
+    chunk.texcoordIndices.resize( 3 * kept );
+    chunk.normalIndices.resize( 3 * kept );
+    chunk.faces.resize( kept );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline bool loadobj( const std::string &path,
+                     objdata &          out,
+                     unsigned int       numThreads,
+                     std::size_t        chunkSize )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    out = objdata{};
+    MappedFile file( path, Access::kSequential );
+    if ( !file.isOpen() )
+        return false;
+
+    const char *data = file.data();
+    std::size_t size = file.size();
+
+    // chunk boundaries are moved forward to the next line start
+    chunkSize = std::max<std::size_t>( chunkSize, 1 );
+    std::size_t numChunks = std::max<std::size_t>( 1, size / chunkSize );
+    std::vector<std::size_t> bounds( numChunks + 1, size );
+    bounds[0] = 0;
+    for ( std::size_t ii = 1; ii < numChunks; ++ii )
+    {
+        std::size_t pos = std::max( ii * size / numChunks, bounds[ii - 1] );
+        const void *eol = pos < size ? memchr( data + pos, '\n', size - pos )
+                                     : nullptr;
+        bounds[ii]      = eol ? static_cast<const char *>( eol ) - data + 1
+                              : size;
+    }
+
+    std::vector<objchunk> chunks( numChunks );
+    auto                  parse = [&]( unsigned int ii, unsigned int ) {
+        parseObjChunk( data + bounds[ii], data + bounds[ii + 1], chunks[ii] );
+    };
+
+    // small files are not worth starting threads for
+    unsigned int poolSize = numThreads ? numThreads
+                                       : ThreadPool::hardwareThreads();
+    poolSize = static_cast<unsigned int>(
+        std::min<std::size_t>( poolSize, numChunks ) );
+    std::unique_ptr<ThreadPool> pool;
+    auto                        run = [&]( const ThreadPool::Task &task ) {
+        if ( pool )
+            pool->run( static_cast<unsigned int>( numChunks ), task );
+        else
+            for ( unsigned int ii = 0; ii < numChunks; ++ii )
+                task( ii, 0 );
+    };
+    if ( poolSize > 1 )
+        pool = std::make_unique<ThreadPool>( poolSize );
+
+    run( parse );
+
+    // vertex, face and triangle offsets of every chunk
+    std::vector<unsigned int> base( 4 * numChunks + 4, 0 );
+    std::vector<std::size_t>  triaBase( numChunks + 1, 0 );
+    bool                      hasTexcoords = false, hasNormals = false;
+    for ( std::size_t ii = 0; ii < numChunks; ++ii )
+    {
+        const objchunk &c   = chunks[ii];
+        unsigned int *  cur = &base[4 * ii];
+        unsigned int *  nxt = cur + 4;
+        nxt[0] = cur[0] + static_cast<unsigned int>( c.positions.size() / 3 );
+        nxt[1] = cur[1] + static_cast<unsigned int>( c.texcoords.size() / 2 );
+        nxt[2] = cur[2] + static_cast<unsigned int>( c.normals.size() / 3 );
+        nxt[3] = cur[3] + c.numFaces;
+        hasTexcoords = hasTexcoords || c.hasTexcoords;
+        hasNormals   = hasNormals || c.hasNormals;
+    }
+
+    const unsigned int *totals   = &base[4 * numChunks];
+    std::size_t         total[3] = {totals[0], totals[1], totals[2]};
+    run( [&]( unsigned int ii, unsigned int ) {
+        rebaseObjChunk( chunks[ii], &base[4 * ii], total );
+    } );
+
+    for ( std::size_t ii = 0; ii < numChunks; ++ii )
+    {
+        triaBase[ii + 1] = triaBase[ii] + chunks[ii].faces.size();
+        out.numInvalidFaces += chunks[ii].numInvalidFaces;
+    }
+
+    std::size_t numTrias = triaBase[numChunks];
+    out.positions.resize( 3 * std::size_t( totals[0] ) );
+    out.texcoords.resize( 2 * std::size_t( totals[1] ) );
+    out.normals.resize( 3 * std::size_t( totals[2] ) );
+    out.trias.resize( 3 * numTrias );
+    out.faces.resize( numTrias );
+    if ( hasTexcoords )
+        out.texcoordIndices.resize( 3 * numTrias );
+    if ( hasNormals )
+        out.normalIndices.resize( 3 * numTrias );
+    out.numFaces = totals[3];
+
+    run( [&]( unsigned int ii, unsigned int ) {
+        const objchunk &c = chunks[ii];
+        const unsigned int *b = &base[4 * ii];
+        std::copy( c.positions.begin(),
+                   c.positions.end(),
+                   out.positions.begin() + 3 * std::size_t( b[0] ) );
+        std::copy( c.texcoords.begin(),
+                   c.texcoords.end(),
+                   out.texcoords.begin() + 2 * std::size_t( b[1] ) );
+        std::copy( c.normals.begin(),
+                   c.normals.end(),
+                   out.normals.begin() + 3 * std::size_t( b[2] ) );
+        std::copy( c.trias.begin(),
+                   c.trias.end(),
+                   out.trias.begin() + 3 * triaBase[ii] );
+        std::copy( c.faces.begin(),
+                   c.faces.end(),
+                   out.faces.begin() + triaBase[ii] );
+        if ( hasTexcoords )
+            std::copy( c.texcoordIndices.begin(),
+                       c.texcoordIndices.end(),
+                       out.texcoordIndices.begin() + 3 * triaBase[ii] );
+        if ( hasNormals )
+            std::copy( c.normalIndices.begin(),
+                       c.normalIndices.end(),
+                       out.normalIndices.begin() + 3 * triaBase[ii] );
+        chunks[ii] = objchunk{};
+    } );
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    out.bytes   = size;
+    out.seconds = elapsed.count();
+    return true;
+}
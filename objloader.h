@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// geometry of a wavefront .obj file in flat arrays. faces of any size are fan
+// triangulated. every triangle corner has a position index and, when the file
+// gives them, texture coordinate and normal indices. all indices are 0 based
+// -----------------------------------------------------------------------------
+struct objdata
+{
+    // corner without a texture coordinate or normal
+    static constexpr unsigned int kNoIndex = ~0u;
+
+    std::vector<float> positions; // x y z
+    std::vector<float> texcoords; // u v
+    std::vector<float> normals;   // x y z
+
+    // three corners per triangle. texcoordIndices and normalIndices are empty
+    // if no face references texture coordinates or normals
+    std::vector<unsigned int> trias;
+    std::vector<unsigned int> texcoordIndices;
+    std::vector<unsigned int> normalIndices;
+
+    // source face of every triangle, faces are numbered in file order
+    std::vector<unsigned int> faces;
+    unsigned int              numFaces = 0;
+
+    // faces dropped for referencing vertices that do not exist
+    unsigned int numInvalidFaces = 0;
+
+    std::size_t bytes   = 0; // file size
+    double      seconds = 0; // time to map, parse and merge
+
+    unsigned int numTriangles() const noexcept
+    {
+        return static_cast<unsigned int>( trias.size() / 3 );
+    }
+
+    // load throughput in MB/s
+    double throughput() const noexcept
+    {
+        return seconds > 0 ? bytes / seconds * 1e-6 : 0.0;
+    }
+};
+
+// files are split into chunks of about this size that are parsed in parallel
+constexpr std::size_t kObjChunkSize = 1 << 20;
+
+// memory maps the file, parses its chunks on numThreads threads (0 uses every
+// hardware thread) and merges them into out. returns false if the file cannot
+// be opened
+inline bool loadobj( const std::string &path,
+                     objdata &          out,
+                     unsigned int       numThreads = 0,
+                     std::size_t        chunkSize  = kObjChunkSize );
+
+#include "objloader.cc"
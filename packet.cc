@@ -0,0 +1,425 @@
+#include <cmath>
+#include <limits>
+
+#if PT_X86
+#include <immintrin.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+unsigned int packetscalar<T>::intersectBox( const bbox<T> &      box,
+                                            const raypacket<T> &p,
+                                            T &                  tnear ) noexcept
+{
+    unsigned int mask = 0;
+    tnear             = std::numeric_limits<T>::max();
+    for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+    {
+        if ( !( p.active & ( 1u << lane ) ) )
+            continue;
+
+        T t = T( 0 );
+        if ( box.intersect( {p.ox[lane], p.oy[lane], p.oz[lane]},
+                            {p.ix[lane], p.iy[lane], p.iz[lane]},
+                            p.tmax[lane],
+                            t ) )
+        {
+            mask |= 1u << lane;
+            tnear = t < tnear ? t : tnear;
+        }
+    }
+    return mask;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+unsigned int packetscalar<T>::intersectTriangle( const vec3<T> &      v0,
+                                                 const vec3<T> &      v1,
+                                                 const vec3<T> &      v2,
+                                                 const raypacket<T> &p,
+                                                 unsigned int         mask,
+                                                 T *                  t ) noexcept
+{
+    unsigned int hits = 0;
+    for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+    {
+        if ( !( mask & ( 1u << lane ) ) )
+            continue;
+
+        T dist;
+        if ( !::intersectTriangle( p.shear( lane ), v0, v1, v2, dist ) ||
+             !( dist < p.tmax[lane] ) )
+            continue;
+
+        t[lane] = dist;
+        hits |= 1u << lane;
+    }
+    return hits;
+}
+
+#if PT_X86
+
+// -----------------------------------------------------------------------------
+// sse2 versions, two groups of 4 lanes. the arithmetic follows the scalar
+// kernels operation by operation so all paths produce the same distances
+// -----------------------------------------------------------------------------
+inline __m128 slabSSE( float bound, __m128 o, __m128 inv ) noexcept
+{
+    return _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( bound ), o ), inv );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline unsigned int intersectBoxSSE( const bbox<float> &      box,
+                                     const raypacket<float> &p,
+                                     float &                  tnear ) noexcept
+{
+    alignas( 16 ) float entry[kPacketSize];
+    unsigned int        mask = 0;
+    for ( unsigned int base = 0; base < kPacketSize; base += 4 )
+    {
+        __m128 ox = _mm_load_ps( p.ox + base );
+        __m128 oy = _mm_load_ps( p.oy + base );
+        __m128 oz = _mm_load_ps( p.oz + base );
+        __m128 ix = _mm_load_ps( p.ix + base );
+        __m128 iy = _mm_load_ps( p.iy + base );
+        __m128 iz = _mm_load_ps( p.iz + base );
+
+        __m128 t0x = slabSSE( box.min()[0], ox, ix );
+        __m128 t1x = slabSSE( box.max()[0], ox, ix );
+        __m128 t0y = slabSSE( box.min()[1], oy, iy );
+        __m128 t1y = slabSSE( box.max()[1], oy, iy );
+        __m128 t0z = slabSSE( box.min()[2], oz, iz );
+        __m128 t1z = slabSSE( box.max()[2], oz, iz );
+
+        __m128 tmax = _mm_load_ps( p.tmax + base );
+        __m128 tn   = _mm_max_ps(
+            _mm_max_ps( _mm_min_ps( t0x, t1x ), _mm_min_ps( t0y, t1y ) ),
+            _mm_max_ps( _mm_min_ps( t0z, t1z ), _mm_setzero_ps() ) );
+        __m128 tf = _mm_min_ps(
+            _mm_min_ps( _mm_max_ps( t0x, t1x ), _mm_max_ps( t0y, t1y ) ),
+            _mm_min_ps( _mm_max_ps( t0z, t1z ), tmax ) );
+
+        tf = _mm_mul_ps( tf, _mm_set1_ps( bbox<float>::kExitScale ) );
+        mask |= _mm_movemask_ps( _mm_cmple_ps( tn, tf ) ) << base;
+        _mm_store_ps( entry + base, tn );
+    }
+
+    mask &= p.active;
+    tnear = std::numeric_limits<float>::max();
+    for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+        if ( mask & ( 1u << lane ) )
+            tnear = entry[lane] < tnear ? entry[lane] : tnear;
+    return mask;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline void shearSSE( const vec3<float> &v,
+                      unsigned int        kx,
+                      unsigned int        ky,
+                      unsigned int        kz,
+                      const __m128 *      o,
+                      __m128              sx,
+                      __m128              sy,
+                      __m128 *            out ) noexcept
+{
+    out[2] = _mm_sub_ps( _mm_set1_ps( v[kz] ), o[kz] );
+    out[0] = _mm_sub_ps( _mm_sub_ps( _mm_set1_ps( v[kx] ), o[kx] ),
+                         _mm_mul_ps( sx, out[2] ) );
+    out[1] = _mm_sub_ps( _mm_sub_ps( _mm_set1_ps( v[ky] ), o[ky] ),
+                         _mm_mul_ps( sy, out[2] ) );
+}
+
+// -----------------------------------------------------------------------------
+// needs every lane sheared onto the same axis, the renderer's packets of
+// neighbouring pixels nearly always are. lanes whose edge functions round to
+// 0 are redone by the scalar kernel, which resolves their signs exactly
+// -----------------------------------------------------------------------------
+inline unsigned int intersectTriangleSSE( const vec3<float> &      v0,
+                                          const vec3<float> &      v1,
+                                          const vec3<float> &      v2,
+                                          const raypacket<float> &p,
+                                          unsigned int             mask,
+                                          float *                  t ) noexcept
+{
+    if ( p.axes & ( p.axes - 1 ) )
+        return packetscalar<float>::intersectTriangle(
+            v0, v1, v2, p, mask, t );
+
+    const __m128 zero = _mm_setzero_ps();
+    unsigned int kz   = p.axes == 1 ? 0 : p.axes == 2 ? 1 : 2;
+    unsigned int kx   = kz == 2 ? 0 : kz + 1;
+    unsigned int ky   = kx == 2 ? 0 : kx + 1;
+
+    unsigned int hits = 0, exact = 0;
+    for ( unsigned int base = 0; base < kPacketSize; base += 4 )
+    {
+        if ( !( ( mask >> base ) & 0xf ) )
+            continue;
+
+        __m128 o[3] = {_mm_load_ps( p.ox + base ),
+                       _mm_load_ps( p.oy + base ),
+                       _mm_load_ps( p.oz + base )};
+        __m128 sx   = _mm_load_ps( p.sx + base );
+        __m128 sy   = _mm_load_ps( p.sy + base );
+        __m128 sz   = _mm_load_ps( p.sz + base );
+
+        __m128 a[3], b[3], c[3];
+        shearSSE( v0, kx, ky, kz, o, sx, sy, a );
+        shearSSE( v1, kx, ky, kz, o, sx, sy, b );
+        shearSSE( v2, kx, ky, kz, o, sx, sy, c );
+
+        // edge functions, all of one sign inside the triangle
+        __m128 u = _mm_sub_ps( _mm_mul_ps( c[0], b[1] ),
+                               _mm_mul_ps( c[1], b[0] ) );
+        __m128 v = _mm_sub_ps( _mm_mul_ps( a[0], c[1] ),
+                               _mm_mul_ps( a[1], c[0] ) );
+        __m128 w = _mm_sub_ps( _mm_mul_ps( b[0], a[1] ),
+                               _mm_mul_ps( b[1], a[0] ) );
+
+        __m128 zeros = _mm_or_ps(
+            _mm_or_ps( _mm_cmpeq_ps( u, zero ), _mm_cmpeq_ps( v, zero ) ),
+            _mm_cmpeq_ps( w, zero ) );
+        __m128 neg = _mm_or_ps(
+            _mm_or_ps( _mm_cmplt_ps( u, zero ), _mm_cmplt_ps( v, zero ) ),
+            _mm_cmplt_ps( w, zero ) );
+        __m128 pos = _mm_or_ps(
+            _mm_or_ps( _mm_cmpgt_ps( u, zero ), _mm_cmpgt_ps( v, zero ) ),
+            _mm_cmpgt_ps( w, zero ) );
+        __m128 det   = _mm_add_ps( _mm_add_ps( u, v ), w );
+        __m128 valid = _mm_andnot_ps( _mm_and_ps( neg, pos ),
+                                      _mm_cmpneq_ps( det, zero ) );
+
+        // t = ( u az + v bz + w cz ) / det
+        __m128 tu   = _mm_mul_ps( u, _mm_mul_ps( sz, a[2] ) );
+        __m128 tv   = _mm_mul_ps( v, _mm_mul_ps( sz, b[2] ) );
+        __m128 tw   = _mm_mul_ps( w, _mm_mul_ps( sz, c[2] ) );
+        __m128 dist = _mm_div_ps( _mm_add_ps( _mm_add_ps( tu, tv ), tw ), det );
+        __m128 tmax = _mm_load_ps( p.tmax + base );
+        valid       = _mm_and_ps( valid, _mm_cmpgt_ps( dist, zero ) );
+        valid       = _mm_and_ps( valid, _mm_cmplt_ps( dist, tmax ) );
+
+        unsigned int lanes    = mask & ( 0xfu << base );
+        unsigned int redo     = ( _mm_movemask_ps( zeros ) << base ) & lanes;
+        unsigned int laneHits = ( _mm_movemask_ps( valid ) << base ) & lanes;
+        laneHits &= ~redo;
+        exact |= redo;
+        if ( laneHits )
+        {
+            alignas( 16 ) float d[4];
+            _mm_store_ps( d, dist );
+            for ( unsigned int ii = 0; ii < 4; ++ii )
+                if ( laneHits & ( 1u << ( base + ii ) ) )
+                    t[base + ii] = d[ii];
+            hits |= laneHits;
+        }
+    }
+
+    if ( exact )
+        hits |= packetscalar<float>::intersectTriangle(
+            v0, v1, v2, p, exact, t );
+    return hits;
+}
+
+// -----------------------------------------------------------------------------
+// avx2 versions, all 8 lanes at once
+// -----------------------------------------------------------------------------
+PT_TARGET_AVX2 inline __m256 slabAVX2( float bound, __m256 o, __m256 inv )
+{
+    return _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( bound ), o ), inv );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+PT_TARGET_AVX2 inline unsigned int
+intersectBoxAVX2( const bbox<float> &      box,
+                  const raypacket<float> &p,
+                  float &                  tnear ) noexcept
+{
+    __m256 ox = _mm256_load_ps( p.ox );
+    __m256 oy = _mm256_load_ps( p.oy );
+    __m256 oz = _mm256_load_ps( p.oz );
+    __m256 ix = _mm256_load_ps( p.ix );
+    __m256 iy = _mm256_load_ps( p.iy );
+    __m256 iz = _mm256_load_ps( p.iz );
+
+    __m256 t0x = slabAVX2( box.min()[0], ox, ix );
+    __m256 t1x = slabAVX2( box.max()[0], ox, ix );
+    __m256 t0y = slabAVX2( box.min()[1], oy, iy );
+    __m256 t1y = slabAVX2( box.max()[1], oy, iy );
+    __m256 t0z = slabAVX2( box.min()[2], oz, iz );
+    __m256 t1z = slabAVX2( box.max()[2], oz, iz );
+
+    __m256 tmax = _mm256_load_ps( p.tmax );
+    __m256 tn   = _mm256_max_ps(
+        _mm256_max_ps( _mm256_min_ps( t0x, t1x ), _mm256_min_ps( t0y, t1y ) ),
+        _mm256_max_ps( _mm256_min_ps( t0z, t1z ), _mm256_setzero_ps() ) );
+    __m256 tf = _mm256_min_ps(
+        _mm256_min_ps( _mm256_max_ps( t0x, t1x ), _mm256_max_ps( t0y, t1y ) ),
+        _mm256_min_ps( _mm256_max_ps( t0z, t1z ), tmax ) );
+
+    tf = _mm256_mul_ps( tf, _mm256_set1_ps( bbox<float>::kExitScale ) );
+    __m256       overlap = _mm256_cmp_ps( tn, tf, _CMP_LE_OQ );
+    unsigned int mask    = _mm256_movemask_ps( overlap ) & p.active;
+
+    alignas( 32 ) float entry[kPacketSize];
+    _mm256_store_ps( entry, tn );
+    tnear = std::numeric_limits<float>::max();
+    for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+        if ( mask & ( 1u << lane ) )
+            tnear = entry[lane] < tnear ? entry[lane] : tnear;
+    return mask;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+PT_TARGET_AVX2 inline void shearAVX2( const vec3<float> &v,
+                                     unsigned int        kx,
+                                     unsigned int        ky,
+                                     unsigned int        kz,
+                                     const __m256 *      o,
+                                     __m256              sx,
+                                     __m256              sy,
+                                     __m256 *            out )
+{
+    out[2] = _mm256_sub_ps( _mm256_set1_ps( v[kz] ), o[kz] );
+    out[0] = _mm256_sub_ps( _mm256_sub_ps( _mm256_set1_ps( v[kx] ), o[kx] ),
+                            _mm256_mul_ps( sx, out[2] ) );
+    out[1] = _mm256_sub_ps( _mm256_sub_ps( _mm256_set1_ps( v[ky] ), o[ky] ),
+                            _mm256_mul_ps( sy, out[2] ) );
+}
+
+// -----------------------------------------------------------------------------
+// same scheme as intersectTriangleSSE
+// -----------------------------------------------------------------------------
+PT_TARGET_AVX2 inline unsigned int
+intersectTriangleAVX2( const vec3<float> &      v0,
+                       const vec3<float> &      v1,
+                       const vec3<float> &      v2,
+                       const raypacket<float> &p,
+                       unsigned int             mask,
+                       float *                  t ) noexcept
+{
+    if ( p.axes & ( p.axes - 1 ) )
+        return packetscalar<float>::intersectTriangle(
+            v0, v1, v2, p, mask, t );
+
+    const __m256 zero = _mm256_setzero_ps();
+    unsigned int kz   = p.axes == 1 ? 0 : p.axes == 2 ? 1 : 2;
+    unsigned int kx   = kz == 2 ? 0 : kz + 1;
+    unsigned int ky   = kx == 2 ? 0 : kx + 1;
+
+    __m256 o[3] = {
+        _mm256_load_ps( p.ox ), _mm256_load_ps( p.oy ), _mm256_load_ps( p.oz )};
+    __m256 sx = _mm256_load_ps( p.sx );
+    __m256 sy = _mm256_load_ps( p.sy );
+    __m256 sz = _mm256_load_ps( p.sz );
+
+    __m256 a[3], b[3], c[3];
+    shearAVX2( v0, kx, ky, kz, o, sx, sy, a );
+    shearAVX2( v1, kx, ky, kz, o, sx, sy, b );
+    shearAVX2( v2, kx, ky, kz, o, sx, sy, c );
+
+    // edge functions, all of one sign inside the triangle
+    __m256 u = _mm256_sub_ps( _mm256_mul_ps( c[0], b[1] ),
+                              _mm256_mul_ps( c[1], b[0] ) );
+    __m256 v = _mm256_sub_ps( _mm256_mul_ps( a[0], c[1] ),
+                              _mm256_mul_ps( a[1], c[0] ) );
+    __m256 w = _mm256_sub_ps( _mm256_mul_ps( b[0], a[1] ),
+                              _mm256_mul_ps( b[1], a[0] ) );
+
+    __m256 zeros =
+        _mm256_or_ps( _mm256_or_ps( _mm256_cmp_ps( u, zero, _CMP_EQ_OQ ),
+                                    _mm256_cmp_ps( v, zero, _CMP_EQ_OQ ) ),
+                      _mm256_cmp_ps( w, zero, _CMP_EQ_OQ ) );
+    __m256 neg =
+        _mm256_or_ps( _mm256_or_ps( _mm256_cmp_ps( u, zero, _CMP_LT_OQ ),
+                                    _mm256_cmp_ps( v, zero, _CMP_LT_OQ ) ),
+                      _mm256_cmp_ps( w, zero, _CMP_LT_OQ ) );
+    __m256 pos =
+        _mm256_or_ps( _mm256_or_ps( _mm256_cmp_ps( u, zero, _CMP_GT_OQ ),
+                                    _mm256_cmp_ps( v, zero, _CMP_GT_OQ ) ),
+                      _mm256_cmp_ps( w, zero, _CMP_GT_OQ ) );
+    __m256 det   = _mm256_add_ps( _mm256_add_ps( u, v ), w );
+    __m256 valid = _mm256_andnot_ps(
+        _mm256_and_ps( neg, pos ), _mm256_cmp_ps( det, zero, _CMP_NEQ_UQ ) );
+
+    // t = ( u az + v bz + w cz ) / det
+    __m256 tu   = _mm256_mul_ps( u, _mm256_mul_ps( sz, a[2] ) );
+    __m256 tv   = _mm256_mul_ps( v, _mm256_mul_ps( sz, b[2] ) );
+    __m256 tw   = _mm256_mul_ps( w, _mm256_mul_ps( sz, c[2] ) );
+    __m256 dist =
+        _mm256_div_ps( _mm256_add_ps( _mm256_add_ps( tu, tv ), tw ), det );
+    __m256 tmax = _mm256_load_ps( p.tmax );
+    valid = _mm256_and_ps( valid, _mm256_cmp_ps( dist, zero, _CMP_GT_OQ ) );
+    valid = _mm256_and_ps( valid, _mm256_cmp_ps( dist, tmax, _CMP_LT_OQ ) );
+
+    unsigned int redo = _mm256_movemask_ps( zeros ) & mask;
+    unsigned int hits = _mm256_movemask_ps( valid ) & mask & ~redo;
+    if ( hits )
+    {
+        alignas( 32 ) float d[kPacketSize];
+        _mm256_store_ps( d, dist );
+        for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+            if ( hits & ( 1u << lane ) )
+                t[lane] = d[lane];
+    }
+
+    if ( redo )
+        hits |= packetscalar<float>::intersectTriangle(
+            v0, v1, v2, p, redo, t );
+    return hits;
+}
+
+#endif // PT_X86
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline const char *packetops<float>::isa() noexcept
+{
+#if PT_X86
+    return CpuFeatures::get().avx2() ? "avx2" : "sse2";
+#else
+    return packetscalar<float>::isa();
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline unsigned int
+packetops<float>::intersectBox( const bbox<float> &      box,
+                                const raypacket<float> &p,
+                                float &                  tnear ) noexcept
+{
+#if PT_X86
+    static const bool avx2 = CpuFeatures::get().avx2();
+    if ( avx2 )
+        return intersectBoxAVX2( box, p, tnear );
+    return intersectBoxSSE( box, p, tnear );
+#else
+    return packetscalar<float>::intersectBox( box, p, tnear );
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline unsigned int
+packetops<float>::intersectTriangle( const vec3<float> &      v0,
+                                     const vec3<float> &      v1,
+                                     const vec3<float> &      v2,
+                                     const raypacket<float> &p,
+                                     unsigned int             mask,
+                                     float *                  t ) noexcept
+{
+#if PT_X86
+    static const bool avx2 = CpuFeatures::get().avx2();
+    if ( avx2 )
+        return intersectTriangleAVX2( v0, v1, v2, p, mask, t );
+    return intersectTriangleSSE( v0, v1, v2, p, mask, t );
+#else
+    return packetscalar<float>::intersectTriangle( v0, v1, v2, p, mask, t );
+#endif
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include "boundingbox.h"
+#include "ray.h"
+#include "triangle.h"
+#include "util/cpu.h"
+
+template <typename T>
+class primitive;
+
+// rays are traced in packets of 8 lanes, one avx register of floats
+constexpr unsigned int kPacketSize = 8;
+
+// -----------------------------------------------------------------------------
+// structure of arrays ray packet with precomputed reciprocal directions and
+// triangle test shears. tmax shrinks lane by lane while the packet is traced,
+// active holds one bit per lane that still takes part
+// -----------------------------------------------------------------------------
+template <typename T>
+struct alignas( 32 ) raypacket
+{
+    T ox[kPacketSize] = {}, oy[kPacketSize] = {}, oz[kPacketSize] = {};
+    T dx[kPacketSize] = {}, dy[kPacketSize] = {}, dz[kPacketSize] = {};
+    T ix[kPacketSize] = {}, iy[kPacketSize] = {}, iz[kPacketSize] = {};
+    T tmax[kPacketSize] = {};
+
+    // shearedray of every lane, axes has bit kz set for the kz of every lane
+    T sx[kPacketSize] = {}, sy[kPacketSize] = {}, sz[kPacketSize] = {};
+
+    unsigned int kz[kPacketSize] = {};
+    unsigned int axes            = 0;
+
+    unsigned int active = 0;
+
+    void set( unsigned int lane, const ray<T> &r ) noexcept
+    {
+        ox[lane]   = r.o[0];
+        oy[lane]   = r.o[1];
+        oz[lane]   = r.o[2];
+        dx[lane]   = r.d[0];
+        dy[lane]   = r.d[1];
+        dz[lane]   = r.d[2];
+        ix[lane]   = T( 1 ) / r.d[0];
+        iy[lane]   = T( 1 ) / r.d[1];
+        iz[lane]   = T( 1 ) / r.d[2];
+        tmax[lane] = r.tmax;
+
+        shearedray<T> s( r );
+        sx[lane] = s.sx;
+        sy[lane] = s.sy;
+        sz[lane] = s.sz;
+        kz[lane] = s.kz;
+        axes |= 1u << s.kz;
+        active |= 1u << lane;
+    }
+
+    shearedray<T> shear( unsigned int lane ) const noexcept
+    {
+        shearedray<T> s;
+        s.o  = {ox[lane], oy[lane], oz[lane]};
+        s.kz = kz[lane];
+        s.kx = s.kz == 2 ? 0 : s.kz + 1;
+        s.ky = s.kx == 2 ? 0 : s.kx + 1;
+        s.sx = sx[lane];
+        s.sy = sy[lane];
+        s.sz = sz[lane];
+        return s;
+    }
+
+    ray<T> get( unsigned int lane ) const noexcept
+    {
+        ray<T> r( {ox[lane], oy[lane], oz[lane]},
+                  {dx[lane], dy[lane], dz[lane]} );
+        r.tmax = tmax[lane];
+        return r;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// closest hit of every lane. only the distance, the primitive and the element
+// within it (the triangle of a mesh) are recorded, position, normal and
+// material are resolved afterwards for the lanes that need them
+// -----------------------------------------------------------------------------
+template <typename T>
+struct packethit
+{
+    T                   t[kPacketSize];
+    unsigned int        element[kPacketSize];
+    const primitive<T> *object[kPacketSize];
+    unsigned int        mask = 0; // lanes with a hit
+};
+
+// -----------------------------------------------------------------------------
+// portable lane by lane kernels, the reference for the simd versions
+// -----------------------------------------------------------------------------
+template <typename T>
+struct packetscalar
+{
+    static const char *isa() noexcept { return "scalar"; }
+
+    // returns the active lanes whose ray overlaps the box within their tmax,
+    // tnear receives the smallest entry distance among them
+    static unsigned int intersectBox( const bbox<T> &      box,
+                                      const raypacket<T> &p,
+                                      T &                  tnear ) noexcept;
+
+    // watertight test against one triangle for the lanes in mask, see
+    // intersectTriangle in triangle.h. returns the lanes that hit it closer
+    // than their tmax, t receives the distances
+    static unsigned int intersectTriangle( const vec3<T> &      v0,
+                                           const vec3<T> &      v1,
+                                           const vec3<T> &      v2,
+                                           const raypacket<T> &p,
+                                           unsigned int         mask,
+                                           T *                  t ) noexcept;
+};
+
+// -----------------------------------------------------------------------------
+// kernels used for tracing, picks simd implementations where they exist
+// -----------------------------------------------------------------------------
+template <typename T>
+struct packetops : packetscalar<T>
+{
+};
+
+template <>
+struct packetops<float>
+{
+    static const char *isa() noexcept;
+
+    static unsigned int intersectBox( const bbox<float> &      box,
+                                      const raypacket<float> &p,
+                                      float &                  tnear ) noexcept;
+
+    static unsigned int intersectTriangle( const vec3<float> &      v0,
+                                           const vec3<float> &      v1,
+                                           const vec3<float> &      v2,
+                                           const raypacket<float> &p,
+                                           unsigned int             mask,
+                                           float *                  t ) noexcept;
+};
+
+#include "packet.cc"
@@ -5,11 +5,18 @@
 #include "sphere.h"
 #include "vec3.h"
 #include "renderer.h"
+#include "denoiser.h"
+#include "scenes.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <random>
-#include "renderer.h"
+#include <vector>
 
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
@@ -24,7 +31,7 @@
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-using FLOAT = double;
+using FLOAT = float;
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -34,102 +41,425 @@ using hitf   = hit<FLOAT>;
 using scenef = scene<FLOAT>;
 using meshf  = mesh<FLOAT>;
 
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-static void buildCornellBoxScene( scenef &world )
-{
-    material redDiffuse{{1.0f, 0.0f, 0.0f, 1.0f}};
-    material blueDiffuse{{1.0f, 0.0f, 1.0f, 1.0f}};
-    material greenDiffuse{{1.0f, 1.0f, 0.0f, 1.0f}};
-    material whiteEmissive{{1.0f, 1.0f, 1.0f, 1.0f}};
-    whiteEmissive.setEmissive( 50.0f );
-
-    auto cornellbox = new meshf( "/home/nebula/code/path_tracer/cornellbox.obj" );
-    cornellbox->transform(mat44<FLOAT>::makeRotation(90, 2));
-    world
-        << new sphere<FLOAT>( {0.4f, 0.0f, -0.6f}, 0.75f * 0.5f, redDiffuse )
-        << new sphere<FLOAT>( {-0.4f, 0.5f, -0.6f}, 0.75f * 0.5f, blueDiffuse )
-        << new sphere<FLOAT>(
-               {-0.4f, -0.5f, -0.6f}, 0.75f * 0.5f, greenDiffuse )
-        << new sphere<FLOAT>( {0.0f, 0.0f, 1.25f}, 0.75f * 0.5f, whiteEmissive )
-        << cornellbox;
-}
-
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 class RenderResult
 {
 public:
-    RenderResult( int width, int height ) : p_width( width ), p_height( height )
+    // dirty regions are tracked in the renderer's tiles, converged tiles
+    // stay as they are from one pass to the next
+    static constexpr unsigned int kTileSize = renderer<FLOAT>::kTileSize;
+
+    // the film as rendered and its denoised version, which is left empty
+    // while denoising is off. tileVersions holds the version at which each
+    // tile of image last changed, in row major order
+    struct Snapshot
+    {
+        int                        width   = 0;
+        int                        height  = 0;
+        unsigned int               version = 0;
+        std::vector<unsigned int>  tileVersions;
+        std::vector<unsigned char> image;
+        std::vector<unsigned char> denoised;
+    };
+
+    // render thread: resolves the film into the back buffer and publishes it.
+    // the denoiser runs if the gui asks for it, and always on the final film
+    // so that it can be toggled once rendering is done
+    void Publish( const film &f, bool final = false )
+    {
+        Snapshot &snapshot = p_snapshots.back();
+        snapshot.width     = static_cast<int>( f.width() );
+        snapshot.height    = static_cast<int>( f.height() );
+        f.resolve( snapshot.image );
+        MarkChanged( snapshot );
+        snapshot.denoised.clear();
+        if ( final || p_denoise.load( std::memory_order_relaxed ) )
+        {
+            p_denoiser.run( f, p_filtered );
+            p_filtered.resolve( snapshot.denoised );
+        }
+        p_snapshots.publish();
+    }
+
+    // gui thread: picks up the latest published snapshot, false if none
+    bool Update() { return p_snapshots.update(); }
+    const Snapshot &Front() const { return p_snapshots.front(); }
+
+    // whether ImageBuffer() is the denoised image
+    bool ShowsDenoised() const
     {
+        return Denoise() && !p_snapshots.front().denoised.empty();
     }
 
-    std::vector<unsigned char> &ImageBuffer() { return p_imgBuffer; }
     const std::vector<unsigned char> &ImageBuffer() const
     {
-        return p_imgBuffer;
+        const Snapshot &snapshot = p_snapshots.front();
+        return ShowsDenoised() ? snapshot.denoised : snapshot.image;
+    }
+
+    bool Denoise() const { return p_denoise.load( std::memory_order_relaxed ); }
+    void SetDenoise( bool denoise )
+    {
+        p_denoise.store( denoise, std::memory_order_relaxed );
     }
 
-    int Width() const { return p_width; }
-    int Height() const { return p_height; }
+    // of the snapshot picked up last, parameters may change between frames
+    int Width() const { return p_snapshots.front().width; }
+    int Height() const { return p_snapshots.front().height; }
 
 private:
-    std::vector<unsigned char> p_imgBuffer;
-    int                        p_width  = 0;
-    int                        p_height = 0;
+    // compares the image with the one published before, tile by tile. the
+    // versions keep counting across snapshots, so that the gui finds what
+    // changed since its last upload even when it skipped snapshots
+    void MarkChanged( Snapshot &snapshot )
+    {
+        unsigned int width   = static_cast<unsigned int>( snapshot.width );
+        unsigned int height  = static_cast<unsigned int>( snapshot.height );
+        unsigned int tilesX  = ( width + kTileSize - 1 ) / kTileSize;
+        unsigned int tilesY  = ( height + kTileSize - 1 ) / kTileSize;
+        bool         resized = p_previous.size() != snapshot.image.size() ||
+                       p_tileVersions.size() != tilesX * tilesY;
+
+        ++p_version;
+        p_tileVersions.resize( tilesX * tilesY );
+        for ( unsigned int tile = 0; tile < tilesX * tilesY; ++tile )
+        {
+            unsigned int x0 = ( tile % tilesX ) * kTileSize;
+            unsigned int y0 = ( tile / tilesX ) * kTileSize;
+            unsigned int x1 = std::min( x0 + kTileSize, width );
+            unsigned int y1 = std::min( y0 + kTileSize, height );
+
+            bool changed = resized;
+            for ( unsigned int y = y0; y < y1 && !changed; ++y )
+            {
+                std::size_t offset = 4 * ( std::size_t( y ) * width + x0 );
+                changed = memcmp( snapshot.image.data() + offset,
+                                  p_previous.data() + offset,
+                                  4 * ( x1 - x0 ) ) != 0;
+            }
+            if ( changed )
+                p_tileVersions[tile] = p_version;
+        }
+
+        p_previous            = snapshot.image;
+        snapshot.version      = p_version;
+        snapshot.tileVersions = p_tileVersions;
+    }
+
+    TripleBuffer<Snapshot>     p_snapshots;
+    std::atomic<bool>          p_denoise{ true };
+    denoiser                   p_denoiser;
+    film                       p_filtered;
+    std::vector<unsigned char> p_previous;
+    std::vector<unsigned int>  p_tileVersions;
+    unsigned int               p_version = 0;
 };
 
 // -----------------------------------------------------------------------------
+// renders frames on a thread of its own until stopped. Restart() drops the
+// frame in progress and starts over with another camera or other parameters,
+// the coarse previews of the new frame arrive within the first passes. a
+// finished frame waits for the next restart
 // -----------------------------------------------------------------------------
 class RenderJob
 {
 public:
     RenderJob( const renderparams &params, RenderResult &result )
-        : rp( params ), renderDevice( cam, rp ), renderResult( result )
+        : rp( params ), cam( buildCornellBoxScene( world ) ),
+          renderDevice( cam, rp ), renderResult( result )
     {
-        buildCornellBoxScene( world );
     }
 
-    void do_it() { renderDevice.render( world, renderResult.ImageBuffer() ); }
+    void do_it()
+    {
+        while ( true )
+        {
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                if ( quit )
+                    return;
+
+                // the renderer refers to cam and rp, between frames nothing
+                // reads them
+                if ( restart )
+                {
+                    cam     = pendingCam;
+                    rp      = pendingParams;
+                    restart = false;
+                }
+                cancel.Reset();
+            }
+
+            bool done = renderDevice.render(
+                world,
+                accumulation,
+                [this]( const film &f ) { renderResult.Publish( f ); },
+                {},
+                &cancel );
+            if ( !done )
+                continue;
+
+            renderResult.Publish( accumulation, true );
+            accumulation.writeppm( "render.ppm" );
+
+            std::unique_lock<std::mutex> lock( mutex );
+            wakeup.wait( lock, [this]() { return quit || restart; } );
+        }
+    }
+
+    // any thread: the next frame renders with c and params
+    void Restart( const camera<FLOAT> &c, const renderparams &params )
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        pendingCam    = c;
+        pendingParams = params;
+        restart       = true;
+        cancel.Cancel();
+        wakeup.notify_one();
+    }
+
+    // any thread: ends the frame in progress, do_it() returns soon after
+    void Stop()
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        quit = true;
+        cancel.Cancel();
+        wakeup.notify_one();
+    }
+
+    // before the thread starts, the camera of the scene
+    const camera<FLOAT> &GetCamera() const { return cam; }
 
     const RenderResult &GetResult() const { return renderResult; }
 
     void operator()() { do_it(); }
 
 private:
-    renderparams  rp{ 256, 256, 4, 32 };
-    camera<FLOAT> cam{ { 2.472f, 0, 0 }, { 0, 0, 0 }, 60 };
+    renderparams  rp{ 256, 256, 8, 32 };
     scenef        world;
+    camera<FLOAT> cam;
 
     renderer<FLOAT> renderDevice;
+    film            accumulation;
     RenderResult   &renderResult;
+
+    // requests of the gui thread, cancel is set under the mutex so that a
+    // frame never starts with a request it has not taken
+    std::mutex              mutex;
+    std::condition_variable wakeup;
+    CancelToken             cancel;
+    camera<FLOAT>           pendingCam = cam;
+    renderparams            pendingParams;
+    bool                    restart = false;
+    bool                    quit    = false;
 };
 
 // -----------------------------------------------------------------------------
+// a texture that lives as long as the image keeps its size. each update
+// copies only the tiles that changed since the last one into the next of a
+// ring of pixel buffer objects, from which glTexSubImage2D reads them
+// without the cpu waiting for the transfer. the texture is drawn from the
+// buffer written kBuffers updates earlier at the latest, so writing the
+// next one does not stall on it either
 // -----------------------------------------------------------------------------
-static GLuint CreateTexture(const RenderResult &result )
+class TextureStream
 {
-    GLuint textureID = 0u;
-    glGenTextures( 1, &textureID );
-    glBindTexture( GL_TEXTURE_2D, textureID );
-
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP );
-
-    glTexImage2D( GL_TEXTURE_2D,
-                  0,
-                  GL_RGBA8,
-                  result.Width(),
-                  result.Height(),
-                  0,
-                  GL_RGBA,
-                  GL_UNSIGNED_BYTE,
-                  result.ImageBuffer().data() );
-    glBindTexture( GL_TEXTURE_2D, 0 );
-    return textureID;
-}
+public:
+    static constexpr unsigned int kBuffers = 3;
+
+    TextureStream() = default;
+    TextureStream( const TextureStream & ) = delete;
+    TextureStream &operator=( const TextureStream & ) = delete;
+
+    GLuint Texture() const { return p_texture; }
+
+    // gui thread, with the context current: brings the texture up to date
+    // with the snapshot the result picked up last
+    void Upload( const RenderResult &result )
+    {
+        const RenderResult::Snapshot &snapshot = result.Front();
+        if ( snapshot.width <= 0 || snapshot.height <= 0 )
+            return;
+
+        if ( snapshot.width != p_width || snapshot.height != p_height )
+            Resize( snapshot.width, snapshot.height );
+
+        // the denoiser changes every pixel, its image goes up whole
+        bool denoised = result.ShowsDenoised();
+        bool full     = p_full || denoised || denoised != p_denoised;
+
+        // dirty tiles, runs of them along a row of tiles go up together
+        const unsigned int tileSize = RenderResult::kTileSize;
+        const unsigned int tilesX   = ( p_width + tileSize - 1 ) / tileSize;
+        const unsigned int tilesY   = ( p_height + tileSize - 1 ) / tileSize;
+        p_regions.clear();
+        for ( unsigned int ty = 0; ty < tilesY; ++ty )
+        {
+            for ( unsigned int tx = 0; tx < tilesX; )
+            {
+                auto dirty = [&]( unsigned int x ) {
+                    return full || snapshot.tileVersions[ty * tilesX + x] >
+                                       p_version;
+                };
+                if ( !dirty( tx ) )
+                {
+                    ++tx;
+                    continue;
+                }
+
+                unsigned int end = tx + 1;
+                while ( end < tilesX && dirty( end ) )
+                    ++end;
+
+                Region region;
+                region.x      = tx * tileSize;
+                region.y      = ty * tileSize;
+                region.width =
+                    std::min( end * tileSize, unsigned( p_width ) ) - region.x;
+                region.height =
+                    std::min( region.y + tileSize, unsigned( p_height ) ) -
+                    region.y;
+                p_regions.push_back( region );
+                tx = end;
+            }
+        }
+
+        p_version  = snapshot.version;
+        p_denoised = denoised;
+        p_full     = false;
+        if ( p_regions.empty() )
+            return;
+
+        // the buffer mirrors the layout of the image, only the dirty regions
+        // are written. invalidating it lets the driver hand out fresh memory
+        // if the gpu still reads the previous contents
+        const std::vector<unsigned char> &image = result.ImageBuffer();
+        GLsizeiptr size = GLsizeiptr( 4 ) * p_width * p_height;
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, p_buffers[p_next] );
+        p_next = ( p_next + 1 ) % kBuffers;
+        auto mapped = static_cast<unsigned char *>( glMapBufferRange(
+            GL_PIXEL_UNPACK_BUFFER,
+            0,
+            size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT ) );
+        if ( !mapped )
+        {
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+            p_full = true;
+            return;
+        }
+
+        for ( const Region &region : p_regions )
+        {
+            for ( unsigned int y = region.y; y < region.y + region.height; ++y )
+            {
+                std::size_t offset =
+                    4 * ( std::size_t( y ) * p_width + region.x );
+                memcpy(
+                    mapped + offset, image.data() + offset, 4 * region.width );
+            }
+        }
+
+        // the contents are undefined if the buffer was lost while mapped,
+        // the next update then sends everything again
+        if ( glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER ) != GL_TRUE )
+        {
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+            p_full = true;
+            return;
+        }
+
+        glBindTexture( GL_TEXTURE_2D, p_texture );
+        glPixelStorei( GL_UNPACK_ROW_LENGTH, p_width );
+        for ( const Region &region : p_regions )
+        {
+            std::size_t offset = 4 * ( std::size_t( region.y ) * p_width +
+                                       region.x );
+            glTexSubImage2D( GL_TEXTURE_2D,
+                             0,
+                             GLint( region.x ),
+                             GLint( region.y ),
+                             GLsizei( region.width ),
+                             GLsizei( region.height ),
+                             GL_RGBA,
+                             GL_UNSIGNED_BYTE,
+                             reinterpret_cast<const void *>( offset ) );
+        }
+        glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+        glBindTexture( GL_TEXTURE_2D, 0 );
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    }
+
+    // with the context current, before it goes away
+    void Release()
+    {
+        if ( p_texture != 0 )
+        {
+            glDeleteTextures( 1, &p_texture );
+            glDeleteBuffers( kBuffers, p_buffers );
+        }
+        p_texture = 0;
+        p_width   = 0;
+        p_height  = 0;
+    }
+
+private:
+    struct Region
+    {
+        unsigned int x, y, width, height;
+    };
+
+    // storage for the texture and the buffers, the first upload after it
+    // sends the whole image
+    void Resize( int width, int height )
+    {
+        if ( p_texture == 0 )
+        {
+            glGenTextures( 1, &p_texture );
+            glGenBuffers( kBuffers, p_buffers );
+        }
+
+        glBindTexture( GL_TEXTURE_2D, p_texture );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+        glTexImage2D( GL_TEXTURE_2D,
+                      0,
+                      GL_RGBA8,
+                      width,
+                      height,
+                      0,
+                      GL_RGBA,
+                      GL_UNSIGNED_BYTE,
+                      nullptr );
+        glBindTexture( GL_TEXTURE_2D, 0 );
+
+        GLsizeiptr size = GLsizeiptr( 4 ) * width * height;
+        for ( GLuint buffer : p_buffers )
+        {
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, buffer );
+            glBufferData(
+                GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW );
+        }
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+        p_width  = width;
+        p_height = height;
+        p_full   = true;
+    }
+
+    GLuint              p_texture           = 0;
+    GLuint              p_buffers[kBuffers] = {};
+    unsigned int        p_next              = 0;
+    int                 p_width             = 0;
+    int                 p_height            = 0;
+    unsigned int        p_version           = 0; // of the last upload
+    bool                p_denoised          = false;
+    bool                p_full              = true;
+    std::vector<Region> p_regions;
+};
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -213,29 +543,32 @@ int main()
     // io.Fonts->AddFontFromFileTTF("c:\\Windows\\Fonts\\ArialUni.ttf", 18.0f,
     // NULL, io.Fonts->GetGlyphRangesJapanese()); IM_ASSERT(font != NULL);
 
-    GLuint textureID = 0;
+    TextureStream texture;
 
-    double updateTime = 0.0f;
+    // previews at 1/8, 1/4 and 1/2 of the resolution come first
+    renderparams rp{ 256, 256, 8, 32 };
+    rp._previewLevels = 3;
+    RenderResult result;
+    RenderJob    job( rp, result );
 
-    renderparams rp{ 256, 256, 4, 32 };
-    RenderResult result( rp.width(), rp.height() );
-    std::thread  renderThread( RenderJob( rp, result ) );
+    camera<FLOAT> cam = job.GetCamera();
+    float         eye[3] = { float( cam.position()[0] ),
+                             float( cam.position()[1] ),
+                             float( cam.position()[2] ) };
+    int           samples = static_cast<int>( rp.numSamples() );
 
+    std::thread renderThread( std::ref( job ) );
+
+    bool denoise = result.Denoise();
     while ( !glfwWindowShouldClose( window ) )
     {
-        double time = glfwGetTime();
-        if ( time - updateTime > 1.0 )
-        {
-            updateTime = time;
+        bool toggled = denoise != result.Denoise();
+        if ( toggled )
+            result.SetDenoise( denoise );
 
-            if ( textureID != 0 )
-            {
-                glDeleteTextures( 1, &textureID );
-                textureID = 0;
-            }
-
-            textureID  = CreateTexture( result );
-        }
+        // a snapshot arrives with every finished pass or preview
+        if ( result.Update() || toggled )
+            texture.Upload( result );
 
         glfwPollEvents();
 
@@ -251,12 +584,26 @@ int main()
         if ( show_demo_window )
             ImGui::ShowDemoWindow( &show_demo_window );
 
-        if ( textureID != 0 )
+        if ( texture.Texture() != 0 )
         {
             ImGui::Begin( "OpenGL Texture Text" );
             // ImGui::Text( "pointer = %p", textureID );
             // ImGui::Image( (void *)(intptr_t)textureID, ImVec2( 540, 960 ) );
-            ImGui::Image( (void *)(intptr_t)textureID, ImVec2( 256, 256 ) );
+            ImGui::Image( (void *)(intptr_t)texture.Texture(),
+                          ImVec2( float( result.Width() ),
+                                  float( result.Height() ) ) );
+            ImGui::Checkbox( "denoise", &denoise );
+
+            // any change starts the frame over
+            bool changed = ImGui::SliderFloat3( "camera", eye, -5.0f, 5.0f );
+            changed |= ImGui::SliderInt( "samples", &samples, 1, 1024 );
+            if ( changed )
+            {
+                rp._numSamples = static_cast<unsigned int>( samples );
+                cam = camera<FLOAT>(
+                    { eye[0], eye[1], eye[2] }, cam.lookAt(), cam.fov() );
+                job.Restart( cam, rp );
+            }
             ImGui::End(); 
         }
 
@@ -272,9 +619,11 @@ int main()
         glfwSwapBuffers( window );
     }
 
+    texture.Release();
     if ( window )
         glfwDestroyWindow( window );
 
+    job.Stop();
     renderThread.join();
     return 0;
 }
@@ -1,17 +1,126 @@
 #ifndef _primitive_h_
 #define _primitive_h_
 
+#include "boundingbox.h"
 #include "hit.h"
+#include "packet.h"
 #include "ray.h"
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// a point sampled on an emitter as seen from a shading point
+// -----------------------------------------------------------------------------
+template <typename T>
+struct lightsample
+{
+    vec3<T> pos;      // point on the emitter
+    vec3<T> normal;   // emitter normal, facing the shading point
+    color   radiance; // emitted towards the shading point
+    float   pdf = 0;  // solid angle density at the shading point
+};
 
 template <typename T>
 class primitive
 {
 public:
+    virtual ~primitive() = default;
+
+    // closest hit before r.tmax, only the compact record is filled in
     virtual bool intersect( const ray<T> &r, hit<T> &h ) const noexcept
     {
         return false;
     }
+
+    // position, normal and material of a hit of r on this primitive
+    virtual void shade( const ray<T> &r,
+                        const hit<T> &h,
+                        surface<T> &  s ) const noexcept
+    {
+    }
+
+    // world space bounds, used by the scene level acceleration structure
+    virtual bbox<T> bounds() const noexcept { return {}; }
+
+    // fills the record of a hit at distance t found by a packet query.
+    // element identifies the part of the primitive that was hit
+    virtual void resolve( const ray<T> &r,
+                          T             t,
+                          unsigned int  element,
+                          hit<T> &      h ) const noexcept
+    {
+        intersect( r, h );
+    }
+
+    // true if anything blocks the ray before r.tmax
+    virtual bool occluded( const ray<T> &r ) const noexcept
+    {
+        hit<T> h;
+        return intersect( r, h );
+    }
+
+    // appends the elements that emit light, the scene picks among them in
+    // proportion to emitterPower()
+    virtual void emitters( std::vector<unsigned int> &elements ) const {}
+
+    virtual float emitterPower( unsigned int element ) const noexcept
+    {
+        return 0.0f;
+    }
+
+    // samples a point of element as seen from the point from, with u and v
+    // in [0, 1). false if the element cannot be seen from there at all
+    virtual bool sampleEmitter( unsigned int    element,
+                                const vec3<T> & from,
+                                float           u,
+                                float           v,
+                                lightsample<T> &ls ) const noexcept
+    {
+        return false;
+    }
+
+    // solid angle density with which sampleEmitter() picks the point pos of
+    // element when called from the point from
+    virtual float emitterPdf( unsigned int   element,
+                              const vec3<T> &from,
+                              const vec3<T> &pos ) const noexcept
+    {
+        return 0.0f;
+    }
+
+    // closest hits for the active lanes of a packet. lanes that hit closer
+    // than their tmax get their tmax shrunk and h updated. the default
+    // traces the lanes one by one
+    virtual void intersect( raypacket<T> &p, packethit<T> &h ) const noexcept
+    {
+        for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+        {
+            hit<T> laneHit;
+            if ( !( p.active & ( 1u << lane ) ) ||
+                 !intersect( p.get( lane ), laneHit ) ||
+                 !( laneHit._t < p.tmax[lane] ) )
+                continue;
+
+            p.tmax[lane]    = laneHit._t;
+            h.t[lane]       = laneHit._t;
+            h.element[lane] = 0;
+            h.object[lane]  = this;
+            h.mask |= 1u << lane;
+        }
+    }
+
+    // occlusion for the active lanes of a packet. blocked lanes are removed
+    // from p.active and returned
+    virtual unsigned int occluded( raypacket<T> &p ) const noexcept
+    {
+        unsigned int blocked = 0;
+        for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+        {
+            if ( ( p.active & ( 1u << lane ) ) && occluded( p.get( lane ) ) )
+                blocked |= 1u << lane;
+        }
+        p.active &= ~blocked;
+        return blocked;
+    }
 };
 
 #endif // _primitive_h_
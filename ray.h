@@ -2,6 +2,11 @@
 #define _ray_h_
 
 #include "vec3.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -16,8 +21,44 @@ public:
     {
     }
 
-    vec3<T> o;                      // origin
-    vec3<T> d = {T(1), T(0), T(0)}; // direction
+    vec3<T> o;                                    // origin
+    vec3<T> d    = {T(1), T(0), T(0)};            // direction
+    T       tmax = std::numeric_limits<T>::max(); // hits beyond are ignored
 };
 
+// -----------------------------------------------------------------------------
+// origin for a ray leaving the surface point p on the side of the geometric
+// normal n. p carries the rounding error of the intersection, so it is pushed
+// off the surface by a fixed number of ulps per component, or by a fixed
+// distance near zero where ulps get too small. after wachter and binder, "a
+// fast and robust method for avoiding self-intersection"
+// -----------------------------------------------------------------------------
+template <typename T>
+vec3<T> offsetRayOrigin( const vec3<T> &p, const vec3<T> &n ) noexcept
+{
+    using bits =
+        std::conditional_t<sizeof( T ) == 4, std::int32_t, std::int64_t>;
+
+    constexpr T kOrigin     = T( 1 ) / T( 32 );
+    constexpr T kFloatScale = T( 128 ) * std::numeric_limits<T>::epsilon();
+    constexpr T kIntScale   = T( 256 );
+
+    vec3<T> result;
+    for ( unsigned int ii = 0; ii < 3; ++ii )
+    {
+        if ( std::abs( p[ii] ) < kOrigin )
+        {
+            result[ii] = p[ii] + kFloatScale * n[ii];
+            continue;
+        }
+
+        bits offset = static_cast<bits>( kIntScale * n[ii] );
+        bits value;
+        memcpy( &value, &p[ii], sizeof( T ) );
+        value += p[ii] < 0 ? -offset : offset;
+        memcpy( &result[ii], &value, sizeof( T ) );
+    }
+    return result;
+}
+
 #endif // _ray_h_
@@ -1,128 +1,554 @@
+// -----------------------------------------------------------------------------
+// weight of a sample drawn with density pdf when the other strategy draws it
+// with density other, the power heuristic of veach
+// -----------------------------------------------------------------------------
+inline float powerHeuristic( float pdf, float other ) noexcept
+{
+    float a = pdf * pdf;
+    float b = other * other;
+    return a + b > 0.0f ? a / ( a + b ) : 0.0f;
+}
+
+// -----------------------------------------------------------------------------
+// iterative path tracer. the path carries its throughput, the product of the
+// surface albedos seen so far, and after rouletteDepth bounces it survives
+// each further bounce with probability max( throughput ). survivors are
+// reweighted by 1 / probability, which keeps the estimate unbiased while dark
+// paths stop early. first is the hit of r, shared by all samples of a
+// subpixel. later hits are only shaded once the closest one is found
+//
+// with light sampling every bounce also connects to a point sampled on an
+// emitter. light found that way and light found by the cosine sampled bounce
+// are weighted by multiple importance sampling, so each strategy counts most
+// where it is the better one: light sampling for small lights, the bounce for
+// large ones seen at grazing angles
+// -----------------------------------------------------------------------------
+template <typename T>
+color renderer<T>::tracepath( const scene<T> &   world,
+                              sampler &          smp,
+                              const ray<T> &     r,
+                              const hit<T> &     first,
+                              const surface<T> & firstSurface )
+{
+    bool lightSampling = _renderParams.lightSampling() && world.hasLights();
+
+    color      radiance      = {0, 0, 0, 0};
+    color      throughput    = {1, 1, 1, 1};
+    ray<T>     curray        = r;
+    hit<T>     h             = first;
+    surface<T> s             = firstSurface;
+    vec3<T>    from;             // start of the bounce that found h
+    float      bouncePdf = 0.0f; // solid angle density of that bounce
+    for ( unsigned int depth = 0; depth < _renderParams.maxDepth(); ++depth )
+    {
+        if ( depth > 0 )
+        {
+            PT_STAT_RAYS( depth, 1 );
+            if ( !world.intersect( curray, h ) )
+                break;
+            world.shade( curray, h, s );
+        }
+
+        const material &mat = *s._mat;
+        if ( mat.emission() > 0.0f )
+        {
+            float weight = 1.0f;
+            if ( lightSampling && depth > 0 )
+                weight = powerHeuristic( bouncePdf,
+                                         world.lightPdf( from, h, s._pos ) );
+            color emit = mat.diffuse() * mat.emission();
+            radiance   = radiance + throughput * emit * weight;
+        }
+        throughput = throughput * mat.diffuse();
+
+        if ( depth + 1 == _renderParams.maxDepth() )
+            break;
+
+        if ( depth + 1 >= _renderParams.rouletteDepth() )
+        {
+            float survive =
+                std::max( {throughput.r, throughput.g, throughput.b} );
+            survive = std::min( survive, 1.0f );
+            if ( survive <= 0.0f || smp.next1D() >= survive )
+                break;
+            throughput = throughput / survive;
+        }
+
+        // both strategies start off the surface, on the side the path is on.
+        // from a light's own surface that also settles whether the light is
+        // seen from inside or outside
+        vec3<T> origin = offsetRayOrigin( s._pos, s._normal );
+
+        // LIGHT SAMPLING, a shadow ray to a point on an emitter. throughput
+        // holds albedo, the lambertian brdf is albedo / pi
+        if ( lightSampling )
+        {
+            float          select = smp.next1D();
+            float          lu, lv;
+            lightsample<T> ls;
+            smp.next2D( lu, lv );
+            if ( world.sampleLight( origin, select, lu, lv, ls ) )
+            {
+                vec3<T> d      = offsetRayOrigin( ls.pos, ls.normal ) - origin;
+                T       dist   = d.normalize();
+                float   cosine = static_cast<float>( d % s._normal );
+                if ( cosine > 0.0f && dist > T( 0 ) )
+                {
+                    ray<T> shadow( origin, d );
+                    shadow.tmax = dist;
+                    PT_STAT_ADD( kShadowRays, 1 );
+                    if ( !world.occluded( shadow ) )
+                    {
+                        float weight = powerHeuristic( ls.pdf, cosine / M_PI );
+                        float scale  = weight * cosine / ( M_PI * ls.pdf );
+                        radiance = radiance + throughput * ls.radiance * scale;
+                    }
+                }
+            }
+        }
+
+        // DIFFUSE COMPONENT, cosine weighted
+        vec3<T> w = s._normal;
+        vec3<T> u, v;
+        orthonormalBasis( w, u, v );
+
+        float r1, r2;
+        smp.next2D( r1, r2 );
+        r1 *= 2.0f * M_PI;
+        float r2s    = std::sqrt( r2 );
+        float cosine = std::sqrt( 1 - r2 );
+        curray.o     = origin;
+        curray.d     = u * std::cos( r1 ) * r2s + v * std::sin( r1 ) * r2s +
+                   w * cosine;
+        curray.d.normalize();
+        from      = origin;
+        bouncePdf = cosine / M_PI;
+    }
+
+    return radiance;
+}
+
+// -----------------------------------------------------------------------------
+// sums numSamples paths for each of the four subpixels of count consecutive
+// pixels of row jj, starting at column ii. the camera rays of a subpixel are
+// traced together as one packet. every subpixel has its own sample sequence:
+// index pass jitters its camera ray and indices firstSample onwards drive its
+// paths, from dimension 2 on. only the lanes set in active trace paths, the
+// others leave their sums at 0. returns the lanes with a camera ray that hit
+// the scene. the features of the four camera rays are summed as well
+// -----------------------------------------------------------------------------
+template <typename T>
+unsigned int renderer<T>::renderSpan( const scene<T> &world,
+                              unsigned int    ii,
+                              unsigned int    jj,
+                              unsigned int    count,
+                              unsigned int    pass,
+                              unsigned int    firstSample,
+                              unsigned int    numSamples,
+                              unsigned int    active,
+                              pixelsamples *  pixels )
+{
+    // pixels are square, the vertical field of view follows the aspect
+    unsigned int width  = _renderParams.width();
+    unsigned int height = _renderParams.height();
+    for ( unsigned int lane = 0; lane < count; ++lane )
+        pixels[lane] = {{0, 0, 0, 0}, 0, {0, 0, 0, 0}, {0, 0, 0}, 0};
+
+    samplertype  type = _renderParams.samplerType();
+    unsigned int hits = 0;
+    // subpixel y
+    for ( unsigned int spy = 0; spy < 2; ++spy )
+    {
+        // subpixel x
+        for ( unsigned int spx = 0; spx < 2; ++spx )
+        {
+            raypacket<T>  packet;
+            std::uint32_t keys[kPacketSize];
+            for ( unsigned int lane = 0; lane < count; ++lane )
+            {
+                keys[lane] = 4 * ( jj * width + ii + lane ) + 2 * spy + spx;
+                sampler jitter( type, keys[lane], pass );
+                float   dx, dy;
+                jitter.next2D( dx, dy );
+                dx -= 0.5f;
+                dy -= 0.5f;
+                // build ray for pixel (ii + lane, jj)
+                T u = 1.0f * ( ii + lane + dx ) / ( width - 1 ) - 0.5f;
+                T v = 1.0f * ( height - 1 - ( jj + dy ) ) / ( width - 1 ) -
+                      0.5f * ( height - 1 ) / ( width - 1 );
+                vec3<T> dir = _camera.direction( u, v );
+                dir.normalize();
+                packet.set( lane, {_camera.position(), dir} );
+            }
+
+            packethit<T> primary;
+            PT_STAT_RAYS( 0, count );
+            world.intersect( packet, primary );
+            hits |= primary.mask;
+
+            for ( unsigned int lane = 0; lane < count; ++lane )
+            {
+                // a camera ray that escapes contributes nothing
+                if ( !( primary.mask & active & ( 1u << lane ) ) )
+                    continue;
+
+                ray<T> r = packet.get( lane );
+                r.tmax   = std::numeric_limits<T>::max();
+
+                hit<T>     first;
+                surface<T> firstSurface;
+                world.resolve( packet, primary, lane, first );
+                world.shade( r, first, firstSurface );
+                pixelsamples &px = pixels[lane];
+                px.albedo        = px.albedo + firstSurface._mat->diffuse();
+                px.normal += {float( firstSurface._normal[0] ),
+                              float( firstSurface._normal[1] ),
+                              float( firstSurface._normal[2] )};
+                px.depth += static_cast<float>( first._t );
+
+                for ( unsigned int sample = 0; sample < numSamples; ++sample )
+                {
+                    sampler smp( type, keys[lane], firstSample + sample, 2 );
+                    color   c = tracepath( world, smp, r, first, firstSurface );
+                    px.sum    = px.sum + c;
+                    px.sumSquared += c.luminance() * c.luminance();
+                }
+            }
+        }
+    }
+    return hits;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+unsigned int renderer<T>::numTiles( const renderparams &rp ) noexcept
+{
+    unsigned int tilesX = ( rp.width() + kTileSize - 1 ) / kTileSize;
+    unsigned int tilesY = ( rp.height() + kTileSize - 1 ) / kTileSize;
+    return tilesX * tilesY;
+}
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 template <typename T>
-color renderer<T>::tracepath( const scene<T> &world,
-                              std::mt19937 &  rng,
-                              const ray<T> &  r,
-                              unsigned int    depth )
+void renderer<T>::tileBounds( const renderparams &rp,
+                              unsigned int        tile,
+                              unsigned int &      x0,
+                              unsigned int &      y0,
+                              unsigned int &      x1,
+                              unsigned int &      y1 ) noexcept
 {
-    if ( depth >= _renderParams.maxDepth() )
-        return {0, 0, 0, 0};
-
-    hit<T> h;
-    if ( !world.intersect( r, h ) )
-        return {0, 0, 0, 0};
-
-    ray<T> newray{h._pos, h._normal};
-
-    // DIFFUSE COMPONENT
-    vec3<T> w = h._normal;
-    vec3<T> u;
-
-    auto x = std::abs(w[0]);
-    auto y = std::abs(w[1]);
-    auto z = std::abs(w[2]);
-
-    if ( x > y && x > z )
-        u = w * vec3<T>( 0, 1, 0 );
-    else if ( y > x && y > z )
-        u = w * vec3<T>( 0, 0, 1 );
-    else
-        u = w * vec3<T>( 1, 0, 0 );
-
-    vec3<T> v = w * u;
-    assert ( v.len2() != 0 );
-
-    auto  range = ( rng.max() - rng.min() );
-    float r1    = 2.0f * M_PI * ( 1.0f * ( rng() - rng.min() ) / range );
-    float r2    = 1.0f * ( rng() - rng.min() ) / range;
-    float r2s   = std::sqrt( r2 );
-    newray.d    = u * std::cos( r1 ) * r2s + v * std::sin( r1 ) * r2s +
-               w * std::sqrt( 1 - r2 );
-    newray.d.normalize();
-
-    color emit     = h._mat.diffuse() * h._mat.emission();
-    color diffuse  = h._mat.diffuse();
-    color incoming = tracepath( world, rng, newray, depth + 1 );
-
-    // SPECULAR COMPONENT
-    // newray.d = r.d - h._normal * 2 * (r.d % h._normal);
-    // newray.d.normalize();
-    // incoming =  incoming + tracepath(world, rng, newray, depth + 1);
-    return emit + diffuse * incoming;
+    unsigned int width  = rp.width();
+    unsigned int height = rp.height();
+    unsigned int tilesX = ( width + kTileSize - 1 ) / kTileSize;
+    x0                  = ( tile % tilesX ) * kTileSize;
+    y0                  = ( tile / tilesX ) * kTileSize;
+    x1                  = std::min( x0 + kTileSize, width );
+    y1                  = std::min( y0 + kTileSize, height );
+}
+
+// -----------------------------------------------------------------------------
+// one pass over a tile: passSamples per subpixel for every pixel whose flag
+// in active is set. seen collects the pixels whose camera rays hit the scene.
+// with a threshold the flags of pixels that converged are cleared
+// -----------------------------------------------------------------------------
+template <typename T>
+void renderer<T>::renderTilePass( const scene<T> &world,
+                                  unsigned int    tile,
+                                  unsigned int    pass,
+                                  unsigned int    passSamples,
+                                  float           threshold,
+                                  film &          f,
+                                  unsigned char * active,
+                                  unsigned char * seen )
+{
+    unsigned int width = _renderParams.width();
+    unsigned int samplesPerPass =
+        std::max( 1u, _renderParams.samplesPerPass() );
+    unsigned int x0, y0, x1, y1;
+    tileBounds( _renderParams, tile, x0, y0, x1, y1 );
+    for ( unsigned int jj = y0; jj < y1; ++jj )
+    {
+        for ( unsigned int ii = x0; ii < x1; ii += kPacketSize )
+        {
+            unsigned int   count = std::min( kPacketSize, x1 - ii );
+            unsigned char *flags = &active[jj * width + ii];
+            unsigned int   mask  = 0;
+            for ( unsigned int lane = 0; lane < count; ++lane )
+                mask |= flags[lane] ? 1u << lane : 0u;
+            if ( !mask )
+                continue;
+
+            pixelsamples pixels[kPacketSize];
+            unsigned int hits = renderSpan( world,
+                                            ii,
+                                            jj,
+                                            count,
+                                            pass,
+                                            pass * samplesPerPass,
+                                            passSamples,
+                                            mask,
+                                            pixels );
+            for ( unsigned int lane = 0; lane < count; ++lane )
+            {
+                if ( !flags[lane] )
+                    continue;
+
+                const pixelsamples &px = pixels[lane];
+                f.add( ii + lane, jj, px.sum, 4 * passSamples, px.sumSquared );
+                f.addFeatures(
+                    ii + lane, jj, px.albedo, px.normal, px.depth, 4 );
+
+                unsigned char &wasSeen = seen[jj * width + ii + lane];
+                wasSeen |= hits & ( 1u << lane ) ? 1 : 0;
+
+                unsigned int taken = f.samples( ii + lane, jj ) / 4;
+                if ( threshold > 0.0f && taken >= kMinAdaptiveSamples &&
+                     ( !wasSeen ||
+                       f.relativeError( ii + lane, jj ) < threshold ) )
+                    flags[lane] = 0;
+            }
+        }
+    }
 }
 
 // -----------------------------------------------------------------------------
+// passes run over the tiles until every pixel has its samples. with an
+// adaptive threshold, pixels drop out once their relative error is below it,
+// and passes go on over the remaining pixels until they used up the samples
+// of the whole image or converged too
 // -----------------------------------------------------------------------------
 template <typename T>
-void renderer<T>::render( const scene<T> &world, std::vector<unsigned char> &imgBuffer )
+bool renderer<T>::render( const scene<T> &     world,
+                          film &               f,
+                          const passcallback &onPass,
+                          const tilecallback &onTile,
+                          const CancelToken * cancel )
 {
     unsigned int height = _renderParams.height();
     unsigned int width  = _renderParams.width();
-    unsigned int maxDepth = _renderParams.maxDepth();
 
-    imgBuffer.resize( 4 * width * height, 0u );
-    auto imgBufferPtr = imgBuffer.data();
+    f.resize( width, height );
 
-    std::unique_ptr<FILE, decltype( &fclose )> image(
-        fopen( "render.ppm", "w" ), &fclose );
+    auto       start  = std::chrono::steady_clock::now();
+    StatCounts before = Stats::Collect();
 
-    fprintf( image.get(), "P6\n%d %d\n255\n", width, height );
-    float progPercent = 0.0f;
-    for ( unsigned int jj = 0; jj < height; ++jj )
+    unsigned int numSamples     = _renderParams.numSamples();
+    unsigned int samplesPerPass = _renderParams.samplesPerPass();
+    samplesPerPass              = std::max( 1u, samplesPerPass );
+    float        threshold      = _renderParams.adaptiveThreshold();
+    bool         adaptive       = threshold > 0.0f;
+    unsigned int maxSamples =
+        adaptive ? kMaxAdaptiveFactor * numSamples : numSamples;
+    unsigned int numPasses =
+        ( maxSamples + samplesPerPass - 1 ) / samplesPerPass;
+
+    // 1 for every pixel that still takes samples. seen marks the pixels
+    // whose camera rays hit something, the others are black for certain
+    std::vector<unsigned char> active( std::size_t( width ) * height, 1 );
+    std::vector<unsigned char> seen( active.size(), 0 );
+    std::size_t                numActive = active.size();
+    unsigned long long         budget    = 4ull * numSamples * active.size();
+    unsigned long long         spent     = 0;
+
+    // tiles handed to onTile already
+    unsigned int               tiles = numTiles( _renderParams );
+    std::vector<unsigned char> finished( tiles, 0 );
+    auto                       tileActive = [&]( unsigned int tile ) {
+        unsigned int x0, y0, x1, y1;
+        tileBounds( _renderParams, tile, x0, y0, x1, y1 );
+        for ( unsigned int y = y0; y < y1; ++y )
+        {
+            const unsigned char *row = &active[std::size_t( y ) * width];
+            if ( std::find( row + x0, row + x1, 1 ) != row + x1 )
+                return true;
+        }
+        return false;
+    };
+
+    // a tile is rendered by one thread per pass, so its time needs no lock
+    std::vector<double> tileSeconds( tiles, 0.0 );
+
+    auto cancelled = [cancel]() { return cancel && cancel->Cancelled(); };
+    bool stopped   = false;
+
+    // samples are keyed by subpixel and sample index, so the image does not
+    // depend on which thread renders which tile
+    ThreadPool pool( _renderParams.numThreads() );
+    if ( onPass )
+    {
+        film preview;
+        for ( unsigned int level = _renderParams.previewLevels();
+              level > 0 && !cancelled();
+              --level )
+        {
+            renderPreview( world, 1u << level, pool, preview );
+            onPass( preview );
+        }
+    }
+
+    for ( unsigned int pass = 0; pass < numPasses && numActive; ++pass )
     {
-        float curProg = ( 100.0f * jj / ( height - 1 ) );
-        if ( curProg > progPercent )
+        if ( cancelled() )
         {
-            progPercent += 10;
-            std::cout << "[" << progPercent << "% ...]"
+            stopped = true;
+            break;
+        }
+
+        // the last pass stops short of the budget, whichever pixels are left
+        unsigned long long left = ( budget - spent ) / ( 4 * numActive );
+        if ( !left )
+            break;
+        PT_TRACE_SCOPE( "pass", "render", "pass", pass );
+        unsigned int passSamples = static_cast<unsigned int>( std::min<
+            unsigned long long>(
+            {samplesPerPass, maxSamples - pass * samplesPerPass, left} ) );
+
+        pool.run( tiles, [&]( unsigned int tile, unsigned int ) {
+            if ( finished[tile] || cancelled() )
+                return;
+
+            PT_TRACE_SCOPE( "tile", "render", "tile", tile, "pass", pass );
+            auto tileStart = std::chrono::steady_clock::now();
+            renderTilePass( world,
+                            tile,
+                            pass,
+                            passSamples,
+                            threshold,
+                            f,
+                            active.data(),
+                            seen.data() );
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - tileStart;
+            tileSeconds[tile] += elapsed.count();
+
+            if ( onTile && !tileActive( tile ) )
+            {
+                finished[tile] = 1;
+                onTile( f, tile );
+            }
+        } );
+
+        // tiles may have been skipped, the pass is not worth showing
+        if ( cancelled() )
+        {
+            stopped = true;
+            break;
+        }
+
+        // progress in tenths of the sample budget
+        unsigned long long before = spent;
+        spent += 4ull * passSamples * numActive;
+        if ( 10 * spent / budget != 10 * before / budget )
+        {
+            std::cout << "[" << 10 * std::min( 10 * spent / budget, 10ull )
+                      << "% ...]"
                       << "\n";
         }
 
-        for ( unsigned int ii = 0; ii < width; ++ii )
+        numActive = std::count( active.begin(), active.end(), 1 );
+        if ( spent >= budget )
+            numActive = 0;
+
+        if ( onPass )
+            onPass( f );
+    }
+
+    // whatever is left once the budget ran out
+    for ( unsigned int tile = 0; onTile && !stopped && tile < tiles; ++tile )
+    {
+        if ( !finished[tile] )
+            onTile( f, tile );
+    }
+
+    // the workers are idle, their counters are complete
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    _stats.width       = width;
+    _stats.height      = height;
+    _stats.threads     = pool.size();
+    _stats.seconds     = elapsed.count();
+    _stats.paths       = f.totalSamples();
+    _stats.counts      = Stats::Collect() - before;
+    _stats.tileSeconds = std::move( tileSeconds );
+    return !stopped;
+}
+
+// -----------------------------------------------------------------------------
+// blocks are spread over the threads by rows. their paths use the keys of
+// the center pixel's first pass, which previews never add to f
+// -----------------------------------------------------------------------------
+template <typename T>
+void renderer<T>::renderPreview( const scene<T> &world,
+                                 unsigned int    scale,
+                                 ThreadPool &    pool,
+                                 film &          preview )
+{
+    PT_TRACE_SCOPE( "preview", "render", "scale", scale );
+    unsigned int width   = _renderParams.width();
+    unsigned int height  = _renderParams.height();
+    unsigned int blocksX = ( width + scale - 1 ) / scale;
+    unsigned int blocksY = ( height + scale - 1 ) / scale;
+
+    preview.resize( width, height );
+    pool.run( blocksY, [&]( unsigned int by, unsigned int ) {
+        for ( unsigned int bx = 0; bx < blocksX; ++bx )
         {
-            color        pixcolor   = {0, 0, 0, 0};
-            unsigned int numSamples = 512;
-            // subpixel y
-            for ( unsigned int spy = 0; spy < 2; ++spy )
+            unsigned int x0 = bx * scale, y0 = by * scale;
+            unsigned int x1 = std::min( x0 + scale, width );
+            unsigned int y1 = std::min( y0 + scale, height );
+
+            pixelsamples px;
+            renderSpan(
+                world, ( x0 + x1 ) / 2, ( y0 + y1 ) / 2, 1, 0, 0, 1, 1u, &px );
+            for ( unsigned int y = y0; y < y1; ++y )
             {
-                // subpixel x
-                for ( unsigned int spx = 0; spx < 2; ++spx )
+                for ( unsigned int x = x0; x < x1; ++x )
                 {
-                    std::mt19937 mtrng( jj * width + ii );
-                    float        dx =
-                        1.0f * mtrng() / ( mtrng.max() - mtrng.min() ) - 0.5f;
-                    float dy =
-                        1.0f * mtrng() / ( mtrng.max() - mtrng.min() ) - 0.5f;
-                    // build ray for pixel (ii, jj)
-                    T u = 1.0f * ( ii + dx ) / ( width - 1 ) - 0.5f;
-                    T v =
-                        1.0f * ( width - 1 - ( jj + dy ) ) / ( width - 1 ) -
-                        0.5f;
-                    vec3<T> dir = _camera.direction( u, v );
-                    dir.normalize();
-                    ray<T> r = {_camera.position(), dir};
-                    for ( unsigned int sample = 0; sample < numSamples;
-                          ++sample )
-                    {
-                        pixcolor = pixcolor + tracepath( world, mtrng, r, 0 );
-                    }
+                    preview.add( x, y, px.sum, 4, px.sumSquared );
+                    preview.addFeatures(
+                        x, y, px.albedo, px.normal, px.depth, 4 );
                 }
             }
+        }
+    } );
+}
 
-            pixcolor              = pixcolor / ( 4 * numSamples * maxDepth );
-            vec3<unsigned char> c = pixcolor.touchar();
+// -----------------------------------------------------------------------------
+// every pass of a tile in a row. a pixel sees the same passes in the same
+// order as in render(), so its sums come out bit for bit the same
+// -----------------------------------------------------------------------------
+template <typename T>
+void renderer<T>::renderTiles( const scene<T> &                 world,
+                               const std::vector<unsigned int> &tiles,
+                               film &                           f )
+{
+    unsigned int width          = _renderParams.width();
+    unsigned int height         = _renderParams.height();
+    unsigned int numSamples     = _renderParams.numSamples();
+    unsigned int samplesPerPass = _renderParams.samplesPerPass();
+    samplesPerPass              = std::max( 1u, samplesPerPass );
 
-            *imgBufferPtr = c[0];
-            imgBufferPtr++;
-            *imgBufferPtr = c[1];
-            imgBufferPtr++;
-            *imgBufferPtr = c[2];
-            imgBufferPtr++;
-            *imgBufferPtr = 255;
-            imgBufferPtr++;
+    std::vector<unsigned char> active( std::size_t( width ) * height, 1 );
+    std::vector<unsigned char> seen( active.size(), 0 );
 
-            fprintf( image.get(), "%c%c%c", c[0], c[1], c[2] );
-        }
-    }
+    ThreadPool pool( _renderParams.numThreads() );
+    pool.run( static_cast<unsigned int>( tiles.size() ),
+              [&]( unsigned int index, unsigned int ) {
+                  PT_TRACE_SCOPE( "tile", "render", "tile", tiles[index] );
+                  for ( unsigned int first = 0; first < numSamples;
+                        first += samplesPerPass )
+                  {
+                      renderTilePass(
+                          world,
+                          tiles[index],
+                          first / samplesPerPass,
+                          std::min( samplesPerPass, numSamples - first ),
+                          0.0f,
+                          f,
+                          active.data(),
+                          seen.data() );
+                  }
+              } );
 }
@@ -1,9 +1,17 @@
 #pragma once
 
 #include "camera.h"
+#include "film.h"
 #include "scene.h"
 #include "material.h"
-#include <random>
+#include "renderstats.h"
+#include "sampler.h"
+#include "util/concurrent.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -13,11 +21,41 @@ struct renderparams
     constexpr unsigned int height() const noexcept { return _height; }
     constexpr unsigned int maxDepth() const noexcept { return _maxDepth; }
     constexpr unsigned int numSamples() const noexcept { return _numSamples; }
+    constexpr unsigned int numThreads() const noexcept { return _numThreads; }
+    constexpr unsigned int samplesPerPass() const noexcept
+    {
+        return _samplesPerPass;
+    }
+    constexpr unsigned int rouletteDepth() const noexcept
+    {
+        return _rouletteDepth;
+    }
+    constexpr samplertype samplerType() const noexcept { return _samplerType; }
+    constexpr bool lightSampling() const noexcept { return _lightSampling; }
+    constexpr float adaptiveThreshold() const noexcept
+    {
+        return _adaptiveThreshold;
+    }
+    constexpr unsigned int previewLevels() const noexcept
+    {
+        return _previewLevels;
+    }
 
-    unsigned int _width      = 512;
-    unsigned int _height     = 512;
-    unsigned int _maxDepth   = 4;
-    unsigned int _numSamples = 512;
+    unsigned int _width          = 512;
+    unsigned int _height         = 512;
+    unsigned int _maxDepth       = 4;
+    unsigned int _numSamples     = 512;
+    unsigned int _numThreads     = 0; // 0 uses every hardware thread
+    unsigned int _samplesPerPass = 1;
+    unsigned int _rouletteDepth  = 3; // bounces before russian roulette
+    samplertype  _samplerType    = samplertype::kSobol;
+    bool         _lightSampling  = true; // next event estimation with mis
+    // relative error at which a pixel stops sampling, 0 samples every pixel
+    // numSamples times
+    float        _adaptiveThreshold = 0.0f;
+    // coarse previews before the first pass, at 1 / 2^levels of the
+    // resolution and then at twice that up to 1 / 2. 0 shows none
+    unsigned int _previewLevels = 0;
 };
 
 // -----------------------------------------------------------------------------
@@ -26,20 +64,106 @@ template <typename T>
 class renderer
 {
 public:
+    // the image is split into square tiles that are rendered in parallel
+    static constexpr unsigned int kTileSize = 32;
+
+    // with adaptive sampling a pixel takes at least kMinAdaptiveSamples per
+    // subpixel before its error is trusted, and at most kMaxAdaptiveFactor
+    // times numSamples from the budget the converged pixels left over
+    static constexpr unsigned int kMinAdaptiveSamples = 8;
+    static constexpr unsigned int kMaxAdaptiveFactor  = 4;
+
     renderer( const camera<T> &cam, const renderparams &rp )
         : _camera( cam ), _renderParams( rp )
     {
     }
 
-    void render( const scene<T> &world, std::vector<unsigned char> &imgBuffer );
+    // called from the render thread after every completed pass
+    using passcallback = std::function<void( const film & )>;
+
+    // called once per tile as soon as its pixels take no more samples, from
+    // whichever thread finished it. the tile's pixels stay as they are
+    using tilecallback = std::function<void( const film &, unsigned int )>;
+
+    // accumulates numSamples per subpixel into the film, samplesPerPass at a
+    // time over the whole image. with an adaptive threshold the same total is
+    // spent, but only on the pixels that have not converged yet. previews go
+    // to onPass in films of their own, f is left as it would be without them
+    //
+    // cancel is polled before every tile and pass. returns false if it
+    // stopped the render, f then holds the passes that were finished and
+    // part of the one that was not
+    bool render( const scene<T> &     world,
+                 film &               f,
+                 const passcallback &onPass = {},
+                 const tilecallback &onTile = {},
+                 const CancelToken * cancel = nullptr );
+
+    // timings and counters of the last render()
+    const renderstats &stats() const noexcept { return _stats; }
+
+    // tiles of the image in row major order, kTileSize pixels square
+    static unsigned int numTiles( const renderparams &rp ) noexcept;
+    static void         tileBounds( const renderparams &rp,
+                                    unsigned int        tile,
+                                    unsigned int &      x0,
+                                    unsigned int &      y0,
+                                    unsigned int &      x1,
+                                    unsigned int &      y1 ) noexcept;
+
+    // renders all samples of the listed tiles into f, which must already
+    // have the size of the image. pixels come out as render() leaves them
+    // without adaptive sampling, so tiles rendered in different processes
+    // merge into the same image
+    void renderTiles( const scene<T> &                 world,
+                      const std::vector<unsigned int> &tiles,
+                      film &                           f );
+
+    // radiance along one path that starts with r, whose hit is first and
+    // shades as firstSurface. the path draws its random numbers from smp
+    color tracepath( const scene<T> &   world,
+                     sampler &          smp,
+                     const ray<T> &     r,
+                     const hit<T> &     first,
+                     const surface<T> & firstSurface );
 
 private:
-    color               tracepath( const scene<T> &world,
-                                   std::mt19937 &  rng,
-                                   const ray<T> &  r,
-                                   unsigned int    depth );
+    // what renderSpan() gathers for one pixel
+    struct pixelsamples
+    {
+        color       sum;        // radiance of all paths
+        float       sumSquared; // their squared luminances
+        color       albedo;     // first hit features of the camera rays
+        vec3<float> normal;
+        float       depth;
+    };
+
+    // one path per subpixel for the center of every scale x scale block,
+    // shown by all pixels of the block
+    void                renderPreview( const scene<T> &world,
+                                       unsigned int    scale,
+                                       ThreadPool &    pool,
+                                       film &          preview );
+    unsigned int        renderSpan( const scene<T> &world,
+                                    unsigned int    ii,
+                                    unsigned int    jj,
+                                    unsigned int    count,
+                                    unsigned int    pass,
+                                    unsigned int    firstSample,
+                                    unsigned int    numSamples,
+                                    unsigned int    active,
+                                    pixelsamples *  pixels );
+    void                renderTilePass( const scene<T> &world,
+                                        unsigned int    tile,
+                                        unsigned int    pass,
+                                        unsigned int    passSamples,
+                                        float           threshold,
+                                        film &          f,
+                                        unsigned char * active,
+                                        unsigned char * seen );
     const camera<T> &   _camera;
     const renderparams &_renderParams;
+    renderstats         _stats;
 };
 
 #include "renderer.cc"
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "util/pagecache.h"
+#include "util/stats.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// what one frame of renderer::render() did. timings are always taken, the
+// counters only when the tracer is built with PT_STATS, see util/stats.h
+// -----------------------------------------------------------------------------
+struct renderstats
+{
+    unsigned int        width   = 0;
+    unsigned int        height  = 0;
+    unsigned int        threads = 0;
+    double              seconds = 0.0; // wall time of the frame
+    unsigned long long  paths   = 0;   // samples added to the film
+    StatCounts          counts;        // counted during the frame
+    std::vector<double> tileSeconds;   // render time of every tile, all passes
+
+    // cluster cache of a mesh rendered out of core since it was opened,
+    // left empty by the renderer for the caller to fill in
+    PageStats paging;
+
+    // rays of every depth and shadow rays, each traverses the scene once
+    std::uint64_t traced() const noexcept
+    {
+        return counts.rays() + counts[Stat::kShadowRays];
+    }
+
+    double mraysPerSecond() const noexcept
+    {
+        return seconds > 0.0 ? traced() / seconds * 1e-6 : 0.0;
+    }
+
+    // the report as json, false if the file cannot be written
+    bool writejson( const std::string &path ) const;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline bool renderstats::writejson( const std::string &path ) const
+{
+    FILE *file = fopen( path.c_str(), "w" );
+    if ( !file )
+        return false;
+
+    fprintf( file, "{\n" );
+    fprintf( file, "  \"width\": %u,\n", width );
+    fprintf( file, "  \"height\": %u,\n", height );
+    fprintf( file, "  \"threads\": %u,\n", threads );
+    fprintf( file, "  \"seconds\": %.6f,\n", seconds );
+    fprintf( file, "  \"paths\": %llu,\n", paths );
+    fprintf( file,
+             "  \"mpaths_per_second\": %.6f,\n",
+             seconds > 0.0 ? paths / seconds * 1e-6 : 0.0 );
+    fprintf( file, "  \"counters\": %s,\n", PT_STATS ? "true" : "false" );
+
+#if PT_STATS
+    auto perRay = [&]( Stat s ) {
+        return traced() ? double( counts[s] ) / traced() : 0.0;
+    };
+
+    // trailing depths nothing reached are left out
+    unsigned int depths = kStatDepths;
+    while ( depths > 1 && !counts.raysByDepth[depths - 1] )
+        --depths;
+
+    fprintf( file, "  \"rays\": {\n" );
+    fprintf( file,
+             "    \"total\": %llu,\n",
+             static_cast<unsigned long long>( counts.rays() ) );
+    fprintf( file, "    \"by_depth\": [" );
+    for ( unsigned int ii = 0; ii < depths; ++ii )
+    {
+        fprintf( file,
+                 "%s%llu",
+                 ii ? ", " : "",
+                 static_cast<unsigned long long>( counts.raysByDepth[ii] ) );
+    }
+    fprintf( file, "],\n" );
+    fprintf( file,
+             "    \"shadow\": %llu,\n",
+             static_cast<unsigned long long>( counts[Stat::kShadowRays] ) );
+    fprintf( file,
+             "    \"hits\": %llu,\n",
+             static_cast<unsigned long long>( counts[Stat::kHits] ) );
+    fprintf( file, "    \"mrays_per_second\": %.6f\n", mraysPerSecond() );
+    fprintf( file, "  },\n" );
+
+    const std::pair<const char *, Stat> tests[] = {
+        {"box", Stat::kBoxTests},
+        {"triangle", Stat::kTriangleTests},
+        {"sphere", Stat::kSphereTests}};
+    fprintf( file, "  \"tests\": {\n" );
+    for ( const auto &test : tests )
+    {
+        fprintf( file,
+                 "    \"%s\": %llu,\n",
+                 test.first,
+                 static_cast<unsigned long long>( counts[test.second] ) );
+    }
+    fprintf( file, "    \"per_ray\": {" );
+    for ( const auto &test : tests )
+    {
+        fprintf( file,
+                 "%s\"%s\": %.4f",
+                 &test == tests ? "" : ", ",
+                 test.first,
+                 perRay( test.second ) );
+    }
+    fprintf( file, "}\n" );
+    fprintf( file, "  },\n" );
+#endif
+
+    if ( paging.hits + paging.misses )
+    {
+        fprintf( file, "  \"paging\": {\n" );
+        fprintf( file,
+                 "    \"hits\": %llu,\n",
+                 static_cast<unsigned long long>( paging.hits ) );
+        fprintf( file,
+                 "    \"misses\": %llu,\n",
+                 static_cast<unsigned long long>( paging.misses ) );
+        fprintf( file, "    \"hit_rate\": %.6f,\n", paging.hitRate() );
+        fprintf( file,
+                 "    \"evictions\": %llu,\n",
+                 static_cast<unsigned long long>( paging.evictions ) );
+        fprintf( file,
+                 "    \"bytes_read\": %llu,\n",
+                 static_cast<unsigned long long>( paging.bytesRead ) );
+        fprintf( file, "    \"peak_resident\": %zu,\n", paging.peakResident );
+        fprintf( file, "    \"budget\": %zu\n", paging.budget );
+        fprintf( file, "  },\n" );
+    }
+
+    double tileMin = 0.0, tileMax = 0.0, tileSum = 0.0;
+    if ( !tileSeconds.empty() )
+    {
+        auto range =
+            std::minmax_element( tileSeconds.begin(), tileSeconds.end() );
+        tileMin = *range.first;
+        tileMax = *range.second;
+        for ( double t : tileSeconds )
+            tileSum += t;
+    }
+    fprintf( file, "  \"tiles\": {\n" );
+    fprintf( file, "    \"count\": %zu,\n", tileSeconds.size() );
+    fprintf( file, "    \"min_seconds\": %.6f,\n", tileMin );
+    fprintf( file,
+             "    \"mean_seconds\": %.6f,\n",
+             tileSeconds.empty() ? 0.0 : tileSum / tileSeconds.size() );
+    fprintf( file, "    \"max_seconds\": %.6f,\n", tileMax );
+    fprintf( file, "    \"seconds\": [" );
+    for ( std::size_t ii = 0; ii < tileSeconds.size(); ++ii )
+        fprintf( file, "%s%.6f", ii ? ", " : "", tileSeconds[ii] );
+    fprintf( file, "]\n" );
+    fprintf( file, "  }\n" );
+    fprintf( file, "}\n" );
+
+    return fclose( file ) == 0;
+}
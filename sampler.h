@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+
+// -----------------------------------------------------------------------------
+// sample sequences for the integrator. kRandom hashes every value from its
+// coordinates, kSobol draws owen scrambled sobol points, which stratify each
+// pair of dimensions and converge faster at the same sample count
+// -----------------------------------------------------------------------------
+enum class samplertype
+{
+    kRandom,
+    kSobol
+};
+
+// -----------------------------------------------------------------------------
+// stateless generator: the value of dimension d of sample index of a sequence
+// is a pure function of ( key, index, d ), so a sampler costs a few integers
+// to set up and any sample can be regenerated out of order. key tells the
+// sequences apart, the renderer uses one per subpixel
+//
+// sobol points use the first two sobol dimensions for every pair of
+// dimensions, with the index shuffled and the values owen scrambled by hashes
+// of key and dimension, after burley, "practical hash-based owen scrambling"
+// -----------------------------------------------------------------------------
+class sampler
+{
+public:
+    sampler( samplertype   type,
+             std::uint32_t key,
+             std::uint32_t index,
+             std::uint32_t dimension = 0 ) noexcept
+        : _type( type ), _key( key ), _index( index ), _dimension( dimension )
+    {
+    }
+
+    // next value in [0, 1)
+    float next1D() noexcept
+    {
+        std::uint32_t d = _dimension++;
+        if ( _type == samplertype::kRandom )
+            return toUnit( random( d ) );
+
+        std::uint32_t seed = mix( _key, d );
+        std::uint32_t ii   = scramble( _index, seed );
+        return toUnit( scramble( reverse( ii ), mix( seed, 1 ) ) );
+    }
+
+    // next point in [0, 1)^2
+    void next2D( float &u, float &v ) noexcept
+    {
+        std::uint32_t d = _dimension;
+        _dimension += 2;
+        if ( _type == samplertype::kRandom )
+        {
+            u = toUnit( random( d ) );
+            v = toUnit( random( d + 1 ) );
+            return;
+        }
+
+        std::uint32_t seed = mix( _key, d );
+        std::uint32_t ii   = scramble( _index, seed );
+        u = toUnit( scramble( reverse( ii ), mix( seed, 1 ) ) );
+        v = toUnit( scramble( sobol1( ii ), mix( seed, 2 ) ) );
+    }
+
+    std::uint32_t dimension() const noexcept { return _dimension; }
+
+private:
+    // splitmix64 finalizer over the packed counter
+    std::uint32_t random( std::uint32_t d ) const noexcept
+    {
+        std::uint64_t x = ( std::uint64_t( _key ) << 32 | _index ) ^
+                          ( ( d + 1ull ) * 0x9e3779b97f4a7c15ull );
+        x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+        x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebull;
+        return static_cast<std::uint32_t>( ( x ^ ( x >> 31 ) ) >> 32 );
+    }
+
+    // pcg output hash of a combined with b
+    static std::uint32_t mix( std::uint32_t a, std::uint32_t b ) noexcept
+    {
+        std::uint32_t state = ( a ^ ( b * 0x9e3779b9u ) ) * 747796405u +
+                              2891336453u;
+        std::uint32_t word =
+            ( ( state >> ( ( state >> 28 ) + 4 ) ) ^ state ) * 277803737u;
+        return ( word >> 22 ) ^ word;
+    }
+
+    static std::uint32_t reverse( std::uint32_t x ) noexcept
+    {
+        x = ( x << 16 ) | ( x >> 16 );
+        x = ( ( x & 0x00ff00ffu ) << 8 ) | ( ( x & 0xff00ff00u ) >> 8 );
+        x = ( ( x & 0x0f0f0f0fu ) << 4 ) | ( ( x & 0xf0f0f0f0u ) >> 4 );
+        x = ( ( x & 0x33333333u ) << 2 ) | ( ( x & 0xccccccccu ) >> 2 );
+        x = ( ( x & 0x55555555u ) << 1 ) | ( ( x & 0xaaaaaaaau ) >> 1 );
+        return x;
+    }
+
+    // owen scramble of the bits of x, most significant first, keyed by seed.
+    // the laine-karras hash works from the low bits, hence the reversals
+    static std::uint32_t scramble( std::uint32_t x,
+                                   std::uint32_t seed ) noexcept
+    {
+        x = reverse( x );
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverse( x );
+    }
+
+    // second sobol dimension, its direction numbers are the rows of the
+    // pascal matrix mod 2
+    static std::uint32_t sobol1( std::uint32_t index ) noexcept
+    {
+        std::uint32_t result = 0;
+        std::uint32_t v      = 1u << 31;
+        for ( ; index; index >>= 1, v ^= v >> 1 )
+        {
+            if ( index & 1 )
+                result ^= v;
+        }
+        return result;
+    }
+
+    // top 24 bits, so that the float is exact and below 1
+    static float toUnit( std::uint32_t x ) noexcept
+    {
+        return ( x >> 8 ) * ( 1.0f / 16777216.0f );
+    }
+
+    samplertype   _type;
+    std::uint32_t _key;
+    std::uint32_t _index;
+    std::uint32_t _dimension;
+};
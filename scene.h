@@ -1,48 +1,346 @@
 #ifndef _scene_h_
 #define _scene_h_
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <limits>
 #include <vector>
+#include "bvh.h"
 #include "hit.h"
+#include "mesh.h"
 #include "primitive.h"
+#include "sphere.h"
+#include "spheregroup.h"
+#include "util/stats.h"
+#include "util/trace.h"
 
 // ----------------------------------------------------------------------------------------
+// primitives are stored by type: spheres by value in one spheregroup, meshes
+// in a list of their own and everything else behind the primitive interface.
+// the top level bvh knows the group of every entry and calls the two built in
+// types directly instead of through virtual functions
 // ----------------------------------------------------------------------------------------
 template <typename T>
 class scene
 {
 public:
-    constexpr scene() noexcept = default;
+    scene() = default;
+
+    scene( const scene &other )
+        : _spheres( other._spheres ),
+          _meshes( other._meshes ),
+          _primitives( other._primitives )
+    {
+    }
+
+    scene &operator=( const scene &other )
+    {
+        _spheres    = other._spheres;
+        _meshes     = other._meshes;
+        _primitives = other._primitives;
+        _dirty.store( true, std::memory_order_release );
+        return *this;
+    }
+
+    // copied into the sphere group, no allocation per sphere
+    scene &operator<<( const sphere<T> &s )
+    {
+        _spheres.add( s );
+        _dirty.store( true, std::memory_order_release );
+        return *this;
+    }
+
+    scene &operator<<( mesh<T> *m ) noexcept
+    {
+        _meshes.emplace_back( m );
+        _dirty.store( true, std::memory_order_release );
+        return *this;
+    }
 
     scene& operator << (primitive<T> *p) noexcept
     {
         _primitives.emplace_back( p );
+        _dirty.store( true, std::memory_order_release );
         return *this;
     }
 
-    constexpr bool intersect(const ray<T> &r, hit<T> &h) const noexcept
+    bool intersect(const ray<T> &r, hit<T> &h) const noexcept
     {
+        if ( _dirty.load( std::memory_order_acquire ) )
+            rebuild();
+
+        // every candidate only has to beat the closest hit found so far
+        ray<T> clipped = r;
         hit<T> curHit;
-        T dist = std::numeric_limits<T>::infinity();
-        for ( auto& p : _primitives)
+        auto   leaf = [&]( unsigned int first, unsigned int count, T &tmax ) {
+            bool found = false;
+            for ( unsigned int ii = first; ii < first + count; ++ii )
+            {
+                clipped.tmax = tmax;
+                bool isec    = visit( _ordered[ii], [&]( const auto &p ) {
+                    return p.intersect( clipped, curHit );
+                } );
+                if ( !isec || curHit._t >= tmax )
+                    continue;
+
+                tmax  = curHit._t;
+                h     = curHit;
+                found = true;
+            }
+            return found;
+        };
+
+        bool found = _bvh.traverse( r, r.tmax, leaf );
+        if ( found )
+            PT_STAT_ADD( kHits, 1 );
+        return found;
+    }
+
+    // true if anything blocks the ray before r.tmax, stops at the first hit
+    bool occluded( const ray<T> &r ) const noexcept
+    {
+        if ( _dirty.load( std::memory_order_acquire ) )
+            rebuild();
+
+        auto leaf = [&]( unsigned int first, unsigned int count, T &tmax ) {
+            for ( unsigned int ii = first; ii < first + count; ++ii )
+            {
+                if ( visit( _ordered[ii], [&]( const auto &p ) {
+                         return p.occluded( r );
+                     } ) )
+                {
+                    tmax = T( -1 );
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        return _bvh.traverse( r, r.tmax, leaf );
+    }
+
+    // closest hits of the active lanes, only distance and primitive are
+    // recorded. use resolve() for the lanes whose hit point is needed
+    void intersect( raypacket<T> &p, packethit<T> &h ) const noexcept
+    {
+        if ( _dirty.load( std::memory_order_acquire ) )
+            rebuild();
+
+        h.mask    = 0;
+        auto leaf = [&]( unsigned int first, unsigned int count,
+                         raypacket<T> &pk ) {
+            for ( unsigned int ii = first; ii < first + count; ++ii )
+            {
+                visit( _ordered[ii],
+                       [&]( const auto &p ) { p.intersect( pk, h ); } );
+            }
+        };
+
+        _bvh.traverse( p, leaf );
+        PT_STAT_ADD( kHits, BitCount( h.mask ) );
+    }
+
+    // returns the active lanes that are blocked before their tmax. they are
+    // removed from p.active
+    unsigned int occluded( raypacket<T> &p ) const noexcept
+    {
+        if ( _dirty.load( std::memory_order_acquire ) )
+            rebuild();
+
+        unsigned int blocked = 0;
+        auto         leaf    = [&]( unsigned int first, unsigned int count,
+                             raypacket<T> &pk ) {
+            for ( unsigned int ii = first; ii < first + count && pk.active;
+                  ++ii )
+            {
+                blocked |= visit( _ordered[ii], [&]( const auto &p ) {
+                    return p.occluded( pk );
+                } );
+            }
+        };
+
+        _bvh.traverse( p, leaf );
+        return blocked;
+    }
+
+    // hit record of one lane of a packet query
+    void resolve( const raypacket<T> & p,
+                  const packethit<T> &ph,
+                  unsigned int        lane,
+                  hit<T> &            h ) const noexcept
+    {
+        ph.object[lane]->resolve( p.get( lane ), ph.t[lane],
+                                  ph.element[lane], h );
+    }
+
+    // shading data of the hit h of r, once it is known to be the closest
+    void shade( const ray<T> &r, const hit<T> &h, surface<T> &s ) const noexcept
+    {
+        h._object->shade( r, h, s );
+    }
+
+    const bvh<T> &accel() const noexcept
+    {
+        if ( _dirty.load( std::memory_order_acquire ) )
+            rebuild();
+        return _bvh;
+    }
+
+    // true if any primitive emits light
+    bool hasLights() const noexcept
+    {
+        if ( _dirty.load( std::memory_order_acquire ) )
+            rebuild();
+        return !_lights.empty();
+    }
+
+    // picks an emitter in proportion to its power with select and samples a
+    // point of it seen from the point from with u and v. ls.pdf includes the
+    // probability of picking the emitter
+    bool sampleLight( const vec3<T> & from,
+                      float           select,
+                      float           u,
+                      float           v,
+                      lightsample<T> &ls ) const noexcept
+    {
+        if ( !hasLights() )
+            return false;
+
+        float       target = select * _lightCdf.back();
+        std::size_t index =
+            std::upper_bound( _lightCdf.begin(), _lightCdf.end(), target ) -
+            _lightCdf.begin();
+        index = std::min( index, _lights.size() - 1 );
+
+        const emitter &e = _lights[index];
+        if ( !e.object->sampleEmitter( e.element, from, u, v, ls ) )
+            return false;
+        ls.pdf *= e.object->emitterPower( e.element ) / _lightCdf.back();
+        return true;
+    }
+
+    // density with which sampleLight() from the point from picks the point
+    // pos of the hit h, 0 if h is not on an emitter
+    float lightPdf( const vec3<T> &from,
+                    const hit<T> & h,
+                    const vec3<T> &pos ) const noexcept
+    {
+        if ( !h._object || !hasLights() )
+            return 0.0f;
+
+        float power = h._object->emitterPower( h._element );
+        if ( !( power > 0.0f ) )
+            return 0.0f;
+        return power / _lightCdf.back() *
+               h._object->emitterPdf( h._element, from, pos );
+    }
+
+private:
+
+    enum class group : unsigned char
+    {
+        kSpheres,
+        kMesh,
+        kOther
+    };
+
+    struct entry
+    {
+        const primitive<T> *object;
+        group               kind;
+    };
+
+    // calls fn with the primitive of e as its own type. spheregroup and mesh
+    // are final, so the calls fn makes on them are not virtual
+    template <typename Fn>
+    static decltype( auto ) visit( const entry &e, Fn &&fn ) noexcept
+    {
+        switch ( e.kind )
         {
-            if ( !p->intersect(r, curHit))
-                continue;
+        case group::kSpheres:
+            return fn( static_cast<const spheregroup<T> &>( *e.object ) );
+        case group::kMesh:
+            return fn( static_cast<const mesh<T> &>( *e.object ) );
+        default:
+            return fn( *e.object );
+        }
+    }
+
+    // the top level bvh is rebuilt lazily by the first query after primitives
+    // were added, so a batch of insertions pays for a single build
+    void rebuild() const noexcept
+    {
+        std::lock_guard<std::mutex> lock( _buildMutex );
+        if ( !_dirty.load( std::memory_order_relaxed ) )
+            return;
+
+        PT_TRACE_SCOPE( "build scene bvh", "scene" );
+        _spheres.build();
 
-            T curDist = (curHit._pos - r.o).len2();
-            if ( curDist < dist )
+        std::vector<entry> entries;
+        if ( !_spheres.empty() )
+            entries.push_back( {&_spheres, group::kSpheres} );
+        for ( auto &m : _meshes )
+            entries.push_back( {m.get(), group::kMesh} );
+        for ( auto &p : _primitives )
+            entries.push_back( {p.get(), group::kOther} );
+
+        std::vector<bbox<T>> bounds;
+        bounds.reserve( entries.size() );
+        for ( const entry &e : entries )
+            bounds.push_back( e.object->bounds() );
+
+        _bvh.build( bounds );
+
+        _ordered.resize( entries.size() );
+        for ( unsigned int ii = 0; ii < entries.size(); ++ii )
+            _ordered[ii] = entries[_bvh.order()[ii]];
+
+        _lights.clear();
+        _lightCdf.clear();
+        std::vector<unsigned int> elements;
+        float                     total = 0.0f;
+        for ( const entry &e : _ordered )
+        {
+            const primitive<T> *p = e.object;
+            elements.clear();
+            p->emitters( elements );
+            for ( unsigned int element : elements )
             {
-                dist = curDist;
-                h = curHit;
+                float power = p->emitterPower( element );
+                if ( !( power > 0.0f ) )
+                    continue;
+                total += power;
+                _lights.push_back( {p, element} );
+                _lightCdf.push_back( total );
             }
         }
-        return ( dist != std::numeric_limits<T>::infinity() );
+
+        _dirty.store( false, std::memory_order_release );
     }
 
-private:
+    struct emitter
+    {
+        const primitive<T> *object;
+        unsigned int        element;
+    };
+
+    // built along with the top level bvh
+    mutable spheregroup<T>                     _spheres;
+    std::vector<std::shared_ptr<mesh<T>>>      _meshes;
+    std::vector<std::shared_ptr<primitive<T>>> _primitives;
+
+    // entries of the top level bvh in leaf order
+    mutable std::vector<entry> _ordered;
 
-    std::vector<std::shared_ptr<primitive<T>>>  _primitives;
+    // emitting elements with the running sum of their power
+    mutable std::vector<emitter> _lights;
+    mutable std::vector<float>   _lightCdf;
+    mutable bvh<T>                            _bvh;
+    mutable std::atomic<bool>                 _dirty{true};
+    mutable std::mutex                        _buildMutex;
 };
 
 #endif // _scene_h_
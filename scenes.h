@@ -0,0 +1,107 @@
+#pragma once
+
+#include "camera.h"
+#include "mat44.h"
+#include "mesh.h"
+#include "scene.h"
+#include "sphere.h"
+#include "streamedmesh.h"
+#include <string>
+
+// bundled .obj files live in the repository root
+#ifndef PATHTRACER_ASSET_DIR
+#define PATHTRACER_ASSET_DIR "."
+#endif
+
+// -----------------------------------------------------------------------------
+// the cornell box from the repository with three diffuse spheres and a
+// spherical light, seen through the returned camera
+// -----------------------------------------------------------------------------
+template <typename T>
+camera<T> buildCornellBoxScene(
+    scene<T> &world, const std::string &assetDir = PATHTRACER_ASSET_DIR )
+{
+    material redDiffuse{{1.0f, 0.0f, 0.0f, 1.0f}};
+    material blueDiffuse{{1.0f, 0.0f, 1.0f, 1.0f}};
+    material greenDiffuse{{1.0f, 1.0f, 0.0f, 1.0f}};
+    material whiteEmissive{{1.0f, 1.0f, 1.0f, 1.0f}};
+    whiteEmissive.setEmissive( 12.5f );
+
+    auto cornellbox = new mesh<T>( assetDir + "/cornellbox.obj" );
+    cornellbox->transform( mat44<T>::makeRotation( 90, 2 ) );
+    world << sphere<T>( {0.4f, 0.0f, -0.6f}, 0.75f * 0.5f, redDiffuse )
+          << sphere<T>( {-0.4f, 0.5f, -0.6f}, 0.75f * 0.5f, blueDiffuse )
+          << sphere<T>( {-0.4f, -0.5f, -0.6f}, 0.75f * 0.5f, greenDiffuse )
+          << sphere<T>( {0.0f, 0.0f, 1.25f}, 0.75f * 0.5f, whiteEmissive )
+          << cornellbox;
+
+    return {{2.472f, 0, 0}, {0, 0, 0}, 60};
+}
+
+// -----------------------------------------------------------------------------
+// a single model lit by a spherical light above it. the camera looks at the
+// model from the +x side and frames its bounds
+// -----------------------------------------------------------------------------
+template <typename T, typename MODEL>
+camera<T> buildModelScene( scene<T> &world, MODEL *model )
+{
+    material whiteEmissive{{1.0f, 1.0f, 1.0f, 1.0f}};
+    whiteEmissive.setEmissive( 12.5f );
+
+    world << model;
+
+    bbox<T> box    = model->bounds();
+    vec3<T> center = box.center();
+    T       radius = box.radius();
+    if ( !box.isvalid() || !( radius > T( 0 ) ) )
+    {
+        center = {0, 0, 0};
+        radius = T( 1 );
+    }
+
+    world << sphere<T>( center + vec3<T>{radius, 0, 2 * radius},
+                        T( 0.5 ) * radius,
+                        whiteEmissive );
+
+    return {center + vec3<T>{T( 2.5 ) * radius, 0, T( 0.5 ) * radius},
+            center,
+            60};
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+camera<T> buildMeshScene( scene<T> &world, const std::string &path )
+{
+    return buildModelScene( world, new mesh<T>( path ) );
+}
+
+// -----------------------------------------------------------------------------
+// the scene the command line names: "cornell", the path of an .obj file or
+// of a cluster file written by streamedmesh<T>::write(), which is rendered
+// out of core with budget bytes of clusters in memory. streamed receives the
+// streamed mesh, if any, for its paging statistics
+// -----------------------------------------------------------------------------
+template <typename T>
+camera<T> buildScene( scene<T> &              world,
+                      const std::string &     name,
+                      std::size_t             budget   = kClusterBudget,
+                      const streamedmesh<T> **streamed = nullptr )
+{
+    PT_TRACE_SCOPE( "build scene", "scene" );
+    if ( name == "cornell" )
+        return buildCornellBoxScene( world );
+
+    const std::string extension = kClusterFileExtension;
+    if ( name.size() > extension.size() &&
+         name.compare( name.size() - extension.size(),
+                       extension.size(),
+                       extension ) == 0 )
+    {
+        auto model = new streamedmesh<T>( name, budget );
+        if ( streamed )
+            *streamed = model;
+        return buildModelScene( world, model );
+    }
+    return buildMeshScene( world, name );
+}
@@ -4,32 +4,179 @@
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 template <typename T>
-bool sphere<T>::intersect( const ray<T> &r, hit<T> &h ) const noexcept
+bool intersectSphere( const vec3<T> &center,
+                      T              radius,
+                      const ray<T> & r,
+                      T &            t ) noexcept
 {
-    // Solve t^2*d.d + 2*t*(o-p).d + (o-p).(o-p)-R^2 = 0
-    auto op            = _center - r.o;
-    auto radiusSquared = _radius * _radius;
+    // Solve t^2*d.d + 2*t*(o-p).d + (o-p).(o-p)-R^2 = 0. the determinant is
+    // R^2 minus the squared distance of the center from the ray, which keeps
+    // its precision far from the sphere, unlike b^2 - (o-p).(o-p) + R^2
+    auto op            = center - r.o;
+    auto radiusSquared = radius * radius;
     auto b             = op % r.d;
-    auto determinant   = b * b - op.len2() + radiusSquared;
+    auto determinant   = radiusSquared - ( op - r.d * b ).len2();
     if ( determinant < 0 )
         return false;
 
-    determinant              = std::sqrt( determinant );
-    auto             minusT  = b - determinant;
-    auto             plusT   = b + determinant;
-    constexpr double Epsilon = 0.000000001;
-    if ( minusT < Epsilon && plusT < Epsilon )
+    determinant = std::sqrt( determinant );
+    auto minusT = b - determinant;
+    auto plusT  = b + determinant;
+    if ( minusT < kSphereEpsilon && plusT < kSphereEpsilon )
         return false;
 
-    auto t           = minusT > Epsilon ? minusT : plusT;
-    auto hitPosition = r.o + r.d * t;
+    t = minusT > kSphereEpsilon ? minusT : plusT;
+    return !( t > r.tmax );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+bool sphere<T>::intersect( const ray<T> &r, hit<T> &h ) const noexcept
+{
+    T t;
+    PT_STAT_ADD( kSphereTests, 1 );
+    if ( !intersectSphere( _center, _radius, r, t ) )
+        return false;
+
+    resolve( r, t, 0, h );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void sphere<T>::resolve( const ray<T> &r,
+                         T             t,
+                         unsigned int  element,
+                         hit<T> &      h ) const noexcept
+{
+    h._t       = t;
+    h._object  = this;
+    h._element = 0;
+    h._u       = 0.0f;
+    h._v       = 0.0f;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void sphere<T>::shade( const ray<T> &r,
+                       const hit<T> &h,
+                       surface<T> &  s ) const noexcept
+{
+    auto hitPosition = r.o + r.d * h._t;
     auto normal      = ( hitPosition - _center );
     normal.normalize();
+    // back onto the surface, which removes most of the error of t
+    hitPosition = _center + normal * _radius;
     bool inside = normal % r.d > 0;
     if ( inside )
         normal = normal * -1.0f;
-    h._pos    = hitPosition;
-    h._normal = normal;
-    h._mat    = _mat;
+    s._pos    = hitPosition;
+    s._normal = normal;
+    s._mat    = &_mat;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void sphere<T>::emitters( std::vector<unsigned int> &elements ) const
+{
+    if ( _mat.emission() > 0.0f )
+        elements.push_back( 0 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+float sphere<T>::emitterPower( unsigned int element ) const noexcept
+{
+    float area = 4.0f * M_PI * _radius * _radius;
+    return _mat.emission() * _mat.diffuse().luminance() * area;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+bool sphere<T>::sampleEmitter( unsigned int    element,
+                               const vec3<T> & from,
+                               float           u,
+                               float           v,
+                               lightsample<T> &ls ) const noexcept
+{
+    vec3<T> axis          = _center - from;
+    T       dist2         = axis.len2();
+    T       radiusSquared = _radius * _radius;
+    float   phi           = 2.0f * M_PI * v;
+    ls.radiance           = _mat.diffuse() * _mat.emission();
+    if ( dist2 <= radiusSquared )
+    {
+        // uniform on the surface
+        float   z = 1.0f - 2.0f * u;
+        float   s = std::sqrt( std::max( 0.0f, 1.0f - z * z ) );
+        vec3<T> n{T( s * std::cos( phi ) ), T( s * std::sin( phi ) ), T( z )};
+        n.normalize();
+        ls.pos    = _center + n * _radius;
+        ls.normal = n * T( -1 );
+        ls.pdf    = emitterPdf( element, from, ls.pos );
+        return ls.pdf > 0.0f;
+    }
+
+    // uniform in the cone, 1 - cos is taken from sin^2 to keep small lights
+    // accurate in float
+    T dist        = std::sqrt( dist2 );
+    T sin2Max     = radiusSquared / dist2;
+    T cosMax      = std::sqrt( std::max( T( 0 ), 1 - sin2Max ) );
+    T oneMinusCos = sin2Max / ( 1 + cosMax );
+    T cosTheta    = 1 - u * oneMinusCos;
+    T sin2Theta   = std::max( T( 0 ), 1 - cosTheta * cosTheta );
+    T sinTheta    = std::sqrt( sin2Theta );
+
+    vec3<T> w = axis / dist;
+    vec3<T> tu, tv;
+    orthonormalBasis( w, tu, tv );
+    vec3<T> d = tu * ( sinTheta * std::cos( phi ) ) +
+                tv * ( sinTheta * std::sin( phi ) ) + w * cosTheta;
+
+    // near intersection of the sampled direction with the sphere
+    T t = dist * cosTheta -
+          std::sqrt( std::max( T( 0 ), radiusSquared - dist2 * sin2Theta ) );
+    vec3<T> n = from + d * t - _center;
+    n.normalize();
+    ls.pos    = _center + n * _radius;
+    ls.normal = n;
+    ls.pdf    = 1.0f / ( 2.0f * M_PI * oneMinusCos );
     return true;
 }
+
+// -----------------------------------------------------------------------------
+// from outside only the visible cap is sampled, so every point the ray can
+// hit there has the density of the cone
+// -----------------------------------------------------------------------------
+template <typename T>
+float sphere<T>::emitterPdf( unsigned int   element,
+                             const vec3<T> &from,
+                             const vec3<T> &pos ) const noexcept
+{
+    vec3<T> axis          = _center - from;
+    T       dist2         = axis.len2();
+    T       radiusSquared = _radius * _radius;
+    if ( dist2 > radiusSquared )
+    {
+        T sin2Max     = radiusSquared / dist2;
+        T cosMax      = std::sqrt( std::max( T( 0 ), 1 - sin2Max ) );
+        T oneMinusCos = sin2Max / ( 1 + cosMax );
+        return 1.0f / ( 2.0f * M_PI * oneMinusCos );
+    }
+
+    // area density converted to solid angle at from
+    vec3<T> n      = pos - _center;
+    vec3<T> d      = pos - from;
+    T       len2   = d.len2();
+    T       cosine = std::abs( n % d ) / ( _radius * std::sqrt( len2 ) );
+    if ( !( cosine > T( 0 ) ) )
+        return 0.0f;
+    float area = 4.0f * M_PI * radiusSquared;
+    return len2 / ( cosine * area );
+}
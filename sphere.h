@@ -5,6 +5,20 @@
 #include "material.h"
 #include "primitive.h"
 #include "ray.h"
+#include "util/stats.h"
+
+// hits closer than this to the ray origin are ignored
+constexpr double kSphereEpsilon = 0.000000001;
+
+// -----------------------------------------------------------------------------
+// distance along r to the sphere of the given center and radius, the near side
+// unless r starts inside it. false if it is missed or lies beyond r.tmax
+// -----------------------------------------------------------------------------
+template <typename T>
+bool intersectSphere( const vec3<T> &center,
+                      T              radius,
+                      const ray<T> & r,
+                      T &            t ) noexcept;
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -27,6 +41,37 @@ public:
     virtual bool intersect( const ray<T> &r, hit<T> &h ) const
         noexcept override;
 
+    virtual void resolve( const ray<T> &r,
+                          T             t,
+                          unsigned int  element,
+                          hit<T> &      h ) const noexcept override;
+
+    virtual void shade( const ray<T> &r,
+                        const hit<T> &h,
+                        surface<T> &  s ) const noexcept override;
+
+    virtual void emitters( std::vector<unsigned int> &elements ) const override;
+
+    virtual float emitterPower( unsigned int element ) const noexcept override;
+
+    // points of the cone of directions the sphere covers from outside, points
+    // of the whole surface from inside
+    virtual bool sampleEmitter( unsigned int    element,
+                                const vec3<T> & from,
+                                float           u,
+                                float           v,
+                                lightsample<T> &ls ) const noexcept override;
+
+    virtual float emitterPdf( unsigned int   element,
+                              const vec3<T> &from,
+                              const vec3<T> &pos ) const noexcept override;
+
+    virtual bbox<T> bounds() const noexcept override
+    {
+        vec3<T> extent{_radius, _radius, _radius};
+        return {_center - extent, _center + extent};
+    }
+
     constexpr const material &getMaterial() const noexcept { return _mat; }
 
 private:
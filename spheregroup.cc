@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <cmath>
+
+#if PT_X86
+#include <immintrin.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// portable version of the leaf test, sphere by sphere
+// -----------------------------------------------------------------------------
+template <typename T>
+unsigned int intersectSpheres( const T *     cx,
+                               const T *     cy,
+                               const T *     cz,
+                               const T *     radius,
+                               unsigned int  count,
+                               const ray<T> &r,
+                               T             tmax,
+                               T *           t ) noexcept
+{
+    ray<T> clipped = r;
+    clipped.tmax   = tmax;
+
+    unsigned int hits = 0;
+    for ( unsigned int ii = 0; ii < count; ++ii )
+    {
+        if ( intersectSphere( vec3<T>{cx[ii], cy[ii], cz[ii]},
+                              radius[ii],
+                              clipped,
+                              t[ii] ) )
+            hits |= 1u << ii;
+    }
+    return hits;
+}
+
+#if PT_X86
+
+// -----------------------------------------------------------------------------
+// sse2 version, 4 spheres at once. the arithmetic follows intersectSphere
+// operation by operation so both produce the same distances. its double
+// epsilon is replaced by the smallest float above it, which float distances
+// compare to the same way
+// -----------------------------------------------------------------------------
+inline unsigned int intersectSpheres( const float *     cx,
+                                      const float *     cy,
+                                      const float *     cz,
+                                      const float *     radius,
+                                      unsigned int      count,
+                                      const ray<float> &r,
+                                      float             tmax,
+                                      float *           t ) noexcept
+{
+    static const float epsilon = [] {
+        float e = static_cast<float>( kSphereEpsilon );
+        return e > kSphereEpsilon ? e : std::nextafter( e, 1.0f );
+    }();
+
+    __m128 opx = _mm_sub_ps( _mm_loadu_ps( cx ), _mm_set1_ps( r.o[0] ) );
+    __m128 opy = _mm_sub_ps( _mm_loadu_ps( cy ), _mm_set1_ps( r.o[1] ) );
+    __m128 opz = _mm_sub_ps( _mm_loadu_ps( cz ), _mm_set1_ps( r.o[2] ) );
+    __m128 rad = _mm_loadu_ps( radius );
+    __m128 dx  = _mm_set1_ps( r.d[0] );
+    __m128 dy  = _mm_set1_ps( r.d[1] );
+    __m128 dz  = _mm_set1_ps( r.d[2] );
+
+    __m128 b = _mm_add_ps(
+        _mm_add_ps( _mm_mul_ps( opx, dx ), _mm_mul_ps( opy, dy ) ),
+        _mm_mul_ps( opz, dz ) );
+    __m128 qx  = _mm_sub_ps( opx, _mm_mul_ps( dx, b ) );
+    __m128 qy  = _mm_sub_ps( opy, _mm_mul_ps( dy, b ) );
+    __m128 qz  = _mm_sub_ps( opz, _mm_mul_ps( dz, b ) );
+    __m128 len = _mm_add_ps(
+        _mm_add_ps( _mm_mul_ps( qx, qx ), _mm_mul_ps( qy, qy ) ),
+        _mm_mul_ps( qz, qz ) );
+    __m128 determinant = _mm_sub_ps( _mm_mul_ps( rad, rad ), len );
+    __m128 miss = _mm_cmplt_ps( determinant, _mm_setzero_ps() );
+
+    determinant   = _mm_sqrt_ps( determinant );
+    __m128 minusT = _mm_sub_ps( b, determinant );
+    __m128 plusT  = _mm_add_ps( b, determinant );
+    __m128 eps    = _mm_set1_ps( epsilon );
+    miss          = _mm_or_ps(
+        miss,
+        _mm_and_ps( _mm_cmplt_ps( minusT, eps ), _mm_cmplt_ps( plusT, eps ) ) );
+
+    __m128 front = _mm_cmpge_ps( minusT, eps );
+    __m128 dist  = _mm_or_ps( _mm_and_ps( front, minusT ),
+                              _mm_andnot_ps( front, plusT ) );
+    miss = _mm_or_ps( miss, _mm_cmpgt_ps( dist, _mm_set1_ps( tmax ) ) );
+
+    unsigned int hits = ~_mm_movemask_ps( miss ) & ( ( 1u << count ) - 1 );
+    if ( hits )
+        _mm_storeu_ps( t, dist );
+    return hits;
+}
+
+#endif // PT_X86
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void spheregroup<T>::add( const sphere<T> &s )
+{
+    // drop the padding, build() puts it back
+    for ( std::vector<T> *c : {&_cx, &_cy, &_cz, &_radius} )
+        c->resize( _count );
+
+    _cx.push_back( s.center()[0] );
+    _cy.push_back( s.center()[1] );
+    _cz.push_back( s.center()[2] );
+    _radius.push_back( s.radius() );
+    _materials.push_back( s.getMaterial() );
+    ++_count;
+    _built = false;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void spheregroup<T>::build()
+{
+    if ( _built )
+        return;
+    _built = true;
+
+    std::vector<bbox<T>> bounds( _count );
+    for ( unsigned int ii = 0; ii < _count; ++ii )
+    {
+        vec3<T> extent{_radius[ii], _radius[ii], _radius[ii]};
+        bounds[ii] = {center( ii ) - extent, center( ii ) + extent};
+    }
+    _bvh.build( bounds );
+    _box = _bvh.empty() ? bbox<T>() : _bvh.bounds();
+
+    const auto &order = _bvh.order();
+    for ( std::vector<T> *c : {&_cx, &_cy, &_cz, &_radius} )
+    {
+        std::vector<T> sorted( _count + kLanes - 1, T( 0 ) );
+        for ( unsigned int ii = 0; ii < _count; ++ii )
+            sorted[ii] = ( *c )[order[ii]];
+        c->swap( sorted );
+    }
+
+    std::vector<material> materials( _count );
+    for ( unsigned int ii = 0; ii < _count; ++ii )
+        materials[ii] = _materials[order[ii]];
+    _materials.swap( materials );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+unsigned int spheregroup<T>::intersectLeaf( const ray<T> &r,
+                                            unsigned int  first,
+                                            unsigned int  count,
+                                            T             tmax,
+                                            T *           t ) const noexcept
+{
+    PT_STAT_ADD( kSphereTests, count );
+    return intersectSpheres( _cx.data() + first,
+                             _cy.data() + first,
+                             _cz.data() + first,
+                             _radius.data() + first,
+                             count,
+                             r,
+                             tmax,
+                             t );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+bool spheregroup<T>::intersect( const ray<T> &r, hit<T> &h ) const noexcept
+{
+    unsigned int closest  = 0;
+    T            tclosest = T( 0 );
+    auto leaf = [&]( unsigned int first, unsigned int count, T &tmax ) {
+        bool found = false;
+        for ( unsigned int base = first; base < first + count; base += kLanes )
+        {
+            T            t[kLanes];
+            unsigned int n    = std::min( kLanes, first + count - base );
+            unsigned int hits = intersectLeaf( r, base, n, tmax, t );
+            for ( unsigned int ii = 0; hits; ++ii, hits >>= 1 )
+            {
+                if ( !( hits & 1u ) || !( t[ii] < tmax ) )
+                    continue;
+                tmax     = t[ii];
+                tclosest = t[ii];
+                closest  = base + ii;
+                found    = true;
+            }
+        }
+        return found;
+    };
+
+    if ( !_bvh.traverse( r, r.tmax, leaf ) )
+        return false;
+
+    resolve( r, tclosest, closest, h );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+bool spheregroup<T>::occluded( const ray<T> &r ) const noexcept
+{
+    auto leaf = [&]( unsigned int first, unsigned int count, T &tmax ) {
+        for ( unsigned int base = first; base < first + count; base += kLanes )
+        {
+            T            t[kLanes];
+            unsigned int n = std::min( kLanes, first + count - base );
+            if ( intersectLeaf( r, base, n, tmax, t ) )
+            {
+                // any hit will do, a negative tmax ends the traversal
+                tmax = T( -1 );
+                return true;
+            }
+        }
+        return false;
+    };
+
+    return _bvh.traverse( r, r.tmax, leaf );
+}
+
+// -----------------------------------------------------------------------------
+// the lanes of a packet rarely agree on which spheres they hit, each active
+// lane is tested on its own against 4 spheres at a time
+// -----------------------------------------------------------------------------
+template <typename T>
+void spheregroup<T>::intersect( raypacket<T> &p, packethit<T> &h ) const
+    noexcept
+{
+    auto leaf = [&]( unsigned int first, unsigned int count,
+                     raypacket<T> &pk ) {
+        for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+        {
+            if ( !( pk.active & ( 1u << lane ) ) )
+                continue;
+
+            ray<T> r = pk.get( lane );
+            for ( unsigned int base = first; base < first + count;
+                  base += kLanes )
+            {
+                T            t[kLanes];
+                unsigned int n = std::min( kLanes, first + count - base );
+                unsigned int hits =
+                    intersectLeaf( r, base, n, pk.tmax[lane], t );
+                for ( unsigned int ii = 0; hits; ++ii, hits >>= 1 )
+                {
+                    if ( !( hits & 1u ) || !( t[ii] < pk.tmax[lane] ) )
+                        continue;
+                    pk.tmax[lane]   = t[ii];
+                    h.t[lane]       = t[ii];
+                    h.element[lane] = base + ii;
+                    h.object[lane]  = this;
+                    h.mask |= 1u << lane;
+                }
+            }
+        }
+    };
+
+    _bvh.traverse( p, leaf );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+unsigned int spheregroup<T>::occluded( raypacket<T> &p ) const noexcept
+{
+    unsigned int blocked = 0;
+    auto leaf = [&]( unsigned int first, unsigned int count,
+                     raypacket<T> &pk ) {
+        for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+        {
+            if ( !( pk.active & ( 1u << lane ) ) )
+                continue;
+
+            ray<T> r = pk.get( lane );
+            for ( unsigned int base = first; base < first + count;
+                  base += kLanes )
+            {
+                T            t[kLanes];
+                unsigned int n = std::min( kLanes, first + count - base );
+                if ( intersectLeaf( r, base, n, pk.tmax[lane], t ) )
+                {
+                    blocked |= 1u << lane;
+                    pk.active &= ~( 1u << lane );
+                    break;
+                }
+            }
+        }
+    };
+
+    _bvh.traverse( p, leaf );
+    return blocked;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void spheregroup<T>::resolve( const ray<T> &r,
+                              T             t,
+                              unsigned int  element,
+                              hit<T> &      h ) const noexcept
+{
+    h._t       = t;
+    h._object  = this;
+    h._element = element;
+    h._u       = 0.0f;
+    h._v       = 0.0f;
+}
+
+// -----------------------------------------------------------------------------
+// same as sphere::shade()
+// -----------------------------------------------------------------------------
+template <typename T>
+void spheregroup<T>::shade( const ray<T> &r,
+                            const hit<T> &h,
+                            surface<T> &  s ) const noexcept
+{
+    vec3<T> c           = center( h._element );
+    auto    hitPosition = r.o + r.d * h._t;
+    auto    normal      = ( hitPosition - c );
+    normal.normalize();
+    // back onto the surface, which removes most of the error of t
+    hitPosition = c + normal * _radius[h._element];
+    bool inside = normal % r.d > 0;
+    if ( inside )
+        normal = normal * -1.0f;
+    s._pos    = hitPosition;
+    s._normal = normal;
+    s._mat    = &_materials[h._element];
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void spheregroup<T>::emitters( std::vector<unsigned int> &elements ) const
+{
+    for ( unsigned int ii = 0; ii < _count; ++ii )
+    {
+        if ( _materials[ii].emission() > 0.0f )
+            elements.push_back( ii );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+float spheregroup<T>::emitterPower( unsigned int element ) const noexcept
+{
+    return sphereAt( element ).emitterPower( 0 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+bool spheregroup<T>::sampleEmitter( unsigned int    element,
+                                    const vec3<T> & from,
+                                    float           u,
+                                    float           v,
+                                    lightsample<T> &ls ) const noexcept
+{
+    return sphereAt( element ).sampleEmitter( 0, from, u, v, ls );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+float spheregroup<T>::emitterPdf( unsigned int   element,
+                                  const vec3<T> &from,
+                                  const vec3<T> &pos ) const noexcept
+{
+    return sphereAt( element ).emitterPdf( 0, from, pos );
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "boundingbox.h"
+#include "bvh.h"
+#include "hit.h"
+#include "material.h"
+#include "primitive.h"
+#include "ray.h"
+#include "sphere.h"
+#include "util/cpu.h"
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// many spheres as a single primitive. centers and radii are kept in structure
+// of arrays form in bvh leaf order, so a leaf is a run of consecutive values
+// that is tested against a ray 4 spheres at a time. the element of a hit is
+// the index of its sphere in that order
+// -----------------------------------------------------------------------------
+template <typename T>
+class spheregroup final : public primitive<T>
+{
+public:
+    // spheres tested by one simd operation
+    static constexpr unsigned int kLanes = 4;
+
+    spheregroup() = default;
+
+    // copies s in, build() has to run before the group is traced again
+    void add( const sphere<T> &s );
+
+    // the bvh over the spheres, only does work after add()
+    void build();
+
+    unsigned int size() const noexcept { return _count; }
+    bool         empty() const noexcept { return _count == 0; }
+
+    virtual bool intersect( const ray<T> &r, hit<T> &h ) const
+        noexcept override;
+
+    virtual void intersect( raypacket<T> &p, packethit<T> &h ) const
+        noexcept override;
+
+    virtual bool occluded( const ray<T> &r ) const noexcept override;
+
+    virtual unsigned int occluded( raypacket<T> &p ) const noexcept override;
+
+    virtual void resolve( const ray<T> &r,
+                          T             t,
+                          unsigned int  element,
+                          hit<T> &      h ) const noexcept override;
+
+    virtual void shade( const ray<T> &r,
+                        const hit<T> &h,
+                        surface<T> &  s ) const noexcept override;
+
+    virtual bbox<T> bounds() const noexcept override { return _box; }
+
+    virtual void emitters( std::vector<unsigned int> &elements ) const override;
+
+    virtual float emitterPower( unsigned int element ) const noexcept override;
+
+    virtual bool sampleEmitter( unsigned int    element,
+                                const vec3<T> & from,
+                                float           u,
+                                float           v,
+                                lightsample<T> &ls ) const noexcept override;
+
+    virtual float emitterPdf( unsigned int   element,
+                              const vec3<T> &from,
+                              const vec3<T> &pos ) const noexcept override;
+
+    const bvh<T> &accel() const noexcept { return _bvh; }
+
+    vec3<T> center( unsigned int ii ) const noexcept
+    {
+        return {_cx[ii], _cy[ii], _cz[ii]};
+    }
+    T radius( unsigned int ii ) const noexcept { return _radius[ii]; }
+
+private:
+    // the spheres first to first + count - 1, at most kLanes of them, that r
+    // hits no farther than tmax. bit ii stands for sphere first + ii, whose
+    // distance goes to t[ii]
+    unsigned int intersectLeaf( const ray<T> &r,
+                                unsigned int  first,
+                                unsigned int  count,
+                                T             tmax,
+                                T *           t ) const noexcept;
+
+    // copy of sphere element, whose emitter sampling the group shares
+    sphere<T> sphereAt( unsigned int element ) const noexcept
+    {
+        return {center( element ), radius( element ), _materials[element]};
+    }
+
+    // component arrays padded by kLanes - 1 zeros so that the last leaf can
+    // be loaded whole
+    std::vector<T>        _cx, _cy, _cz, _radius;
+    std::vector<material> _materials;
+    unsigned int          _count = 0;
+
+    bbox<T> _box;
+    bvh<T>  _bvh;
+    bool    _built = true;
+};
+
+#include "spheregroup.cc"
@@ -0,0 +1,611 @@
+#include "util/mappedfile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// the clusters are the highest subtrees of the mesh bvh with at most
+// maxTriangles triangles, found left to right so that they follow each other
+// in leaf order. written to a temporary file that is renamed over path once
+// complete, like the mesh cache
+// -----------------------------------------------------------------------------
+template <typename T>
+bool streamedmesh<T>::write( const mesh<T> &    m,
+                             const std::string &path,
+                             unsigned int       maxTriangles )
+{
+    PT_TRACE_SCOPE( "write clusters", "scene", "triangles", m.numTriangles() );
+    const auto &nodes = m.accel().nodes();
+    maxTriangles      = std::max( maxTriangles, 1u );
+
+    // triangles and nodes below every node
+    std::vector<unsigned int> begin( nodes.size() ), end( nodes.size() ),
+        size( nodes.size() );
+    std::function<void( unsigned int )> measure = [&]( unsigned int node ) {
+        const bvhnode<T> &n = nodes[node];
+        size[node]          = 1;
+        if ( n.isleaf() )
+        {
+            begin[node] = n.first;
+            end[node]   = n.first + n.count;
+            return;
+        }
+        measure( n.first );
+        measure( n.first + 1 );
+        begin[node] = std::min( begin[n.first], begin[n.first + 1] );
+        end[node]   = std::max( end[n.first], end[n.first + 1] );
+        size[node] += size[n.first] + size[n.first + 1];
+    };
+
+    std::vector<unsigned int>           roots;
+    std::function<void( unsigned int )> split = [&]( unsigned int node ) {
+        const bvhnode<T> &n = nodes[node];
+        if ( n.isleaf() || end[node] - begin[node] <= maxTriangles )
+        {
+            roots.push_back( node );
+            return;
+        }
+        split( n.first );
+        split( n.first + 1 );
+    };
+
+    if ( !nodes.empty() )
+    {
+        measure( 0 );
+        split( 0 );
+    }
+
+    const MappedArray<material> &     materials = m.materials();
+    const MappedArray<std::uint32_t> &ids       = m.materialIds();
+
+    clusterfileheader header;
+    memcpy( header.magic, kClusterFileMagic, sizeof( header.magic ) );
+    header.version      = kClusterFileVersion;
+    header.byteOrder    = kMeshCacheByteOrder;
+    header.scalarSize   = sizeof( T );
+    header.numTriangles = m.numTriangles();
+    for ( unsigned int ii = 0; ii < 3; ++ii )
+    {
+        header.boxMin[ii] = m.bounds().min()[ii];
+        header.boxMax[ii] = m.bounds().max()[ii];
+    }
+
+    auto align = []( std::uint64_t offset, std::uint64_t alignment ) {
+        return ( offset + alignment - 1 ) / alignment * alignment;
+    };
+
+    std::uint64_t offset = align( sizeof( header ), kMeshCacheAlignment );
+    header.materials     = {offset, materials.size(), sizeof( material )};
+    offset = align( offset + materials.size() * sizeof( material ),
+                    kMeshCacheAlignment );
+    header.clusters = {offset, roots.size(), sizeof( clusterinfo )};
+    offset          = offset + roots.size() * sizeof( clusterinfo );
+
+    std::vector<clusterinfo> table( roots.size() );
+    for ( std::size_t ii = 0; ii < roots.size(); ++ii )
+    {
+        unsigned int  root = roots[ii];
+        clusterinfo & info = table[ii];
+        std::uint64_t values, idsOffset;
+        for ( unsigned int jj = 0; jj < 3; ++jj )
+        {
+            info.boxMin[jj] = nodes[root].box.min()[jj];
+            info.boxMax[jj] = nodes[root].box.max()[jj];
+        }
+        info.first        = begin[root];
+        info.numTriangles = end[root] - begin[root];
+        info.numNodes     = size[root];
+        for ( unsigned int jj = info.first; jj < end[root]; ++jj )
+        {
+            if ( materials[ids[jj]].emission() > 0.0f )
+                ++info.numEmitters;
+        }
+        clusterLayout<bvhnode<T>, T>( info.numNodes,
+                                      info.numTriangles,
+                                      cluster::kNumComponents,
+                                      values,
+                                      idsOffset,
+                                      info.bytes );
+        info.offset = align( offset, kClusterAlignment );
+        offset      = info.offset + info.bytes;
+    }
+
+    std::string tmpPath = path + ".tmp";
+    FILE *      file    = fopen( tmpPath.c_str(), "wb" );
+    if ( !file )
+        return false;
+
+    static const char padding[kClusterAlignment] = {};
+    std::uint64_t     written                    = 0;
+    auto put = [&]( std::uint64_t at, const void *data, std::size_t bytes ) {
+        bool ok = fwrite( padding, 1, at - written, file ) == at - written &&
+                  fwrite( data, 1, bytes, file ) == bytes;
+        written = at + bytes;
+        return ok;
+    };
+
+    bool ok = put( 0, &header, sizeof( header ) ) &&
+              put( header.materials.offset,
+                   materials.data(),
+                   materials.size() * sizeof( material ) ) &&
+              put( header.clusters.offset,
+                   table.data(),
+                   table.size() * sizeof( clusterinfo ) );
+
+    // one cluster at a time: its subtree with children renumbered and
+    // leaves indexing from the first triangle, then its triangles
+    std::vector<char> blob;
+    for ( std::size_t ii = 0; ok && ii < roots.size(); ++ii )
+    {
+        const clusterinfo &       info = table[ii];
+        std::vector<bvhnode<T>>   local{nodes[roots[ii]]};
+        std::vector<unsigned int> source{roots[ii]};
+        for ( std::size_t jj = 0; jj < local.size(); ++jj )
+        {
+            const bvhnode<T> &n = nodes[source[jj]];
+            if ( n.isleaf() )
+            {
+                local[jj].first = n.first - info.first;
+                continue;
+            }
+            local[jj].first = static_cast<unsigned int>( local.size() );
+            local.push_back( nodes[n.first] );
+            local.push_back( nodes[n.first + 1] );
+            source.push_back( n.first );
+            source.push_back( n.first + 1 );
+        }
+
+        std::uint64_t values, idsOffset, bytes;
+        clusterLayout<bvhnode<T>, T>( info.numNodes,
+                                      info.numTriangles,
+                                      cluster::kNumComponents,
+                                      values,
+                                      idsOffset,
+                                      bytes );
+        blob.assign( bytes, 0 );
+        memcpy(
+            blob.data(), local.data(), local.size() * sizeof( bvhnode<T> ) );
+
+        unsigned int count  = info.numTriangles;
+        T *          column = reinterpret_cast<T *>( blob.data() + values );
+        for ( unsigned int jj = 0; jj < count; ++jj, ++column )
+        {
+            vec3<T> v0, v1, v2, n;
+            m.triangleVertices( info.first + jj, v0, v1, v2, n );
+            column[cluster::kV0x * count] = v0[0];
+            column[cluster::kV0y * count] = v0[1];
+            column[cluster::kV0z * count] = v0[2];
+            column[cluster::kV1x * count] = v1[0];
+            column[cluster::kV1y * count] = v1[1];
+            column[cluster::kV1z * count] = v1[2];
+            column[cluster::kV2x * count] = v2[0];
+            column[cluster::kV2y * count] = v2[1];
+            column[cluster::kV2z * count] = v2[2];
+            column[cluster::kNx * count]  = n[0];
+            column[cluster::kNy * count]  = n[1];
+            column[cluster::kNz * count]  = n[2];
+        }
+        memcpy( blob.data() + idsOffset,
+                ids.data() + info.first,
+                count * sizeof( std::uint32_t ) );
+
+        ok = put( info.offset, blob.data(), blob.size() );
+    }
+    ok = fclose( file ) == 0 && ok;
+
+    // rename does not replace an existing file everywhere
+    std::remove( path.c_str() );
+    if ( !ok || std::rename( tmpPath.c_str(), path.c_str() ) != 0 )
+    {
+        std::remove( tmpPath.c_str() );
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// checks that the clusters cover the triangles in order and lie within the
+// file, the clusters themselves are only read and checked when a ray reaches
+// them
+// -----------------------------------------------------------------------------
+template <typename T>
+streamedmesh<T>::streamedmesh( const std::string &path,
+                               std::size_t        budget ) noexcept
+{
+    PT_TRACE_SCOPE( "open clusters", "scene" );
+    auto file = std::make_shared<MappedFile>();
+    if ( !file->open( path ) || file->size() < sizeof( clusterfileheader ) )
+    {
+        std::cout << "could not open " << path << "\n";
+        return;
+    }
+
+    clusterfileheader header;
+    memcpy( &header, file->data(), sizeof( header ) );
+    bool valid = header.matches( sizeof( T ) );
+    auto mat   = mapCacheSection<material>( file, header.materials, valid );
+    auto table = mapCacheSection<clusterinfo>( file, header.clusters, valid );
+
+    std::uint64_t next = 0;
+    for ( const clusterinfo &c : table )
+    {
+        std::uint64_t values, ids, bytes;
+        clusterLayout<bvhnode<T>, T>( c.numNodes,
+                                      c.numTriangles,
+                                      cluster::kNumComponents,
+                                      values,
+                                      ids,
+                                      bytes );
+        valid = valid && c.first == next && c.numTriangles > 0 &&
+                c.numNodes > 0 && c.bytes == bytes &&
+                c.offset % kClusterAlignment == 0 &&
+                c.offset <= file->size() && c.bytes <= file->size() - c.offset;
+        next += c.numTriangles;
+    }
+    valid = valid && next == header.numTriangles &&
+            ( next == 0 || !mat.empty() );
+    if ( !valid )
+    {
+        std::cout << path << " is not a cluster file of this build\n";
+        return;
+    }
+
+    _numTriangles = header.numTriangles;
+    _materials.assign( mat.begin(), mat.end() );
+    _clusters.assign( table.begin(), table.end() );
+    vec3<T> boxMin{T( header.boxMin[0] ),
+                   T( header.boxMin[1] ),
+                   T( header.boxMin[2] )};
+    vec3<T> boxMax{T( header.boxMax[0] ),
+                   T( header.boxMax[1] ),
+                   T( header.boxMax[2] )};
+    _box = {boxMin, boxMax};
+
+    std::vector<bbox<T>>                           bounds;
+    std::vector<typename PageCache<cluster>::Page> pages;
+    for ( const clusterinfo &c : _clusters )
+    {
+        vec3<T> cmin{T( c.boxMin[0] ), T( c.boxMin[1] ), T( c.boxMin[2] )};
+        vec3<T> cmax{T( c.boxMax[0] ), T( c.boxMax[1] ), T( c.boxMax[2] )};
+        bounds.push_back( {cmin, cmax} );
+        pages.push_back( {c.offset, c.bytes} );
+    }
+    _top.build( bounds );
+
+    auto load = [this]( unsigned int page, const char *data, std::size_t ) {
+        const clusterinfo &info = _clusters[page];
+        std::uint64_t      values, ids, bytes;
+        clusterLayout<bvhnode<T>, T>( info.numNodes,
+                                      info.numTriangles,
+                                      cluster::kNumComponents,
+                                      values,
+                                      ids,
+                                      bytes );
+
+        auto c   = std::make_unique<cluster>();
+        c->first = info.first;
+        c->count = info.numTriangles;
+
+        auto nodes = reinterpret_cast<const bvhnode<T> *>( data );
+        auto v     = reinterpret_cast<const T *>( data + values );
+        auto m     = reinterpret_cast<const std::uint32_t *>( data + ids );
+        c->tree.assign( std::vector<bvhnode<T>>( nodes, nodes + info.numNodes ),
+                        {} );
+        c->values.assign( v, v + cluster::kNumComponents * c->count );
+        c->ids.assign( m, m + c->count );
+
+        // the table only vouches for where the cluster is, a cluster whose
+        // nodes or materials index out of range is left empty
+        bool valid = c->tree.valid( c->count );
+        for ( std::uint32_t id : c->ids )
+            valid = valid && id < _materials.size();
+        if ( !valid )
+        {
+            std::cout << "cluster " << page << " is corrupt, left out\n";
+            c->tree.clear();
+            c->values.clear();
+            c->ids.clear();
+            c->count = 0;
+        }
+        return std::unique_ptr<const cluster>( std::move( c ) );
+    };
+    _pages = std::make_unique<PageCache<cluster>>(
+        std::move( file ), std::move( pages ), budget, load );
+
+    std::cout << "mesh stats: " << _numTriangles << " triangles in "
+              << _clusters.size() << " clusters | bounding box " << _box
+              << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// the bvh over the clusters finds the clusters along the ray front to back,
+// each of them is traversed with the tmax found so far
+// -----------------------------------------------------------------------------
+template <typename T>
+bool streamedmesh<T>::intersect( const ray<T> &r, hit<T> &h ) const noexcept
+{
+    if ( _top.empty() )
+        return false;
+
+    shearedray<T> sr( r );
+    clusterref    closest;
+    unsigned int  element  = 0;
+    T             tclosest = T( 0 );
+    auto clusters = [&]( unsigned int first, unsigned int count, T &tmax ) {
+        bool found = false;
+        for ( unsigned int ii = first; ii < first + count; ++ii )
+        {
+            clusterref c    = _pages->acquire( _top.order()[ii] );
+            auto       leaf = [&]( unsigned int lfirst,
+                             unsigned int lcount,
+                             T &          ltmax ) {
+                PT_STAT_ADD( kTriangleTests, lcount );
+                bool closer = false;
+                for ( unsigned int jj = lfirst; jj < lfirst + lcount; ++jj )
+                {
+                    T t;
+                    if ( ::intersectTriangle(
+                             sr, c->v0( jj ), c->v1( jj ), c->v2( jj ), t ) &&
+                         t < ltmax )
+                    {
+                        ltmax    = t;
+                        tmax     = t;
+                        tclosest = t;
+                        element  = jj;
+                        closer   = true;
+                    }
+                }
+                return closer;
+            };
+
+            if ( c->tree.traverse( r, tmax, leaf ) )
+            {
+                closest = std::move( c );
+                found   = true;
+            }
+        }
+        return found;
+    };
+
+    if ( !_top.traverse( r, r.tmax, clusters ) )
+        return false;
+
+    fill( *closest, element, r, tclosest, h );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// lane by lane, the elements found are kept for resolve()
+// -----------------------------------------------------------------------------
+template <typename T>
+void streamedmesh<T>::intersect( raypacket<T> &p, packethit<T> &h ) const
+    noexcept
+{
+    for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+    {
+        hit<T> laneHit;
+        if ( !( p.active & ( 1u << lane ) ) ||
+             !intersect( p.get( lane ), laneHit ) ||
+             !( laneHit._t < p.tmax[lane] ) )
+            continue;
+
+        p.tmax[lane]    = laneHit._t;
+        h.t[lane]       = laneHit._t;
+        h.element[lane] = laneHit._element;
+        h.object[lane]  = this;
+        h.mask |= 1u << lane;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+bool streamedmesh<T>::occluded( const ray<T> &r ) const noexcept
+{
+    if ( _top.empty() )
+        return false;
+
+    shearedray<T> sr( r );
+    auto clusters = [&]( unsigned int first, unsigned int count, T &tmax ) {
+        for ( unsigned int ii = first; ii < first + count; ++ii )
+        {
+            clusterref c    = _pages->acquire( _top.order()[ii] );
+            auto       leaf = [&]( unsigned int lfirst,
+                             unsigned int lcount,
+                             T &          ltmax ) {
+                for ( unsigned int jj = lfirst; jj < lfirst + lcount; ++jj )
+                {
+                    T t;
+                    PT_STAT_ADD( kTriangleTests, 1 );
+                    if ( ::intersectTriangle(
+                             sr, c->v0( jj ), c->v1( jj ), c->v2( jj ), t ) &&
+                         t < ltmax )
+                    {
+                        ltmax = T( -1 );
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            // any hit will do, a negative tmax ends the traversal
+            if ( c->tree.traverse( r, tmax, leaf ) )
+            {
+                tmax = T( -1 );
+                return true;
+            }
+        }
+        return false;
+    };
+
+    return _top.traverse( r, r.tmax, clusters );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void streamedmesh<T>::fill( const cluster &c,
+                            unsigned int   local,
+                            const ray<T> & r,
+                            T              t,
+                            hit<T> &       h ) const noexcept
+{
+    T b1, b2;
+    barycentrics(
+        r.o + r.d * t, c.v0( local ), c.v1( local ), c.v2( local ), b1, b2 );
+    h._t       = t;
+    h._object  = this;
+    h._element = c.first + local;
+    h._u       = static_cast<float>( b1 );
+    h._v       = static_cast<float>( b2 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void streamedmesh<T>::resolve( const ray<T> &r,
+                               T             t,
+                               unsigned int  element,
+                               hit<T> &      h ) const noexcept
+{
+    unsigned int local;
+    clusterref   c = find( element, local );
+    fill( *c, local, r, t, h );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+void streamedmesh<T>::shade( const ray<T> &r,
+                             const hit<T> &h,
+                             surface<T> &  s ) const noexcept
+{
+    unsigned int local;
+    clusterref   c = find( h._element, local );
+
+    // the normal faces the side the ray came from
+    vec3<T> N = c->normal( local );
+    s._normal = N;
+    if ( N % r.d > 0 )
+        s._normal = N * -1.0;
+    s._pos = r.o + r.d * h._t;
+    s._mat = &_materials[c->ids[local]];
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+typename streamedmesh<T>::clusterref
+streamedmesh<T>::find( unsigned int element, unsigned int &local ) const
+{
+    auto next = std::upper_bound(
+        _clusters.begin(),
+        _clusters.end(),
+        element,
+        []( unsigned int e, const clusterinfo &c ) { return e < c.first; } );
+    auto index = static_cast<unsigned int>( next - _clusters.begin() ) - 1;
+    local      = element - _clusters[index].first;
+    return _pages->acquire( index );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+T streamedmesh<T>::area( const cluster &c, unsigned int ii ) noexcept
+{
+    vec3<T> v0 = c.v0( ii );
+    return T( 0.5 ) * ( ( c.v1( ii ) - v0 ) * ( c.v2( ii ) - v0 ) ).len();
+}
+
+// -----------------------------------------------------------------------------
+// only the clusters the table lists with emitters are read
+// -----------------------------------------------------------------------------
+template <typename T>
+void streamedmesh<T>::emitters( std::vector<unsigned int> &elements ) const
+{
+    for ( unsigned int ii = 0; ii < _clusters.size(); ++ii )
+    {
+        if ( !_clusters[ii].numEmitters )
+            continue;
+
+        clusterref c = _pages->acquire( ii );
+        for ( unsigned int jj = 0; jj < c->count; ++jj )
+        {
+            if ( _materials[c->ids[jj]].emission() > 0.0f )
+                elements.push_back( c->first + jj );
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+float streamedmesh<T>::emitterPower( unsigned int element ) const noexcept
+{
+    unsigned int    local;
+    clusterref      c   = find( element, local );
+    const material &mat = _materials[c->ids[local]];
+    return mat.emission() * mat.diffuse().luminance() * area( *c, local );
+}
+
+// -----------------------------------------------------------------------------
+// uniform on the triangle, both sides emit
+// -----------------------------------------------------------------------------
+template <typename T>
+bool streamedmesh<T>::sampleEmitter( unsigned int    element,
+                                     const vec3<T> & from,
+                                     float           u,
+                                     float           v,
+                                     lightsample<T> &ls ) const noexcept
+{
+    unsigned int local;
+    clusterref   c  = find( element, local );
+    float        su = std::sqrt( u );
+    T            b1 = T( 1.0f - su );
+    T            b2 = T( v * su );
+    vec3<T>      v0 = c->v0( local );
+    ls.pos = v0 + ( c->v1( local ) - v0 ) * b1 + ( c->v2( local ) - v0 ) * b2;
+
+    vec3<T> n = c->normal( local );
+    ls.normal = n % ( from - ls.pos ) < 0 ? n * T( -1 ) : n;
+
+    const material &mat = _materials[c->ids[local]];
+    ls.radiance         = mat.diffuse() * mat.emission();
+    ls.pdf              = pdf( *c, local, from, ls.pos );
+    return ls.pdf > 0.0f;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+float streamedmesh<T>::emitterPdf( unsigned int   element,
+                                   const vec3<T> &from,
+                                   const vec3<T> &pos ) const noexcept
+{
+    unsigned int local;
+    clusterref   c = find( element, local );
+    return pdf( *c, local, from, pos );
+}
+
+// -----------------------------------------------------------------------------
+// area density converted to solid angle at from
+// -----------------------------------------------------------------------------
+template <typename T>
+float streamedmesh<T>::pdf( const cluster &c,
+                            unsigned int   ii,
+                            const vec3<T> &from,
+                            const vec3<T> &pos ) noexcept
+{
+    vec3<T> n      = c.normal( ii );
+    vec3<T> d      = pos - from;
+    T       len2   = d.len2();
+    T       cosine = std::abs( n % d ) / std::sqrt( len2 );
+    T       a      = area( c, ii );
+    if ( !( cosine > T( 0 ) ) || !( a > T( 0 ) ) )
+        return 0.0f;
+    return static_cast<float>( len2 / ( cosine * a ) );
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include "boundingbox.h"
+#include "bvh.h"
+#include "clusterfile.h"
+#include "hit.h"
+#include "material.h"
+#include "mesh.h"
+#include "primitive.h"
+#include "ray.h"
+#include "triangle.h"
+#include "util/pagecache.h"
+#include "util/stats.h"
+#include "util/trace.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// triangle mesh rendered out of core from a cluster file, see clusterfile.h.
+// only the cluster table and a bvh over the clusters stay in memory, the
+// clusters are read in when a ray reaches them and evicted least recently
+// used first once they take more than the budget. hits and elements are the
+// ones of the mesh the file was written from
+// -----------------------------------------------------------------------------
+template <typename T>
+class streamedmesh final : public primitive<T>
+{
+public:
+    // triangles per cluster, a few hundred kilobytes of data each
+    static constexpr unsigned int kClusterTriangles = 4096;
+
+    // splits m along its bvh into clusters of at most maxTriangles and writes
+    // them to path. false if the file cannot be written
+    static bool write( const mesh<T> &    m,
+                       const std::string &path,
+                       unsigned int       maxTriangles = kClusterTriangles );
+
+    // maps a file written by write(), budget bounds the bytes of the clusters
+    // kept in memory. isOpen() is false if the file is missing or invalid
+    explicit streamedmesh( const std::string &path,
+                           std::size_t budget = kClusterBudget ) noexcept;
+
+    // the cache reads clusters in for this object
+    streamedmesh( const streamedmesh & ) = delete;
+    streamedmesh &operator=( const streamedmesh & ) = delete;
+
+    virtual bool intersect( const ray<T> &r, hit<T> &h ) const
+        noexcept override;
+
+    virtual void intersect( raypacket<T> &p, packethit<T> &h ) const
+        noexcept override;
+
+    virtual bool occluded( const ray<T> &r ) const noexcept override;
+
+    virtual void resolve( const ray<T> &r,
+                          T             t,
+                          unsigned int  element,
+                          hit<T> &      h ) const noexcept override;
+
+    virtual void shade( const ray<T> &r,
+                        const hit<T> &h,
+                        surface<T> &  s ) const noexcept override;
+
+    virtual bbox<T> bounds() const noexcept override { return _box; }
+
+    virtual void emitters( std::vector<unsigned int> &elements ) const override;
+
+    virtual float emitterPower( unsigned int element ) const noexcept override;
+
+    virtual bool sampleEmitter( unsigned int    element,
+                                const vec3<T> & from,
+                                float           u,
+                                float           v,
+                                lightsample<T> &ls ) const noexcept override;
+
+    virtual float emitterPdf( unsigned int   element,
+                              const vec3<T> &from,
+                              const vec3<T> &pos ) const noexcept override;
+
+    bool isOpen() const noexcept { return _pages != nullptr; }
+
+    unsigned int numTriangles() const noexcept { return _numTriangles; }
+    unsigned int numClusters() const noexcept
+    {
+        return static_cast<unsigned int>( _clusters.size() );
+    }
+
+    // hits and misses of the cluster cache since the file was opened
+    PageStats paging() const
+    {
+        return _pages ? _pages->stats() : PageStats{};
+    }
+
+private:
+    // a cluster read into memory, in the layout of mesh<T>
+    struct cluster
+    {
+        enum component
+        {
+            kV0x,
+            kV0y,
+            kV0z,
+            kV1x,
+            kV1y,
+            kV1z,
+            kV2x,
+            kV2y,
+            kV2z,
+            kNx,
+            kNy,
+            kNz,
+            kNumComponents
+        };
+
+        bvh<T>                     tree;
+        std::vector<T>             values;
+        std::vector<std::uint32_t> ids;
+        unsigned int               first = 0;
+        unsigned int               count = 0;
+
+        T get( unsigned int c, unsigned int ii ) const noexcept
+        {
+            return values[c * count + ii];
+        }
+        vec3<T> v0( unsigned int ii ) const noexcept
+        {
+            return {get( kV0x, ii ), get( kV0y, ii ), get( kV0z, ii )};
+        }
+        vec3<T> v1( unsigned int ii ) const noexcept
+        {
+            return {get( kV1x, ii ), get( kV1y, ii ), get( kV1z, ii )};
+        }
+        vec3<T> v2( unsigned int ii ) const noexcept
+        {
+            return {get( kV2x, ii ), get( kV2y, ii ), get( kV2z, ii )};
+        }
+        vec3<T> normal( unsigned int ii ) const noexcept
+        {
+            return {get( kNx, ii ), get( kNy, ii ), get( kNz, ii )};
+        }
+    };
+
+    using clusterref = typename PageCache<cluster>::Ref;
+
+    // the cluster of element, and the index of element within it
+    clusterref find( unsigned int element, unsigned int &local ) const;
+
+    // fills the record of a hit at distance t on triangle local of c
+    void fill( const cluster &c,
+               unsigned int   local,
+               const ray<T> & r,
+               T              t,
+               hit<T> &       h ) const noexcept;
+
+    // area of triangle ii of c
+    static T area( const cluster &c, unsigned int ii ) noexcept;
+
+    // solid angle density at from of sampling pos on triangle ii of c
+    static float pdf( const cluster &c,
+                      unsigned int   ii,
+                      const vec3<T> &from,
+                      const vec3<T> &pos ) noexcept;
+
+    bbox<T>                  _box;
+    unsigned int             _numTriangles = 0;
+    std::vector<material>    _materials;
+    std::vector<clusterinfo> _clusters;
+
+    // bvh over the cluster bounds, its order() maps leaves to clusters
+    bvh<T> _top;
+
+    std::unique_ptr<PageCache<cluster>> _pages;
+};
+
+#include "streamedmesh.cc"
@@ -0,0 +1,125 @@
+#include "../renderer.h"
+#include "../sphere.h"
+#include <cassert>
+
+using FLOAT   = float;
+using vec3f   = vec3<FLOAT>;
+using scenef  = scene<FLOAT>;
+using spheref = sphere<FLOAT>;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static bool identical( const film &a, const film &b )
+{
+    if ( a.width() != b.width() || a.height() != b.height() )
+        return false;
+    for ( unsigned int y = 0; y < a.height(); ++y )
+    {
+        for ( unsigned int x = 0; x < a.width(); ++x )
+        {
+            color ca = a.pixel( x, y ), cb = b.pixel( x, y );
+            if ( ca.r != cb.r || ca.g != cb.g || ca.b != cb.b ||
+                 a.samples( x, y ) != b.samples( x, y ) )
+                return false;
+        }
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static film reference( const scenef &       world,
+                       const camera<FLOAT> &cam,
+                       const renderparams & rp )
+{
+    renderer<FLOAT> rdr( cam, rp );
+    film            f;
+    assert( rdr.render( world, f ) );
+    return f;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    material light{{1.0f, 1.0f, 1.0f, 1.0f}};
+    light.setEmissive( 4.0f );
+    material red{{0.8f, 0.2f, 0.2f, 1.0f}};
+
+    scenef world;
+    world << spheref( {0.0f, 0.0f, 0.0f}, 1.0f, red )
+          << spheref( {0.0f, 0.0f, 3.0f}, 0.5f, light );
+
+    renderparams rp{48, 40, 3, 4};
+    rp._numThreads     = 2;
+    rp._samplesPerPass = 1;
+
+    camera<FLOAT> cam{{-4.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 60};
+    film          expected = reference( world, cam, rp );
+
+    {
+        // previews come first, coarser to finer, and leave f untouched
+        renderparams previewed = rp;
+        previewed._previewLevels = 3;
+
+        renderer<FLOAT>   rdr( cam, previewed );
+        film              f;
+        std::vector<bool> blocky;
+        bool done = rdr.render( world, f, [&]( const film &shown ) {
+            assert( shown.width() == 48 && shown.height() == 40 );
+            // a preview repeats its block centers, a pass does not
+            blocky.push_back( &shown != &f );
+            if ( &shown != &f && blocky.size() == 1 )
+            {
+                color c = shown.pixel( 8, 8 );
+                for ( unsigned int y = 8; y < 16; ++y )
+                    for ( unsigned int x = 8; x < 16; ++x )
+                        assert( shown.pixel( x, y ).r == c.r );
+            }
+        } );
+        assert( done );
+        assert( ( blocky == std::vector<bool>{true, true, true, false, false,
+                                              false, false} ) );
+        assert( identical( f, expected ) );
+    }
+
+    {
+        // cancelled before it starts nothing is rendered
+        CancelToken cancel;
+        cancel.Cancel();
+        renderer<FLOAT> rdr( cam, rp );
+        film            f;
+        unsigned int    passes = 0;
+        assert( !rdr.render( world, f, [&]( const film & ) { ++passes; }, {},
+                             &cancel ) );
+        assert( passes == 0 && f.totalSamples() == 0 );
+    }
+
+    {
+        // cancelled after the first pass, the film keeps that pass. the
+        // renderer refers to the camera and parameters, so a restart with
+        // other ones renders what a new renderer would
+        CancelToken     cancel;
+        camera<FLOAT>   current = cam;
+        renderparams    params  = rp;
+        renderer<FLOAT> rdr( current, params );
+        film            f;
+        unsigned int    tiles = 0;
+        bool done = rdr.render( world,
+                                f,
+                                [&]( const film & ) { cancel.Cancel(); },
+                                [&]( const film &, unsigned int ) { ++tiles; },
+                                &cancel );
+        assert( !done );
+        assert( tiles == 0 );
+        assert( f.totalSamples() == 4ull * 48 * 40 );
+
+        cancel.Reset();
+        current = camera<FLOAT>{{-3.0f, 1.0f, 0.5f}, {0.0f, 0.0f, 0.0f}, 50};
+        params._numSamples = 2;
+        assert( rdr.render( world, f, {}, {}, &cancel ) );
+        assert( identical( f, reference( world, current, params ) ) );
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "../denoiser.h"
+#include "../sampler.h"
+#include <cassert>
+#include <cmath>
+
+// -----------------------------------------------------------------------------
+// two walls meeting along x = kEdge: the left one faces the camera, the right
+// one is turned away and darker. the albedo is a checkerboard on both
+// -----------------------------------------------------------------------------
+constexpr unsigned int kSize = 32;
+constexpr unsigned int kEdge = 16;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static color albedoAt( unsigned int x, unsigned int y )
+{
+    float a = ( x / 2 + y / 2 ) % 2 ? 0.8f : 0.3f;
+    return {a, a, a, 1.0f};
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static color truthAt( unsigned int x, unsigned int y )
+{
+    return albedoAt( x, y ) * ( x < kEdge ? 1.0f : 0.25f );
+}
+
+// -----------------------------------------------------------------------------
+// numSamples samples per pixel, each off the truth by up to +-noise times
+// itself
+// -----------------------------------------------------------------------------
+static film makeFilm( unsigned int numSamples, float noise )
+{
+    film f( kSize, kSize );
+    for ( unsigned int y = 0; y < kSize; ++y )
+    {
+        for ( unsigned int x = 0; x < kSize; ++x )
+        {
+            for ( unsigned int ii = 0; ii < numSamples; ++ii )
+            {
+                sampler s( samplertype::kRandom, y * kSize + x, ii );
+                float   u = 2.0f * s.next1D() - 1.0f;
+                color   c = truthAt( x, y ) * ( 1.0f + noise * u );
+                float   l = c.luminance();
+                f.add( x, y, c, 1, l * l );
+            }
+
+            vec3<float> n = x < kEdge ? vec3<float>{0.0f, 0.0f, 1.0f}
+                                      : vec3<float>{1.0f, 0.0f, 0.0f};
+            f.addFeatures( x, y, albedoAt( x, y ), n, 5.0f, 1 );
+        }
+    }
+    return f;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static float rmse( const film &f )
+{
+    float sum = 0.0f;
+    for ( unsigned int y = 0; y < kSize; ++y )
+    {
+        for ( unsigned int x = 0; x < kSize; ++x )
+        {
+            float d = f.pixel( x, y ).luminance() - truthAt( x, y ).luminance();
+            sum += d * d;
+        }
+    }
+    return std::sqrt( sum / ( kSize * kSize ) );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    denoiseparams dp;
+    dp._numThreads = 2;
+    denoiser filter( dp );
+
+    {
+        // without noise the image is left as it is, checkerboard included
+        film in = makeFilm( 4, 0.0f );
+        film out;
+        filter.run( in, out );
+        assert( out.width() == kSize && out.height() == kSize );
+        assert( rmse( out ) < 1e-4f );
+        assert( out.samples( 3, 7 ) == 1 );
+        assert( out.albedo( 3, 7 ).r == in.albedo( 3, 7 ).r );
+    }
+
+    {
+        // noise is removed without bleeding across the normal edge
+        film in = makeFilm( 4, 0.8f );
+        film out;
+        filter.run( in, out );
+        assert( rmse( out ) < 0.5f * rmse( in ) );
+
+        for ( unsigned int y = 0; y < kSize; ++y )
+        {
+            for ( unsigned int x = kEdge - 1; x <= kEdge; ++x )
+            {
+                float truth = truthAt( x, y ).luminance();
+                float error = std::abs( out.pixel( x, y ).luminance() - truth );
+                assert( error < 0.25f * truth );
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include "../distributed.h"
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+using FLOAT = float;
+
+// -----------------------------------------------------------------------------
+// connects to the coordinator and takes one batch of tiles like a worker
+// would, but never renders them
+// -----------------------------------------------------------------------------
+static Socket takeTiles( const std::string &address )
+{
+    Socket connection = Socket::Connect( address );
+    assert( connection.Valid() );
+
+    std::uint32_t hello[2] = {kProtocolVersion, 2};
+    assert( sendMessage( connection, message::kHello, hello, sizeof( hello ) ) );
+
+    message           type;
+    std::vector<char> payload;
+    assert( receiveMessage( connection, type, payload ) );
+    assert( type == message::kJob );
+    assert( receiveMessage( connection, type, payload ) );
+    assert( type == message::kTiles && payload.size() == 8 );
+    return connection;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    // a pyramid under the light of the mesh scene
+    std::string path = "distributedTests.obj";
+    {
+        std::ofstream obj( path );
+        obj << "v -1 -1 0\nv 1 -1 0\nv 1 1 0\nv -1 1 0\nv 0 0 1\n"
+            << "f 1 2 5\nf 2 3 5\nf 3 4 5\nf 4 1 5\nf 1 3 2\nf 1 4 3\n";
+    }
+
+    renderparams rp{80, 70, 4, 5};
+    rp._numThreads     = 2;
+    rp._samplesPerPass = 2;
+
+    film reference;
+    {
+        scene<FLOAT>    world;
+        camera<FLOAT>   cam = buildScene( world, path );
+        renderer<FLOAT> device( cam, rp );
+        device.render( world, reference );
+    }
+
+    {
+        // the job survives the trip field by field, and a short one is refused
+        renderparams sent       = rp;
+        sent._samplerType       = samplertype::kRandom;
+        sent._lightSampling     = false;
+        sent._adaptiveThreshold = 0.25f;
+        sent._previewLevels     = 3;
+        renderparams received;
+        std::string  name;
+        assert( unpackJob( packJob( sent, path ), received, name ) );
+        assert( name == path );
+        assert( received.width() == sent.width() &&
+                received.height() == sent.height() &&
+                received.maxDepth() == sent.maxDepth() &&
+                received.numSamples() == sent.numSamples() &&
+                received.numThreads() == sent.numThreads() &&
+                received.samplesPerPass() == sent.samplesPerPass() &&
+                received.rouletteDepth() == sent.rouletteDepth() &&
+                received.samplerType() == sent.samplerType() &&
+                received.lightSampling() == sent.lightSampling() &&
+                received.adaptiveThreshold() == sent.adaptiveThreshold() &&
+                received.previewLevels() == sent.previewLevels() );
+        std::vector<char> job = packJob( sent, path );
+        job.resize( 12 );
+        assert( !unpackJob( job, received, name ) );
+    }
+
+    std::string address = "unix:distributedTests.sock";
+    Socket      listener = Socket::Listen( address );
+    assert( listener.Valid() );
+
+    {
+        // adaptive sampling does not split into tiles
+        renderparams adaptive       = rp;
+        adaptive._adaptiveThreshold = 0.1f;
+        film f;
+        assert( !coordinator<FLOAT>( adaptive, path ).render( listener, f ) );
+    }
+
+    {
+        // one worker dies with its tiles, another hangs on to them, and a
+        // third renders everything. the merged pixels match bit for bit
+        std::atomic<bool> finished{false};
+        std::atomic<int>  waiting{2};
+        std::thread       dying( [&] {
+            Socket connection = takeTiles( address );
+            --waiting;
+        } );
+        std::thread hanging( [&] {
+            Socket connection = takeTiles( address );
+            --waiting;
+            while ( !finished )
+                std::this_thread::yield();
+        } );
+        std::thread good( [&] {
+            while ( waiting )
+                std::this_thread::yield();
+            Socket connection = Socket::Connect( address );
+            assert( connection.Valid() );
+            assert( worker<FLOAT>( 2 ).run( connection ) );
+        } );
+
+        film f;
+        assert( coordinator<FLOAT>( rp, path, 30.0 ).render( listener, f ) );
+        finished = true;
+        dying.join();
+        hanging.join();
+        good.join();
+
+        assert( f.width() == reference.width() );
+        assert( f.height() == reference.height() );
+        for ( unsigned int y = 0; y < f.height(); ++y )
+        {
+            for ( unsigned int x = 0; x < f.width(); ++x )
+            {
+                film::pixelstate a = f.state( x, y );
+                film::pixelstate b = reference.state( x, y );
+                assert( !std::memcmp( &a, &b, sizeof( a ) ) );
+            }
+        }
+    }
+
+    {
+        // a worker stops halfway through its hello header. the coordinator
+        // gives up on it instead of waiting for the rest, and another worker
+        // renders the image
+        std::atomic<bool> finished{false};
+        std::atomic<bool> stalled{false};
+        std::thread       stalling( [&] {
+            Socket connection = Socket::Connect( address );
+            assert( connection.Valid() );
+            std::uint32_t type = static_cast<std::uint32_t>( message::kHello );
+            assert( connection.SendAll( &type, sizeof( type ) ) );
+            stalled = true;
+            while ( !finished )
+                std::this_thread::yield();
+        } );
+        std::thread good( [&] {
+            while ( !stalled )
+                std::this_thread::yield();
+            Socket connection = Socket::Connect( address );
+            assert( connection.Valid() );
+            assert( worker<FLOAT>( 2 ).run( connection ) );
+        } );
+
+        film f;
+        assert( coordinator<FLOAT>( rp, path, 1.0 ).render( listener, f ) );
+        finished = true;
+        stalling.join();
+        good.join();
+    }
+
+    std::remove( "distributedTests.sock" );
+    return 0;
+}
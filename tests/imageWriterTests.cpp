@@ -0,0 +1,168 @@
+#include "../imagewriter.h"
+#include "../vendor/stb_image/stb_image.h"
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// -----------------------------------------------------------------------------
+// a smooth gradient with a band of noise, so that png has both long matches
+// and rows it cannot predict
+// -----------------------------------------------------------------------------
+constexpr unsigned int kWidth  = 70;
+constexpr unsigned int kHeight = 45;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static color colorAt( unsigned int x, unsigned int y )
+{
+    float noise = 0.0f;
+    if ( y > 20 && y < 30 )
+        noise = ( ( x * 7919u + y * 104729u ) % 97 ) / 97.0f;
+    return {x / float( kWidth ), y / float( kHeight ), 0.3f + 0.5f * noise,
+            1.0f};
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static film makeFilm()
+{
+    film f( kWidth, kHeight );
+    for ( unsigned int y = 0; y < kHeight; ++y )
+    {
+        for ( unsigned int x = 0; x < kWidth; ++x )
+            f.add( x, y, colorAt( x, y ) * 2.0f, 2 );
+    }
+    return f;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static std::vector<char> readFile( const char *path )
+{
+    std::vector<char> data;
+    FILE *            file = fopen( path, "rb" );
+    assert( file );
+    char   buffer[4096];
+    size_t read;
+    while ( ( read = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+        data.insert( data.end(), buffer, buffer + read );
+    fclose( file );
+    return data;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    {
+        // the gamma table agrees with the power it replaces
+        for ( unsigned int ii = 0; ii <= 100000; ++ii )
+        {
+            float linear   = ii / 100000.0f;
+            auto  expected = static_cast<unsigned char>(
+                255 * std::pow( linear, 1 / 2.2f ) + 0.5f );
+            assert( gammaEncode( linear ) == expected );
+        }
+    }
+
+    {
+        imageformat format;
+        assert( imageFormat( "a.png", format ) && format == imageformat::kPNG );
+        assert( imageFormat( "b.PFM", format ) && format == imageformat::kPFM );
+        assert( imageFormat( "c/d.ppm", format ) &&
+                format == imageformat::kPPM );
+        assert( !imageFormat( "e.exr", format ) );
+        assert( !imageFormat( "png", format ) );
+    }
+
+    film f = makeFilm();
+    {
+        // tiles submitted out of order and from several threads add up to the
+        // whole image, whose files are written before finish()
+        imagewriter writer( kWidth,
+                            kHeight,
+                            {"imagewriter.ppm", "imagewriter.pfm",
+                             "imagewriter.png"} );
+        std::vector<std::thread> threads;
+        for ( unsigned int y0 = 0; y0 < kHeight; y0 += 16 )
+        {
+            threads.emplace_back( [&, y0]() {
+                for ( unsigned int x0 : {64u, 0u, 32u} )
+                {
+                    writer.submit( f,
+                                   x0,
+                                   y0,
+                                   std::min( x0 + 32, kWidth ),
+                                   std::min( y0 + 16, kHeight ) );
+                }
+            } );
+        }
+        for ( std::thread &t : threads )
+            t.join();
+        assert( writer.finish() );
+        assert( writer.failed().empty() );
+        assert( writer.finish() );
+    }
+
+    {
+        // 8 bit formats hold the same gamma encoded bytes
+        int            width, height, channels;
+        unsigned char *png =
+            stbi_load( "imagewriter.png", &width, &height, &channels, 3 );
+        assert( png && width == int( kWidth ) && height == int( kHeight ) );
+
+        std::vector<char> ppm = readFile( "imagewriter.ppm" );
+        assert( ppm.size() > 3 * kWidth * kHeight );
+        const char *pixels = ppm.data() + ppm.size() - 3 * kWidth * kHeight;
+        assert( !memcmp( png, pixels, 3 * kWidth * kHeight ) );
+
+        for ( unsigned int y = 0; y < kHeight; ++y )
+        {
+            for ( unsigned int x = 0; x < kWidth; ++x )
+            {
+                color          c = f.pixel( x, y );
+                unsigned char *p = png + 3 * ( y * kWidth + x );
+                assert( p[0] == gammaEncode( c.r ) );
+                assert( p[1] == gammaEncode( c.g ) );
+                assert( p[2] == gammaEncode( c.b ) );
+            }
+        }
+        stbi_image_free( png );
+    }
+
+    {
+        // pfm keeps the linear floats, bottom row first
+        std::vector<char> pfm  = readFile( "imagewriter.pfm" );
+        std::size_t       size = 3 * kWidth * kHeight * sizeof( float );
+        assert( !strncmp( pfm.data(), "PF\n70 45\n", 9 ) );
+        assert( pfm.size() > size );
+        const char *data = pfm.data() + pfm.size() - size;
+        for ( unsigned int y = 0; y < kHeight; ++y )
+        {
+            for ( unsigned int x = 0; x < kWidth; ++x )
+            {
+                float rgb[3];
+                memcpy( rgb,
+                        data + 3 * sizeof( float ) *
+                                   ( ( kHeight - 1 - y ) * kWidth + x ),
+                        sizeof( rgb ) );
+                color c = f.pixel( x, y );
+                assert( rgb[0] == c.r && rgb[1] == c.g && rgb[2] == c.b );
+            }
+        }
+    }
+
+    {
+        // an unknown format or a missing directory is reported on finish()
+        imagewriter writer( 2, 2, {"missing/dir/a.png", "imagewriter.txt"} );
+        writer.submit( f, 0, 0, 2, 2 );
+        assert( !writer.finish() );
+        assert( writer.failed().size() == 2 );
+    }
+
+    for ( const char *path :
+          {"imagewriter.ppm", "imagewriter.pfm", "imagewriter.png"} )
+        remove( path );
+    return 0;
+}
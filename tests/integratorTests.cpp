@@ -0,0 +1,192 @@
+#include "../mesh.h"
+#include "../renderer.h"
+#include "../sphere.h"
+#include <cassert>
+
+using FLOAT   = double;
+using vec3f   = vec3<FLOAT>;
+using scenef  = scene<FLOAT>;
+using spheref = sphere<FLOAT>;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static color meanradiance( const scenef &world, const renderparams &rp )
+{
+    camera<FLOAT>   cam{{-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 60};
+    renderer<FLOAT> rdr( cam, rp );
+    film            f;
+    rdr.render( world, f );
+
+    color sum = {0, 0, 0, 0};
+    for ( unsigned int y = 0; y < f.height(); ++y )
+        for ( unsigned int x = 0; x < f.width(); ++x )
+            sum = sum + f.pixel( x, y );
+    return sum / static_cast<float>( f.width() * f.height() );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static bool close( float a, float b, float tolerance )
+{
+    return std::abs( a - b ) <= tolerance * std::abs( b );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    renderparams rp{16, 16, 12, 64};
+    rp._numThreads = 1;
+
+    renderparams noRoulette   = rp;
+    noRoulette._rouletteDepth = rp._maxDepth;
+
+    {
+        // furnace: camera inside a closed emissive sphere of albedo a. every
+        // path bounces maxDepth times and each hit adds a * E times the
+        // throughput so far, so every pixel converges to
+        // a * E * ( 1 - a^maxDepth ) / ( 1 - a )
+        constexpr float albedo   = 0.6f;
+        constexpr float emission = 2.0f;
+
+        material wall{{albedo, albedo, albedo, 1.0f}};
+        wall.setEmissive( emission );
+
+        scenef world;
+        world << new spheref( {0.0f, 0.0f, 0.0f}, 5.0f, wall );
+
+        float expected = albedo * emission *
+                         ( 1.0f - std::pow( albedo, rp.maxDepth() ) ) /
+                         ( 1.0f - albedo );
+
+        // without roulette every path is the same and there is no variance
+        color exact = meanradiance( world, noRoulette );
+        assert( close( exact.r, expected, 1e-4f ) );
+
+        // so adaptive sampling stops every pixel at its minimum sample count
+        renderparams adaptive       = noRoulette;
+        adaptive._adaptiveThreshold = 0.01f;
+        camera<FLOAT>   cam{{-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 60};
+        renderer<FLOAT> rdr( cam, adaptive );
+        film            f;
+        rdr.render( world, f );
+        for ( unsigned int y = 0; y < f.height(); ++y )
+        {
+            for ( unsigned int x = 0; x < f.width(); ++x )
+            {
+                assert( f.samples( x, y ) ==
+                        4 * renderer<FLOAT>::kMinAdaptiveSamples );
+                assert( close( f.pixel( x, y ).r, expected, 1e-4f ) );
+            }
+        }
+
+        color rr = meanradiance( world, rp );
+        std::cout << "furnace: expected " << expected << " | no roulette "
+                  << exact.r << " | roulette " << rr.r << "\n";
+        assert( close( rr.r, expected, 0.01f ) );
+    }
+
+    {
+        // coloured spheres lit by a small emitter inside a grey room. the
+        // roulette estimate must agree with the full-depth estimate
+        material grey{{0.75f, 0.75f, 0.75f, 1.0f}};
+        material red{{0.9f, 0.1f, 0.1f, 1.0f}};
+        material blue{{0.1f, 0.2f, 0.9f, 1.0f}};
+        material light{{1.0f, 1.0f, 1.0f, 1.0f}};
+        light.setEmissive( 20.0f );
+
+        scenef world;
+        world << new spheref( {0.0f, 0.0f, 0.0f}, 3.0f, grey )
+              << new spheref( {1.0f, 0.6f, -0.5f}, 0.5f, red )
+              << new spheref( {1.0f, -0.6f, -0.5f}, 0.5f, blue )
+              << new spheref( {0.5f, 0.0f, 2.0f}, 0.5f, light );
+
+        rp._numSamples         = 256;
+        noRoulette._numSamples = 256;
+
+        color reference = meanradiance( world, noRoulette );
+        color rr        = meanradiance( world, rp );
+        std::cout << "room: no roulette " << reference.r << ", "
+                  << reference.g << ", " << reference.b << " | roulette "
+                  << rr.r << ", " << rr.g << ", " << rr.b << "\n";
+        assert( close( rr.r, reference.r, 0.04f ) );
+        assert( close( rr.g, reference.g, 0.04f ) );
+        assert( close( rr.b, reference.b, 0.04f ) );
+
+        // light sampling is only a better estimator of the same image
+        renderparams bounceOnly   = noRoulette;
+        bounceOnly._lightSampling = false;
+        color bounce              = meanradiance( world, bounceOnly );
+        std::cout << "room: bounces only " << bounce.r << ", " << bounce.g
+                  << ", " << bounce.b << "\n";
+        assert( close( bounce.r, reference.r, 0.04f ) );
+        assert( close( bounce.g, reference.g, 0.04f ) );
+        assert( close( bounce.b, reference.b, 0.04f ) );
+
+        // adaptive sampling spends at most the same budget, unevenly, and
+        // converges to the same image
+        renderparams adaptive       = rp;
+        adaptive._adaptiveThreshold = 0.2f;
+        camera<FLOAT>   cam{{-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 60};
+        renderer<FLOAT> rdr( cam, adaptive );
+        film            f;
+        rdr.render( world, f );
+
+        unsigned int fewest = ~0u, most = 0;
+        color        sum    = {0, 0, 0, 0};
+        for ( unsigned int y = 0; y < f.height(); ++y )
+        {
+            for ( unsigned int x = 0; x < f.width(); ++x )
+            {
+                fewest = std::min( fewest, f.samples( x, y ) );
+                most   = std::max( most, f.samples( x, y ) );
+                sum    = sum + f.pixel( x, y );
+            }
+        }
+        color mean = sum / static_cast<float>( f.width() * f.height() );
+        std::cout << "adaptive: " << mean.r << ", " << mean.g << ", "
+                  << mean.b << " | " << fewest / 4 << " to " << most / 4
+                  << " samples\n";
+        assert( f.totalSamples() <=
+                4ull * rp.numSamples() * f.width() * f.height() );
+        assert( fewest < most );
+        assert( close( mean.r, reference.r, 0.04f ) );
+        assert( close( mean.g, reference.g, 0.04f ) );
+        assert( close( mean.b, reference.b, 0.04f ) );
+    }
+
+    {
+        // the same for an emissive quad, lit from both sides, above a grey
+        // floor
+        material grey{{0.75f, 0.75f, 0.75f, 1.0f}};
+        material light{{1.0f, 0.8f, 0.6f, 1.0f}};
+        light.setEmissive( 10.0f );
+
+        auto quad = new mesh<FLOAT>( {{-0.5f, -0.5f, 1.0f},
+                                      {0.5f, -0.5f, 1.0f},
+                                      {0.5f, 0.5f, 1.0f},
+                                      {-0.5f, 0.5f, 1.0f}},
+                                     {0, 1, 2, 0, 2, 3} );
+        quad->setMaterial( light );
+
+        scenef world;
+        world << new spheref( {0.0f, 0.0f, 0.0f}, 3.0f, grey ) << quad;
+
+        renderparams lights    = noRoulette;
+        lights._numSamples     = 256;
+        renderparams bounces   = lights;
+        bounces._lightSampling = false;
+
+        color reference = meanradiance( world, lights );
+        color bounce    = meanradiance( world, bounces );
+        std::cout << "quad light: " << reference.r << ", " << reference.g
+                  << ", " << reference.b << " | bounces only " << bounce.r
+                  << ", " << bounce.g << ", " << bounce.b << "\n";
+        assert( close( bounce.r, reference.r, 0.04f ) );
+        assert( close( bounce.g, reference.g, 0.04f ) );
+        assert( close( bounce.b, reference.b, 0.04f ) );
+    }
+
+    std::cout << "All tests passed\n";
+    return 0;
+}
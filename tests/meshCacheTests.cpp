@@ -0,0 +1,162 @@
+#include "../mesh.h"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+using vec3f = vec3<float>;
+using rayf  = ray<float>;
+using meshf = mesh<float>;
+
+static std::mt19937 rng;
+static auto         range = rng.max() - rng.min();
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+float randomlength() { return ( 1.0f * rng() / range ); }
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+vec3f randomdirection()
+{
+    float x = randomlength() - 0.5f;
+    float y = randomlength() - 0.5f;
+    float z = randomlength() - 0.5f;
+    vec3f v{x, y, z};
+    v.normalize();
+    return v;
+}
+
+// -----------------------------------------------------------------------------
+// triangle soup inside the unit sphere
+// -----------------------------------------------------------------------------
+static void writeObj( const std::string &path, unsigned int numTrias )
+{
+    FILE *file = fopen( path.c_str(), "wb" );
+    assert( file );
+    for ( unsigned int ii = 0; ii < numTrias; ++ii )
+    {
+        vec3f center = randomdirection() * randomlength();
+        for ( unsigned int jj = 0; jj < 3; ++jj )
+        {
+            vec3f v = center + randomdirection() * 0.1f;
+            fprintf( file, "v %f %f %f\n", v[0], v[1], v[2] );
+        }
+        fprintf( file, "f -3 -2 -1\n" );
+    }
+    fclose( file );
+}
+
+// -----------------------------------------------------------------------------
+// both meshes must report identical hits
+// -----------------------------------------------------------------------------
+static void compare( const meshf &a, const meshf &b )
+{
+    assert( a.numTriangles() == b.numTriangles() );
+    assert( a.accel().nodes().size() == b.accel().nodes().size() );
+
+    for ( int ii = 0; ii < 1000; ++ii )
+    {
+        rayf       r( randomdirection() * 2.0f, randomdirection() );
+        hit<float> ha, hb;
+        bool       hitA = a.intersect( r, ha );
+        assert( hitA == b.intersect( r, hb ) );
+        if ( !hitA )
+            continue;
+
+        surface<float> sa, sb;
+        a.shade( r, ha, sa );
+        b.shade( r, hb, sb );
+        assert( ha._t == hb._t );
+        assert( ha._u == hb._u && ha._v == hb._v );
+        assert( ( sa._normal - sb._normal ).len2() == 0.0f );
+        assert( sa._mat->diffuse().r == sb._mat->diffuse().r );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// overwrites an index at offset within a section of the cache, leaving its
+// size and header intact
+// -----------------------------------------------------------------------------
+static void corrupt( const std::string &      cache,
+                     meshcacheheader::section section,
+                     std::uint64_t            offset,
+                     unsigned int             value )
+{
+    FILE *file = fopen( cache.c_str(), "r+b" );
+    assert( file );
+    meshcacheheader header;
+    assert( fread( &header, sizeof( header ), 1, file ) == 1 );
+    fseek( file, long( header.sections[section].offset + offset ), SEEK_SET );
+    fwrite( &value, sizeof( value ), 1, file );
+    fclose( file );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    std::string path  = "meshCacheTests.obj";
+    std::string cache = meshCachePath<float>( path );
+    std::remove( cache.c_str() );
+    writeObj( path, 2000 );
+
+    // the first load builds the mesh and writes the cache, the second maps it
+    meshf built( path );
+    assert( !built.mapped() );
+    meshf mapped( path );
+    assert( mapped.mapped() );
+    compare( built, mapped );
+
+    // copies share the mapping, transforming makes the data private again
+    meshf copy = mapped;
+    assert( copy.mapped() );
+    copy.transform( mat44<float>::makeRotation( 0, 2 ) );
+    assert( !copy.mapped() && mapped.mapped() );
+    compare( mapped, copy );
+
+    // a different source invalidates the cache, which is then rewritten
+    writeObj( path, 500 );
+    meshf changed( path );
+    assert( !changed.mapped() && changed.numTriangles() == 500 );
+    meshf remapped( path );
+    assert( remapped.mapped() && remapped.numTriangles() == 500 );
+
+    // a truncated cache is ignored
+    FILE *file = fopen( cache.c_str(), "wb" );
+    fwrite( "ptmesh", 1, 6, file );
+    fclose( file );
+    meshf truncated( path );
+    assert( !truncated.mapped() && truncated.numTriangles() == 500 );
+
+    // so is a cache of the right size with an index out of range, whether
+    // into the vertices, the materials or the bvh
+    meshf rewritten( path );
+    assert( rewritten.mapped() );
+    corrupt( cache, meshcacheheader::kTrias, 0, 0xffffffffu );
+    meshf badVertex( path );
+    assert( !badVertex.mapped() && badVertex.numTriangles() == 500 );
+    corrupt( cache, meshcacheheader::kMaterialIds, 4, 1000000u );
+    meshf badMaterial( path );
+    assert( !badMaterial.mapped() && badMaterial.numTriangles() == 500 );
+    corrupt( cache,
+             meshcacheheader::kNodes,
+             offsetof( bvhnode<float>, first ),
+             0xfffffff0u );
+    meshf badNode( path );
+    assert( !badNode.mapped() && badNode.numTriangles() == 500 );
+    meshf restored( path );
+    assert( restored.mapped() );
+    compare( badNode, restored );
+
+    // without the cache nothing is read or written
+    std::remove( cache.c_str() );
+    meshf uncached( path, false );
+    assert( !uncached.mapped() );
+    assert( fopen( cache.c_str(), "rb" ) == nullptr );
+
+    std::remove( path.c_str() );
+    return 0;
+}
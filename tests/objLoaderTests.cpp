@@ -0,0 +1,151 @@
+#include "../objloader.h"
+#include <cassert>
+#include <cstdio>
+#include <random>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static std::string writeFile( const char *name, const std::string &contents )
+{
+    std::string path = std::string( "objLoaderTests_" ) + name + ".obj";
+    FILE *      file = fopen( path.c_str(), "wb" );
+    assert( file );
+    fwrite( contents.data(), 1, contents.size(), file );
+    fclose( file );
+    return path;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void testSyntax()
+{
+    // every face syntax, relative indices, an n-gon, comments, crlf line
+    // ends, a face that references a missing vertex and corners cut off
+    // after a slash, one followed by a line that starts with a digit
+    std::string path = writeFile( "syntax",
+                                  "# comment\n"
+                                  "mtllib scene.mtl\n"
+                                  "o thing\n"
+                                  "v 0 0 0\r\n"
+                                  "v 1.5 0 0\n"
+                                  "v\t1 1e1 -2.5E-1\n"
+                                  "v 0 1 0 1.0\n"
+                                  "v -1 .5 0\n"
+                                  "vt 0.25 0.75\n"
+                                  "vt 1 0\n"
+                                  "vn 0 0 1\n"
+                                  "usemtl red\n"
+                                  "s off\n"
+                                  "f 1 2 3\n"
+                                  "f 1/1 2/2 3/1\n"
+                                  "f 1//1 2//1 3//1\r\n"
+                                  "f 1/2/1 2/1/1 3/2/1 4/1/1\n"
+                                  "f -5 -4 -3 -2 -1\n"
+                                  "f 1 2 9\n"
+                                  "f 1 2\n"
+                                  "f 1 2 3/1/\n"
+                                  "f 1 2 3/\n"
+                                  "1\n" );
+
+    objdata obj;
+    assert( loadobj( path, obj ) );
+    remove( path.c_str() );
+
+    assert( obj.positions.size() == 15 );
+    assert( obj.positions[3] == 1.5f );
+    assert( obj.positions[7] == 10.0f );
+    assert( obj.positions[8] == -0.25f );
+    assert( obj.positions[13] == 0.5f );
+    assert( obj.texcoords.size() == 4 && obj.texcoords[1] == 0.75f );
+    assert( obj.normals.size() == 3 && obj.normals[2] == 1.0f );
+
+    // 1 + 1 + 1 + 2 + 3 triangles, the last four faces are dropped
+    assert( obj.numTriangles() == 8 );
+    assert( obj.numFaces == 9 );
+    assert( obj.numInvalidFaces == 4 );
+
+    unsigned int faces[] = {0, 1, 2, 3, 3, 4, 4, 4};
+    for ( unsigned int ii = 0; ii < 8; ++ii )
+        assert( obj.faces[ii] == faces[ii] );
+
+    // quads and larger faces are fanned around their first corner
+    unsigned int trias[] = {0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2,
+                            0, 2, 3, 0, 1, 2, 0, 2, 3, 0, 3, 4};
+    for ( unsigned int ii = 0; ii < 24; ++ii )
+        assert( obj.trias[ii] == trias[ii] );
+
+    constexpr unsigned int none = objdata::kNoIndex;
+    assert( obj.texcoordIndices.size() == 24 );
+    assert( obj.texcoordIndices[0] == none );
+    assert( obj.texcoordIndices[5] == 0 );
+    assert( obj.texcoordIndices[9] == 1 && obj.texcoordIndices[14] == 0 );
+    assert( obj.texcoordIndices[17] == none );
+    assert( obj.normalIndices[3] == none && obj.normalIndices[6] == 0 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void testChunks()
+{
+    // a file split into many tiny chunks has to merge into exactly what a
+    // single chunk yields, including relative indices that reach back into
+    // earlier chunks
+    std::mt19937 rng;
+    std::string  contents;
+    unsigned int numVertices = 0;
+    for ( unsigned int ii = 0; ii < 2000; ++ii )
+    {
+        if ( numVertices < 5 || rng() % 3 )
+        {
+            contents += "v " + std::to_string( rng() % 1000 ) + "." +
+                        std::to_string( rng() % 1000 ) + " -1 2\n";
+            contents += "vn 0 1 0\n";
+            ++numVertices;
+            continue;
+        }
+
+        contents += "f";
+        unsigned int corners = 3 + rng() % 3;
+        for ( unsigned int c = 0; c < corners; ++c )
+        {
+            int index = 1 + static_cast<int>( rng() % numVertices );
+            if ( rng() % 2 )
+                index -= static_cast<int>( numVertices ) + 1;
+            contents += " " + std::to_string( index ) + "//" +
+                        std::to_string( index );
+        }
+        contents += "\n";
+    }
+
+    std::string path = writeFile( "chunks", contents );
+
+    objdata whole, split;
+    assert( loadobj( path, whole, 1 ) );
+    assert( loadobj( path, split, 3, 64 ) );
+    remove( path.c_str() );
+
+    assert( whole.numTriangles() > 500 );
+    assert( whole.numInvalidFaces == 0 );
+    assert( whole.texcoordIndices.empty() );
+    assert( whole.positions == split.positions );
+    assert( whole.normals == split.normals );
+    assert( whole.trias == split.trias );
+    assert( whole.normalIndices == split.normalIndices );
+    assert( whole.trias == whole.normalIndices );
+    assert( whole.faces == split.faces );
+    assert( whole.numFaces == split.numFaces );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    testSyntax();
+    testChunks();
+
+    objdata missing;
+    assert( !loadobj( "objLoaderTests_missing.obj", missing ) );
+
+    return 0;
+}
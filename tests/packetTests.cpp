@@ -0,0 +1,137 @@
+#include "../mesh.h"
+#include "../scene.h"
+#include "../sphere.h"
+#include <cassert>
+#include <cmath>
+#include <random>
+
+using vec3f   = vec3<float>;
+using rayf    = ray<float>;
+using meshf   = mesh<float>;
+using spheref = sphere<float>;
+
+static std::mt19937 rng;
+static auto         range = rng.max() - rng.min();
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+float randomlength() { return ( 1.0f * rng() / range ); }
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+vec3f randomdirection()
+{
+    float x = randomlength() - 0.5f;
+    float y = randomlength() - 0.5f;
+    float z = randomlength() - 0.5f;
+    vec3f v{x, y, z};
+    v.normalize();
+    return v;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+meshf randomtriangles( unsigned int count )
+{
+    std::vector<vec3f>        vertices;
+    std::vector<unsigned int> trias;
+    for ( unsigned int ii = 0; ii < count; ++ii )
+    {
+        vec3f center = randomdirection() * ( 4.0f * randomlength() );
+        for ( unsigned int jj = 0; jj < 3; ++jj )
+        {
+            trias.push_back( static_cast<unsigned int>( vertices.size() ) );
+            vertices.push_back( center + randomdirection() * 0.5f );
+        }
+    }
+    return meshf( std::move( vertices ), std::move( trias ) );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    constexpr int numPackets = 2000;
+
+    scene<float> world;
+    world << new meshf( randomtriangles( 500 ) );
+    for ( int ii = 0; ii < 50; ++ii )
+    {
+        spheref s( randomdirection() * ( 4.0f * randomlength() ),
+                   0.1f + 0.3f * randomlength() );
+
+        // grouped by value and on their own behind the primitive interface
+        if ( ii % 2 )
+            world << s;
+        else
+            world << new spheref( s );
+    }
+
+    // packets of nearby rays, like neighbouring camera rays, must report the
+    // same closest hits and occlusion as tracing every lane on its own
+    int numHits = 0;
+    for ( int ii = 0; ii < numPackets; ++ii )
+    {
+        vec3f origin = randomdirection() * 8.0f;
+        vec3f target = randomdirection() * ( 2.0f * randomlength() );
+
+        raypacket<float> packet;
+        rayf             rays[kPacketSize];
+        unsigned int     count = 1 + ii % kPacketSize;
+        for ( unsigned int lane = 0; lane < count; ++lane )
+        {
+            vec3f d = target + randomdirection() * 0.5f - origin;
+            d.normalize();
+            rays[lane] = {origin, d};
+            packet.set( lane, rays[lane] );
+        }
+
+        raypacket<float> shadow = packet;
+        for ( unsigned int lane = 0; lane < count; ++lane )
+            shadow.tmax[lane] = 8.0f;
+
+        packethit<float> ph;
+        world.intersect( packet, ph );
+        unsigned int blocked = world.occluded( shadow );
+
+        for ( unsigned int lane = 0; lane < count; ++lane )
+        {
+            hit<float> expected;
+            bool       found = world.intersect( rays[lane], expected );
+            assert( found == ( ( ph.mask >> lane ) & 1u ) );
+
+            rayf shadowRay = rays[lane];
+            shadowRay.tmax = 8.0f;
+            bool occluded  = world.occluded( shadowRay );
+            assert( occluded == ( ( blocked >> lane ) & 1u ) );
+            assert( !( ( blocked >> lane ) & 1u ) ||
+                    !( ( shadow.active >> lane ) & 1u ) );
+
+            if ( !found )
+                continue;
+
+            ++numHits;
+            hit<float>     h;
+            surface<float> s, expectedSurface;
+            world.resolve( packet, ph, lane, h );
+            world.shade( rays[lane], h, s );
+            world.shade( rays[lane], expected, expectedSurface );
+            assert( std::abs( h._t - expected._t ) < 1e-4f );
+            assert( h._object == expected._object );
+            assert( ( s._pos - expectedSurface._pos ).len2() < 1e-6f );
+            assert( ( s._normal - expectedSurface._normal ).len2() < 1e-6f );
+            assert( s._mat == expectedSurface._mat );
+        }
+    }
+
+    // the test is pointless if hardly anything is hit
+    assert( numHits > numPackets );
+
+    // a packet without active lanes is left alone
+    raypacket<float> empty;
+    packethit<float> ph;
+    world.intersect( empty, ph );
+    assert( ph.mask == 0 );
+
+    return 0;
+}
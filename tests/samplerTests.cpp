@@ -0,0 +1,111 @@
+#include "../sampler.h"
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// true if every one of the 2^m points falls into its own cell of each
+// 2^a x 2^( m - a ) grid, the ( 0, m, 2 ) net property of sobol points
+// -----------------------------------------------------------------------------
+static bool isnet( const std::vector<float> &u,
+                   const std::vector<float> &v,
+                   unsigned int              m )
+{
+    unsigned int n = 1u << m;
+    for ( unsigned int a = 0; a <= m; ++a )
+    {
+        unsigned int     cols = 1u << a;
+        unsigned int     rows = n / cols;
+        std::vector<int> cells( n, 0 );
+        for ( unsigned int ii = 0; ii < n; ++ii )
+        {
+            auto x = static_cast<unsigned int>( u[ii] * cols );
+            auto y = static_cast<unsigned int>( v[ii] * rows );
+            if ( cells[y * cols + x]++ )
+                return false;
+        }
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    for ( samplertype type : {samplertype::kRandom, samplertype::kSobol} )
+    {
+        // values are in [0, 1), depend only on ( key, index, dimension ) and
+        // differ between keys
+        sampler a( type, 17, 5 );
+        sampler b( type, 17, 5 );
+        sampler c( type, 18, 5 );
+        unsigned int same = 0;
+        for ( unsigned int d = 0; d < 64; ++d )
+        {
+            float x = a.next1D();
+            assert( x >= 0.0f && x < 1.0f );
+            assert( x == b.next1D() );
+            same += x == c.next1D() ? 1 : 0;
+        }
+        assert( same < 4 );
+        assert( a.dimension() == 64 );
+
+        // a sampler started at a later dimension continues the sequence
+        sampler full( type, 3, 9 );
+        full.next1D();
+        full.next1D();
+        sampler tail( type, 3, 9, 2 );
+        float   u0, v0, u1, v1;
+        full.next2D( u0, v0 );
+        tail.next2D( u1, v1 );
+        assert( u0 == u1 && v0 == v1 );
+
+        // unbiased on average
+        double sum = 0;
+        for ( unsigned int ii = 0; ii < 4096; ++ii )
+        {
+            sampler s( type, 7, ii, 4 );
+            sum += s.next1D();
+        }
+        assert( std::abs( sum / 4096 - 0.5 ) < 0.02 );
+    }
+
+    {
+        // the first 2^m sobol samples of every key and dimension pair are a
+        // ( 0, m, 2 ) net and stratify one dimension into 2^m intervals
+        for ( unsigned int key = 0; key < 8; ++key )
+        {
+            for ( unsigned int dim = 0; dim < 8; dim += 2 )
+            {
+                constexpr unsigned int m = 8;
+                std::vector<float>     u( 1u << m ), v( 1u << m );
+                std::vector<int>       strata( 1u << m, 0 );
+                for ( unsigned int ii = 0; ii < ( 1u << m ); ++ii )
+                {
+                    sampler s( samplertype::kSobol, key, ii, dim );
+                    s.next2D( u[ii], v[ii] );
+
+                    sampler t( samplertype::kSobol, key, ii, dim );
+                    auto    x = static_cast<unsigned int>(
+                        t.next1D() * ( 1u << m ) );
+                    assert( strata[x]++ == 0 );
+                }
+                assert( isnet( u, v, m ) );
+            }
+        }
+    }
+
+    {
+        // random points are no net
+        constexpr unsigned int m = 8;
+        std::vector<float>     u( 1u << m ), v( 1u << m );
+        for ( unsigned int ii = 0; ii < ( 1u << m ); ++ii )
+        {
+            sampler s( samplertype::kRandom, 1, ii );
+            s.next2D( u[ii], v[ii] );
+        }
+        assert( !isnet( u, v, m ) );
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "../ray.h"
+#include "../scene.h"
+#include "../sphere.h"
+#include <cassert>
+#include <random>
+
+using vec3f   = vec3<float>;
+using rayf    = ray<float>;
+using spheref = sphere<float>;
+
+static std::mt19937 rng;
+static auto         range = rng.max() - rng.min();
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+float randomlength() { return ( 1.0f * rng() / range ); }
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+vec3f randomdirection()
+{
+    float x = randomlength() - 0.5f;
+    float y = randomlength() - 0.5f;
+    float z = randomlength() - 0.5f;
+    vec3f v{x, y, z};
+    v.normalize();
+    return v;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    constexpr int numSpheres = 2000;
+    constexpr int numTrials  = 2000;
+
+    // the bvh traversal must find the same closest hit as a linear scan
+    std::vector<spheref> spheres;
+    scene<float>         world;
+    for ( int ii = 0; ii < numSpheres; ++ii )
+    {
+        vec3f center = randomdirection() * ( 10.0f * randomlength() );
+        spheres.emplace_back( center, 0.05f + 0.2f * randomlength() );
+        world << spheres.back();
+    }
+
+    int numHits = 0;
+    for ( int ii = 0; ii < numTrials; ++ii )
+    {
+        rayf r( randomdirection() * 12.0f, randomdirection() );
+
+        hit<float> expected;
+        float      closest = std::numeric_limits<float>::max();
+        for ( const auto &s : spheres )
+        {
+            hit<float> h;
+            if ( s.intersect( r, h ) && h._t < closest )
+            {
+                closest  = h._t;
+                expected = h;
+            }
+        }
+
+        hit<float> h;
+        bool       isec = world.intersect( r, h );
+        assert( isec == ( closest != std::numeric_limits<float>::max() ) );
+        assert( world.occluded( r ) == isec );
+        if ( isec )
+        {
+            surface<float> s, expectedSurface;
+            world.shade( r, h, s );
+            expected._object->shade( r, expected, expectedSurface );
+            assert( h._t == expected._t );
+            assert( s._pos == expectedSurface._pos );
+            ++numHits;
+        }
+    }
+    assert( numHits > 0 );
+
+    // adding a primitive after the first query rebuilds the hierarchy
+    rayf r( {50.0f, 50.0f, -100.0f}, {0.0f, 0.0f, 1.0f} );
+    hit<float> h;
+    assert( !world.intersect( r, h ) );
+    world << new spheref( {50.0f, 50.0f, 0.0f}, 1.0f );
+    assert( world.intersect( r, h ) );
+    assert( std::abs( h._t - 99.0f ) < 1e-3f );
+
+    std::cout << "All tests passed\n";
+    return 0;
+}
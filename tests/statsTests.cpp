@@ -0,0 +1,124 @@
+#include "../renderer.h"
+#include "../sphere.h"
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <thread>
+
+using FLOAT   = float;
+using scenef  = scene<FLOAT>;
+using spheref = sphere<FLOAT>;
+
+static_assert( PT_STATS, "the counters are compiled in for this test" );
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static std::string readFile( const char *path )
+{
+    std::string text;
+    FILE *      file = fopen( path, "r" );
+    assert( file );
+    char   buffer[4096];
+    size_t read;
+    while ( ( read = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+        text.append( buffer, read );
+    fclose( file );
+    return text;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    {
+        // counts of threads that are still running and of threads that
+        // exited are both collected
+        StatCounts before = Stats::Collect();
+        std::thread exited( []() { Stats::Add( Stat::kHits, 5 ); } );
+        exited.join();
+
+        std::atomic<bool> counted{false}, done{false};
+        std::thread       running( [&]() {
+            Stats::Add( Stat::kHits, 7 );
+            Stats::AddRays( 2, 3 );
+            Stats::AddRays( 100, 1 );
+            counted = true;
+            while ( !done )
+                std::this_thread::yield();
+        } );
+        while ( !counted )
+            std::this_thread::yield();
+
+        StatCounts frame = Stats::Collect() - before;
+        assert( frame[Stat::kHits] == 12 );
+        assert( frame.raysByDepth[2] == 3 );
+        assert( frame.raysByDepth[kStatDepths - 1] == 1 );
+        assert( frame.rays() == 4 );
+
+        done = true;
+        running.join();
+        frame = Stats::Collect() - before;
+        assert( frame[Stat::kHits] == 12 && frame.rays() == 4 );
+    }
+
+    {
+        // camera inside a closed sphere without roulette: every ray hits and
+        // every path runs to the maximum depth
+        renderparams rp{40, 24, 3, 4};
+        rp._numThreads     = 2;
+        rp._samplesPerPass = 2;
+        rp._rouletteDepth  = rp._maxDepth;
+
+        material wall{{0.6f, 0.6f, 0.6f, 1.0f}};
+        wall.setEmissive( 1.0f );
+        scenef world;
+        world << spheref( {0.0f, 0.0f, 0.0f}, 5.0f, wall );
+
+        camera<FLOAT>   cam{{-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 60};
+        renderer<FLOAT> rdr( cam, rp );
+        film            f;
+        rdr.render( world, f );
+
+        const renderstats &stats  = rdr.stats();
+        std::uint64_t      pixels = 40 * 24;
+        std::uint64_t      paths  = 4 * pixels * rp.numSamples();
+        unsigned int       passes = rp.numSamples() / rp.samplesPerPass();
+        assert( stats.width == 40 && stats.height == 24 );
+        assert( stats.threads == 2 );
+        assert( stats.paths == paths );
+        assert( stats.counts.raysByDepth[0] == 4 * pixels * passes );
+        for ( unsigned int depth = 1; depth < kStatDepths; ++depth )
+        {
+            std::uint64_t expected = depth < rp.maxDepth() ? paths : 0;
+            assert( stats.counts.raysByDepth[depth] == expected );
+        }
+        assert( stats.counts[Stat::kHits] == stats.counts.rays() );
+        assert( stats.counts[Stat::kShadowRays] > 0 );
+        assert( stats.counts[Stat::kSphereTests] >= stats.counts.rays() );
+        assert( stats.counts[Stat::kBoxTests] >= stats.traced() );
+        assert( stats.counts[Stat::kTriangleTests] == 0 );
+        assert( stats.seconds > 0.0 && stats.mraysPerSecond() > 0.0 );
+
+        // 2 x 1 tiles, every one timed
+        assert( stats.tileSeconds.size() == 2 );
+        for ( double t : stats.tileSeconds )
+            assert( t > 0.0 );
+
+        // a frame reports its own counts only
+        StatCounts first = stats.counts;
+        rdr.render( world, f );
+        assert( rdr.stats().counts.rays() == first.rays() );
+        assert( rdr.stats().counts[Stat::kHits] == first[Stat::kHits] );
+
+        assert( stats.writejson( "stats.json" ) );
+        std::string json = readFile( "stats.json" );
+        assert( json.find( "\"counters\": true" ) != std::string::npos );
+        assert( json.find( "\"mrays_per_second\"" ) != std::string::npos );
+        assert( json.find( "\"by_depth\": [7680, 15360, 15360]" ) !=
+                std::string::npos );
+        assert( json.find( "\"count\": 2" ) != std::string::npos );
+        remove( "stats.json" );
+    }
+
+    return 0;
+}
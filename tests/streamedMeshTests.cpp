@@ -0,0 +1,256 @@
+#include "../streamedmesh.h"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+
+using vec3f     = vec3<float>;
+using rayf      = ray<float>;
+using meshf     = mesh<float>;
+using streamedf = streamedmesh<float>;
+
+static std::mt19937 rng;
+static auto         range = rng.max() - rng.min();
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+float randomlength() { return ( 1.0f * rng() / range ); }
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+vec3f randomdirection()
+{
+    float x = randomlength() - 0.5f;
+    float y = randomlength() - 0.5f;
+    float z = randomlength() - 0.5f;
+    vec3f v{x, y, z};
+    v.normalize();
+    return v;
+}
+
+// -----------------------------------------------------------------------------
+// triangle soup inside the unit sphere
+// -----------------------------------------------------------------------------
+static meshf soup( unsigned int numTrias )
+{
+    std::vector<vec3f>        vertices;
+    std::vector<unsigned int> trias;
+    for ( unsigned int ii = 0; ii < numTrias; ++ii )
+    {
+        vec3f center = randomdirection() * randomlength();
+        for ( unsigned int jj = 0; jj < 3; ++jj )
+        {
+            trias.push_back( static_cast<unsigned int>( vertices.size() ) );
+            vertices.push_back( center + randomdirection() * 0.1f );
+        }
+    }
+    return meshf( std::move( vertices ), std::move( trias ) );
+}
+
+// -----------------------------------------------------------------------------
+// the streamed mesh must report the hits of the mesh it was written from
+// -----------------------------------------------------------------------------
+static void compare( const meshf &a, const streamedf &b, unsigned int rays )
+{
+    for ( unsigned int ii = 0; ii < rays; ++ii )
+    {
+        rayf       r( randomdirection() * 2.0f, randomdirection() );
+        hit<float> ha, hb;
+        bool       hitA = a.intersect( r, ha );
+        assert( hitA == b.intersect( r, hb ) );
+        assert( a.occluded( r ) == b.occluded( r ) );
+        if ( !hitA )
+            continue;
+
+        surface<float> sa, sb;
+        a.shade( r, ha, sa );
+        b.shade( r, hb, sb );
+        assert( ha._t == hb._t && ha._element == hb._element );
+        assert( ha._u == hb._u && ha._v == hb._v );
+        assert( hb._object == &b );
+        assert( ( sa._normal - sb._normal ).len2() == 0.0f );
+        assert( sa._mat->diffuse().r == sb._mat->diffuse().r );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    std::string path = "streamedMeshTests.ptclusters";
+    meshf       model = soup( 3000 );
+    assert( streamedf::write( model, path, 64 ) );
+
+    {
+        // everything fits, every cluster is read once
+        streamedf streamed( path );
+        assert( streamed.isOpen() );
+        assert( streamed.numTriangles() == 3000 );
+        assert( streamed.numClusters() >= 3000 / 64 );
+        assert( streamed.bounds().min()[0] == model.bounds().min()[0] );
+        compare( model, streamed, 2000 );
+
+        PageStats paging = streamed.paging();
+        assert( paging.misses <= streamed.numClusters() );
+        assert( paging.hits > paging.misses );
+        assert( paging.evictions == 0 );
+        assert( paging.resident == paging.peakResident );
+
+        // packets keep the element of every lane
+        raypacket<float> p;
+        rayf             rays[kPacketSize];
+        for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+        {
+            rays[lane] = rayf( {-3.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f} );
+            rays[lane].d = ( randomdirection() * 0.2f - rays[lane].o );
+            rays[lane].d.normalize();
+            p.set( lane, rays[lane] );
+        }
+        packethit<float> ph;
+        streamed.intersect( p, ph );
+        for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+        {
+            hit<float> h;
+            bool       found = model.intersect( rays[lane], h );
+            assert( found == ( ( ph.mask >> lane ) & 1u ) );
+            if ( !found )
+                continue;
+            hit<float> resolved;
+            streamed.resolve(
+                rays[lane], ph.t[lane], ph.element[lane], resolved );
+            assert( resolved._element == h._element && resolved._t == h._t );
+        }
+    }
+
+    {
+        // a budget of a few clusters evicts, but keeps within the budget
+        streamedf streamed( path, 4 * 64 * 12 * sizeof( float ) );
+        compare( model, streamed, 2000 );
+
+        PageStats paging = streamed.paging();
+        assert( paging.misses > streamed.numClusters() );
+        assert( paging.evictions > 0 );
+        assert( paging.resident <= paging.budget );
+        assert( paging.bytesRead > paging.budget );
+        assert( paging.hitRate() > 0.0 && paging.hitRate() < 1.0 );
+    }
+
+    {
+        // threads share the cache and evict each other's clusters
+        std::size_t              budget = 2 * 64 * 12 * sizeof( float );
+        streamedf                streamed( path, budget );
+        std::vector<std::thread> threads;
+        for ( unsigned int ii = 0; ii < 4; ++ii )
+        {
+            threads.emplace_back( [&, ii]() {
+                std::mt19937 local( ii );
+                for ( unsigned int jj = 0; jj < 500; ++jj )
+                {
+                    vec3f o{2.0f * ( 1.0f * local() / range ) - 1.0f, -3.0f,
+                            2.0f * ( 1.0f * local() / range ) - 1.0f};
+                    rayf       r( o, {0.0f, 1.0f, 0.0f} );
+                    hit<float> ha, hb;
+                    bool       hitA = model.intersect( r, ha );
+                    assert( hitA == streamed.intersect( r, hb ) );
+                    assert( !hitA || ha._element == hb._element );
+                }
+            } );
+        }
+        for ( auto &t : threads )
+            t.join();
+        assert( streamed.paging().evictions > 0 );
+    }
+
+    {
+        // emitters are found without reading clusters that have none
+        material light{{1.0f, 1.0f, 1.0f, 1.0f}};
+        light.setEmissive( 5.0f );
+        meshf lamp = soup( 200 );
+        lamp.setMaterial( light );
+        assert( streamedf::write( lamp, path, 16 ) );
+
+        streamedf                 streamed( path );
+        std::vector<unsigned int> expected, found;
+        lamp.emitters( expected );
+        streamed.emitters( found );
+        assert( found == expected && found.size() == 200 );
+
+        vec3f from{0.0f, 0.0f, 3.0f};
+        for ( unsigned int element : found )
+        {
+            assert( lamp.emitterPower( element ) ==
+                    streamed.emitterPower( element ) );
+            lightsample<float> la, lb;
+            bool seen = lamp.sampleEmitter( element, from, 0.3f, 0.6f, la );
+            assert( seen ==
+                    streamed.sampleEmitter( element, from, 0.3f, 0.6f, lb ) );
+            assert( ( la.pos - lb.pos ).len2() == 0.0f && la.pdf == lb.pdf );
+        }
+
+        meshf plain = soup( 200 );
+        assert( streamedf::write( plain, path, 16 ) );
+        streamedf unlit( path );
+        found.clear();
+        unlit.emitters( found );
+        assert( found.empty() && unlit.paging().misses == 0 );
+    }
+
+    {
+        // a cluster whose nodes or material ids index out of range is left
+        // out instead of being traversed, the others still render
+        meshf small = soup( 200 );
+        assert( streamedf::write( small, path, 16 ) );
+        clusterfileheader header;
+        clusterinfo       first, second;
+        FILE *            file = fopen( path.c_str(), "r+b" );
+        assert( fread( &header, sizeof( header ), 1, file ) == 1 );
+        fseek( file, long( header.clusters.offset ), SEEK_SET );
+        assert( fread( &first, sizeof( first ), 1, file ) == 1 );
+        assert( fread( &second, sizeof( second ), 1, file ) == 1 );
+        std::uint32_t bad = 0xfffffff0u;
+        fseek( file,
+               long( first.offset + offsetof( bvhnode<float>, first ) ),
+               SEEK_SET );
+        fwrite( &bad, sizeof( bad ), 1, file );
+        // 12 components per triangle, 3 vertices and the normal
+        std::uint64_t values, ids, bytes;
+        clusterLayout<bvhnode<float>, float>(
+            second.numNodes, second.numTriangles, 12, values, ids, bytes );
+        fseek( file, long( second.offset + ids ), SEEK_SET );
+        fwrite( &bad, sizeof( bad ), 1, file );
+        fclose( file );
+
+        streamedf corrupt( path );
+        assert( corrupt.isOpen() );
+        unsigned int hits = 0;
+        for ( unsigned int ii = 0; ii < 2000; ++ii )
+        {
+            rayf       r( randomdirection() * 2.0f, randomdirection() );
+            hit<float> h;
+            if ( !corrupt.intersect( r, h ) )
+                continue;
+            assert( h._element >= first.numTriangles + second.numTriangles );
+            surface<float> s;
+            corrupt.shade( r, h, s );
+            ++hits;
+        }
+        assert( hits > 0 );
+    }
+
+    {
+        // files of other kinds are refused
+        FILE *file = fopen( path.c_str(), "wb" );
+        fwrite( "ptmesh", 1, 6, file );
+        fclose( file );
+        streamedf invalid( path );
+        assert( !invalid.isOpen() && invalid.numTriangles() == 0 );
+        hit<float> h;
+        assert( !invalid.intersect( rayf( {0, 0, 0}, {1, 0, 0} ), h ) );
+    }
+
+    std::remove( path.c_str() );
+    return 0;
+}
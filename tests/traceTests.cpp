@@ -0,0 +1,99 @@
+#include "../util/concurrent.h"
+#include "../util/trace.h"
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static std::string readFile( const char *path )
+{
+    std::string text;
+    FILE *      file = fopen( path, "r" );
+    assert( file );
+    char   buffer[4096];
+    size_t read;
+    while ( ( read = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+        text.append( buffer, read );
+    fclose( file );
+    return text;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static unsigned int occurrences( const std::string &text,
+                                 const std::string &pattern )
+{
+    unsigned int count = 0;
+    for ( std::size_t pos = text.find( pattern ); pos != std::string::npos;
+          pos             = text.find( pattern, pos + 1 ) )
+        ++count;
+    return count;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    {
+        // nothing is recorded while the tracer is off
+        PT_TRACE_SCOPE( "ignored", "test" );
+    }
+
+    Tracer::Start();
+    Tracer::SetThreadName( "main" );
+    {
+        PT_TRACE_SCOPE( "outer", "test", "value", 42 );
+        PT_TRACE_SCOPE( "inner", "test", "a", -1, "b", 2 );
+    }
+
+    {
+        // the workers exit with the pool, their events stay
+        ThreadPool pool( 3 );
+        pool.run( 10, []( unsigned int task, unsigned int ) {
+            PT_TRACE_SCOPE( "task", "test", "task", task );
+        } );
+    }
+
+    {
+        // a full ring keeps the latest events
+        std::thread busy( []() {
+            Tracer::SetThreadName( "busy" );
+            for ( unsigned int ii = 0; ii < Tracer::kRingSize + 5; ++ii )
+            {
+                PT_TRACE_SCOPE( "spin", "test", "ii", ii );
+            }
+        } );
+        busy.join();
+    }
+
+    assert( Tracer::Write( "trace.json" ) );
+    std::string json = readFile( "trace.json" );
+    remove( "trace.json" );
+
+    assert( json.find( "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" ) ==
+            0 );
+    assert( json.find( "\"ignored\"" ) == std::string::npos );
+    assert( occurrences( json, "\"name\": \"outer\"" ) == 1 );
+    assert( json.find( "\"args\": {\"value\": 42}" ) != std::string::npos );
+    assert( json.find( "\"args\": {\"a\": -1, \"b\": 2}" ) !=
+            std::string::npos );
+    assert( occurrences( json, "\"name\": \"task\"" ) == 10 );
+    assert( occurrences( json, "\"thread_name\"" ) == 5 );
+    assert( json.find( "{\"name\": \"main\"}" ) != std::string::npos );
+    assert( json.find( "{\"name\": \"worker 2\"}" ) != std::string::npos );
+
+    assert( occurrences( json, "\"name\": \"spin\"" ) == Tracer::kRingSize );
+    assert( json.find( "{\"ii\": 4}" ) == std::string::npos );
+    assert( json.find( "{\"ii\": 5}" ) != std::string::npos );
+    assert( json.find( "{\"ii\": 65540}" ) != std::string::npos );
+
+    // the inner scope closes first, both are nested in time
+    std::size_t inner = json.find( "\"name\": \"inner\"" );
+    std::size_t outer = json.find( "\"name\": \"outer\"" );
+    assert( inner < outer );
+
+    Tracer::Stop();
+    assert( !Tracer::Enabled() );
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include "../mesh.h"
+#include "../sphere.h"
+#include <cassert>
+#include <cmath>
+#include <random>
+
+static std::mt19937 rng;
+static auto         range = rng.max() - rng.min();
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static float randomlength() { return ( 1.0f * rng() / range ); }
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <typename T>
+static vec3<T> randomdirection()
+{
+    vec3<T> v;
+    do
+    {
+        v = {randomlength() - 0.5f, randomlength() - 0.5f, randomlength() - 0.5f};
+    } while ( v.len2() < 1e-4f );
+    v.normalize();
+    return v;
+}
+
+// -----------------------------------------------------------------------------
+// a size x size grid of quads, each split into two triangles, tilted and
+// moved away from the origin where float ulps are coarse
+// -----------------------------------------------------------------------------
+template <typename T>
+static mesh<T> tiltedgrid( unsigned int size, std::vector<vec3<T>> &vertices )
+{
+    vec3<T> origin{T( 101.3 ), T( -47.9 ), T( 230.1 )};
+    vec3<T> du{T( 0.37 ), T( 0.11 ), T( -0.05 )};
+    vec3<T> dv{T( -0.07 ), T( 0.29 ), T( 0.13 )};
+
+    std::vector<unsigned int> trias;
+    for ( unsigned int jj = 0; jj <= size; ++jj )
+        for ( unsigned int ii = 0; ii <= size; ++ii )
+            vertices.push_back( origin + du * T( ii ) + dv * T( jj ) );
+
+    for ( unsigned int jj = 0; jj < size; ++jj )
+    {
+        for ( unsigned int ii = 0; ii < size; ++ii )
+        {
+            unsigned int a = jj * ( size + 1 ) + ii;
+            unsigned int b = a + 1;
+            unsigned int c = a + size + 1;
+            unsigned int d = c + 1;
+            trias.insert( trias.end(), {a, b, d, a, d, c} );
+        }
+    }
+    return mesh<T>( vertices, trias );
+}
+
+// -----------------------------------------------------------------------------
+// rays aimed exactly at shared vertices and at points on shared edges of the
+// grid must hit it, one ray at a time and in packets
+// -----------------------------------------------------------------------------
+template <typename T>
+static void watertight()
+{
+    constexpr unsigned int kSize = 6;
+    std::vector<vec3<T>>   vertices;
+    mesh<T>                grid = tiltedgrid<T>( kSize, vertices );
+
+    std::vector<vec3<T>> targets;
+    for ( unsigned int jj = 1; jj < kSize; ++jj )
+    {
+        for ( unsigned int ii = 1; ii < kSize; ++ii )
+        {
+            const vec3<T> &v = vertices[jj * ( kSize + 1 ) + ii];
+            const vec3<T> &r = vertices[jj * ( kSize + 1 ) + ii + 1];
+            const vec3<T> &u = vertices[( jj + 1 ) * ( kSize + 1 ) + ii];
+            const vec3<T> &d = vertices[( jj + 1 ) * ( kSize + 1 ) + ii + 1];
+            targets.push_back( v );
+            for ( T s : {T( 0.25 ), T( 0.5 ), T( 0.7 )} )
+            {
+                targets.push_back( v + ( r - v ) * s );
+                targets.push_back( v + ( u - v ) * s );
+                targets.push_back( v + ( d - v ) * s );
+            }
+        }
+    }
+
+    vec3<T> center = grid.bounds().center();
+    for ( const vec3<T> &target : targets )
+    {
+        raypacket<T> p;
+        for ( unsigned int lane = 0; lane < kPacketSize; ++lane )
+        {
+            // origins on both sides of the grid
+            vec3<T> o = center + randomdirection<T>() * T( 3 );
+            vec3<T> d = target - o;
+            d.normalize();
+            ray<T> r( o, d );
+
+            hit<T> h;
+            assert( grid.intersect( r, h ) );
+            assert( grid.occluded( r ) );
+            p.set( lane, r );
+        }
+
+        raypacket<T> q = p;
+        packethit<T> ph;
+        grid.intersect( p, ph );
+        assert( ph.mask == ( 1u << kPacketSize ) - 1 );
+        assert( grid.occluded( q ) == ( 1u << kPacketSize ) - 1 );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// rays leaving a hit point through offsetRayOrigin never find the surface
+// they start on, on a plane and on the outside of a sphere far from the
+// origin
+// -----------------------------------------------------------------------------
+template <typename T>
+static void selfintersection()
+{
+    std::vector<vec3<T>> vertices;
+    mesh<T>              grid   = tiltedgrid<T>( 4, vertices );
+    vec3<T>              center = grid.bounds().center();
+    sphere<T>            ball( {T( -310.7 ), T( 82.3 ), T( 455.9 )}, T( 2.5 ) );
+
+    for ( unsigned int ii = 0; ii < 2000; ++ii )
+    {
+        const primitive<T> *shape = ii % 2 ? static_cast<const primitive<T> *>(
+                                                 &grid )
+                                           : &ball;
+        vec3<T> aim = ii % 2 ? center : ball.center();
+        vec3<T> o   = aim + randomdirection<T>() * T( 10 );
+        vec3<T> d   = aim + randomdirection<T>() - o;
+        d.normalize();
+
+        ray<T>     in( o, d );
+        hit<T>     h;
+        surface<T> s;
+        if ( !shape->intersect( in, h ) )
+            continue;
+        shape->shade( in, h, s );
+
+        // away from the surface on the side the ray came from
+        vec3<T> out = randomdirection<T>();
+        if ( out % s._normal < 0 )
+            out = out * T( -1 );
+
+        hit<T> again;
+        ray<T> r( offsetRayOrigin( s._pos, s._normal ), out );
+        assert( !shape->intersect( r, again ) );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main()
+{
+    watertight<float>();
+    watertight<double>();
+    selfintersection<float>();
+    selfintersection<double>();
+    return 0;
+}
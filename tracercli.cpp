@@ -0,0 +1,531 @@
+#include "denoiser.h"
+#include "film.h"
+#include "imagewriter.h"
+#include "renderer.h"
+#include "scenes.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include "distributed.h"
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// headless batch renderer. renders one scene with the given parameters,
+// writes the image and exits, so it runs on machines without a display
+// -----------------------------------------------------------------------------
+using FLOAT = float;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct Options
+{
+    renderparams             rp;
+    std::string              scene = "cornell";
+    std::vector<std::string> outputs;
+    std::string              heatmap;
+    std::string              stats;
+    std::string              trace;
+    std::size_t              budget = kClusterBudget;
+    std::string              split;
+    std::string  albedo;
+    std::string  normals;
+    bool         denoise = false;
+
+    // distributed rendering: the address the coordinator listens on, the
+    // number of local workers it starts, and for a worker the coordinator
+    std::string  listen;
+    unsigned int workers = 0;
+    std::string  connect;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void PrintUsage( const char *program )
+{
+    renderparams defaults;
+    std::cout
+        << "usage: " << program << " [options]\n"
+        << "  --width <n>      image width (" << defaults.width() << ")\n"
+        << "  --height <n>     image height (" << defaults.height() << ")\n"
+        << "  --samples <n>    samples per subpixel (" << defaults.numSamples()
+        << ")\n"
+        << "  --depth <n>      maximum path length (" << defaults.maxDepth()
+        << ")\n"
+        << "  --threads <n>    render threads, 0 uses all ("
+        << defaults.numThreads() << ")\n"
+        << "  --pass <n>       samples per progressive pass ("
+        << defaults.samplesPerPass() << ")\n"
+        << "  --sampler <s>    'sobol' or 'random' (sobol)\n"
+        << "  --lights <s>     'on' samples emitters directly, 'off' only\n"
+        << "                   finds them by bouncing (on)\n"
+        << "  --adaptive <e>   stop pixels at relative error e, 0 is off ("
+        << defaults.adaptiveThreshold() << ")\n"
+        << "  --scene <s>      'cornell', the path of an .obj file or of a\n"
+        << "                   .ptclusters file, rendered out of core (cornell)\n"
+        << "  --budget <mb>    memory for the clusters of a .ptclusters scene ("
+        << ( kClusterBudget >> 20 ) << ")\n"
+        << "  --split <path>   writes the .obj scene as a .ptclusters file and\n"
+        << "                   exits\n"
+        << "  --output <path>  image to write, .ppm, .pfm or .png, may be given\n"
+        << "                   more than once (render.ppm)\n"
+        << "  --denoise <s>    'on' filters the image before writing it (off)\n"
+        << "  --heatmap <path> ppm of the samples taken per pixel\n"
+        << "  --albedo <path>  image of the first hit albedo\n"
+        << "  --normals <path> image of the first hit normals\n"
+        << "  --stats <path>   json report of the render, rays and intersection\n"
+        << "                   tests are counted when built with PATHTRACER_STATS\n"
+        << "  --trace <path>   chrome trace of every thread, for chrome://tracing\n"
+        << "                   or ui.perfetto.dev\n"
+#ifndef _WIN32
+        << "distributed rendering, addresses are unix:<path> or <host>:<port>\n"
+        << "  --listen <addr>  render on the workers that connect to addr\n"
+        << "  --workers <n>    start n local workers\n"
+        << "  --connect <addr> serve the coordinator at addr as a worker\n"
+#endif
+        ;
+}
+
+// -----------------------------------------------------------------------------
+// returns false and prints the reason on malformed arguments
+// -----------------------------------------------------------------------------
+static bool ParseArgs( int argc, char **argv, Options &options )
+{
+    auto number = []( const char *arg, unsigned int &value ) {
+        char *         end    = nullptr;
+        unsigned long  parsed = strtoul( arg, &end, 10 );
+        bool           ok     = *arg && !*end && arg[0] != '-';
+        if ( ok )
+            value = static_cast<unsigned int>( parsed );
+        return ok;
+    };
+
+    auto real = []( const char *arg, float &value ) {
+        char *end    = nullptr;
+        float parsed = strtof( arg, &end );
+        bool  ok     = *arg && !*end && parsed >= 0.0f;
+        if ( ok )
+            value = parsed;
+        return ok;
+    };
+
+    for ( int ii = 1; ii < argc; ++ii )
+    {
+        const char *arg = argv[ii];
+        if ( !strcmp( arg, "-h" ) || !strcmp( arg, "--help" ) )
+            return false;
+
+        if ( ii + 1 >= argc )
+        {
+            std::cerr << "missing value for " << arg << "\n";
+            return false;
+        }
+
+        const char *  value = argv[++ii];
+        renderparams &rp    = options.rp;
+        bool          ok    = true;
+        if ( !strcmp( arg, "--width" ) )
+            ok = number( value, rp._width ) && rp._width > 1;
+        else if ( !strcmp( arg, "--height" ) )
+            ok = number( value, rp._height ) && rp._height > 0;
+        else if ( !strcmp( arg, "--samples" ) )
+            ok = number( value, rp._numSamples );
+        else if ( !strcmp( arg, "--depth" ) )
+            ok = number( value, rp._maxDepth );
+        else if ( !strcmp( arg, "--threads" ) )
+            ok = number( value, rp._numThreads );
+        else if ( !strcmp( arg, "--pass" ) )
+            ok = number( value, rp._samplesPerPass ) && rp._samplesPerPass > 0;
+        else if ( !strcmp( arg, "--sampler" ) )
+        {
+            ok = !strcmp( value, "sobol" ) || !strcmp( value, "random" );
+            rp._samplerType = !strcmp( value, "random" ) ? samplertype::kRandom
+                                                         : samplertype::kSobol;
+        }
+        else if ( !strcmp( arg, "--lights" ) )
+        {
+            ok = !strcmp( value, "on" ) || !strcmp( value, "off" );
+            rp._lightSampling = !strcmp( value, "on" );
+        }
+        else if ( !strcmp( arg, "--adaptive" ) )
+            ok = real( value, rp._adaptiveThreshold );
+        else if ( !strcmp( arg, "--scene" ) )
+            options.scene = value;
+        else if ( !strcmp( arg, "--budget" ) )
+        {
+            unsigned int megabytes = 0;
+            ok             = number( value, megabytes ) && megabytes > 0;
+            options.budget = std::size_t( megabytes ) << 20;
+        }
+        else if ( !strcmp( arg, "--split" ) )
+            options.split = value;
+        else if ( !strcmp( arg, "--output" ) )
+        {
+            imageformat format;
+            ok = imageFormat( value, format );
+            options.outputs.push_back( value );
+        }
+        else if ( !strcmp( arg, "--denoise" ) )
+        {
+            ok              = !strcmp( value, "on" ) || !strcmp( value, "off" );
+            options.denoise = !strcmp( value, "on" );
+        }
+        else if ( !strcmp( arg, "--heatmap" ) )
+            options.heatmap = value;
+        else if ( !strcmp( arg, "--albedo" ) )
+        {
+            imageformat format;
+            ok             = imageFormat( value, format );
+            options.albedo = value;
+        }
+        else if ( !strcmp( arg, "--normals" ) )
+        {
+            imageformat format;
+            ok              = imageFormat( value, format );
+            options.normals = value;
+        }
+        else if ( !strcmp( arg, "--stats" ) )
+            options.stats = value;
+        else if ( !strcmp( arg, "--trace" ) )
+            options.trace = value;
+#ifndef _WIN32
+        else if ( !strcmp( arg, "--listen" ) )
+            options.listen = value;
+        else if ( !strcmp( arg, "--workers" ) )
+            ok = number( value, options.workers );
+        else if ( !strcmp( arg, "--connect" ) )
+            options.connect = value;
+#endif
+        else
+        {
+            std::cerr << "unknown option " << arg << "\n";
+            return false;
+        }
+
+        if ( !ok )
+        {
+            std::cerr << "invalid value '" << value << "' for " << arg << "\n";
+            return false;
+        }
+    }
+
+    if ( options.outputs.empty() )
+        options.outputs.push_back( "render.ppm" );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// reports the files of a writer, false if any of them failed
+// -----------------------------------------------------------------------------
+static bool FinishImages( imagewriter &                   writer,
+                          const std::vector<std::string> &paths )
+{
+    writer.finish();
+    for ( const std::string &path : paths )
+    {
+        const std::vector<std::string> &failed = writer.failed();
+        if ( std::find( failed.begin(), failed.end(), path ) != failed.end() )
+            std::cerr << "could not write " << path << "\n";
+        else
+            std::cout << "wrote " << path << "\n";
+    }
+    return writer.failed().empty();
+}
+
+// -----------------------------------------------------------------------------
+// writes a feature of the film as an image, feature maps a pixel to a color
+// -----------------------------------------------------------------------------
+template <typename FEATURE>
+static bool WriteFeature( const film &       image,
+                          const std::string &path,
+                          FEATURE            feature )
+{
+    film aov( image.width(), image.height() );
+    for ( unsigned int y = 0; y < image.height(); ++y )
+    {
+        for ( unsigned int x = 0; x < image.width(); ++x )
+            aov.add( x, y, feature( x, y ), 1 );
+    }
+
+    imagewriter writer( aov.width(), aov.height(), {path} );
+    writer.submit( aov );
+    return FinishImages( writer, {path} );
+}
+
+// -----------------------------------------------------------------------------
+// loads the .obj scene in memory and writes it as clusters, which render
+// nodes with less memory then stream
+// -----------------------------------------------------------------------------
+static int SplitScene( const Options &options )
+{
+    mesh<FLOAT> model( options.scene, false );
+    if ( !model.numTriangles() )
+        return 1;
+
+    if ( !streamedmesh<FLOAT>::write( model, options.split ) )
+    {
+        std::cerr << "could not write " << options.split << "\n";
+        return 1;
+    }
+    std::cout << "wrote " << options.split << "\n";
+    return 0;
+}
+
+#ifndef _WIN32
+// -----------------------------------------------------------------------------
+// worker mode, retries for a while in case the coordinator is not up yet
+// -----------------------------------------------------------------------------
+static int RunWorker( const Options &options )
+{
+    Socket connection;
+    for ( unsigned int attempt = 0; attempt < 100; ++attempt )
+    {
+        connection = Socket::Connect( options.connect );
+        if ( connection.Valid() )
+            break;
+        std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+    }
+    if ( !connection.Valid() )
+    {
+        std::cerr << "could not connect to " << options.connect << "\n";
+        return 1;
+    }
+
+    worker<FLOAT> w( options.rp.numThreads() );
+    return w.run( connection ) ? 0 : 1;
+}
+
+// -----------------------------------------------------------------------------
+// coordinator mode. local workers run this program again with --connect and
+// share the hardware threads between them
+// -----------------------------------------------------------------------------
+static bool RenderDistributed( const Options &options,
+                               const char *   program,
+                               film &         image )
+{
+    std::string address = options.listen;
+    if ( address.empty() )
+        address = "unix:/tmp/tracer-cli-" + std::to_string( getpid() );
+
+    Socket listener = Socket::Listen( address );
+    if ( !listener.Valid() )
+    {
+        std::cerr << "could not listen on " << address << "\n";
+        return false;
+    }
+
+    unsigned int threads = options.rp.numThreads();
+    if ( !threads && options.workers )
+    {
+        threads = std::max( std::thread::hardware_concurrency(), 1u );
+        threads = std::max( threads / options.workers, 1u );
+    }
+    std::string         threadArg = std::to_string( threads );
+    std::vector<pid_t>  children;
+    for ( unsigned int ii = 0; ii < options.workers; ++ii )
+    {
+        pid_t pid = fork();
+        if ( pid == 0 )
+        {
+            execlp( program,
+                    program,
+                    "--connect",
+                    address.c_str(),
+                    "--threads",
+                    threadArg.c_str(),
+                    static_cast<char *>( nullptr ) );
+            _exit( 127 );
+        }
+        if ( pid > 0 )
+            children.push_back( pid );
+    }
+
+    coordinator<FLOAT> c( options.rp, options.scene );
+    bool               ok = c.render( listener, image );
+    listener.Close();
+    if ( address.compare( 0, 5, "unix:" ) == 0 )
+        unlink( address.c_str() + 5 );
+
+    for ( pid_t pid : children )
+        waitpid( pid, nullptr, 0 );
+    return ok;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main( int argc, char **argv )
+{
+    Options options;
+    if ( !ParseArgs( argc, argv, options ) )
+    {
+        PrintUsage( argv[0] );
+        return 1;
+    }
+
+#ifndef _WIN32
+    if ( !options.connect.empty() )
+        return RunWorker( options );
+#endif
+
+    if ( !options.split.empty() )
+        return SplitScene( options );
+
+    // the timeline starts before any thread it is to show
+    if ( !options.trace.empty() )
+    {
+        Tracer::Start();
+        Tracer::SetThreadName( "main" );
+    }
+
+    const renderparams &rp = options.rp;
+    film                image;
+
+    // without the denoiser the tiles of a local render go to the writer as
+    // they finish, and the files are written while the last ones render
+    imagewriter writer( rp.width(), rp.height(), options.outputs );
+    bool        streamed = false;
+    renderstats stats;
+
+    auto start = std::chrono::steady_clock::now();
+#ifndef _WIN32
+    if ( !options.listen.empty() || options.workers )
+    {
+        if ( !RenderDistributed( options, argv[0], image ) )
+            return 1;
+    }
+    else
+#endif
+    {
+        scene<FLOAT>                world;
+        const streamedmesh<FLOAT> *outOfCore = nullptr;
+        camera<FLOAT>              cam       = buildScene(
+            world, options.scene, options.budget, &outOfCore );
+        renderer<FLOAT> device( cam, rp );
+        renderer<FLOAT>::tilecallback onTile;
+        if ( !options.denoise )
+        {
+            streamed = true;
+            onTile   = [&]( const film &f, unsigned int tile ) {
+                unsigned int x0, y0, x1, y1;
+                renderer<FLOAT>::tileBounds( rp, tile, x0, y0, x1, y1 );
+                writer.submit( f, x0, y0, x1, y1 );
+            };
+        }
+        device.render( world, image, {}, onTile );
+        stats = device.stats();
+        if ( outOfCore )
+            stats.paging = outOfCore->paging();
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    // the workers of a distributed render keep their counters and timings
+    if ( !stats.width )
+    {
+        stats.width   = rp.width();
+        stats.height  = rp.height();
+        stats.seconds = elapsed.count();
+        stats.paths   = image.totalSamples();
+    }
+
+    // without adaptive sampling every pixel traces numSamples paths for each
+    // of its four subpixels
+    double uniform = 4.0 * rp.width() * rp.height() * rp.numSamples();
+    double paths   = static_cast<double>( image.totalSamples() );
+    std::cout << "rendered " << rp.width() << "x" << rp.height() << " with "
+              << rp.numSamples() << " samples in " << elapsed.count()
+              << " s (" << paths / elapsed.count() * 1e-6 << " Mpaths/s)\n";
+    if ( rp.adaptiveThreshold() > 0.0f )
+    {
+        std::cout << "adaptive sampling traced " << paths / uniform * 100
+                  << "% of the uniform paths\n";
+    }
+    if ( PT_STATS && stats.traced() )
+    {
+        std::cout << "traced " << stats.traced() << " rays ("
+                  << stats.mraysPerSecond() << " Mrays/s)\n";
+    }
+    if ( stats.paging.hits + stats.paging.misses )
+    {
+        const PageStats &paging = stats.paging;
+        std::cout << "read " << paging.misses << " clusters ("
+                  << paging.bytesRead / 1e6 << " MB), "
+                  << 100 * paging.hitRate() << "% of requests hit, "
+                  << paging.evictions << " evicted, peak "
+                  << paging.peakResident / 1e6 << " of "
+                  << paging.budget / 1e6 << " MB\n";
+    }
+    if ( !options.stats.empty() )
+    {
+        if ( !stats.writejson( options.stats ) )
+        {
+            std::cerr << "could not write " << options.stats << "\n";
+            return 1;
+        }
+        std::cout << "wrote " << options.stats << "\n";
+    }
+
+    if ( !options.albedo.empty() &&
+         !WriteFeature( image, options.albedo, [&]( unsigned x, unsigned y ) {
+             return image.albedo( x, y );
+         } ) )
+        return 1;
+
+    // normals are mapped from [-1, 1] to [0, 1] per axis
+    if ( !options.normals.empty() &&
+         !WriteFeature( image, options.normals, [&]( unsigned x, unsigned y ) {
+             vec3<float> n = image.normal( x, y );
+             return color{0.5f + 0.5f * n[0],
+                          0.5f + 0.5f * n[1],
+                          0.5f + 0.5f * n[2],
+                          1.0f};
+         } ) )
+        return 1;
+
+    film filtered;
+    if ( options.denoise )
+    {
+        denoiseparams dp;
+        dp._numThreads = rp.numThreads();
+        denoiser filter( dp );
+        start = std::chrono::steady_clock::now();
+        filter.run( image, filtered );
+        elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "denoised in " << elapsed.count() << " s\n";
+    }
+
+    if ( !streamed )
+        writer.submit( options.denoise ? filtered : image );
+    if ( !FinishImages( writer, options.outputs ) )
+        return 1;
+
+    if ( !options.heatmap.empty() )
+    {
+        if ( !image.writeheatmap( options.heatmap ) )
+        {
+            std::cerr << "could not write " << options.heatmap << "\n";
+            return 1;
+        }
+        std::cout << "wrote " << options.heatmap << "\n";
+    }
+
+    if ( !options.trace.empty() )
+    {
+        if ( !Tracer::Write( options.trace ) )
+        {
+            std::cerr << "could not write " << options.trace << "\n";
+            return 1;
+        }
+        std::cout << "wrote " << options.trace << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "ray.h"
+#include <cmath>
+
+// -----------------------------------------------------------------------------
+// a ray prepared for the watertight triangle test: kz is the axis along which
+// the ray direction is largest, kx and ky follow it cyclically. the test moves
+// the ray origin to 0 and shears the direction onto the kz axis, which leaves
+// a 2d point in polygon test on the kx, ky coordinates of the vertices. after
+// woop, benthin and wald, "watertight ray/triangle intersection"
+// -----------------------------------------------------------------------------
+template <typename T>
+struct shearedray
+{
+    shearedray() noexcept = default;
+    explicit shearedray( const ray<T> &r ) noexcept
+        : o( r.o ), kz( dominantAxis( r.d ) )
+    {
+        kx = kz == 2 ? 0 : kz + 1;
+        ky = kx == 2 ? 0 : kx + 1;
+        sx = r.d[kx] / r.d[kz];
+        sy = r.d[ky] / r.d[kz];
+        sz = T( 1 ) / r.d[kz];
+    }
+
+    static unsigned int dominantAxis( const vec3<T> &d ) noexcept
+    {
+        T x = std::abs( d[0] ), y = std::abs( d[1] ), z = std::abs( d[2] );
+        if ( x > y && x > z )
+            return 0;
+        return y > z ? 1 : 2;
+    }
+
+    vec3<T>      o;
+    unsigned int kx = 1, ky = 2, kz = 0;
+    T            sx = T( 0 ), sy = T( 0 ), sz = T( 1 );
+};
+
+// -----------------------------------------------------------------------------
+// a * b - c * d with the correct sign. float products are exact in double,
+// double ones are corrected with a fused multiply add
+// -----------------------------------------------------------------------------
+inline float exactDifference( float a, float b, float c, float d ) noexcept
+{
+    return static_cast<float>( double( a ) * b - double( c ) * d );
+}
+
+inline double exactDifference( double a, double b, double c, double d ) noexcept
+{
+    double cd  = c * d;
+    double err = std::fma( -c, d, cd );
+    return std::fma( a, b, -cd ) + err;
+}
+
+// -----------------------------------------------------------------------------
+// intersects r with the triangle v0 v1 v2 from either side, t receives the
+// distance. every vertex is transformed the same way in every triangle it
+// belongs to and the signs of the edge functions are exact, so a ray through
+// a shared edge or vertex hits at least one of the triangles around it
+// -----------------------------------------------------------------------------
+template <typename T>
+bool intersectTriangle( const shearedray<T> &r,
+                        const vec3<T> &      v0,
+                        const vec3<T> &      v1,
+                        const vec3<T> &      v2,
+                        T &                  t ) noexcept
+{
+    vec3<T> a = v0 - r.o;
+    vec3<T> b = v1 - r.o;
+    vec3<T> c = v2 - r.o;
+
+    T ax = a[r.kx] - r.sx * a[r.kz];
+    T ay = a[r.ky] - r.sy * a[r.kz];
+    T bx = b[r.kx] - r.sx * b[r.kz];
+    T by = b[r.ky] - r.sy * b[r.kz];
+    T cx = c[r.kx] - r.sx * c[r.kz];
+    T cy = c[r.ky] - r.sy * c[r.kz];
+
+    T u = cx * by - cy * bx;
+    T v = ax * cy - ay * cx;
+    T w = bx * ay - by * ax;
+
+    // rounding can only get the sign wrong when the result rounds to 0
+    if ( u == 0 || v == 0 || w == 0 )
+    {
+        u = exactDifference( cx, by, cy, bx );
+        v = exactDifference( ax, cy, ay, cx );
+        w = exactDifference( bx, ay, by, ax );
+    }
+
+    if ( ( u < 0 || v < 0 || w < 0 ) && ( u > 0 || v > 0 || w > 0 ) )
+        return false;
+
+    T det = u + v + w;
+    if ( det == 0 )
+        return false;
+
+    T az = r.sz * a[r.kz];
+    T bz = r.sz * b[r.kz];
+    T cz = r.sz * c[r.kz];
+    t    = ( u * az + v * bz + w * cz ) / det;
+    return t > 0;
+}
+
+// -----------------------------------------------------------------------------
+// weights b1 and b2 of v1 and v2 in the point p of the triangle v0 v1 v2, the
+// weight of v0 is 1 - b1 - b2
+// -----------------------------------------------------------------------------
+template <typename T>
+void barycentrics( const vec3<T> &p,
+                   const vec3<T> &v0,
+                   const vec3<T> &v1,
+                   const vec3<T> &v2,
+                   T &            b1,
+                   T &            b2 ) noexcept
+{
+    vec3<T> e1    = v1 - v0;
+    vec3<T> e2    = v2 - v0;
+    vec3<T> ep    = p - v0;
+    T       d11   = e1 % e1;
+    T       d12   = e1 % e2;
+    T       d22   = e2 % e2;
+    T       dp1   = ep % e1;
+    T       dp2   = ep % e2;
+    T       denom = d11 * d22 - d12 * d12;
+    if ( denom == 0 )
+    {
+        b1 = b2 = T( 0 );
+        return;
+    }
+    b1 = ( d22 * dp1 - d12 * dp2 ) / denom;
+    b2 = ( d11 * dp2 - d12 * dp1 ) / denom;
+}
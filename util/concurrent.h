@@ -1,22 +1,285 @@
 #pragma once
 
+#include "trace.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 // -----------------------------------------------------------------------------
+// fixed size pool of worker threads. run() hands every worker a contiguous
+// block of task indices in its own deque. workers pop from the front of their
+// own deque and, once it runs dry, steal from the back of the others
 // -----------------------------------------------------------------------------
-template <typename Job>
-class ConcurrentTask
+class ThreadPool
 {
 public:
-    ConcurrentTask(std::vector<Job> &tasks)
-            : _tasks(std::move(tasks)
-                    {}
+    using Task = std::function<void( unsigned int task, unsigned int worker )>;
+
+    // 0 threads means one per hardware thread
+    explicit ThreadPool( unsigned int numThreads = 0 )
+        : _queues( numThreads ? numThreads : hardwareThreads() )
+    {
+        for ( unsigned int ii = 0; ii < _queues.size(); ++ii )
+            _threads.emplace_back( [this, ii]() { workerLoop( ii ); } );
+    }
+
+    static unsigned int hardwareThreads() noexcept
+    {
+        unsigned int n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+    }
+
+    ThreadPool( const ThreadPool & ) = delete;
+    ThreadPool &operator=( const ThreadPool & ) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _stop = true;
+        }
+        _wakeup.notify_all();
+        for ( auto &t : _threads )
+            t.join();
+    }
+
+    unsigned int size() const noexcept
+    {
+        return static_cast<unsigned int>( _threads.size() );
+    }
+
+    // runs task( index, worker ) for every index in [0, count) and blocks
+    // until all of them finished. not reentrant
+    void run( unsigned int count, const Task &task )
+    {
+        if ( count == 0 )
+            return;
+
+        std::unique_lock<std::mutex> lock( _mutex );
+
+        // tasks are queued and published under the pool mutex and workers
+        // only become active under it, so no worker of a previous run can
+        // pick up tasks of this one
+        _done.wait( lock, [this]() { return _active == 0; } );
+
+        unsigned int numWorkers = size();
+        for ( unsigned int ii = 0; ii < numWorkers; ++ii )
+        {
+            std::lock_guard<std::mutex> qlock( _queues[ii].mutex );
+            auto begin = static_cast<unsigned int>( 1ull * count * ii /
+                                                    numWorkers );
+            auto end   = static_cast<unsigned int>( 1ull * count * ( ii + 1 ) /
+                                                  numWorkers );
+            for ( unsigned int jj = begin; jj < end; ++jj )
+                _queues[ii].tasks.push_back( jj );
+        }
+
+        _task    = &task;
+        _pending = count;
+        ++_generation;
+        _wakeup.notify_all();
+
+        _done.wait( lock, [this]() { return _pending == 0 && _active == 0; } );
+        _task = nullptr;
+    }
 
-    Job& getNextJob() {
-        return _tasks.pop_back();}
 private:
+    struct alignas( 64 ) Queue
+    {
+        std::mutex               mutex;
+        std::deque<unsigned int> tasks;
+    };
+
+    bool pop( unsigned int self, unsigned int &task )
+    {
+        std::lock_guard<std::mutex> lock( _queues[self].mutex );
+        if ( _queues[self].tasks.empty() )
+            return false;
+        task = _queues[self].tasks.front();
+        _queues[self].tasks.pop_front();
+        return true;
+    }
+
+    bool steal( unsigned int self, unsigned int &task )
+    {
+        unsigned int numWorkers = size();
+        for ( unsigned int ii = 1; ii < numWorkers; ++ii )
+        {
+            Queue &victim = _queues[( self + ii ) % numWorkers];
+            std::lock_guard<std::mutex> lock( victim.mutex );
+            if ( victim.tasks.empty() )
+                continue;
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop( unsigned int self )
+    {
+        Tracer::SetThreadName( "worker " + std::to_string( self ) );
+        unsigned long long seen = 0;
+        while ( true )
+        {
+            const Task *task = nullptr;
+            {
+                std::unique_lock<std::mutex> lock( _mutex );
+                _wakeup.wait(
+                    lock, [&]() { return _stop || _generation != seen; } );
+                if ( _stop )
+                    return;
+                seen = _generation;
+                task = _task;
+                ++_active;
+            }
+
+            // all tasks of a run are queued before it is published, so a
+            // worker that finds every deque empty is done with it
+            unsigned int index     = 0;
+            unsigned int completed = 0;
+            while ( pop( self, index ) || steal( self, index ) )
+            {
+                ( *task )( index, self );
+                ++completed;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                _pending -= completed;
+                --_active;
+            }
+            _done.notify_all();
+        }
+    }
+
+    std::vector<Queue>       _queues;
+    std::vector<std::thread> _threads;
+
+    std::mutex              _mutex;
+    std::condition_variable _wakeup;
+    std::condition_variable _done;
+    const Task *            _task       = nullptr;
+    unsigned int            _pending    = 0;
+    unsigned int            _active     = 0;
+    unsigned long long      _generation = 0;
+    bool                    _stop       = false;
+};
+
+// -----------------------------------------------------------------------------
+// lock-free single producer / single consumer triple buffer. the producer
+// fills back() and publishes it, the consumer calls update() to swap in the
+// most recently published buffer and reads it through front(). neither side
+// ever blocks or sees a buffer the other side is still touching
+// -----------------------------------------------------------------------------
+template <typename T>
+class TripleBuffer
+{
+public:
+    // producer side
+    T &back() noexcept { return _buffers[_back]; }
+
+    void publish() noexcept
+    {
+        unsigned int prev = _middle.exchange( _back | kFresh,
+                                              std::memory_order_acq_rel );
+        _back = prev & kIndexMask;
+    }
 
-    std::mutex          _mutex;
-    std::vector<Job>    _tasks;
+    // consumer side, returns false if nothing new was published
+    bool update() noexcept
+    {
+        if ( !( _middle.load( std::memory_order_relaxed ) & kFresh ) )
+            return false;
+        unsigned int prev =
+            _middle.exchange( _front, std::memory_order_acq_rel );
+        _front = prev & kIndexMask;
+        return true;
+    }
+
+    const T &front() const noexcept { return _buffers[_front]; }
+
+private:
+    static constexpr unsigned int kIndexMask = 3;
+    static constexpr unsigned int kFresh     = 4;
+
+    T                         _buffers[3];
+    unsigned int              _back = 0;
+    std::atomic<unsigned int> _middle{1};
+    unsigned int              _front = 2;
+};
+
+// -----------------------------------------------------------------------------
+// unbounded blocking queue for any number of producers and consumers. pop()
+// waits for an item and returns false once the queue is closed and drained
+// -----------------------------------------------------------------------------
+template <typename T>
+class WorkQueue
+{
+public:
+    void push( T item )
+    {
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _items.push_back( std::move( item ) );
+        }
+        _ready.notify_one();
+    }
+
+    bool pop( T &item )
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _ready.wait( lock, [this]() { return _closed || !_items.empty(); } );
+        if ( _items.empty() )
+            return false;
+        item = std::move( _items.front() );
+        _items.pop_front();
+        return true;
+    }
+
+    // no more items will come, wakes every waiting consumer
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _closed = true;
+        }
+        _ready.notify_all();
+    }
+
+private:
+    std::mutex              _mutex;
+    std::condition_variable _ready;
+    std::deque<T>           _items;
+    bool                    _closed = false;
+};
+
+// -----------------------------------------------------------------------------
+// cooperative cancellation. one side requests it, the work polls it where
+// stopping leaves a consistent state and returns early
+// -----------------------------------------------------------------------------
+class CancelToken
+{
+public:
+    void Cancel() noexcept
+    {
+        _cancelled.store( true, std::memory_order_release );
+    }
+
+    void Reset() noexcept
+    {
+        _cancelled.store( false, std::memory_order_release );
+    }
+
+    bool Cancelled() const noexcept
+    {
+        return _cancelled.load( std::memory_order_acquire );
+    }
+
+private:
+    std::atomic<bool> _cancelled{false};
 };
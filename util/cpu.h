@@ -0,0 +1,59 @@
+#pragma once
+
+// simd kernels are only built for x86-64, where sse2 is always present
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#define PT_X86 1
+#else
+#define PT_X86 0
+#endif
+
+#if PT_X86 && defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+// gcc and clang only emit avx2 instructions inside functions that ask for it,
+// msvc accepts the intrinsics anywhere
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define PT_TARGET_AVX2 __attribute__( ( target( "avx2" ) ) )
+#else
+#define PT_TARGET_AVX2
+#endif
+
+// -----------------------------------------------------------------------------
+// runtime instruction set detection, queried once per process. sse2 is part
+// of the x86-64 baseline and needs no check
+// -----------------------------------------------------------------------------
+class CpuFeatures
+{
+public:
+    static const CpuFeatures &get()
+    {
+        static const CpuFeatures features;
+        return features;
+    }
+
+    bool avx2() const noexcept { return _avx2; }
+
+private:
+    CpuFeatures()
+    {
+#if PT_X86 && ( defined( __GNUC__ ) || defined( __clang__ ) )
+        __builtin_cpu_init();
+        _avx2 = __builtin_cpu_supports( "avx2" );
+#elif PT_X86 && defined( _MSC_VER )
+        int info[4];
+        __cpuid( info, 0 );
+        int maxLeaf = info[0];
+        __cpuid( info, 1 );
+        bool osxsave  = ( info[2] & ( 1 << 27 ) ) != 0;
+        bool ymmSaved = osxsave && ( _xgetbv( 0 ) & 6 ) == 6;
+        if ( maxLeaf >= 7 && ymmSaved )
+        {
+            __cpuidex( info, 7, 0 );
+            _avx2 = ( info[1] & ( 1 << 5 ) ) != 0;
+        }
+#endif
+    }
+
+    bool _avx2 = false;
+};
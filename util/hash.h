@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// -----------------------------------------------------------------------------
+// 64 bit non-cryptographic hash following xxhash64, fast enough to fingerprint
+// multi-gigabyte files at memory bandwidth
+// -----------------------------------------------------------------------------
+inline std::uint64_t Hash64( const void *data,
+                             std::size_t size,
+                             std::uint64_t seed = 0 ) noexcept
+{
+    constexpr std::uint64_t kPrime1 = 11400714785074694791ull;
+    constexpr std::uint64_t kPrime2 = 14029467366897019727ull;
+    constexpr std::uint64_t kPrime3 = 1609587929392839161ull;
+    constexpr std::uint64_t kPrime4 = 9650029242287828579ull;
+    constexpr std::uint64_t kPrime5 = 2870177450012600261ull;
+
+    auto rotl = []( std::uint64_t x, int r ) {
+        return ( x << r ) | ( x >> ( 64 - r ) );
+    };
+    auto read64 = []( const unsigned char *p ) {
+        std::uint64_t v;
+        memcpy( &v, p, sizeof( v ) );
+        return v;
+    };
+    auto read32 = []( const unsigned char *p ) {
+        std::uint32_t v;
+        memcpy( &v, p, sizeof( v ) );
+        return v;
+    };
+    auto round = [&]( std::uint64_t acc, std::uint64_t input ) {
+        acc += input * kPrime2;
+        return rotl( acc, 31 ) * kPrime1;
+    };
+    auto merge = [&]( std::uint64_t acc, std::uint64_t value ) {
+        acc ^= round( 0, value );
+        return acc * kPrime1 + kPrime4;
+    };
+
+    const auto *p   = static_cast<const unsigned char *>( data );
+    const auto *end = p + size;
+
+    std::uint64_t h;
+    if ( size >= 32 )
+    {
+        std::uint64_t v1 = seed + kPrime1 + kPrime2;
+        std::uint64_t v2 = seed + kPrime2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - kPrime1;
+        for ( ; p + 32 <= end; p += 32 )
+        {
+            v1 = round( v1, read64( p ) );
+            v2 = round( v2, read64( p + 8 ) );
+            v3 = round( v3, read64( p + 16 ) );
+            v4 = round( v4, read64( p + 24 ) );
+        }
+        h = rotl( v1, 1 ) + rotl( v2, 7 ) + rotl( v3, 12 ) + rotl( v4, 18 );
+        h = merge( h, v1 );
+        h = merge( h, v2 );
+        h = merge( h, v3 );
+        h = merge( h, v4 );
+    }
+    else
+    {
+        h = seed + kPrime5;
+    }
+
+    h += static_cast<std::uint64_t>( size );
+    for ( ; p + 8 <= end; p += 8 )
+        h = rotl( h ^ round( 0, read64( p ) ), 27 ) * kPrime1 + kPrime4;
+    if ( p + 4 <= end )
+    {
+        h ^= read32( p ) * kPrime1;
+        h = rotl( h, 23 ) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for ( ; p < end; ++p )
+    {
+        h ^= *p * kPrime5;
+        h = rotl( h, 11 ) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// contiguous array that either owns its elements or borrows them from memory
+// kept alive by someone else, typically a mapped file. readers do not care
+// which, writers go through edit() which turns a borrowed array into an owned
+// copy first
+// -----------------------------------------------------------------------------
+template <typename E>
+class MappedArray
+{
+    static_assert( std::is_trivially_copyable<E>::value,
+                   "mapped elements must be trivially copyable" );
+
+public:
+    MappedArray() = default;
+    MappedArray( std::vector<E> values ) : p_owned( std::move( values ) ) {}
+
+    // views size elements at data, owner keeps the memory alive
+    static MappedArray borrow( const E *                   data,
+                               std::size_t                 size,
+                               std::shared_ptr<const void> owner )
+    {
+        MappedArray a;
+        a.p_data  = data;
+        a.p_size  = size;
+        a.p_owner = std::move( owner );
+        return a;
+    }
+
+    bool borrowed() const noexcept { return p_owner != nullptr; }
+
+    std::vector<E> &edit()
+    {
+        if ( borrowed() )
+        {
+            p_owned.assign( p_data, p_data + p_size );
+            p_data = nullptr;
+            p_size = 0;
+            p_owner.reset();
+        }
+        return p_owned;
+    }
+
+    void clear() noexcept
+    {
+        p_owned.clear();
+        p_data = nullptr;
+        p_size = 0;
+        p_owner.reset();
+    }
+
+    const E *data() const noexcept
+    {
+        return borrowed() ? p_data : p_owned.data();
+    }
+
+    std::size_t size() const noexcept
+    {
+        return borrowed() ? p_size : p_owned.size();
+    }
+
+    bool empty() const noexcept { return size() == 0; }
+
+    const E &operator[]( std::size_t ii ) const noexcept { return data()[ii]; }
+    const E &front() const noexcept { return data()[0]; }
+    const E &back() const noexcept { return data()[size() - 1]; }
+    const E *begin() const noexcept { return data(); }
+    const E *end() const noexcept { return data() + size(); }
+
+private:
+    std::vector<E>              p_owned;
+    const E *                   p_data = nullptr;
+    std::size_t                 p_size = 0;
+    std::shared_ptr<const void> p_owner;
+};
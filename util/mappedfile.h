@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// how the mapping will be read, passed to the os as a paging hint. a file
+// that is parsed front to back can drop pages right after they are read, one
+// that is used in place for a whole render must keep them
+// -----------------------------------------------------------------------------
+enum class Access
+{
+    kNormal,     // no hint, the os default read ahead
+    kSequential, // read once front to back
+    kRandom      // used in place, accessed in no particular order
+};
+
+// -----------------------------------------------------------------------------
+// read only view of a whole file mapped into memory. pages are faulted in by
+// the os on first access, so several threads can parse disjoint ranges of a
+// large file without any copying
+// -----------------------------------------------------------------------------
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile( const std::string &path,
+                         Access             access = Access::kNormal )
+    {
+        open( path, access );
+    }
+
+    MappedFile( const MappedFile & ) = delete;
+    MappedFile &operator=( const MappedFile & ) = delete;
+
+    ~MappedFile() { close(); }
+
+    // returns false if the file does not exist or cannot be mapped. an empty
+    // file opens successfully with size() == 0
+    bool open( const std::string &path, Access access = Access::kNormal )
+    {
+        close();
+#ifdef _WIN32
+        DWORD flags = FILE_ATTRIBUTE_NORMAL;
+        if ( access == Access::kSequential )
+            flags = FILE_FLAG_SEQUENTIAL_SCAN;
+        else if ( access == Access::kRandom )
+            flags = FILE_FLAG_RANDOM_ACCESS;
+        p_file = CreateFileA( path.c_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              OPEN_EXISTING,
+                              flags,
+                              nullptr );
+        if ( p_file == INVALID_HANDLE_VALUE )
+            return false;
+
+        LARGE_INTEGER size;
+        if ( !GetFileSizeEx( p_file, &size ) )
+        {
+            close();
+            return false;
+        }
+        p_size = static_cast<std::size_t>( size.QuadPart );
+        if ( p_size == 0 )
+        {
+            p_open = true;
+            return true;
+        }
+
+        p_mapping =
+            CreateFileMappingA( p_file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+        if ( !p_mapping )
+        {
+            close();
+            return false;
+        }
+        p_data = static_cast<const char *>(
+            MapViewOfFile( p_mapping, FILE_MAP_READ, 0, 0, 0 ) );
+#else
+        int fd = ::open( path.c_str(), O_RDONLY );
+        if ( fd < 0 )
+            return false;
+
+        struct stat st;
+        if ( fstat( fd, &st ) != 0 )
+        {
+            ::close( fd );
+            return false;
+        }
+        p_size = static_cast<std::size_t>( st.st_size );
+        if ( p_size == 0 )
+        {
+            ::close( fd );
+            p_open = true;
+            return true;
+        }
+
+        void *data = mmap( nullptr, p_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        ::close( fd );
+        if ( data == MAP_FAILED )
+        {
+            p_size = 0;
+            return false;
+        }
+        if ( access == Access::kSequential )
+            madvise( data, p_size, MADV_SEQUENTIAL );
+        else if ( access == Access::kRandom )
+            madvise( data, p_size, MADV_RANDOM );
+        p_data = static_cast<const char *>( data );
+#endif
+        p_open = p_data != nullptr;
+        if ( !p_open )
+            close();
+        return p_open;
+    }
+
+    void close() noexcept
+    {
+#ifdef _WIN32
+        if ( p_data )
+            UnmapViewOfFile( p_data );
+        if ( p_mapping )
+            CloseHandle( p_mapping );
+        if ( p_file != INVALID_HANDLE_VALUE )
+            CloseHandle( p_file );
+        p_mapping = nullptr;
+        p_file    = INVALID_HANDLE_VALUE;
+#else
+        if ( p_data )
+            munmap( const_cast<char *>( p_data ), p_size );
+#endif
+        p_data = nullptr;
+        p_size = 0;
+        p_open = false;
+    }
+
+    // drops the pages of [offset, offset + size) from the process, a later
+    // access reads them from the file again. for data that was copied out
+    // and is not needed in place anymore. a hint, ignored on windows
+    void discard( std::size_t offset, std::size_t size ) const noexcept
+    {
+#ifndef _WIN32
+        if ( !p_data || offset >= p_size )
+            return;
+        std::size_t page  = static_cast<std::size_t>( sysconf( _SC_PAGESIZE ) );
+        std::size_t begin = offset / page * page;
+        std::size_t end   = std::min( offset + size, p_size );
+        madvise( const_cast<char *>( p_data ) + begin,
+                 end - begin,
+                 MADV_DONTNEED );
+#endif
+    }
+
+    bool        isOpen() const noexcept { return p_open; }
+    const char *data() const noexcept { return p_data; }
+    std::size_t size() const noexcept { return p_size; }
+
+private:
+    const char *p_data = nullptr;
+    std::size_t p_size = 0;
+    bool        p_open = false;
+#ifdef _WIN32
+    HANDLE p_file    = INVALID_HANDLE_VALUE;
+    HANDLE p_mapping = nullptr;
+#endif
+};
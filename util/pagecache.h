@@ -0,0 +1,263 @@
+#pragma once
+
+#include "mappedfile.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// how a PageCache did so far. a budget that keeps most requests hits with few
+// evictions holds the working set of a frame
+// -----------------------------------------------------------------------------
+struct PageStats
+{
+    std::uint64_t hits         = 0; // requests for a resident page
+    std::uint64_t misses       = 0; // requests that read the page in
+    std::uint64_t evictions    = 0;
+    std::uint64_t bytesRead    = 0;
+    std::size_t   resident     = 0; // bytes of the pages kept now
+    std::size_t   peakResident = 0;
+    std::size_t   budget       = 0;
+
+    double hitRate() const noexcept
+    {
+        std::uint64_t requests = hits + misses;
+        return requests ? double( hits ) / requests : 0.0;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// resident copies of the pages of a mapped file, read in on first request and
+// evicted once they take more than the budget. a page is any range of the
+// file, the loader turns its bytes into a P and the range is then dropped
+// from the mapping. requests may come from any thread
+//
+// a request for a resident page takes no lock, it pins the page and marks it
+// as used. the lock is only taken to read a page in and to evict, which goes
+// least recently used first with a second chance for pages used since the
+// last time they came up. a copy stays alive while a Ref holds it, even if
+// evicted meanwhile, so pages in use come on top of the budget until released
+// -----------------------------------------------------------------------------
+template <typename P>
+class PageCache
+{
+    struct Entry;
+
+public:
+    struct Page
+    {
+        std::uint64_t offset;
+        std::uint64_t bytes;
+    };
+
+    // load( page, data, bytes ) makes the copy of a page
+    using Loader = std::function<std::unique_ptr<const P>(
+        unsigned int, const char *, std::size_t )>;
+
+    // a page pinned in memory. must not outlive the cache
+    class Ref
+    {
+    public:
+        Ref() = default;
+
+        Ref( const Ref & ) = delete;
+        Ref &operator=( const Ref & ) = delete;
+
+        Ref( Ref &&other ) noexcept
+            : p_entry( std::exchange( other.p_entry, nullptr ) ),
+              p_data( std::exchange( other.p_data, nullptr ) )
+        {
+        }
+        Ref &operator=( Ref &&other ) noexcept
+        {
+            if ( this != &other )
+            {
+                release();
+                p_entry = std::exchange( other.p_entry, nullptr );
+                p_data  = std::exchange( other.p_data, nullptr );
+            }
+            return *this;
+        }
+
+        ~Ref() { release(); }
+
+        const P &operator*() const noexcept { return *p_data; }
+        const P *operator->() const noexcept { return p_data; }
+        explicit operator bool() const noexcept { return p_data != nullptr; }
+
+    private:
+        friend class PageCache;
+
+        // e must already be pinned for data
+        Ref( Entry &e, const P *data ) : p_entry( &e ), p_data( data ) {}
+
+        void release() noexcept
+        {
+            if ( p_entry )
+                p_entry->pins.fetch_sub( 1 );
+            p_entry = nullptr;
+            p_data  = nullptr;
+        }
+
+        Entry *  p_entry = nullptr;
+        const P *p_data  = nullptr;
+    };
+
+    PageCache( std::shared_ptr<const MappedFile> file,
+               std::vector<Page>                 pages,
+               std::size_t                       budget,
+               Loader                            load )
+        : p_file( std::move( file ) ),
+          p_load( std::move( load ) ),
+          p_entries( new Entry[pages.size()] ),
+          p_size( pages.size() )
+    {
+        for ( std::size_t ii = 0; ii < pages.size(); ++ii )
+            p_entries[ii].page = pages[ii];
+        p_stats.budget = budget;
+    }
+
+    PageCache( const PageCache & ) = delete;
+    PageCache &operator=( const PageCache & ) = delete;
+
+    ~PageCache()
+    {
+        for ( std::size_t ii = 0; ii < p_size; ++ii )
+            delete p_entries[ii].data.load();
+        for ( const retired &r : p_retired )
+            delete r.data;
+    }
+
+    // the page, read in if it is not resident. two threads missing the same
+    // page may both read it, the first to finish wins
+    Ref acquire( unsigned int page )
+    {
+        // pinned before the data is looked at, so an eviction that clears
+        // the data after this sees the pin and keeps the copy alive
+        Entry &e = p_entries[page];
+        e.pins.fetch_add( 1 );
+        if ( const P *data = e.data.load() )
+        {
+            e.hits.fetch_add( 1, std::memory_order_relaxed );
+            if ( !e.touched.load( std::memory_order_relaxed ) )
+                e.touched.store( true, std::memory_order_relaxed );
+            return Ref( e, data );
+        }
+        e.pins.fetch_sub( 1 );
+        return load( page );
+    }
+
+    PageStats stats() const
+    {
+        std::lock_guard<std::mutex> lock( p_mutex );
+        PageStats                   stats = p_stats;
+        for ( std::size_t ii = 0; ii < p_size; ++ii )
+            stats.hits += p_entries[ii].hits.load( std::memory_order_relaxed );
+        return stats;
+    }
+
+    std::size_t size() const noexcept { return p_size; }
+
+private:
+    struct Entry
+    {
+        Page                       page = {0, 0};
+        std::atomic<const P *>     data{nullptr};  // null unless resident
+        std::atomic<unsigned int>  pins{0};        // Refs held, and lookups
+        std::atomic<bool>          touched{false}; // used since it came up
+        std::atomic<std::uint64_t> hits{0};
+        typename std::list<unsigned int>::iterator pos; // in p_lru
+    };
+
+    // a copy evicted while it was pinned, freed once its page has no pins
+    struct retired
+    {
+        unsigned int page;
+        const P *    data;
+    };
+
+    Ref load( unsigned int page )
+    {
+        Entry &                  e = p_entries[page];
+        std::unique_ptr<const P> data;
+        {
+            PT_TRACE_SCOPE( "page in", "scene", "page", page );
+            data = p_load( page,
+                           p_file->data() + e.page.offset,
+                           static_cast<std::size_t>( e.page.bytes ) );
+            p_file->discard( static_cast<std::size_t>( e.page.offset ),
+                             static_cast<std::size_t>( e.page.bytes ) );
+        }
+
+        // data only changes under the lock
+        std::lock_guard<std::mutex> lock( p_mutex );
+        ++p_stats.misses;
+        p_stats.bytesRead += e.page.bytes;
+        e.pins.fetch_add( 1 );
+        if ( const P *resident = e.data.load() )
+            return Ref( e, resident );
+
+        const P *resident = data.release();
+        e.data.store( resident );
+        e.touched.store( true, std::memory_order_relaxed );
+        e.pos = p_lru.insert( p_lru.begin(), page );
+        p_stats.resident += e.page.bytes;
+        p_stats.peakResident =
+            std::max( p_stats.peakResident, p_stats.resident );
+        evict( page );
+        return Ref( e, resident );
+    }
+
+    // from the back of p_lru until the pages fit the budget. a page used
+    // since it last came up goes to the front once instead, the page just
+    // read stays whatever its size
+    void evict( unsigned int keep )
+    {
+        std::size_t steps = 2 * p_lru.size();
+        while ( p_stats.resident > p_stats.budget && p_lru.size() > 1 &&
+                steps-- )
+        {
+            unsigned int page   = p_lru.back();
+            Entry &      victim = p_entries[page];
+            if ( page == keep ||
+                 victim.touched.exchange( false, std::memory_order_relaxed ) )
+            {
+                p_lru.splice( p_lru.begin(), p_lru, victim.pos );
+                continue;
+            }
+
+            p_lru.pop_back();
+            p_retired.push_back( {page, victim.data.exchange( nullptr )} );
+            p_stats.resident -= victim.page.bytes;
+            ++p_stats.evictions;
+        }
+
+        for ( std::size_t ii = 0; ii < p_retired.size(); )
+        {
+            if ( p_entries[p_retired[ii].page].pins.load() )
+            {
+                ++ii;
+                continue;
+            }
+            delete p_retired[ii].data;
+            p_retired[ii] = p_retired.back();
+            p_retired.pop_back();
+        }
+    }
+
+    std::shared_ptr<const MappedFile> p_file;
+    Loader                            p_load;
+    std::unique_ptr<Entry[]>          p_entries;
+    std::size_t                       p_size = 0;
+    std::list<unsigned int>           p_lru; // most recently used first
+    std::vector<retired>              p_retired;
+    PageStats                         p_stats; // hits are kept per entry
+    mutable std::mutex                p_mutex;
+};
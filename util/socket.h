@@ -0,0 +1,233 @@
+#pragma once
+
+// posix only, the distributed renderer is not built on windows
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// -----------------------------------------------------------------------------
+// owning handle of a blocking stream socket. addresses are either
+// "unix:<path>" for a unix domain socket or "<host>:<port>" for tcp, where an
+// empty host listens on every interface. failures leave the socket invalid
+// -----------------------------------------------------------------------------
+class Socket
+{
+public:
+    Socket() = default;
+    explicit Socket( int fd ) : p_fd( fd ) {}
+
+    Socket( const Socket & ) = delete;
+    Socket &operator=( const Socket & ) = delete;
+
+    Socket( Socket &&other ) noexcept : p_fd( std::exchange( other.p_fd, -1 ) )
+    {
+    }
+    Socket &operator=( Socket &&other ) noexcept
+    {
+        if ( this != &other )
+        {
+            Close();
+            p_fd = std::exchange( other.p_fd, -1 );
+        }
+        return *this;
+    }
+
+    ~Socket() { Close(); }
+
+    static Socket Listen( const std::string &address, int backlog = 64 )
+    {
+        Socket s;
+        if ( IsUnix( address ) )
+        {
+            sockaddr_un sa;
+            if ( !UnixAddress( address, sa ) )
+                return s;
+            ::unlink( sa.sun_path );
+            s.p_fd = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+            if ( s.p_fd < 0 ||
+                 ::bind( s.p_fd, (const sockaddr *)&sa, sizeof( sa ) ) < 0 ||
+                 ::listen( s.p_fd, backlog ) < 0 )
+                s.Close();
+            return s;
+        }
+
+        addrinfo *list = Resolve( address, true );
+        for ( addrinfo *ai = list; ai && !s.Valid(); ai = ai->ai_next )
+        {
+            s.p_fd  = ::socket( ai->ai_family, ai->ai_socktype, 0 );
+            int yes = 1;
+            if ( s.p_fd < 0 ||
+                 ::setsockopt( s.p_fd,
+                               SOL_SOCKET,
+                               SO_REUSEADDR,
+                               &yes,
+                               sizeof( yes ) ) < 0 ||
+                 ::bind( s.p_fd, ai->ai_addr, ai->ai_addrlen ) < 0 ||
+                 ::listen( s.p_fd, backlog ) < 0 )
+                s.Close();
+        }
+        if ( list )
+            ::freeaddrinfo( list );
+        return s;
+    }
+
+    static Socket Connect( const std::string &address )
+    {
+        Socket s;
+        if ( IsUnix( address ) )
+        {
+            sockaddr_un sa;
+            if ( !UnixAddress( address, sa ) )
+                return s;
+            s.p_fd = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+            if ( s.p_fd < 0 ||
+                 ::connect( s.p_fd, (const sockaddr *)&sa, sizeof( sa ) ) < 0 )
+                s.Close();
+            return s;
+        }
+
+        addrinfo *list = Resolve( address, false );
+        for ( addrinfo *ai = list; ai && !s.Valid(); ai = ai->ai_next )
+        {
+            s.p_fd = ::socket( ai->ai_family, ai->ai_socktype, 0 );
+            if ( s.p_fd < 0 ||
+                 ::connect( s.p_fd, ai->ai_addr, ai->ai_addrlen ) < 0 )
+                s.Close();
+        }
+        if ( list )
+            ::freeaddrinfo( list );
+
+        // requests are small and answered right away
+        int yes = 1;
+        if ( s.Valid() )
+            ::setsockopt(
+                s.p_fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof( yes ) );
+        return s;
+    }
+
+    Socket Accept() const
+    {
+        int fd;
+        do
+            fd = ::accept( p_fd, nullptr, nullptr );
+        while ( fd < 0 && errno == EINTR );
+        return Socket( fd );
+    }
+
+    // bounds every send and receive call, one that makes no progress for
+    // longer fails with EAGAIN. 0 blocks for as long as it takes
+    bool SetTimeout( double seconds )
+    {
+        timeval tv;
+        tv.tv_sec  = static_cast<time_t>( seconds );
+        tv.tv_usec = static_cast<suseconds_t>( ( seconds - tv.tv_sec ) * 1e6 );
+        return ::setsockopt(
+                   p_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) ) == 0 &&
+               ::setsockopt(
+                   p_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof( tv ) ) == 0;
+    }
+
+    // false once the peer is gone, on a timeout or on any error
+    bool SendAll( const void *data, std::size_t size )
+    {
+        const char *ptr = static_cast<const char *>( data );
+        while ( size )
+        {
+            ssize_t sent = ::send( p_fd, ptr, size, kSendFlags );
+            if ( sent < 0 && errno == EINTR )
+                continue;
+            if ( sent <= 0 )
+                return false;
+            ptr += sent;
+            size -= static_cast<std::size_t>( sent );
+        }
+        return true;
+    }
+
+    bool RecvAll( void *data, std::size_t size )
+    {
+        char *ptr = static_cast<char *>( data );
+        while ( size )
+        {
+            ssize_t received = ::recv( p_fd, ptr, size, 0 );
+            if ( received < 0 && errno == EINTR )
+                continue;
+            if ( received <= 0 )
+                return false;
+            ptr += received;
+            size -= static_cast<std::size_t>( received );
+        }
+        return true;
+    }
+
+    bool Valid() const noexcept { return p_fd >= 0; }
+    int  Fd() const noexcept { return p_fd; }
+
+    void Close() noexcept
+    {
+        if ( p_fd >= 0 )
+            ::close( p_fd );
+        p_fd = -1;
+    }
+
+private:
+    // a peer that went away must not kill the process with sigpipe
+#ifdef MSG_NOSIGNAL
+    static constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+    static constexpr int kSendFlags = 0;
+#endif
+
+    static bool IsUnix( const std::string &address )
+    {
+        return address.compare( 0, 5, "unix:" ) == 0;
+    }
+
+    static bool UnixAddress( const std::string &address, sockaddr_un &sa )
+    {
+        std::string path = address.substr( 5 );
+        if ( path.empty() || path.size() >= sizeof( sa.sun_path ) )
+            return false;
+        std::memset( &sa, 0, sizeof( sa ) );
+        sa.sun_family = AF_UNIX;
+        std::memcpy( sa.sun_path, path.c_str(), path.size() + 1 );
+        return true;
+    }
+
+    // host and port split at the last colon, nullptr if it does not resolve
+    static addrinfo *Resolve( const std::string &address, bool passive )
+    {
+        std::size_t colon = address.rfind( ':' );
+        if ( colon == std::string::npos )
+            return nullptr;
+        std::string host = address.substr( 0, colon );
+        std::string port = address.substr( colon + 1 );
+
+        addrinfo hints;
+        std::memset( &hints, 0, sizeof( hints ) );
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags    = passive ? AI_PASSIVE : 0;
+
+        addrinfo *list = nullptr;
+        if ( ::getaddrinfo( host.empty() ? nullptr : host.c_str(),
+                            port.c_str(),
+                            &hints,
+                            &list ) != 0 )
+            return nullptr;
+        return list;
+    }
+
+    int p_fd = -1;
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+// counters are compiled in with PT_STATS 1, cmake -DPATHTRACER_STATS=ON.
+// otherwise the PT_STAT macros expand to nothing and cost nothing
+#ifndef PT_STATS
+#define PT_STATS 0
+#endif
+
+// -----------------------------------------------------------------------------
+// events counted on the hot paths. tests are counted per ray, a box tested
+// against a packet counts once for every active lane
+// -----------------------------------------------------------------------------
+enum class Stat : unsigned int
+{
+    kBoxTests,      // ray against the bounds of a bvh node
+    kTriangleTests, // ray against a triangle
+    kSphereTests,   // ray against a sphere
+    kHits,          // closest hit queries that found something
+    kShadowRays,    // occlusion queries towards sampled lights
+    kCount
+};
+
+// rays are counted by path depth, the camera rays at 0. depths past the
+// last slot are counted in it
+constexpr unsigned int kStatDepths = 16;
+
+// -----------------------------------------------------------------------------
+// plain totals of the counters
+// -----------------------------------------------------------------------------
+struct StatCounts
+{
+    std::uint64_t counts[static_cast<unsigned int>( Stat::kCount )] = {};
+    std::uint64_t raysByDepth[kStatDepths]                          = {};
+
+    std::uint64_t operator[]( Stat s ) const noexcept
+    {
+        return counts[static_cast<unsigned int>( s )];
+    }
+
+    // rays of all depths, shadow rays not included
+    std::uint64_t rays() const noexcept
+    {
+        std::uint64_t total = 0;
+        for ( std::uint64_t n : raysByDepth )
+            total += n;
+        return total;
+    }
+
+    StatCounts &operator+=( const StatCounts &other ) noexcept
+    {
+        for ( unsigned int ii = 0; ii < std::size( counts ); ++ii )
+            counts[ii] += other.counts[ii];
+        for ( unsigned int ii = 0; ii < kStatDepths; ++ii )
+            raysByDepth[ii] += other.raysByDepth[ii];
+        return *this;
+    }
+
+    StatCounts operator-( const StatCounts &other ) const noexcept
+    {
+        StatCounts d = *this;
+        for ( unsigned int ii = 0; ii < std::size( counts ); ++ii )
+            d.counts[ii] -= other.counts[ii];
+        for ( unsigned int ii = 0; ii < kStatDepths; ++ii )
+            d.raysByDepth[ii] -= other.raysByDepth[ii];
+        return d;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// per thread counters. every thread owns a block that only it writes, so
+// counting takes no lock and shares no cache line. blocks register once per
+// thread, and fold into the retired totals when their thread exits. totals
+// only grow: a frame is measured as the difference of two Collect() calls
+// -----------------------------------------------------------------------------
+class Stats
+{
+public:
+    static void Add( Stat s, std::uint64_t n = 1 ) noexcept
+    {
+        Block &b = Local();
+        Bump( b.counts[static_cast<unsigned int>( s )], n );
+    }
+
+    static void AddRays( unsigned int depth, std::uint64_t n = 1 ) noexcept
+    {
+        Block &b = Local();
+        Bump( b.raysByDepth[depth < kStatDepths ? depth : kStatDepths - 1],
+              n );
+    }
+
+    // sum over all threads so far, including those that exited
+    static StatCounts Collect()
+    {
+        Registry &                  r = registry();
+        std::lock_guard<std::mutex> lock( r.mutex );
+        StatCounts                  total = r.retired;
+        for ( const Block *b : r.live )
+            total += b->totals();
+        return total;
+    }
+
+private:
+    struct alignas( 64 ) Block
+    {
+        std::atomic<std::uint64_t> counts[static_cast<unsigned int>(
+            Stat::kCount )] = {};
+        std::atomic<std::uint64_t> raysByDepth[kStatDepths] = {};
+
+        StatCounts totals() const noexcept
+        {
+            StatCounts t;
+            for ( unsigned int ii = 0; ii < std::size( counts ); ++ii )
+                t.counts[ii] = counts[ii].load( std::memory_order_relaxed );
+            for ( unsigned int ii = 0; ii < kStatDepths; ++ii )
+                t.raysByDepth[ii] =
+                    raysByDepth[ii].load( std::memory_order_relaxed );
+            return t;
+        }
+    };
+
+    struct Registry
+    {
+        std::mutex           mutex;
+        std::vector<Block *> live;
+        StatCounts           retired;
+    };
+
+    // registers the block of a thread for its lifetime
+    struct Owner
+    {
+        Block block;
+
+        Owner()
+        {
+            Registry &                  r = registry();
+            std::lock_guard<std::mutex> lock( r.mutex );
+            r.live.push_back( &block );
+        }
+
+        ~Owner()
+        {
+            Registry &                  r = registry();
+            std::lock_guard<std::mutex> lock( r.mutex );
+            r.retired += block.totals();
+            for ( auto it = r.live.begin(); it != r.live.end(); ++it )
+            {
+                if ( *it == &block )
+                {
+                    r.live.erase( it );
+                    break;
+                }
+            }
+        }
+    };
+
+    static Registry &registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    static Block &Local() noexcept
+    {
+        thread_local Owner owner;
+        return owner.block;
+    }
+
+    // only the owning thread writes, a relaxed load and store is enough and
+    // compiles to plain moves. readers see a value at most slightly stale
+    static void Bump( std::atomic<std::uint64_t> &c, std::uint64_t n ) noexcept
+    {
+        c.store( c.load( std::memory_order_relaxed ) + n,
+                 std::memory_order_relaxed );
+    }
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline unsigned int BitCount( unsigned int mask ) noexcept
+{
+    unsigned int n = 0;
+    for ( ; mask; mask &= mask - 1 )
+        ++n;
+    return n;
+}
+
+#if PT_STATS
+#define PT_STAT_ADD( stat, n ) Stats::Add( Stat::stat, n )
+#define PT_STAT_RAYS( depth, n ) Stats::AddRays( depth, n )
+#else
+#define PT_STAT_ADD( stat, n ) ( (void)0 )
+#define PT_STAT_RAYS( depth, n ) ( (void)0 )
+#endif
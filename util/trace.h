@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// timeline of scoped events in the chrome trace event format, which
+// chrome://tracing and perfetto open with one row per thread. off until
+// Start() is called: a TraceScope then costs one relaxed load. on, every
+// thread records into a ring buffer of its own, so recording takes no lock.
+// a full ring overwrites its oldest events. event names, categories and
+// argument names must be string literals or otherwise outlive the tracer
+// -----------------------------------------------------------------------------
+class Tracer
+{
+public:
+    // events a thread keeps, the latest ones win
+    static constexpr unsigned int kRingSize = 1u << 16;
+
+    // an event with up to two integer arguments, names nullptr when unused
+    struct Event
+    {
+        const char *  name;
+        const char *  category;
+        const char *  argNames[2];
+        std::int64_t  args[2];
+        std::uint64_t begin; // nanoseconds since Start()
+        std::uint64_t end;
+    };
+
+    // before the threads to trace start recording
+    static void Start()
+    {
+        Registry &                  r = registry();
+        std::lock_guard<std::mutex> lock( r.mutex );
+        if ( !Enabled() )
+            r.epoch = std::chrono::steady_clock::now();
+        r.enabled.store( true, std::memory_order_release );
+    }
+
+    static void Stop()
+    {
+        registry().enabled.store( false, std::memory_order_release );
+    }
+
+    static bool Enabled() noexcept
+    {
+        return registry().enabled.load( std::memory_order_relaxed );
+    }
+
+    static std::uint64_t Now() noexcept
+    {
+        auto elapsed = std::chrono::steady_clock::now() - registry().epoch;
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed )
+                .count() );
+    }
+
+    // name of the calling thread's row in the viewer, ignored while off
+    static void SetThreadName( std::string name )
+    {
+        if ( !Enabled() )
+            return;
+        Ring &                      ring = Local();
+        std::lock_guard<std::mutex> lock( registry().mutex );
+        ring.name = std::move( name );
+    }
+
+    static void Record( const Event &e ) noexcept
+    {
+        Ring &        ring  = Local();
+        std::uint64_t count = ring.count.load( std::memory_order_relaxed );
+        ring.events[count % kRingSize] = e;
+        ring.count.store( count + 1, std::memory_order_release );
+    }
+
+    // events of every thread, including threads that exited. threads that
+    // still record while this runs may have their latest events cut off
+    static bool Write( const std::string &path );
+
+private:
+    struct Ring
+    {
+        unsigned int               tid = 0;
+        std::string                name;
+        std::vector<Event>         events;
+        std::atomic<std::uint64_t> count{0};
+    };
+
+    struct Registry
+    {
+        std::mutex                            mutex;
+        std::atomic<bool>                     enabled{false};
+        std::chrono::steady_clock::time_point epoch;
+        std::vector<std::unique_ptr<Ring>>    rings;
+        unsigned int                          nextTid = 1;
+    };
+
+    static Registry &registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    // rings belong to the registry and outlive their threads, so that
+    // short lived workers stay on the timeline. a thread allocates its ring
+    // on its first event
+    static Ring &Local()
+    {
+        thread_local Ring *ring = nullptr;
+        if ( !ring )
+        {
+            auto owned = std::make_unique<Ring>();
+            owned->events.resize( kRingSize );
+
+            Registry &                  r = registry();
+            std::lock_guard<std::mutex> lock( r.mutex );
+            owned->tid  = r.nextTid++;
+            owned->name = "thread " + std::to_string( owned->tid );
+            ring        = owned.get();
+            r.rings.push_back( std::move( owned ) );
+        }
+        return *ring;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// records the time from construction to destruction as one event
+// -----------------------------------------------------------------------------
+class TraceScope
+{
+public:
+    TraceScope( const char *name,
+                const char *category,
+                const char *argName0 = nullptr,
+                std::int64_t arg0    = 0,
+                const char *argName1 = nullptr,
+                std::int64_t arg1    = 0 ) noexcept
+    {
+        if ( !Tracer::Enabled() )
+            return;
+        _active = true;
+        _event  = {name, category, {argName0, argName1}, {arg0, arg1},
+                  Tracer::Now(), 0};
+    }
+
+    ~TraceScope()
+    {
+        if ( !_active )
+            return;
+        _event.end = Tracer::Now();
+        Tracer::Record( _event );
+    }
+
+    TraceScope( const TraceScope & ) = delete;
+    TraceScope &operator=( const TraceScope & ) = delete;
+
+private:
+    Tracer::Event _event;
+    bool          _active = false;
+};
+
+// -----------------------------------------------------------------------------
+// complete events ("ph": "X") with microsecond timestamps, preceded by one
+// thread_name metadata event per thread
+// -----------------------------------------------------------------------------
+inline bool Tracer::Write( const std::string &path )
+{
+    FILE *file = fopen( path.c_str(), "w" );
+    if ( !file )
+        return false;
+
+    Registry &                  r = registry();
+    std::lock_guard<std::mutex> lock( r.mutex );
+    fprintf( file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" );
+    bool first = true;
+    for ( const auto &ring : r.rings )
+    {
+        fprintf( file,
+                 "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                 "\"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+                 first ? "" : ",\n",
+                 ring->tid,
+                 ring->name.c_str() );
+        first = false;
+
+        std::uint64_t count = ring->count.load( std::memory_order_acquire );
+        std::uint64_t begin = count > kRingSize ? count - kRingSize : 0;
+        for ( std::uint64_t ii = begin; ii < count; ++ii )
+        {
+            const Event &e = ring->events[ii % kRingSize];
+            fprintf( file,
+                     ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+                     "\"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+                     e.name,
+                     e.category,
+                     ring->tid,
+                     e.begin * 1e-3,
+                     ( e.end - e.begin ) * 1e-3 );
+            if ( e.argNames[0] )
+            {
+                fprintf( file,
+                         ", \"args\": {\"%s\": %lld",
+                         e.argNames[0],
+                         static_cast<long long>( e.args[0] ) );
+                if ( e.argNames[1] )
+                    fprintf( file,
+                             ", \"%s\": %lld",
+                             e.argNames[1],
+                             static_cast<long long>( e.args[1] ) );
+                fprintf( file, "}" );
+            }
+            fprintf( file, "}" );
+        }
+    }
+    fprintf( file, "\n]}\n" );
+    return fclose( file ) == 0;
+}
+
+#define PT_TRACE_CONCAT_( a, b ) a##b
+#define PT_TRACE_CONCAT( a, b ) PT_TRACE_CONCAT_( a, b )
+
+// PT_TRACE_SCOPE( "name", "category" [, "arg", value [, "arg", value]] )
+// traces the rest of the enclosing block
+#define PT_TRACE_SCOPE( ... )                                                  \
+    TraceScope PT_TRACE_CONCAT( traceScope, __LINE__ )( __VA_ARGS__ )
@@ -131,6 +131,26 @@ private:
     T _x[3] = {T( 0 ), T( 0 ), T( 0 )};
 };
 
+// -----------------------------------------------------------------------------
+// unit vectors u and v that make an orthonormal basis with the unit vector w.
+// u is perpendicular to w and to the axis along which w is smallest
+// -----------------------------------------------------------------------------
+template <typename T>
+void orthonormalBasis( const vec3<T> &w, vec3<T> &u, vec3<T> &v ) noexcept
+{
+    T x = std::abs( w[0] );
+    T y = std::abs( w[1] );
+    T z = std::abs( w[2] );
+    if ( x <= y && x <= z )
+        u = w * vec3<T>( 1, 0, 0 );
+    else if ( y <= z )
+        u = w * vec3<T>( 0, 1, 0 );
+    else
+        u = w * vec3<T>( 0, 0, 1 );
+    u.normalize();
+    v = w * u;
+}
+
 #include "vec3.cc"
 
 #endif // _vec3_h_